@@ -0,0 +1,346 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // sched_getaffinity
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cpu.h"
+
+static int cpu_limit;
+static int cpu_detected;
+static pthread_once_t cpu_once = PTHREAD_ONCE_INIT;
+
+#ifdef __linux__
+// <numaif.h> comes with libnuma, the system calls do not need it
+#define CPU_MPOL_PREFERRED  1
+#define CPU_MAX_NODES       1024
+
+static cpu_set_t decoder_cpus;
+static int decoder_cpus_set;
+static cpu_set_t io_cpus;
+static int io_node = -1;
+#endif
+
+static int online_count(void)
+{
+#if defined(_WIN32)
+    return pthread_num_processors_np();
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+#else
+    return 1;
+#endif
+}
+
+#ifdef __linux__
+static int read_line(const char *path, char *line, size_t size)
+{
+    FILE *fd = fopen(path, "r");
+    int ret = -1;
+
+    if (!fd)
+        return -1;
+    if (fgets(line, (int) size, fd))
+        ret = 0;
+    fclose(fd);
+    return ret;
+}
+
+// cgroup v2: cpu.max holds "<quota> <period>" or "max <period>", 0 if there is no quota
+static double cgroup2_quota(const char *dir)
+{
+    char path[4096 + 32], line[128];
+    double quota, period;
+
+    snprintf(path, sizeof(path), "%s/cpu.max", dir);
+    if (read_line(path, line, sizeof(line)) != 0 || strncmp(line, "max", 3) == 0)
+        return 0;
+    if (sscanf(line, "%lf %lf", &quota, &period) != 2 || quota <= 0 || period <= 0)
+        return 0;
+    return quota / period;
+}
+
+// cgroup v1: cpu.cfs_quota_us is -1 without a quota
+static double cgroup1_quota(const char *dir)
+{
+    char path[4096 + 32], line[128];
+    double quota, period;
+
+    snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+    if (read_line(path, line, sizeof(line)) != 0 || sscanf(line, "%lf", &quota) != 1 || quota <= 0)
+        return 0;
+    snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+    if (read_line(path, line, sizeof(line)) != 0 || sscanf(line, "%lf", &period) != 1 || period <= 0)
+        return 0;
+    return quota / period;
+}
+
+// the smallest quota of the cgroup and its parents up to the mount point, 0 for none. Inside
+// a container the path may not exist in its mount namespace, then the root of the mount is
+// the container's own cgroup.
+static double cgroup_quota(const char *mount, const char *cgroup, double (*quota_fn)(const char *))
+{
+    char dir[4096];
+    size_t root_len = strlen(mount);
+    double lowest = 0;
+
+    snprintf(dir, sizeof(dir), "%s%s", mount, strcmp(cgroup, "/") == 0 ? "" : cgroup);
+    for (;;)
+    {
+        double quota = quota_fn(dir);
+        char *slash;
+
+        if (quota > 0 && (lowest == 0 || quota < lowest))
+            lowest = quota;
+        slash = strrchr(dir, '/');
+        if (strlen(dir) <= root_len || !slash || (size_t) (slash - dir) < root_len)
+            break;
+        *slash = '\0';
+    }
+    return lowest;
+}
+
+// /proc/self/cgroup: "0::<path>" for v2, "<id>:<controllers>:<path>" for v1
+static double cgroup_cpu_quota(void)
+{
+    static const char *v1_mounts[] = { "/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpuacct,cpu", NULL };
+    FILE *fd = fopen("/proc/self/cgroup", "r");
+    char line[4096];
+    double lowest = 0;
+
+    if (!fd)
+        return 0;
+
+    while (fgets(line, sizeof(line), fd))
+    {
+        char *controllers, *path, *token, *save;
+        double quota = 0;
+        int i;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        controllers = strchr(line, ':');
+        path = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (!path)
+            continue;
+        *path++ = '\0';
+        controllers++;
+
+        if (*controllers == '\0')
+        {
+            quota = cgroup_quota("/sys/fs/cgroup", path, cgroup2_quota);
+        }
+        else
+        {
+            for (token = strtok_r(controllers, ",", &save); token; token = strtok_r(NULL, ",", &save))
+            {
+                if (strcmp(token, "cpu") == 0)
+                    break;
+            }
+            for (i = 0; token && v1_mounts[i] && quota == 0; i++)
+                quota = cgroup_quota(v1_mounts[i], path, cgroup1_quota);
+        }
+
+        if (quota > 0 && (lowest == 0 || quota < lowest))
+            lowest = quota;
+    }
+    fclose(fd);
+    return lowest;
+}
+#endif
+
+static void cpu_detect(void)
+{
+    int count = online_count();
+
+#ifdef __linux__
+    {
+        cpu_set_t set;
+        double quota;
+
+        if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0 && CPU_COUNT(&set) < count)
+            count = CPU_COUNT(&set);
+
+        // a quota of 2.5 processors keeps 3 threads busy
+        quota = cgroup_cpu_quota();
+        if (quota > 0)
+        {
+            int limit = (int) quota + ((double) (int) quota < quota);
+            if (limit < count)
+                count = limit;
+        }
+    }
+#endif
+
+    cpu_detected = count > 0 ? count : 1;
+}
+
+int cpu_count(void)
+{
+    if (cpu_limit > 0)
+        return cpu_limit;
+    pthread_once(&cpu_once, cpu_detect);
+    return cpu_detected;
+}
+
+void cpu_set_limit(int count)
+{
+    cpu_limit = count > 0 ? count : 0;
+}
+
+#ifdef __linux__
+// "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist and taskset -c
+static int parse_cpu_list(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+
+    CPU_ZERO(set);
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long first, last, cpu;
+
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return -1;
+            p = end;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            return -1;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+#endif
+
+int cpu_set_decoder_cpus(const char *list)
+{
+#ifdef __linux__
+    if (parse_cpu_list(list, &decoder_cpus) != 0)
+        return -1;
+    decoder_cpus_set = 1;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int cpu_set_io_node(int node)
+{
+#ifdef __linux__
+    char path[64], list[4096];
+    FILE *fd;
+    int ret = -1;
+
+    if (node < 0 || node >= CPU_MAX_NODES)
+        return -1;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    fd = fopen(path, "r");
+    if (!fd)
+        return -1;
+    if (fgets(list, sizeof(list), fd) && parse_cpu_list(list, &io_cpus) == 0)
+    {
+        io_node = node;
+        ret = 0;
+    }
+    fclose(fd);
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+// the decode threads to start by default, cpu_count() limited to --decoder-cpus
+int cpu_decoder_count(void)
+{
+    int count = cpu_count();
+
+#ifdef __linux__
+    if (decoder_cpus_set && cpu_limit == 0 && CPU_COUNT(&decoder_cpus) < count)
+        count = CPU_COUNT(&decoder_cpus);
+#endif
+    return count;
+}
+
+void cpu_place_decoder_thread(void)
+{
+#ifdef __linux__
+    if (decoder_cpus_set)
+        sched_setaffinity(0, sizeof(decoder_cpus), &decoder_cpus);
+#endif
+}
+
+void cpu_place_io_thread(void)
+{
+#ifdef __linux__
+    unsigned long mask[CPU_MAX_NODES / (8 * sizeof(unsigned long))];
+
+    if (io_node < 0)
+        return;
+    sched_setaffinity(0, sizeof(io_cpus), &io_cpus);
+
+    // the kernel falls back to other nodes when this one runs out of memory
+    memset(mask, 0, sizeof(mask));
+    mask[io_node / (8 * sizeof(unsigned long))] |= 1UL << (io_node % (8 * sizeof(unsigned long)));
+    syscall(SYS_set_mempolicy, CPU_MPOL_PREFERRED, mask, (unsigned long) CPU_MAX_NODES);
+#endif
+}
+
+void cpu_bind_io_memory(void *addr, size_t size)
+{
+#ifdef __linux__
+    unsigned long mask[CPU_MAX_NODES / (8 * sizeof(unsigned long))];
+
+    if (io_node < 0)
+        return;
+    memset(mask, 0, sizeof(mask));
+    mask[io_node / (8 * sizeof(unsigned long))] |= 1UL << (io_node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, addr, size, CPU_MPOL_PREFERRED, mask, (unsigned long) CPU_MAX_NODES, 0UL);
+#else
+    (void) addr;
+    (void) size;
+#endif
+}
@@ -0,0 +1,64 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef CPU_H_INCLUDED
+#define CPU_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The number of processors this process can use: the online processors, lowered by the
+ * affinity mask and by the CPU quota of its cgroup (v1 or v2), at least 1. It sizes the
+ * DST decoder pool and the --batch, --daemon and --catalog workers.
+ */
+int cpu_count(void);
+
+/**
+ * Overrides cpu_count() (-j, --threads), 0 goes back to the detected count.
+ */
+void cpu_set_limit(int count);
+
+/**
+ * Placement of the pipeline threads (Linux only, the setters return -1 elsewhere).
+ *
+ * cpu_set_decoder_cpus() takes a list like "0-7,16-23" for the DST decode threads, which
+ * pin themselves with cpu_place_decoder_thread(). It returns -1 if the list is invalid.
+ *
+ * cpu_set_io_node() keeps the threads that read, parse and write (cpu_place_io_thread())
+ * on the processors of one NUMA node and prefers its memory for their allocations. The
+ * buffers they share with the decode threads are bound to the node with
+ * cpu_bind_io_memory() (page aligned). It returns -1 if the node does not exist.
+ */
+int cpu_set_decoder_cpus(const char *list);
+int cpu_set_io_node(int node);
+int cpu_decoder_count(void);
+void cpu_place_decoder_thread(void);
+void cpu_place_io_thread(void);
+void cpu_bind_io_memory(void *addr, size_t size);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* CPU_H_INCLUDED */
@@ -56,8 +56,10 @@ static sys_mutex_t _log_lock;
 #define _LOCK_LOG() sysMutexLock(_log_lock, 0)
 #define _UNLOCK_LOG() sysMutexUnlock(_log_lock)
 #else
-#define _LOCK_LOG()
-#define _UNLOCK_LOG()
+#include <pthread.h>
+static pthread_mutex_t _log_lock = PTHREAD_MUTEX_INITIALIZER;
+#define _LOCK_LOG() pthread_mutex_lock(&_log_lock)
+#define _UNLOCK_LOG() pthread_mutex_unlock(&_log_lock)
 #endif
 
 #define _PUT_LOG(fd, buf, nb)    { fwrite(buf, 1, nb, fd); fflush(fd); }
@@ -71,7 +73,250 @@ static FILE            *log_file        = NULL;
 static int             output_time_stamp = 0;
 
 #define LINE_BUF_SIZE       512
-#define DEFAULT_BUF_SIZE    16384
+#define DEFAULT_BUF_SIZE    65536
+
+#ifndef __lv2ppu__
+#define LOG_ASYNC           1
+#endif
+
+#ifdef LOG_ASYNC
+/*
+** Asynchronous logging: each thread formats its messages into a ring of its own, without
+** taking a lock, and a flusher thread writes the rings to the log file in the order the
+** messages were made. The formatting stays with the caller, the arguments (often strings
+** on its stack) are gone by the time the flusher runs. A message that does not fit in a
+** full ring is dropped and counted, the log never holds up the thread.
+*/
+typedef struct log_ring_t
+{
+    char               *buf;
+    uint32_t            size;           /* power of two */
+    uint32_t            head;           /* bytes written, only moved by the owning thread */
+    uint32_t            tail;           /* bytes read, only moved by the flusher */
+    uint32_t            dropped;
+    int                 id;
+    int                 closed;         /* the thread ended, freed once drained */
+    struct log_ring_t  *next;
+} log_ring_t;
+
+/* a message in the ring, followed by its text padded to LOG_RECORD_ALIGN */
+typedef struct
+{
+    uint32_t            len;            /* LOG_RECORD_WRAP: the rest of the ring is unused */
+    uint32_t            seq;
+} log_record_t;
+
+#define LOG_RECORD_ALIGN    8
+#define LOG_RECORD_WRAP     0xffffffffU
+#define LOG_FLUSH_INTERVAL  100         /* ms */
+
+static log_ring_t      *log_rings;      /* guarded by _log_lock */
+static int              log_ring_count;
+static uint32_t         log_ring_size;  /* 0: synchronous logging */
+static uint32_t         log_seq;
+static pthread_key_t    log_ring_key;
+static pthread_once_t   log_ring_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t   log_flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t        log_flusher_thread;
+static int              log_flusher_running;
+static int              log_flusher_stop;
+#endif
+
+#ifdef LOG_ASYNC
+static void log_ring_close(void *arg)
+{
+    __atomic_store_n(&((log_ring_t *) arg)->closed, 1, __ATOMIC_RELEASE);
+}
+
+static void log_ring_key_create(void)
+{
+    pthread_key_create(&log_ring_key, log_ring_close);
+}
+
+/* the ring of the calling thread, made on its first message */
+static log_ring_t *log_ring_get(void)
+{
+    log_ring_t *ring;
+
+    pthread_once(&log_ring_once, log_ring_key_create);
+    ring = (log_ring_t *) pthread_getspecific(log_ring_key);
+    if (ring)
+        return ring;
+
+    ring = (log_ring_t *) calloc(1, sizeof(log_ring_t));
+    if (!ring)
+        return NULL;
+    ring->size = log_ring_size;
+    ring->buf  = (char *) malloc(ring->size);
+    if (!ring->buf)
+    {
+        free(ring);
+        return NULL;
+    }
+
+    _LOCK_LOG();
+    ring->id   = log_ring_count++;
+    ring->next = log_rings;
+    log_rings  = ring;
+    _UNLOCK_LOG();
+
+    pthread_setspecific(log_ring_key, ring);
+    return ring;
+}
+
+/* called by the owning thread only, the message is prefix followed by text */
+static void log_ring_put(log_ring_t *ring, const char *prefix, uint32_t prefix_len, const char *text, uint32_t text_len)
+{
+    uint32_t len  = prefix_len + text_len;
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t pos  = head & (ring->size - 1);
+    uint32_t need = (sizeof(log_record_t) + len + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1);
+    uint32_t skip = pos + need > ring->size ? ring->size - pos : 0;
+    log_record_t *record;
+
+    if (need + skip > ring->size - (head - tail))
+    {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&log_flush_cond);
+        return;
+    }
+
+    /* a message is never split over the end of the ring */
+    if (skip)
+    {
+        ((log_record_t *) (ring->buf + pos))->len = LOG_RECORD_WRAP;
+        head += skip;
+        pos   = 0;
+    }
+    record      = (log_record_t *) (ring->buf + pos);
+    record->len = len;
+    record->seq = __atomic_fetch_add(&log_seq, 1, __ATOMIC_RELAXED);
+    memcpy(record + 1, prefix, prefix_len);
+    if (text_len)
+        memcpy((char *) (record + 1) + prefix_len, text, text_len);
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+
+    /* the flusher also comes by on its own, it is woken early when the ring fills up */
+    if (2 * (head + need - tail) > ring->size)
+        pthread_cond_signal(&log_flush_cond);
+}
+
+/* the oldest message of the ring, NULL if it is empty */
+static log_record_t *log_ring_peek(log_ring_t *ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    log_record_t *record;
+
+    while (ring->tail != head)
+    {
+        uint32_t pos = ring->tail & (ring->size - 1);
+
+        record = (log_record_t *) (ring->buf + pos);
+        if (record->len != LOG_RECORD_WRAP)
+            return record;
+        __atomic_store_n(&ring->tail, ring->tail + ring->size - pos, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* writes out every ring, merging them by sequence number; with _log_lock held */
+static void log_rings_drain(void)
+{
+    log_ring_t *ring, **prev;
+
+    for (;;)
+    {
+        log_ring_t   *oldest = NULL;
+        log_record_t *oldest_record = NULL;
+
+        for (ring = log_rings; ring; ring = ring->next)
+        {
+            log_record_t *record = log_ring_peek(ring);
+            if (record && (!oldest_record || (int32_t) (record->seq - oldest_record->seq) < 0))
+            {
+                oldest = ring;
+                oldest_record = record;
+            }
+        }
+        if (!oldest)
+            break;
+
+        fwrite(oldest_record + 1, 1, oldest_record->len, log_file);
+        __atomic_store_n(&oldest->tail, oldest->tail +
+                         ((sizeof(log_record_t) + oldest_record->len + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1)),
+                         __ATOMIC_RELEASE);
+    }
+
+    for (prev = &log_rings; (ring = *prev) != NULL; )
+    {
+        uint32_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+
+        if (dropped)
+            fprintf(log_file, "[%d]: %u log messages dropped, the log could not keep up\n", ring->id, dropped);
+
+        /* a ring of an ended thread goes once it was read to the end */
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && !log_ring_peek(ring))
+        {
+            *prev = ring->next;
+            free(ring->buf);
+            free(ring);
+        }
+        else
+        {
+            prev = &ring->next;
+        }
+    }
+
+    fflush(log_file);
+}
+
+static void *log_flusher(void *arg)
+{
+    struct timespec wake;
+
+    _LOCK_LOG();
+    while (!log_flusher_stop)
+    {
+        if (log_file)
+            log_rings_drain();
+
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += LOG_FLUSH_INTERVAL * 1000000L;
+        if (wake.tv_nsec >= 1000000000L)
+        {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&log_flush_cond, &_log_lock, &wake);
+    }
+    if (log_file)
+        log_rings_drain();
+    _UNLOCK_LOG();
+    return NULL;
+}
+
+static void log_flusher_start(void)
+{
+    if (log_flusher_running)
+        return;
+    log_flusher_stop = 0;
+    log_flusher_running = pthread_create(&log_flusher_thread, NULL, log_flusher, NULL) == 0;
+}
+
+/* the messages still in the rings are written before it returns */
+static void log_flusher_join(void)
+{
+    if (!log_flusher_running)
+        return;
+    _LOCK_LOG();
+    log_flusher_stop = 1;
+    pthread_cond_signal(&log_flush_cond);
+    _UNLOCK_LOG();
+    pthread_join(log_flusher_thread, NULL);
+    log_flusher_running = 0;
+}
+#endif
 
 void log_init(void)
 {
@@ -169,6 +414,10 @@ void log_destroy(void)
 {
     log_module_info_t *lm = logModules;
 
+#ifdef LOG_ASYNC
+    log_flusher_join();
+    log_ring_size = 0;
+#endif
     log_flush();
 
     if (log_file && log_file != stdout && log_file != stderr)
@@ -280,6 +529,23 @@ void set_log_buffering(int buffer_size)
 {
     log_flush();
 
+#ifdef LOG_ASYNC
+    /* the buffer is the ring of every thread, a ring holds at least a few long lines */
+    if (buffer_size >= LINE_BUF_SIZE)
+    {
+        uint32_t size = LINE_BUF_SIZE * 32;
+
+        while (size < (uint32_t) buffer_size)
+            size <<= 1;
+        log_ring_size = size;
+        log_flusher_start();
+    }
+    else
+    {
+        log_flusher_join();
+        log_ring_size = 0;
+    }
+#else
     if (log_buf)
         free(log_buf);
 
@@ -288,6 +554,7 @@ void set_log_buffering(int buffer_size)
         logp    = log_buf = (char *) malloc(buffer_size);
         log_endp = logp + buffer_size;
     }
+#endif
 }
 
 void log_print(const char *fmt, ...)
@@ -303,12 +570,25 @@ void log_print(const char *fmt, ...)
 #endif
     time_t           now;
     struct tm        ts;
+#ifdef LOG_ASYNC
+    log_ring_t       *ring = NULL;
+#endif
 
     if (!log_file)
     {
         return;
     }
 
+#ifdef LOG_ASYNC
+    /* the thread id is the number of its ring */
+    if (log_ring_size && log_flusher_running)
+    {
+        ring = log_ring_get();
+        if (ring)
+            me = ring->id;
+    }
+#endif
+
     if (output_time_stamp)
     {
         time(&now);
@@ -335,15 +615,40 @@ void log_print(const char *fmt, ...)
      * Check if we might have run out of buffer space (in case we have a
      * long line), and malloc a buffer just this once.
      */
-    if (nb == sizeof(line) - 2)
+    if (nb >= sizeof(line) - 2)
     {
+        nb = sizeof(line) - 2;
         line_long = (char *) malloc(LINE_BUF_SIZE * 8);
-        va_start(ap, fmt);
-        vsnprintf(line_long, LINE_BUF_SIZE, fmt, ap);
-        va_end(ap);
+        if (line_long)
+        {
+            va_start(ap, fmt);
+            vsnprintf(line_long, LINE_BUF_SIZE * 8, fmt, ap);
+            va_end(ap);
+        }
         /* If this failed, we'll fall back to writing the truncated line. */
     }
 
+#ifdef LOG_ASYNC
+    if (ring)
+    {
+        if (line_long)
+        {
+            nb = strlen(line_long);
+            if (!nb || line_long[nb - 1] != '\n')
+                line_long[nb++] = '\n';
+            log_ring_put(ring, line, nb_tid, line_long, nb);
+            free(line_long);
+        }
+        else
+        {
+            if (nb && (line[nb - 1] != '\n'))
+                line[nb++] = '\n';
+            log_ring_put(ring, line, nb, NULL, 0);
+        }
+        return;
+    }
+#endif
+
     if (line_long)
     {
         nb = strlen(line_long);
@@ -402,6 +707,14 @@ void log_print(const char *fmt, ...)
 
 void log_flush(void)
 {
+#ifdef LOG_ASYNC
+    if (log_file && log_rings)
+    {
+        _LOCK_LOG();
+        log_rings_drain();
+        _UNLOCK_LOG();
+    }
+#endif
     if (log_buf && log_file)
     {
         _LOCK_LOG();
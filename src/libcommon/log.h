@@ -90,6 +90,10 @@ extern "C" {
 ** The special LogModule name "bufsize:<size>" tells the log service 
 ** to set the log buffer to <size>.
 **
+** Unless "sync" is given, every thread writes its messages into a ring
+** buffer of that size and a flusher thread writes them to the log file,
+** see log.c.
+**
 ** The environment variable LOG_FILE specifies the log file to use
 ** unless the default of "stderr" is acceptable. For MS Windows
 ** systems, LOG_FILE can be set to a special value: "WinDebug"
@@ -202,8 +206,23 @@ void log_assert(const char *s, const char *file, int ln);
 #if defined(DEBUG) || defined(FORCE_LOG)
 #define LOGGING    1
 
+/*
+** LOG_MAX_LEVEL compiles out the LOG() calls above it, e.g. -DLOG_MAX_LEVEL=2 keeps the
+** errors only. At run time the level of the module is checked before anything is
+** formatted, so a message it filters out costs a compare.
+*/
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL    LOG_MAX
+#endif
+
+#if defined(__GNUC__)
+#define LOG_UNLIKELY(_x)    __builtin_expect(!!(_x), 0)
+#else
+#define LOG_UNLIKELY(_x)    (_x)
+#endif
+
 #define LOG_TEST(_module, _level) \
-    ((_module)->level >= (_level))
+    ((_level) <= LOG_MAX_LEVEL && LOG_UNLIKELY((_module)->level >= (_level)))
 
 /*
 ** Log something.
@@ -25,6 +25,8 @@
 #include <malloc.h>
 #endif
 
+#include <cpu.h>
+
 #include "buffer_pool.h"
 
 /* initialize a pool (pool structure itself provided, not allocated) -- the
@@ -76,7 +78,11 @@ buffer_pool_space_t *buffer_pool_get_space(buffer_pool_t *pool)
 #elif __APPLE__
     posix_memalign(&space->buf, 64, pool->size);
 #else
-    space->buf = memalign(64, pool->size);
+    /* page aligned, so that it can be bound to the node of the reader and
+       writer (--io-node) before the first thread touches it */
+    space->buf = memalign(4096, pool->size);
+    if (space->buf != NULL)
+        cpu_bind_io_memory(space->buf, pool->size);
 #endif
     if (space->buf == NULL)
         return 0;
@@ -53,11 +53,9 @@
 #endif
 #include <pthread.h>
 #include <string.h>
-#ifdef __linux__
-#include <sys/sysinfo.h>
-#endif
 
 #include <logging.h>
+#include <cpu.h>
 
 #include "dst_decoder.h"
 #include "yarn.h"
@@ -65,15 +63,12 @@
 #include "dst_fram.h"
 #include "dst_init.h"
 
-#ifdef __APPLE__
-#include <sys/sysctl.h>
-#endif
-
 /* -- parallel decoding -- */
 
-/* decode or write job (passed from decode list to write list) -- if seq is
-   equal to -1, decode_thread is instructed to return; if more is false then
-   this is the last chunk, which after writing tells write_thread to return */
+/* decode or write job (passed from the decode list to the write list of its
+   decoder) -- if seq is equal to -1, a pool thread is instructed to return; if
+   more is false then this is the last chunk, which after writing tells
+   write_thread to return */
 typedef struct job_t
 {
     long seq;                                 /* sequence number */
@@ -81,14 +76,15 @@ typedef struct job_t
     int more;                                 /* true if this is not the last chunk */
     buffer_pool_space_t *in;                  /* input DST data to decode */
     buffer_pool_space_t *out;                 /* resulting DSD decoded data */
+    struct dst_decoder_s *dst_decoder;        /* decoder the job belongs to */
     struct job_t *next;                       /* next job in the list (either list) */
 } 
 job_t;
 
 struct dst_decoder_s
 {
-    int procs;            /* maximum number of compression threads (>= 1) */
     int channel_count;
+    int layout;           /* DST_DECODER_LAYOUT_* of the decoded frames */
 
     int sequence;       /* each job get's a unique sequence number */
 
@@ -96,17 +92,10 @@ struct dst_decoder_s
     buffer_pool_t in_pool;
     buffer_pool_t out_pool;
 
-    /* list of decode jobs (with tail for appending to list) */
-    lock *decode_have;   /* number of decode jobs waiting */
-    job_t *decode_head, **decode_tail;
-
     /* list of write jobs */
     lock *write_first;    /* lowest sequence number in list */
     job_t *write_head;
 
-    /* number of decoding threads running */
-    int cthreads;
-
     /* write thread if running */
     thread *writeth;
 
@@ -115,122 +104,120 @@ struct dst_decoder_s
     void *userdata;
 };
 
-static unsigned processor_count(void)
+/* the decode threads are shared by all decoders, so that several discs
+   processed at the same time never run more decode threads than processors */
+typedef struct
 {
-#if defined(_WIN32)
-    return pthread_num_processors_np();
-#elif defined(__linux__)
-    return get_nprocs();
-#elif defined(__APPLE__) || defined(__FreeBSD__)
-    int count;
-    size_t size=sizeof(count);
-    return sysctlbyname("hw.ncpu",&count,&size,NULL,0) ? 1 : count;
-#endif
-}
+    int max_threads;      /* maximum number of decode threads (>= 1) */
+    int threads;          /* number of decode threads running */
+    thread **thread_list;
 
-/* setup job lists (call from main thread) */
-static void setup_decoding_jobs(dst_decoder_t *dst_decoder)
-{
-    /* set up only if not already set up*/
-    if (dst_decoder->decode_have != NULL)
-        return;
+    /* list of decode jobs of all decoders (with tail for appending to list) */
+    lock *have;           /* number of decode jobs waiting */
+    job_t *head, **tail;
+}
+decoder_pool_t;
 
-    /* allocate locks and initialize lists */
-    dst_decoder->decode_have = new_lock(0);
-    dst_decoder->decode_head = NULL;
-    dst_decoder->decode_tail = &dst_decoder->decode_head;
-    dst_decoder->write_first = new_lock(-1);
-    dst_decoder->write_head = NULL;
+static decoder_pool_t decoder_pool;
+static pthread_mutex_t decoder_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    /* initialize buffer pools */
-    buffer_pool_create(&dst_decoder->in_pool, 64 * 1024, (dst_decoder->procs << 1) + 2);
-    buffer_pool_create(&dst_decoder->out_pool, 64 * 1024, -1);
+/* set up the pool list on first use, decoders may be created from several threads */
+static void decoder_pool_setup(void)
+{
+    pthread_mutex_lock(&decoder_pool_mutex);
+    if (decoder_pool.have == NULL)
+    {
+        if (decoder_pool.max_threads < 1)
+            decoder_pool.max_threads = cpu_decoder_count();
+        decoder_pool.head = NULL;
+        decoder_pool.tail = &decoder_pool.head;
+        decoder_pool.have = new_lock(0);
+    }
+    pthread_mutex_unlock(&decoder_pool_mutex);
 }
 
-/* command the decode threads to all return, then join them all (call from
-   main thread), free all the thread-related resources */
-static void finish_decoding_jobs(dst_decoder_t *dst_decoder)
+/* the decoder state of a pool thread, one per channel count and layout seen */
+typedef struct
 {
-    job_t job;
-    int caught;
-
-    /* only do this once */
-    if (dst_decoder->decode_have == NULL)
-        return;
-
-    /* command all of the extant decode threads to return */
-    possess(dst_decoder->decode_have);
-    job.error = 0;
-    job.seq = -1;
-    job.next = NULL;
-    dst_decoder->decode_head = &job;
-    dst_decoder->decode_tail = &(job.next);
-    twist(dst_decoder->decode_have, BY, +1);       /* will wake them all up */
+    ebunch *D[2][MAX_CHANNELS + 1];
+}
+pool_thread_state_t;
 
-    /* join all of the decode threads, verify they all came back */
-    caught = join_all();
-    LOG(lm_main, LOG_NOTICE, ("-- joined %d decode threads", caught));
-    assert(caught == dst_decoder->cthreads);
-    dst_decoder->cthreads = 0;
+static ebunch *get_decoder_state(pool_thread_state_t *state, dst_decoder_t *dst_decoder)
+{
+    ebunch **D = &state->D[dst_decoder->layout == DST_DECODER_LAYOUT_PLANAR_LSB][dst_decoder->channel_count];
 
-    /* free the resources */
-    caught = buffer_pool_free(&dst_decoder->out_pool);
-    LOG(lm_main, LOG_NOTICE, ("-- freed %d output buffers", caught));
-    caught = buffer_pool_free(&dst_decoder->in_pool);
-    LOG(lm_main, LOG_NOTICE, ("-- freed %d input buffers", caught));
-    free_lock(dst_decoder->write_first);
-    free_lock(dst_decoder->decode_have);
-    dst_decoder->decode_have = NULL;
+    if (*D == NULL)
+    {
+        *D = (ebunch *) malloc(sizeof(ebunch));
+        if (*D == NULL)
+            return NULL;
+        if (DST_InitDecoder(*D, dst_decoder->channel_count, 64) != 0)
+        {
+            free(*D);
+            *D = NULL;
+            return NULL;
+        }
+        (*D)->PlanarLSB = dst_decoder->layout == DST_DECODER_LAYOUT_PLANAR_LSB;
+    }
+    return *D;
 }
 
-/* get the next decoding job from the head of the list, decode and compute
-   the check value on the input, and put a job in the write list with the
-   results -- keep looking for more jobs, returning when a job is found with a
-   sequence number of -1 (leave that job in the list for other incarnations to
-   find) */
+/* get the next decoding job from the head of the pool list, decode it and
+   put it in the write list of its decoder -- keep looking for more jobs,
+   returning when a job is found with a sequence number of -1 (leave that job
+   in the list for other incarnations to find) */
 static void decode_thread(void *userdata)
 {
     job_t *job;                /* job pulled and working on */ 
     job_t *here, **prior;      /* pointers for inserting in write list */ 
-    ebunch      D;
-    dst_decoder_t *dst_decoder = (dst_decoder_t *) userdata;
+    pool_thread_state_t state;
+    dst_decoder_t *dst_decoder;
+    ebunch *D;
+    int i, j;
 
-    if (DST_InitDecoder(&D, dst_decoder->channel_count, 64) != 0)
-    {
-        pthread_exit(0);
-    }
+    (void) userdata;
+    memset(&state, 0, sizeof(state));
+    cpu_place_decoder_thread();
 
     /* keep looking for work */
     for(;;)
     {
         /* get a job */
-        possess(dst_decoder->decode_have);
-        wait_for(dst_decoder->decode_have, NOT_TO_BE, 0);
-        job = dst_decoder->decode_head;
+        possess(decoder_pool.have);
+        wait_for(decoder_pool.have, NOT_TO_BE, 0);
+        job = decoder_pool.head;
         assert(job != NULL);
         if (job->seq == -1)
             break;
-        dst_decoder->decode_head = job->next;
+        decoder_pool.head = job->next;
         if (job->next == NULL)
-            dst_decoder->decode_tail = &dst_decoder->decode_head;
-        twist(dst_decoder->decode_have, BY, -1);
+            decoder_pool.tail = &decoder_pool.head;
+        twist(decoder_pool.have, BY, -1);
 
         /* got a job */
-        //LOG(lm_main, LOG_NOTICE, ("-- decoding #%ld", job->seq));
+        dst_decoder = job->dst_decoder;
 
         if (job->more)
         {
             job->out = buffer_pool_get_space(&dst_decoder->out_pool);
+            job->out->len = (size_t)(MAX_DSDBITS_INFRAME / 8 * dst_decoder->channel_count);
 
             /* Save the error for later, so that the write_thread can output them in DST frame order */
-            job->error = DST_FramDSTDecode(job->in->buf, job->out->buf, job->in->len, job->seq, &D); 
-            if (job->error != DSTErr_NoError)
-                LOG(lm_main, LOG_ERROR, ("ERROR: %s on frame: %d", DST_GetErrorMessage(job->error), D.FrameHdr.FrameNr));
-
-            job->out->len = (size_t)(MAX_DSDBITS_INFRAME / 8 * dst_decoder->channel_count);
+            D = get_decoder_state(&state, dst_decoder);
+            if (D != NULL)
+            {
+                job->error = DST_FramDSTDecode(job->in->buf, job->out->buf, job->in->len, job->seq, D);
+                if (job->error != DSTErr_NoError)
+                    LOG(lm_main, LOG_ERROR, ("ERROR: %s on frame: %d", DST_GetErrorMessage(job->error), D->FrameHdr.FrameNr));
+            }
+            else
+            {
+                job->error = DSTErr_MaxError;
+                memset(job->out->buf, 0, job->out->len);
+                LOG(lm_main, LOG_ERROR, ("ERROR: cannot set up a DST decoder for %d channels", dst_decoder->channel_count));
+            }
             buffer_pool_drop_space(job->in);
-
-            //LOG(lm_main, LOG_NOTICE, ("-- decoded #%ld%s", job->seq, job->more ? "" : " (last)"));
         }
 
         /* insert write job in list in sorted order, alert write thread */
@@ -249,18 +236,90 @@ static void decode_thread(void *userdata)
         /* done with that one -- go find another job */
     } 
 
-    /* found job with seq == -1 -- free deflate memory and return to join */
-    release(dst_decoder->decode_have);
+    /* found job with seq == -1 -- free decoder memory and return to join */
+    release(decoder_pool.have);
 
-    if (DST_CloseDecoder(&D) != 0)
+    for (i = 0; i < 2; i++)
     {
-        pthread_exit(0);
+        for (j = 0; j <= MAX_CHANNELS; j++)
+        {
+            if (state.D[i][j] != NULL)
+            {
+                DST_CloseDecoder(state.D[i][j]);
+                free(state.D[i][j]);
+            }
+        }
     }
 }
 
+/* put a job at the end of the pool list, start another decode thread if
+   needed and let all the decoders know -- max_threads is only an upper bound:
+   a thread is added when the jobs already queued have not been picked up yet,
+   so a disc that the running threads keep up with (or a writer that holds
+   back the reader through the buffer pool) does not spin up idle threads */
+static void queue_job(job_t *job)
+{
+    possess(decoder_pool.have);
+    if (decoder_pool.threads < decoder_pool.max_threads &&
+        (decoder_pool.threads == 0 || peek_lock(decoder_pool.have) > 0))
+    {
+        if (decoder_pool.thread_list == NULL)
+            decoder_pool.thread_list = (thread **) calloc(decoder_pool.max_threads, sizeof(thread *));
+        if (decoder_pool.thread_list == NULL)
+            exit(1);
+        decoder_pool.thread_list[decoder_pool.threads++] = launch(decode_thread, NULL);
+    }
+    job->next = NULL;
+    *decoder_pool.tail = job;
+    decoder_pool.tail = &(job->next);
+    twist(decoder_pool.have, BY, +1);
+}
+
+void dst_decoder_pool_init(int thread_count)
+{
+    /* only before the first decoder, the threads are started on demand */
+    pthread_mutex_lock(&decoder_pool_mutex);
+    if (decoder_pool.have == NULL)
+        decoder_pool.max_threads = thread_count;
+    pthread_mutex_unlock(&decoder_pool_mutex);
+}
+
+void dst_decoder_pool_hugepages(int enable)
+{
+    DST_SetHugePages(enable);
+}
+
+void dst_decoder_pool_destroy(void)
+{
+    job_t job;
+    int i;
+
+    if (decoder_pool.have == NULL)
+        return;
+
+    /* command all of the extant decode threads to return */
+    possess(decoder_pool.have);
+    job.error = 0;
+    job.seq = -1;
+    job.next = NULL;
+    decoder_pool.head = &job;
+    decoder_pool.tail = &(job.next);
+    twist(decoder_pool.have, BY, +1);       /* will wake them all up */
+
+    /* join all of the decode threads */
+    for (i = 0; i < decoder_pool.threads; i++)
+        join(decoder_pool.thread_list[i]);
+    LOG(lm_main, LOG_NOTICE, ("-- joined %d decode threads", decoder_pool.threads));
+
+    free(decoder_pool.thread_list);
+    free_lock(decoder_pool.have);
+    pthread_mutex_lock(&decoder_pool_mutex);
+    memset(&decoder_pool, 0, sizeof(decoder_pool));
+    pthread_mutex_unlock(&decoder_pool_mutex);
+}
+
 /* collect the write jobs off of the list in sequence order and write out the
-   decoded data until the last chunk is written -- also write the header and
-   trailer and combine the individual check values of the input buffers */
+   decoded data until the last chunk is written */
 static void write_thread(void *userdata)
 {
     long seq;                       /* next sequence number looking for */
@@ -268,7 +327,7 @@ static void write_thread(void *userdata)
     int more;                       /* true if more chunks to write */
     dst_decoder_t *dst_decoder = (dst_decoder_t *) userdata;
 
-    /* build and write header */
+    cpu_place_io_thread();
     LOG(lm_main, LOG_NOTICE, ("-- write thread running"));
 
     /* process output of decode threads until end of input */
@@ -302,47 +361,25 @@ static void write_thread(void *userdata)
     } 
     while (more);
 
-    /* verify no more jobs, prepare for next use */
-    possess(dst_decoder->decode_have);
-    assert(dst_decoder->decode_head == NULL && peek_lock(dst_decoder->decode_have) == 0);
-    release(dst_decoder->decode_have);
+    /* verify no more jobs */
     possess(dst_decoder->write_first);
     assert(dst_decoder->write_head == NULL);
     twist(dst_decoder->write_first, TO, -1);
 }
 
-static void finish_write_job(dst_decoder_t *dst_decoder)
+static job_t *new_job(dst_decoder_t *dst_decoder, int more)
 {
-    job_t *job;                /* job for decode, then write */
+    job_t *job = malloc(sizeof(job_t));
 
-    /* create a new job, use next input chunk, previous as dictionary */
-    job = malloc(sizeof(job_t));
     if (job == NULL)
         exit(1);
     job->error = 0;
-    job->seq = dst_decoder->sequence;
-    job->in = 0;
-    job->out = 0;
-    job->more = 0;
-
-    ++dst_decoder->sequence;
-
-    /* start another decode thread if needed */
-    if (dst_decoder->cthreads < dst_decoder->procs) 
-    {
-        (void)launch(decode_thread, dst_decoder);
-        dst_decoder->cthreads++;
-    }
-
-    /* put job at end of decode list, let all the decoders know */
-    possess(dst_decoder->decode_have);
-    job->next = NULL;
-    *dst_decoder->decode_tail = job;
-    dst_decoder->decode_tail = &(job->next);
-    twist(dst_decoder->decode_have, BY, +1);
-
-    join(dst_decoder->writeth);
-    dst_decoder->writeth = NULL;
+    job->seq = dst_decoder->sequence++;
+    job->in = NULL;
+    job->out = NULL;
+    job->more = more;
+    job->dst_decoder = dst_decoder;
+    return job;
 }
 
 dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata)
@@ -354,14 +391,19 @@ dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t fr
 
     assert(frame_decoded_callback);
 
+    decoder_pool_setup();
+
     dst_decoder->channel_count = channel_count;
     dst_decoder->userdata = userdata;
     dst_decoder->frame_decoded_callback = frame_decoded_callback;
     dst_decoder->frame_error_callback = frame_error_callback;
-    dst_decoder->procs = processor_count();
 
-    /* if first time or after an option change, setup the job lists */
-    setup_decoding_jobs(dst_decoder);
+    /* set up the write list and the buffer pools, the number of input buffers
+       limits how far the reader can run ahead of the decode threads */
+    dst_decoder->write_first = new_lock(-1);
+    dst_decoder->write_head = NULL;
+    buffer_pool_create(&dst_decoder->in_pool, 64 * 1024, (decoder_pool.max_threads << 1) + 2);
+    buffer_pool_create(&dst_decoder->out_pool, 64 * 1024, -1);
 
     /* start write thread */
     dst_decoder->writeth = launch(write_thread, dst_decoder);
@@ -369,43 +411,39 @@ dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t fr
     return dst_decoder;
 }
 
+void dst_decoder_set_layout(dst_decoder_t *dst_decoder, int layout)
+{
+    /* must be set before the first frame is queued */
+    assert(dst_decoder->sequence == 0);
+    dst_decoder->layout = layout;
+}
+
 void dst_decoder_destroy(dst_decoder_t *dst_decoder)
 {
-    finish_write_job(dst_decoder);
-    finish_decoding_jobs(dst_decoder);
+    int caught;
+
+    /* the last job tells the write thread to return once all frames are written */
+    queue_job(new_job(dst_decoder, 0));
+    join(dst_decoder->writeth);
+    dst_decoder->writeth = NULL;
+
+    /* free the resources */
+    caught = buffer_pool_free(&dst_decoder->out_pool);
+    LOG(lm_main, LOG_NOTICE, ("-- freed %d output buffers", caught));
+    caught = buffer_pool_free(&dst_decoder->in_pool);
+    LOG(lm_main, LOG_NOTICE, ("-- freed %d input buffers", caught));
+    free_lock(dst_decoder->write_first);
 
     free(dst_decoder);
 }
 
 void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t frame_size)
 {
-    job_t *job;                /* job for decode, then write */
+    job_t *job = new_job(dst_decoder, 1);
 
-    /* create a new job, use next input chunk */
-    job = malloc(sizeof(job_t));
-    if (job == NULL)
-        exit(1);
-    job->error = 0;
-    job->seq = dst_decoder->sequence;
     job->in = buffer_pool_get_space(&dst_decoder->in_pool);
     memcpy(job->in->buf, frame_data, frame_size);
     job->in->len = frame_size;
-    job->out = NULL;
-    job->more = 1;
-
-    ++dst_decoder->sequence;
-
-    /* start another decode thread if needed */
-    if (dst_decoder->cthreads < dst_decoder->procs) 
-    {
-        (void)launch(decode_thread, dst_decoder);
-        dst_decoder->cthreads++;
-    }
 
-    /* put job at end of decode list, let all the decoders know */
-    possess(dst_decoder->decode_have);
-    job->next = NULL;
-    *dst_decoder->decode_tail = job;
-    dst_decoder->decode_tail = &(job->next);
-    twist(dst_decoder->decode_have, BY, +1);
+    queue_job(job);
 }
@@ -28,9 +28,28 @@ typedef struct dst_decoder_s dst_decoder_t;
 typedef void (*frame_decoded_callback_t)(uint8_t* frame_data, size_t frame_size, void *userdata);
 typedef void (*frame_error_callback_t)(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata);
 
+/* layout of the decoded DSD data handed to frame_decoded_callback */
+enum
+{
+    DST_DECODER_LAYOUT_INTERLEAVED_MSB = 0,   /* channel interleaved, MSB first (DSDIFF, default) */
+    DST_DECODER_LAYOUT_PLANAR_LSB      = 1    /* one plane per channel, LSB first (DSF) */
+};
+
 dst_decoder_t* dst_decoder_create(int channel_count, frame_decoded_callback_t frame_decoded_callback, frame_error_callback_t frame_error_callback, void *userdata);
 void dst_decoder_destroy(dst_decoder_t *dst_decoder);
+/* must be called before the first frame is passed to dst_decoder_decode */
+void dst_decoder_set_layout(dst_decoder_t *dst_decoder, int layout);
 void dst_decoder_decode(dst_decoder_t *dst_decoder, uint8_t* frame_data, size_t frame_size);
 
+/* all decoders share one pool of decode threads, by default one per processor;
+   the size can only be set before the first decoder is created */
+void dst_decoder_pool_init(int thread_count);
+/* put the decoder tables of each decode thread (up to about 0.3 MB) on
+   transparent hugepages, a 2 MB page each; only before the first decoder is
+   created */
+void dst_decoder_pool_hugepages(int enable);
+/* joins the decode threads, no decoder may be in use */
+void dst_decoder_pool_destroy(void);
+
 
 #endif /* DST_DECODER_H */
@@ -0,0 +1,726 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+/*
+  DST encoder for one frame, the mirror of UnpackDSTframe() and DST_FramDSTDecode().
+
+  Each channel gets a prediction filter of its own, estimated from the autocorrelation
+  of the frame (Levinson-Durbin), and a probability table built from how often the
+  filter mispredicts for each size of its output. All channels use one segment, the
+  Ptable segmentation and mapping are those of the filters. The prediction residual of
+  the channels is then arithmetic coded, interleaved bit by bit as the decoder reads
+  it. Filters and Ptables are Rice coded with the coefficient predictors of ccp_calc.c
+  when that is shorter than storing them plainly.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ccp_calc.h"
+#include "dst_encode.h"
+
+#define PBITS   AC_BITS             /* as in dst_fram.c */
+#define NBITS   4
+#define ABITS   (PBITS + NBITS)
+#define ONE     (1 << ABITS)
+#define HALF    (1 << (ABITS - 1))
+
+#define FRAME_BITS      MAX_DSDBITS_INFRAME
+#define FRAME_WORDS     (FRAME_BITS / 64)
+
+/* The filters tried for each channel: longer filters predict better, but the larger
+   coefficients they come with lose more to the 9 bit quantization, which one wins
+   depends on the noise shaping of the recording. The white noise added to the
+   autocorrelation keeps the estimation stable, also on periodic frames such as
+   digital silence. Each is run over the first SELECT_BITS bits of the frame and the
+   one with the shortest estimated code is used. */
+static const struct
+{
+    int    Order;
+    double WhiteNoise;
+}
+FilterCandidates[] =
+{
+    {  16, 1e-4 }, {  32, 1e-4 }, {  64, 1e-4 }, { 128, 1e-4 },
+    {  32, 1e-3 }, {  64, 1e-3 }, { 128, 1e-3 }
+};
+#define NROF_CANDIDATES     (int) (sizeof(FilterCandidates) / sizeof(FilterCandidates[0]))
+#define SELECT_BITS         8192
+
+#if defined(__GNUC__)
+#define POPCOUNT64(x)   __builtin_popcountll(x)
+#else
+static int POPCOUNT64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int) ((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+/* -- bit stream, MSB first as read by FIO_BitGet*() -- */
+
+typedef struct
+{
+    uint8_t *buf;           /* zeroed before writing */
+    long     bits;          /* written so far, may pass max_bits */
+    long     max_bits;
+}
+BitWriter;
+
+static void PutBits(BitWriter *W, unsigned int Val, int Len)
+{
+    while (Len-- > 0)
+    {
+        if (((Val >> Len) & 1) && W->bits < W->max_bits)
+            W->buf[W->bits >> 3] |= (uint8_t) (0x80 >> (W->bits & 7));
+        W->bits++;
+    }
+}
+
+static int Log2RoundUp(long x)
+{
+    int y = 0;
+
+    while (x >= (1 << y))
+        y++;
+    return y;
+}
+
+/* the mirror of RiceDecode() in unpack_dst.c */
+static void PutRice(BitWriter *W, int Nr, int m)
+{
+    int Abs = abs(Nr);
+    int RunLength = Abs >> m;
+
+    while (RunLength-- > 0)
+        PutBits(W, 0, 1);
+    PutBits(W, 1, 1);
+    PutBits(W, (unsigned int) Abs & ((1u << m) - 1), m);
+    if (Abs != 0)
+        PutBits(W, Nr < 0, 1);
+}
+
+static int RiceBits(int Nr, int m)
+{
+    int Abs = abs(Nr);
+
+    return (Abs >> m) + 1 + m + (Abs != 0);
+}
+
+/* -- arithmetic encoder, the mirror of LT_ACDecodeBit_*() in dst_fram.c -- */
+
+typedef struct
+{
+    unsigned int A;         /* interval size, ABITS bits */
+    unsigned int L;         /* low end of the interval below the bits written */
+    uint8_t     *cb;        /* code bits, one per byte so a carry is easy to apply */
+    int          len;
+    int          max;       /* the code is useless when it gets longer */
+}
+ACEncoder;
+
+static void ACEncodeInit(ACEncoder *AC, uint8_t *cb, int max)
+{
+    AC->A = ONE - 1;
+    AC->L = 0;
+    AC->cb = cb;
+    AC->max = max;
+    cb[0] = 0;              /* the decoder starts reading at the second bit */
+    AC->len = 1;
+}
+
+/* p is the probability (in 1/256) of b being 0 */
+static inline void ACEncodeBit(ACEncoder *AC, int b, int p)
+{
+    /* approximate (A * p) with "partial rounding", exactly as the decoder */
+    unsigned int ap = ((AC->A >> PBITS) | ((AC->A >> (PBITS - 1)) & 1)) * (unsigned int) p;
+    unsigned int h = AC->A - ap;
+
+    if (b == 0)
+    {
+        AC->L += h;
+        AC->A  = ap;
+    }
+    else
+    {
+        AC->A  = h;
+    }
+
+    /* a carry runs into the bits already written, the first one always stays 0 */
+    if (AC->L >= ONE)
+    {
+        AC->L -= ONE;
+        if (AC->len <= AC->max)
+        {
+            int i = AC->len - 1;
+
+            while (AC->cb[i] == 1)
+                AC->cb[i--] = 0;
+            AC->cb[i] = 1;
+        }
+    }
+
+    while (AC->A < HALF)
+    {
+        AC->A <<= 1;
+        if (AC->len < AC->max)
+            AC->cb[AC->len] = (uint8_t) ((AC->L >> (ABITS - 1)) & 1);
+        AC->len++;
+        AC->L = (AC->L << 1) & (ONE - 1);
+    }
+}
+
+/* writes out the low end, the decoder reads zeros past the end of the code */
+static void ACEncodeFlush(ACEncoder *AC)
+{
+    int i;
+
+    for (i = ABITS - 1; i >= 0; i--)
+    {
+        if (AC->len < AC->max)
+            AC->cb[AC->len] = (uint8_t) ((AC->L >> i) & 1);
+        AC->len++;
+    }
+    if (AC->len <= AC->max)
+    {
+        while (AC->len > 1 && AC->cb[AC->len - 1] == 0)
+            AC->len--;
+    }
+}
+
+/* probability of the first code bit, see Reverse7LSBs() in dst_fram.c */
+static int Reverse7LSBs(int16_t c)
+{
+    int v = (c + (1 << SIZE_PREDCOEF)) & 127;
+    int r = 0;
+    int i;
+
+    for (i = 0; i < 7; i++)
+        r |= ((v >> i) & 1) << (6 - i);
+    return r + 1;
+}
+
+/* -- filter estimation -- */
+
+static void GetChannelBits(DSTEncoder *E, const uint8_t *DSDdata, int ChNr)
+{
+    uint64_t *Bits = E->ChBits[ChNr];
+    const int NrOfChannels = E->NrOfChannels;
+    int WordNr, ByteNr;
+
+    for (WordNr = 0; WordNr < FRAME_WORDS; WordNr++)
+    {
+        uint64_t w = 0;
+
+        for (ByteNr = 0; ByteNr < 8; ByteNr++)
+            w = (w << 8) | DSDdata[(WordNr * 8 + ByteNr) * NrOfChannels + ChNr];
+        Bits[WordNr] = w;
+    }
+}
+
+static inline int GetBit(const uint64_t *Bits, int BitNr)
+{
+    return (int) ((Bits[BitNr >> 6] >> (63 - (BitNr & 63))) & 1);
+}
+
+/* autocorrelation of the channel as +1/-1 samples: one minus twice the share of the
+   bits that differ from the bit Lag positions earlier */
+static void Autocorrelation(const uint64_t *Bits, int MaxLag, double *r)
+{
+    int Lag, WordNr;
+
+    r[0] = 1.0;
+    for (Lag = 1; Lag <= MaxLag; Lag++)
+    {
+        const int q = Lag / 64;
+        const int s = Lag % 64;
+        long Differ = 0;
+
+        for (WordNr = q + 1; WordNr < FRAME_WORDS; WordNr++)
+        {
+            uint64_t Delayed = s == 0 ? Bits[WordNr - q] : (Bits[WordNr - q] >> s) | (Bits[WordNr - q - 1] << (64 - s));
+
+            Differ += POPCOUNT64(Bits[WordNr] ^ Delayed);
+        }
+        r[Lag] = 1.0 - 2.0 * (double) Differ / ((double) (FRAME_WORDS - q - 1) * 64);
+    }
+}
+
+/* Levinson-Durbin recursion: a[k] predicts from the sample k + 1 positions earlier,
+   returns the order reached */
+static int Levinson(const double *r, int Order, double WhiteNoise, double *a)
+{
+    double Prev[1 << SIZE_CODEDPREDORDER];
+    double Err = r[0] * (1.0 + WhiteNoise);
+    int i, j;
+
+    for (i = 0; i < Order; i++)
+        a[i] = 0.0;
+
+    for (i = 0; i < Order; i++)
+    {
+        double Acc = r[i + 1];
+        double k;
+
+        for (j = 0; j < i; j++)
+            Acc -= a[j] * r[i - j];
+        k = Acc / Err;
+        if (k >= 1.0 || k <= -1.0)
+            break;
+
+        memcpy(Prev, a, i * sizeof(double));
+        for (j = 0; j < i; j++)
+            a[j] = Prev[j] - k * Prev[i - 1 - j];
+        a[i] = k;
+
+        Err *= 1.0 - k * k;
+        if (Err < 1e-9)
+            return i + 1;
+    }
+    return i;
+}
+
+/* quantizes the filter to SIZE_PREDCOEF bits, scaled so the largest coefficient just
+   fits; the decoder only looks at the sign and the size of the filter output */
+static void EstimateFilter(DSTEncoder *E, int ChNr, const double *r, int MaxOrder, double WhiteNoise)
+{
+    double a[1 << SIZE_CODEDPREDORDER];
+    double MaxAbs = 0.0, Scale;
+    int16_t *Coef = E->ICoefA[ChNr];
+    int Order, i;
+
+    Order = Levinson(r, MaxOrder, WhiteNoise, a);
+
+    for (i = 0; i < Order; i++)
+    {
+        if (a[i] > MaxAbs)
+            MaxAbs = a[i];
+        else if (-a[i] > MaxAbs)
+            MaxAbs = -a[i];
+    }
+    Scale = MaxAbs > 0.0 ? ((1 << (SIZE_PREDCOEF - 1)) - 1) / MaxAbs : 0.0;
+    if (Scale > 1 << (SIZE_PREDCOEF - 1))
+        Scale = 1 << (SIZE_PREDCOEF - 1);
+
+    memset(Coef, 0, sizeof(E->ICoefA[ChNr]));
+    E->PredOrder[ChNr] = 1;
+    for (i = 0; i < Order; i++)
+    {
+        double c = a[i] * Scale;
+
+        Coef[i] = (int16_t) (c >= 0.0 ? c + 0.5 : c - 0.5);
+        if (Coef[i] != 0)
+            E->PredOrder[ChNr] = i + 1;
+    }
+}
+
+/* runs the filter over the first NrOfBits bits of the channel the way
+   DST_FramDSTDecode() does, from the same 0xaa status, counts the mispredictions per
+   Ptable entry and, when Predict is given, keeps the filter output */
+static void RunFilter(DSTEncoder *E, int ChNr, int NrOfBits, int16_t *Predict, long *Count, long *Errors)
+{
+    int16_t (*ICoefI)[256] = E->ICoefI[ChNr];
+    const int16_t *Coef = E->ICoefA[ChNr];
+    const uint64_t *Bits = E->ChBits[ChNr];
+    const int PredOrder = E->PredOrder[ChNr];
+    const int NrOfTables = (PredOrder + 7) / 8;
+    uint64_t Lo = 0xaaaaaaaaaaaaaaaaULL;    /* bit k is the bit k + 1 positions earlier */
+    uint64_t Hi = 0xaaaaaaaaaaaaaaaaULL;
+    int TableNr, BitNr, i, j;
+
+    for (TableNr = 0; TableNr < NrOfTables; TableNr++)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            int Value = 0;
+
+            for (j = 0; j < 8; j++)
+                Value += (((i >> j) & 1) * 2 - 1) * Coef[TableNr * 8 + j];
+            ICoefI[TableNr][i] = (int16_t) Value;
+        }
+    }
+
+    memset(Count, 0, AC_HISMAX * sizeof(long));
+    memset(Errors, 0, AC_HISMAX * sizeof(long));
+    for (BitNr = 0; BitNr < NrOfBits; BitNr++)
+    {
+        int Sum = 0;
+        int16_t Value;
+        int Bit;
+
+        for (TableNr = 0; TableNr < NrOfTables && TableNr < 8; TableNr++)
+            Sum += ICoefI[TableNr][(Lo >> (TableNr * 8)) & 0xff];
+        for (; TableNr < NrOfTables; TableNr++)
+            Sum += ICoefI[TableNr][(Hi >> ((TableNr - 8) * 8)) & 0xff];
+        Value = (int16_t) Sum;
+        if (Predict)
+            Predict[BitNr] = Value;
+
+        Bit = GetBit(Bits, BitNr);
+        if (BitNr >= PredOrder)     /* the first PredOrder bits are coded with p = 1/2 */
+        {
+            int Index = abs(Value) >> AC_QSTEP;
+
+            if (Index >= AC_HISMAX)
+                Index = AC_HISMAX - 1;
+            Count[Index]++;
+            Errors[Index] += Bit != (Value >= 0);
+        }
+
+        Hi = (Hi << 1) | (Lo >> 63);
+        Lo = (Lo << 1) | (uint64_t) Bit;
+    }
+}
+
+/* estimated length of the code of the counted bits, plus that of the filter */
+static double EstimateBits(const long *Count, const long *Errors, int PredOrder)
+{
+    double Bits = PredOrder * (SIZE_PREDCOEF - 3);
+    int i;
+
+    for (i = 0; i < AC_HISMAX; i++)
+    {
+        if (Errors[i] > 0 && Errors[i] < Count[i])
+        {
+            double p = (double) Errors[i] / Count[i];
+
+            Bits -= Errors[i] * log2(p) + (Count[i] - Errors[i]) * log2(1.0 - p);
+        }
+    }
+    return Bits;
+}
+
+static void SelectFilter(DSTEncoder *E, int ChNr, long *Count, long *Errors)
+{
+    int16_t BestCoef[1 << SIZE_CODEDPREDORDER];
+    double r[(1 << SIZE_CODEDPREDORDER) + 1];
+    double Best = 0.0;
+    int BestOrder = 0;
+    int i;
+
+    Autocorrelation(E->ChBits[ChNr], 1 << SIZE_CODEDPREDORDER, r);
+    for (i = 0; i < NROF_CANDIDATES; i++)
+    {
+        double Bits;
+
+        EstimateFilter(E, ChNr, r, FilterCandidates[i].Order, FilterCandidates[i].WhiteNoise);
+        RunFilter(E, ChNr, SELECT_BITS, NULL, Count, Errors);
+        Bits = EstimateBits(Count, Errors, E->PredOrder[ChNr]);
+        if (BestOrder == 0 || Bits < Best)
+        {
+            Best = Bits;
+            BestOrder = E->PredOrder[ChNr];
+            memcpy(BestCoef, E->ICoefA[ChNr], sizeof(BestCoef));
+        }
+    }
+    memcpy(E->ICoefA[ChNr], BestCoef, sizeof(BestCoef));
+    E->PredOrder[ChNr] = BestOrder;
+}
+
+/* probability of a misprediction for each filter output size, in 1/256 */
+static void BuildPtable(DSTEncoder *E, int ChNr, const long *Count, const long *Errors)
+{
+    int *P_one = E->P_one[ChNr];
+    int Len = 0, First = -1, i;
+
+    for (i = 0; i < AC_HISMAX; i++)
+    {
+        if (Count[i] > 0)
+        {
+            Len = i + 1;
+            if (First < 0)
+                First = i;
+        }
+    }
+    if (Len < 2)
+        Len = 2;                    /* a single entry would mean p = 1/2 */
+    if (First < 0)
+        First = 0;
+
+    for (i = 0; i < Len; i++)
+    {
+        if (Count[i] > 0)
+        {
+            int p = (int) ((Errors[i] + 0.5) * AC_PROBS / (Count[i] + 1) + 0.5);
+
+            P_one[i] = p < 1 ? 1 : p > AC_PROBS / 2 ? AC_PROBS / 2 : p;
+        }
+        else
+            P_one[i] = i > First ? P_one[i - 1] : -1;
+    }
+    /* entries before the first used one take its value, they cost less that way */
+    for (i = First - 1; i >= 0; i--)
+        P_one[i] = P_one[i + 1] < 0 ? AC_PROBS / 2 : P_one[i + 1];
+    if (P_one[First] < 0)
+        P_one[First] = AC_PROBS / 2;
+    for (i = First + 1; i < Len; i++)
+        if (P_one[i] < 0)
+            P_one[i] = P_one[i - 1];
+
+    /* the last entry also serves all larger outputs */
+    while (Len > 2 && P_one[Len - 1] == P_one[Len - 2])
+        Len--;
+    E->PtableLen[ChNr] = Len;
+}
+
+/* -- filters and Ptables in the frame header -- */
+
+/* the mirror of the Rice decoding in ReadFilterCoefSets() and ReadProbabilityTables() */
+static int CodedResidual(const CodedTable *CT, int Method, const int *Data, int Nr)
+{
+    int TapNr, x = 0;
+
+    for (TapNr = 0; TapNr < CT->CPredOrder[Method]; TapNr++)
+        x += CT->CPredCoef[Method][TapNr] * Data[Nr - TapNr - 1];
+    return x >= 0 ? Data[Nr] + (x + 4) / 8 : Data[Nr] - (-x + 3) / 8;
+}
+
+/* picks the shorter of storing the entries plainly (*Method -1) or Rice coded */
+static void ChooseCoding(const CodedTable *CT, const int *Data, int Len, int PlainBits, int MaxM, int *Method, int *M)
+{
+    long Best = (long) Len * PlainBits;
+    int Meth, m, Nr;
+
+    *Method = -1;
+    *M = 0;
+    for (Meth = 0; Meth < NROFFRICEMETHODS; Meth++)
+    {
+        long Bits[MAX_RICE_M_F + 1];
+
+        if (CT->CPredOrder[Meth] >= Len)
+            continue;
+        for (m = 0; m <= MaxM; m++)
+            Bits[m] = SIZE_RICEMETHOD + (long) CT->CPredOrder[Meth] * PlainBits + SIZE_RICEM;
+        for (Nr = CT->CPredOrder[Meth]; Nr < Len; Nr++)
+        {
+            int Residual = CodedResidual(CT, Meth, Data, Nr);
+
+            for (m = 0; m <= MaxM; m++)
+                Bits[m] += RiceBits(Residual, m);
+        }
+        for (m = 0; m <= MaxM; m++)
+        {
+            if (Bits[m] < Best)
+            {
+                Best = Bits[m];
+                *Method = Meth;
+                *M = m;
+            }
+        }
+    }
+}
+
+static void WriteFilter(BitWriter *W, const CodedTable *CT, const int16_t *Coef, int PredOrder)
+{
+    int Data[1 << SIZE_CODEDPREDORDER];
+    int Method, m, Nr;
+
+    for (Nr = 0; Nr < PredOrder; Nr++)
+        Data[Nr] = Coef[Nr];
+    ChooseCoding(CT, Data, PredOrder, SIZE_PREDCOEF, MAX_RICE_M_F, &Method, &m);
+
+    PutBits(W, (unsigned int) PredOrder - 1, SIZE_CODEDPREDORDER);
+    if (Method < 0)
+    {
+        PutBits(W, 0, 1);
+        for (Nr = 0; Nr < PredOrder; Nr++)
+            PutBits(W, (unsigned int) Data[Nr] & ((1u << SIZE_PREDCOEF) - 1), SIZE_PREDCOEF);
+    }
+    else
+    {
+        PutBits(W, 1, 1);
+        PutBits(W, (unsigned int) Method, SIZE_RICEMETHOD);
+        for (Nr = 0; Nr < CT->CPredOrder[Method]; Nr++)
+            PutBits(W, (unsigned int) Data[Nr] & ((1u << SIZE_PREDCOEF) - 1), SIZE_PREDCOEF);
+        PutBits(W, (unsigned int) m, SIZE_RICEM);
+        for (; Nr < PredOrder; Nr++)
+            PutRice(W, CodedResidual(CT, Method, Data, Nr), m);
+    }
+}
+
+static void WritePtable(BitWriter *W, const CodedTable *CT, const int *P_one, int PtableLen)
+{
+    int Method, m, Nr;
+
+    PutBits(W, (unsigned int) PtableLen - 1, AC_HISBITS);
+    if (PtableLen == 1)
+        return;                     /* the decoder uses 128 */
+
+    ChooseCoding(CT, P_one, PtableLen, AC_BITS - 1, MAX_RICE_M_P, &Method, &m);
+    if (Method < 0)
+    {
+        PutBits(W, 0, 1);
+        for (Nr = 0; Nr < PtableLen; Nr++)
+            PutBits(W, (unsigned int) P_one[Nr] - 1, AC_BITS - 1);
+    }
+    else
+    {
+        PutBits(W, 1, 1);
+        PutBits(W, (unsigned int) Method, SIZE_RICEMETHOD);
+        for (Nr = 0; Nr < CT->CPredOrder[Method]; Nr++)
+            PutBits(W, (unsigned int) P_one[Nr] - 1, AC_BITS - 1);
+        PutBits(W, (unsigned int) m, SIZE_RICEM);
+        for (; Nr < PtableLen; Nr++)
+            PutRice(W, CodedResidual(CT, Method, P_one, Nr), m);
+    }
+}
+
+/* -- frame -- */
+
+static size_t StoreDSDFrame(DSTEncoder *E, const uint8_t *DSDdata, uint8_t *DSTdata)
+{
+    size_t Size = DST_ENCODE_MAX_FRAME_SIZE(E->NrOfChannels);
+
+    DSTdata[0] = 0;                 /* DSTCoded 0, DST_X_Bit 0 and the stuffing */
+    memcpy(DSTdata + 1, DSDdata, Size - 1);
+    return Size;
+}
+
+size_t DST_FramDSTEncode(DSTEncoder *E, const uint8_t *DSDdata, uint8_t *DSTdata)
+{
+    const int NrOfChannels = E->NrOfChannels;
+    const size_t MaxSize = DST_ENCODE_MAX_FRAME_SIZE(NrOfChannels);
+    BitWriter W;
+    ACEncoder AC;
+    int ChNr, BitNr, i;
+
+    for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+    {
+        long Count[AC_HISMAX];
+        long Errors[AC_HISMAX];
+
+        GetChannelBits(E, DSDdata, ChNr);
+        SelectFilter(E, ChNr, Count, Errors);
+        RunFilter(E, ChNr, FRAME_BITS, E->Predict[ChNr], Count, Errors);
+        BuildPtable(E, ChNr, Count, Errors);
+    }
+
+    /* a frame is at most as long as the DSD it holds */
+    memset(DSTdata, 0, MaxSize);
+    W.buf = DSTdata;
+    W.bits = 0;
+    W.max_bits = (long) (MaxSize - 1) * 8;
+
+    PutBits(&W, 1, 1);              /* DSTCoded */
+
+    /* segmentation: one segment per channel, for filters and Ptables alike */
+    PutBits(&W, 1, 1);              /* PSameSegAsF */
+    PutBits(&W, 1, 1);              /* SameSegAllCh */
+    PutBits(&W, 1, 1);              /* EndOfChannel */
+
+    /* mapping: channel ChNr uses filter and Ptable ChNr */
+    PutBits(&W, 1, 1);              /* PSameMapAsF */
+    PutBits(&W, 0, 1);              /* SameMapAllCh */
+    for (ChNr = 1; ChNr < NrOfChannels; ChNr++)
+        PutBits(&W, (unsigned int) ChNr, Log2RoundUp(ChNr));
+    for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        PutBits(&W, 1, 1);          /* HalfProb: the filter has no history yet */
+
+    for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        WriteFilter(&W, &E->StrFilter, E->ICoefA[ChNr], E->PredOrder[ChNr]);
+    for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        WritePtable(&W, &E->StrPtable, E->P_one[ChNr], E->PtableLen[ChNr]);
+
+    if (W.bits >= W.max_bits)
+        return StoreDSDFrame(E, DSDdata, DSTdata);
+
+    /* arithmetic coded residual, in the order the decoder reads it */
+    ACEncodeInit(&AC, E->AData, (int) (W.max_bits - W.bits));
+    ACEncodeBit(&AC, 0, Reverse7LSBs(E->ICoefA[0][0]));
+    for (BitNr = 0; BitNr < FRAME_BITS && AC.len <= AC.max; BitNr++)
+    {
+        for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        {
+            const int16_t Predict = E->Predict[ChNr][BitNr];
+            const int Residual = GetBit(E->ChBits[ChNr], BitNr) ^ (Predict < 0);
+            int p;
+
+            if (BitNr < E->PredOrder[ChNr])
+                p = AC_PROBS / 2;
+            else
+            {
+                int Index = abs(Predict) >> AC_QSTEP;
+
+                p = E->P_one[ChNr][Index < E->PtableLen[ChNr] ? Index : E->PtableLen[ChNr] - 1];
+            }
+            ACEncodeBit(&AC, Residual, p);
+        }
+    }
+    ACEncodeFlush(&AC);
+    if (AC.len > AC.max)
+        return StoreDSDFrame(E, DSDdata, DSTdata);
+
+    for (i = 0; i < AC.len; i++)
+        PutBits(&W, AC.cb[i], 1);
+
+    return (size_t) ((W.bits + 7) / 8);
+}
+
+int DST_InitEncoder(DSTEncoder *E, int NrOfChannels)
+{
+    int t, Method;
+
+    memset(E, 0, sizeof(*E));
+    if (NrOfChannels < 1 || NrOfChannels > MAX_CHANNELS)
+        return -1;
+
+    E->NrOfChannels = NrOfChannels;
+
+    for (t = 0; t < 2; t++)
+        for (Method = 0; Method < NROFFRICEMETHODS; Method++)
+            E->CPredCoefRows[t][Method] = E->CPredCoef[t][Method];
+    E->StrFilter.TableType  = FILTER;
+    E->StrFilter.CPredOrder = E->CPredOrder[0];
+    E->StrFilter.CPredCoef  = E->CPredCoefRows[0];
+    E->StrPtable.TableType  = PTABLE;
+    E->StrPtable.CPredOrder = E->CPredOrder[1];
+    E->StrPtable.CPredCoef  = E->CPredCoefRows[1];
+    if (CCP_CalcInit(&E->StrFilter) != 0 || CCP_CalcInit(&E->StrPtable) != 0)
+        return -1;
+
+    E->ADataSize = (int) DST_ENCODE_MAX_FRAME_SIZE(NrOfChannels) * 8;
+    E->ChBits  = malloc(NrOfChannels * sizeof(*E->ChBits));
+    E->Predict = malloc(NrOfChannels * sizeof(*E->Predict));
+    E->ICoefI  = malloc(NrOfChannels * sizeof(*E->ICoefI));
+    E->AData   = malloc(E->ADataSize);
+    if (!E->ChBits || !E->Predict || !E->ICoefI || !E->AData)
+    {
+        DST_CloseEncoder(E);
+        return -1;
+    }
+    return 0;
+}
+
+void DST_CloseEncoder(DSTEncoder *E)
+{
+    free(E->ChBits);
+    free(E->Predict);
+    free(E->ICoefI);
+    free(E->AData);
+    E->ChBits = NULL;
+    E->Predict = NULL;
+    E->ICoefI = NULL;
+    E->AData = NULL;
+}
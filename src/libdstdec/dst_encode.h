@@ -0,0 +1,66 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef DST_ENCODE_H_INCLUDED
+#define DST_ENCODE_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/* number of bytes of a DST frame holding the DSD frame as it is (DSTCoded 0),
+   the encoder never writes a larger frame */
+#define DST_ENCODE_MAX_FRAME_SIZE(NrOfChannels)  (MAX_DSDBITS_INFRAME / 8 * (NrOfChannels) + 1)
+
+/* state of the frame encoder, one per encoding thread */
+typedef struct
+{
+    int        NrOfChannels;
+
+    int        PredOrder[MAX_CHANNELS];                       /* filter (and Ptable) ChNr is used by ChNr    */
+    int16_t    ICoefA[MAX_CHANNELS][1 << SIZE_CODEDPREDORDER];
+    int        PtableLen[MAX_CHANNELS];
+    int        P_one[MAX_CHANNELS][AC_HISMAX];
+
+    CodedTable StrFilter;                                     /* only CPredOrder and CPredCoef are used      */
+    CodedTable StrPtable;
+    int        CPredOrder[2][NROFFRICEMETHODS];
+    int        CPredCoef[2][NROFFRICEMETHODS][MAXCPREDORDER];
+    int       *CPredCoefRows[2][NROFFRICEMETHODS];
+
+    uint64_t   (*ChBits)[MAX_DSDBITS_INFRAME / 64];           /* channel bits, oldest first in the MSB      */
+    int16_t    (*Predict)[MAX_DSDBITS_INFRAME];               /* filter output for each bit                  */
+    int16_t    (*ICoefI)[16][256];                            /* filter output per 8 taps, as the decoder    */
+    uint8_t    *AData;                                        /* arithmetic code, one bit per byte           */
+    int        ADataSize;
+} DSTEncoder;
+
+int DST_InitEncoder(DSTEncoder *E, int NrOfChannels);
+void DST_CloseEncoder(DSTEncoder *E);
+
+/* Encodes one DSD frame (channel interleaved, MSB first, 4704 bytes per channel) into
+   DSTdata, which holds at least DST_ENCODE_MAX_FRAME_SIZE(NrOfChannels) bytes, and returns
+   the size of the DST frame. A frame that does not compress is stored as it is. */
+size_t DST_FramDSTEncode(DSTEncoder *E, const uint8_t *DSDdata, uint8_t *DSTdata);
+
+#endif /* DST_ENCODE_H_INCLUDED */
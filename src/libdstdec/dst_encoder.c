@@ -0,0 +1,295 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+/*
+  The frames are spread over the encode threads and collected in order by a write
+  thread, as in dst_decoder.c (after "pigz" by Mark Adler). Every encoder has threads
+  of its own, they are started as the frames come in.
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <logging.h>
+#include <cpu.h>
+
+#include "dst_encoder.h"
+#include "yarn.h"
+#include "buffer_pool.h"
+#include "dst_encode.h"
+
+/* encode or write job (passed from the encode list to the write list) -- if seq is
+   equal to -1, an encode thread is instructed to return; if more is false then this
+   is the last chunk, which after writing tells write_thread to return */
+typedef struct job_t
+{
+    long seq;                                 /* sequence number */
+    int more;                                 /* true if this is not the last chunk */
+    buffer_pool_space_t *in;                  /* input DSD frame */
+    buffer_pool_space_t *out;                 /* resulting DST frame */
+    struct job_t *next;                       /* next job in the list (either list) */
+}
+job_t;
+
+struct dst_encoder_s
+{
+    int channel_count;
+
+    long sequence;        /* each job gets a unique sequence number */
+
+    /* input and output buffer pools */
+    buffer_pool_t in_pool;
+    buffer_pool_t out_pool;
+
+    /* list of encode jobs (with tail for appending to list) */
+    lock *have;           /* number of encode jobs waiting */
+    job_t *head, **tail;
+
+    int max_threads;
+    int threads;          /* number of encode threads running */
+    thread **thread_list;
+
+    /* list of write jobs */
+    lock *write_first;    /* lowest sequence number in list */
+    job_t *write_head;
+
+    /* write thread if running */
+    thread *writeth;
+
+    frame_encoded_callback_t frame_encoded_callback;
+    void *userdata;
+};
+
+/* get the next encoding job from the head of the list, encode it and put it in the
+   write list -- keep looking for more jobs, returning when a job is found with a
+   sequence number of -1 (leave that job in the list for the other threads to find) */
+static void encode_thread(void *userdata)
+{
+    dst_encoder_t *dst_encoder = (dst_encoder_t *) userdata;
+    job_t *job;                /* job pulled and working on */
+    job_t *here, **prior;      /* pointers for inserting in write list */
+    DSTEncoder E;
+    int ready;
+
+    cpu_place_decoder_thread();
+    ready = DST_InitEncoder(&E, dst_encoder->channel_count) == 0;
+    if (!ready)
+        LOG(lm_main, LOG_ERROR, ("ERROR: cannot set up a DST encoder for %d channels", dst_encoder->channel_count));
+
+    /* keep looking for work */
+    for (;;)
+    {
+        /* get a job */
+        possess(dst_encoder->have);
+        wait_for(dst_encoder->have, NOT_TO_BE, 0);
+        job = dst_encoder->head;
+        assert(job != NULL);
+        if (job->seq == -1)
+            break;
+        dst_encoder->head = job->next;
+        if (job->next == NULL)
+            dst_encoder->tail = &dst_encoder->head;
+        twist(dst_encoder->have, BY, -1);
+
+        /* got a job */
+        if (job->more)
+        {
+            job->out = buffer_pool_get_space(&dst_encoder->out_pool);
+            if (ready)
+                job->out->len = DST_FramDSTEncode(&E, job->in->buf, job->out->buf);
+            else
+            {
+                /* the frame as it is, DSTCoded 0 */
+                ((uint8_t *) job->out->buf)[0] = 0;
+                memcpy((uint8_t *) job->out->buf + 1, job->in->buf, job->in->len);
+                job->out->len = job->in->len + 1;
+            }
+            buffer_pool_drop_space(job->in);
+        }
+
+        /* insert write job in list in sorted order, alert write thread */
+        possess(dst_encoder->write_first);
+        prior = &dst_encoder->write_head;
+        while ((here = *prior) != NULL)
+        {
+            if (here->seq > job->seq)
+                break;
+            prior = &(here->next);
+        }
+        job->next = here;
+        *prior = job;
+        twist(dst_encoder->write_first, TO, dst_encoder->write_head->seq);
+    }
+
+    /* found job with seq == -1 -- return to join */
+    release(dst_encoder->have);
+    if (ready)
+        DST_CloseEncoder(&E);
+}
+
+/* put a job at the end of the encode list and start another encode thread if the
+   ones running have not picked up the jobs queued before */
+static void queue_job(dst_encoder_t *dst_encoder, job_t *job)
+{
+    possess(dst_encoder->have);
+    if (dst_encoder->threads < dst_encoder->max_threads &&
+        (dst_encoder->threads == 0 || peek_lock(dst_encoder->have) > 0))
+    {
+        dst_encoder->thread_list[dst_encoder->threads++] = launch(encode_thread, dst_encoder);
+    }
+    job->next = NULL;
+    *dst_encoder->tail = job;
+    dst_encoder->tail = &(job->next);
+    twist(dst_encoder->have, BY, +1);
+}
+
+/* collect the write jobs off of the list in sequence order and hand the encoded
+   frames to the callback until the last chunk is written */
+static void write_thread(void *userdata)
+{
+    long seq;                       /* next sequence number looking for */
+    job_t *job;                     /* job pulled and working on */
+    int more;                       /* true if more chunks to write */
+    dst_encoder_t *dst_encoder = (dst_encoder_t *) userdata;
+
+    cpu_place_io_thread();
+
+    seq = 0;
+    do
+    {
+        /* get next write job in order */
+        possess(dst_encoder->write_first);
+        wait_for(dst_encoder->write_first, TO_BE, seq);
+        job = dst_encoder->write_head;
+        dst_encoder->write_head = job->next;
+        twist(dst_encoder->write_first, TO, dst_encoder->write_head == NULL ? -1 : dst_encoder->write_head->seq);
+
+        more = job->more;
+        if (more)
+        {
+            dst_encoder->frame_encoded_callback(job->out->buf, job->out->len, dst_encoder->userdata);
+            buffer_pool_drop_space(job->out);
+        }
+        free(job);
+
+        seq++;
+    }
+    while (more);
+
+    /* verify no more jobs */
+    possess(dst_encoder->write_first);
+    assert(dst_encoder->write_head == NULL);
+    twist(dst_encoder->write_first, TO, -1);
+}
+
+static job_t *new_job(dst_encoder_t *dst_encoder, int more)
+{
+    job_t *job = malloc(sizeof(job_t));
+
+    if (job == NULL)
+        exit(1);
+    job->seq = dst_encoder->sequence++;
+    job->in = NULL;
+    job->out = NULL;
+    job->more = more;
+    return job;
+}
+
+dst_encoder_t* dst_encoder_create(int channel_count, int thread_count, frame_encoded_callback_t frame_encoded_callback, void *userdata)
+{
+    dst_encoder_t *dst_encoder = (dst_encoder_t*) calloc(sizeof(dst_encoder_t), 1);
+
+    if (!dst_encoder)
+        exit(1);
+
+    assert(frame_encoded_callback);
+
+    dst_encoder->channel_count = channel_count;
+    dst_encoder->userdata = userdata;
+    dst_encoder->frame_encoded_callback = frame_encoded_callback;
+    dst_encoder->max_threads = thread_count > 0 ? thread_count : cpu_decoder_count();
+    dst_encoder->thread_list = (thread **) calloc(dst_encoder->max_threads, sizeof(thread *));
+    if (!dst_encoder->thread_list)
+        exit(1);
+
+    dst_encoder->head = NULL;
+    dst_encoder->tail = &dst_encoder->head;
+    dst_encoder->have = new_lock(0);
+
+    /* the number of input buffers limits how far the caller can run ahead of the
+       encode threads */
+    dst_encoder->write_first = new_lock(-1);
+    dst_encoder->write_head = NULL;
+    buffer_pool_create(&dst_encoder->in_pool, DST_ENCODE_MAX_FRAME_SIZE(MAX_CHANNELS), (dst_encoder->max_threads << 1) + 2);
+    buffer_pool_create(&dst_encoder->out_pool, DST_ENCODE_MAX_FRAME_SIZE(MAX_CHANNELS), -1);
+
+    /* start write thread */
+    dst_encoder->writeth = launch(write_thread, dst_encoder);
+
+    return dst_encoder;
+}
+
+void dst_encoder_destroy(dst_encoder_t *dst_encoder)
+{
+    job_t job;
+    int caught, i;
+
+    /* the last job tells the write thread to return once all frames are written */
+    queue_job(dst_encoder, new_job(dst_encoder, 0));
+    join(dst_encoder->writeth);
+    dst_encoder->writeth = NULL;
+
+    /* command the encode threads to return */
+    possess(dst_encoder->have);
+    job.seq = -1;
+    job.next = NULL;
+    dst_encoder->head = &job;
+    dst_encoder->tail = &(job.next);
+    twist(dst_encoder->have, BY, +1);
+    for (i = 0; i < dst_encoder->threads; i++)
+        join(dst_encoder->thread_list[i]);
+    LOG(lm_main, LOG_NOTICE, ("-- joined %d encode threads", dst_encoder->threads));
+
+    /* free the resources */
+    caught = buffer_pool_free(&dst_encoder->out_pool);
+    LOG(lm_main, LOG_NOTICE, ("-- freed %d output buffers", caught));
+    caught = buffer_pool_free(&dst_encoder->in_pool);
+    LOG(lm_main, LOG_NOTICE, ("-- freed %d input buffers", caught));
+    free_lock(dst_encoder->write_first);
+    free_lock(dst_encoder->have);
+    free(dst_encoder->thread_list);
+
+    free(dst_encoder);
+}
+
+void dst_encoder_encode(dst_encoder_t *dst_encoder, uint8_t* frame_data, size_t frame_size)
+{
+    job_t *job = new_job(dst_encoder, 1);
+
+    assert(frame_size <= (size_t) DST_ENCODE_MAX_FRAME_SIZE(MAX_CHANNELS) - 1);
+    job->in = buffer_pool_get_space(&dst_encoder->in_pool);
+    memcpy(job->in->buf, frame_data, frame_size);
+    job->in->len = frame_size;
+
+    queue_job(dst_encoder, job);
+}
@@ -0,0 +1,40 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef DST_ENCODER_H
+#define DST_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct dst_encoder_s dst_encoder_t;
+typedef void (*frame_encoded_callback_t)(uint8_t* frame_data, size_t frame_size, void *userdata);
+
+/* Encodes DSD frames (channel interleaved, MSB first, 4704 bytes per channel) into DST
+   frames on a pool of threads, frame_encoded_callback gets them in the order they were
+   passed in, from a thread of its own. thread_count 0 is one per processor. */
+dst_encoder_t* dst_encoder_create(int channel_count, int thread_count, frame_encoded_callback_t frame_encoded_callback, void *userdata);
+void dst_encoder_encode(dst_encoder_t *dst_encoder, uint8_t* frame_data, size_t frame_size);
+/* waits for the frames queued to be passed to the callback */
+void dst_encoder_destroy(dst_encoder_t *dst_encoder);
+
+#endif /* DST_ENCODER_H */
@@ -238,7 +238,7 @@ static int16_t Reverse7LSBs(int16_t c)
     return reverse[(c + (1 << SIZE_PREDCOEF)) & 127];
 }
 
-static void LT_InitCoefTablesI(ebunch *D, int16_t ICoefI[2 * MAX_CHANNELS][16][256])
+static void LT_InitCoefTablesI(ebunch *D, int16_t (*ICoefI)[16][256])
 {
     int FilterNr, FilterLength, TableNr, k, i, j;
 
@@ -294,6 +294,8 @@ static void LT_InitStatus(ebunch *D, uint8_t Status[MAX_CHANNELS][16])
 /*            D->P_one[][], D->AData[], D->ADataLen,                       */
 /*                                                                         */
 /* post     : D->WM.Pwm                                                    */
+/*            MuxedDSDdata holds the channels interleaved MSB first, or    */
+/*            when D->PlanarLSB is set one LSB first plane per channel.    */
 /*                                                                         */
 /***************************************************************************/
 #define LT_RUN_FILTER_I(FilterTable, ChannelStatus) \
@@ -337,23 +339,27 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
     uint8_t   ACError;
     const int NrOfBitsPerCh = D->FrameHdr.NrOfBitsPerCh;
     const int NrOfChannels = D->FrameHdr.NrOfChannels;
+    const int PlanarLSB = D->PlanarLSB;
+    const int ByteStride = PlanarLSB ? 1 : NrOfChannels;
+    const int ChStride = PlanarLSB ? NrOfBitsPerCh / 8 : 1;
     uint8_t   *MuxedDSD = MuxedDSDdata;
 
     D->FrameHdr.FrameNr       = FrameCnt;
     D->FrameHdr.CalcNrOfBytes = FrameSizeInBytes;
     D->FrameHdr.CalcNrOfBits  = D->FrameHdr.CalcNrOfBytes * 8;
 
-    /* unpack DST frame: segmentation, mapping, arithmatic data */
+    /* unpack DST frame: segmentation, mapping, arithmatic data; a non DST */
+    /* coded frame is written out in the output layout already             */
     error = UnpackDSTframe(D, DSTdata, MuxedDSDdata);
 
     if (error == DSTErr_NoError && D->FrameHdr.DSTCoded == 1)
     {
         ACData AC;
+        int16_t  (*LT_ICoefI)[16][256] = D->LT_ICoefI;
+        const int *P_one = D->P_one[0];     /* the rows follow each other in the arena */
 #ifdef _MSC_VER
-        __declspec(align(16)) int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256];
         __declspec(align(16)) uint8_t  LT_Status[MAX_CHANNELS][16];
 #else
-        int16_t  LT_ICoefI[2 * MAX_CHANNELS][16][256]  __attribute__ ((aligned (16)));
         uint8_t  LT_Status[MAX_CHANNELS][16] __attribute__ ((aligned (16)));
 #endif
 
@@ -370,7 +376,8 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
         memset(MuxedDSD, 0, NrOfBitsPerCh * NrOfChannels / 8); 
         for (BitNr = 0; BitNr < NrOfBitsPerCh; BitNr++)
         {
-            int ByteNr = BitNr / 8;
+            uint8_t *DSDByte = MuxedDSD + (BitNr / 8) * ByteStride;
+            const int BitShift = PlanarLSB ? BitNr % 8 : 7 - BitNr % 8;
 
             for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
             {
@@ -395,14 +402,14 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
                     const int table4bit = D->FrameHdr.Ptable4Bit[ChNr][BitNr];
                     const int PtableIndex = LT_ACGetPtableIndex(Predict, D->FrameHdr.PtableLen[table4bit]);
 
-                    LT_ACDecodeBit_Decode(&AC, &Residual, D->P_one[table4bit][PtableIndex], D->AData, D->ADataLen);
+                    LT_ACDecodeBit_Decode(&AC, &Residual, P_one[table4bit * AC_HISMAX + PtableIndex], D->AData, D->ADataLen);
                 }
 
                 /* Channel bit depends on the predicted bit and BitResidual[][] */
                 BitVal = ((((uint16_t)Predict) >> 15) ^ Residual) & 1;
 
                 /* Shift the result into the correct bit position */ \
-                MuxedDSD[ByteNr * NrOfChannels + ChNr] |= (uint8_t)(BitVal << (7 - BitNr % 8));
+                DSDByte[ChNr * ChStride] |= (uint8_t)(BitVal << BitShift);
 
                 /* Update filter */
                 {
@@ -424,8 +431,8 @@ int DST_FramDSTDecode(uint8_t *DSTdata, uint8_t *MuxedDSDdata, int FrameSizeInBy
 
     if (error != DSTErr_NoError)
     {
-        /* Clear the frame output - set to DSD silence */
-        memset(MuxedDSDdata, 0x55, (NrOfBitsPerCh * NrOfChannels) / 8);
+        /* Clear the frame output - set to DSD silence (0x55 bit reversed is 0xaa) */
+        memset(MuxedDSDdata, PlanarLSB ? 0xaa : 0x55, (NrOfBitsPerCh * NrOfChannels) / 8);
     }
 
     return error;
@@ -59,11 +59,13 @@ Changes:
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #ifndef __APPLE__
 #include <malloc.h>
 #endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #if !defined(NO_SSE2) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
 #include <emmintrin.h>
 #endif
@@ -76,17 +78,24 @@ Changes:
 /*       STATIC FUNCTION IMPLEMENTATIONS                                      */
 /*============================================================================*/
 
+#define ARENA_ALIGN     64                  /* cache line */
+#define HUGEPAGE_SIZE   (2 * 1024 * 1024)   /* transparent hugepage on x86-64 and arm64 */
+
+static int UseHugePages = 0;
+
 /* General function for allocating memory for array of any type */
-static void *MemoryAllocate(int NrOfElements, int SizeOfElement) 
+static void *MemoryAllocate(size_t Size) 
 {
   void *Array;
 #if defined(__arm__) || defined(__aarch64__)
-  if ((Array = malloc(NrOfElements * SizeOfElement)) == NULL)
+  if (posix_memalign(&Array, ARENA_ALIGN, Size) != 0)
+    Array = NULL;
+  if (Array == NULL)
   {
     fprintf(stderr,"ERROR: not enough memory available!\n\n");
   }
 #else
-  if ((Array = _mm_malloc(NrOfElements * SizeOfElement, 16)) == NULL) 
+  if ((Array = _mm_malloc(Size, ARENA_ALIGN)) == NULL) 
   {
     fprintf(stderr,"ERROR: not enough memory available!\n\n");
   }
@@ -103,49 +112,61 @@ static void MemoryFree(void *Array)
 #endif
 }
 
-/* General function for allocating memory for array of any type */
-static void *AllocateArray(int Dim, int ElementSize, ...) 
+/* Reserve Size bytes at the next cache line of the arena, returns the offset */
+static size_t ArenaReserve(size_t *Used, size_t Size)
 {
-  void     ***A;   /* stores a pointer to the start of the allocated block for */
-                   /* each dimension  */
-  void     *AA;    /* contains the start of the allocated nD-array */
-  va_list  ap;     /* argument pointer in the variable length list */
-  int      i;      /* */
-  int      j;      /* */
-  int      n;      /* number of entries that are to allocated for a block  */
-  int      *Size;  /* Size (in number of entries) for each dimension       */
-
-  /* Retrieve sizes for the different dimensions from the variable arg. list. */
-  Size = MemoryAllocate(Dim, sizeof(*Size));
-  va_start(ap, ElementSize);
-  for (i = 0; i < Dim; i++)
-  {
-    Size[i] = va_arg(ap, int);
-  }
-  va_end(ap);
-  A = MemoryAllocate(Dim, sizeof(**A));
-  /* Allocate for each dimension a contiguous block of memory. */
-  for (n = 1, i = 0; i < Dim - 1; i++) 
+  size_t Offset = (*Used + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  *Used = Offset + Size;
+  return Offset;
+}
+
+/* A 1D array in the arena, NULL while only the size is counted (Base == NULL) */
+static void *ArenaArray(char *Base, size_t *Used, size_t Size)
+{
+  size_t Offset = ArenaReserve(Used, Size);
+
+  return Base ? Base + Offset : NULL;
+}
+
+/* A 2D array in the arena: the row pointers, then the rows back to back, so   */
+/* that Array[0][Row * Cols + Col] is the same element as Array[Row][Col]      */
+static void *ArenaArray2D(char *Base, size_t *Used, int Rows, int Cols, int ElementSize)
+{
+  size_t RowPtrs = ArenaReserve(Used, Rows * sizeof(void *));
+  size_t Data    = ArenaReserve(Used, (size_t) Rows * Cols * ElementSize);
+  int    r;
+
+  if (Base == NULL)
+    return NULL;
+  for (r = 0; r < Rows; r++)
   {
-    n *= Size[i];
-    A[i] = MemoryAllocate(n, sizeof(void*));
+    ((void **) (Base + RowPtrs))[r] = Base + Data + (size_t) r * Cols * ElementSize;
   }
-  n *= Size[i];
-  A[i] = MemoryAllocate(n, ElementSize);
-  /* Set pointers for each dimension to the correct entries of its lower dim.*/
-  for (n = 1, i = 0; i < Dim - 1; i++) 
+  return Base + RowPtrs;
+}
+
+/* The arena, on hugepages if asked for (rounded up to whole hugepages, as    */
+/* the kernel only maps aligned 2 MB ranges with them)                         */
+static void *ArenaAllocate(size_t *Size, int *Huge)
+{
+  *Huge = 0;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (UseHugePages)
   {
-    n *= Size[i];
-    for (j = 0; j < n; j++)
+    void   *Arena;
+    size_t Rounded = (*Size + HUGEPAGE_SIZE - 1) & ~(size_t) (HUGEPAGE_SIZE - 1);
+
+    if (posix_memalign(&Arena, HUGEPAGE_SIZE, Rounded) == 0)
     {
-      /* A[i][j] = &A[i+1][j * Size[i+1]]; */
-      A[i][j] = &((char *)A[i+1])[j * Size[i+1] * ElementSize];
+      madvise(Arena, Rounded, MADV_HUGEPAGE);
+      *Size = Rounded;
+      *Huge = 1;
+      return Arena;
     }
   }
-  AA = A[0];
-  MemoryFree(A);
-  MemoryFree(Size);
-  return AA;
+#endif
+  return MemoryAllocate(*Size);
 }
 
 /***************************************************************************/
@@ -207,58 +228,67 @@ static unsigned char **AllocateUChar2D (int Rows, int Cols)
 }
 */
 
+/* Lay out all dynamic variables of the decoder in one arena: counts the     */
+/* size if Base is NULL, sets the pointers of D otherwise                      */
+static size_t LayoutDecMemory(ebunch * D, char *Base)
+{
+  size_t Used = 0;
+  int    Filters = D->FrameHdr.MaxNrOfFilters;
+  int    Ptables = D->FrameHdr.MaxNrOfPtables;
+
+  /* read for every bit of the frame, first */
+  D->LT_ICoefI = ArenaArray(Base, &Used, (size_t) Filters * sizeof(*D->LT_ICoefI));
+  D->P_one = ArenaArray2D(Base, &Used, Ptables, AC_HISMAX, sizeof(**D->P_one));
+  D->AData = ArenaArray(Base, &Used, D->FrameHdr.BitStreamLen * sizeof(*D->AData));
+
+  D->FrameHdr.ICoefA = ArenaArray2D(Base, &Used, Filters, (1<<SIZE_CODEDPREDORDER), sizeof(**D->FrameHdr.ICoefA));
+
+  D->StrFilter.Coded = ArenaArray(Base, &Used, Filters * sizeof(*D->StrFilter.Coded));
+  D->StrFilter.BestMethod = ArenaArray(Base, &Used, Filters * sizeof(*D->StrFilter.BestMethod));
+  D->StrFilter.m = ArenaArray2D(Base, &Used, Filters, NROFFRICEMETHODS, sizeof(**D->StrFilter.m));
+  D->StrFilter.Data = ArenaArray2D(Base, &Used, Filters, (1<<SIZE_CODEDPREDORDER) * SIZE_PREDCOEF, sizeof(**D->StrFilter.Data));
+  D->StrFilter.DataLen = ArenaArray(Base, &Used, Filters * sizeof(*D->StrFilter.DataLen));
+  D->StrFilter.CPredOrder = ArenaArray(Base, &Used, NROFFRICEMETHODS * sizeof(*D->StrFilter.CPredOrder));
+  D->StrFilter.CPredCoef = ArenaArray2D(Base, &Used, NROFFRICEMETHODS, MAXCPREDORDER, sizeof(**D->StrFilter.CPredCoef));
+  D->StrPtable.Coded = ArenaArray(Base, &Used, Ptables * sizeof(*D->StrPtable.Coded));
+  D->StrPtable.BestMethod = ArenaArray(Base, &Used, Ptables * sizeof(*D->StrPtable.BestMethod));
+  D->StrPtable.m  = ArenaArray2D(Base, &Used, Ptables, NROFPRICEMETHODS, sizeof(**D->StrPtable.m));
+  D->StrPtable.Data = ArenaArray2D(Base, &Used, Ptables, AC_BITS * AC_HISMAX, sizeof(**D->StrPtable.Data));
+  D->StrPtable.DataLen = ArenaArray(Base, &Used, Ptables * sizeof(*D->StrPtable.DataLen));
+  D->StrPtable.CPredOrder = ArenaArray(Base, &Used, NROFPRICEMETHODS * sizeof(*D->StrPtable.CPredOrder));
+  D->StrPtable.CPredCoef = ArenaArray2D(Base, &Used, NROFPRICEMETHODS, MAXCPREDORDER, sizeof(**D->StrPtable.CPredCoef));
+
+  return Used;
+}
+
 /* Release memory for all dynamic variables of the decoder.*/
 static void FreeDecMemory (ebunch * D) 
 {
-  MemoryFree(D->FrameHdr.ICoefA[0]);
-  MemoryFree(D->FrameHdr.ICoefA);
-
-  MemoryFree(D->StrFilter.m[0]);
-  MemoryFree(D->StrFilter.m);
-  MemoryFree(D->StrFilter.Data[0]);
-  MemoryFree(D->StrFilter.Data);
-  MemoryFree(D->StrFilter.CPredOrder);
-  MemoryFree(D->StrFilter.CPredCoef[0]);
-  MemoryFree(D->StrFilter.CPredCoef);
-  MemoryFree(D->StrFilter.Coded);
-  MemoryFree(D->StrFilter.BestMethod);
-  MemoryFree(D->StrFilter.DataLen);
-  MemoryFree(D->StrPtable.m[0]);
-  MemoryFree(D->StrPtable.m);
-  MemoryFree(D->StrPtable.Data[0]);
-  MemoryFree(D->StrPtable.Data);
-  MemoryFree(D->StrPtable.CPredOrder);
-  MemoryFree(D->StrPtable.CPredCoef[0]);
-  MemoryFree(D->StrPtable.CPredCoef);
-  MemoryFree(D->StrPtable.Coded);
-  MemoryFree(D->StrPtable.BestMethod);
-  MemoryFree(D->StrPtable.DataLen);
-  MemoryFree(D->P_one[0]);
-  MemoryFree(D->P_one);
-  MemoryFree(D->AData);
+  if (D->ArenaHuge)
+    free(D->Arena);
+  else
+    MemoryFree(D->Arena);
+  D->Arena = NULL;
+}
+
+/* Allocate memory for all dynamic variables of the decoder: one allocation,  */
+/* zeroed here, so that its pages are first touched (and placed on the NUMA   */
+/* node of) the thread that creates the decoder                               */
+static int AllocateDecMemory (ebunch * D)
+{
+  size_t Size = LayoutDecMemory(D, NULL);
+
+  D->Arena = ArenaAllocate(&Size, &D->ArenaHuge);
+  if (D->Arena == NULL)
+    return DSTErr_MaxError;
+  memset(D->Arena, 0, Size);
+  LayoutDecMemory(D, D->Arena);
+  return 0;
 }
 
-/* Allocate memory for all dynamic variables of the decoder. */
-static void AllocateDecMemory (ebunch * D)
+void DST_SetHugePages(int Enable)
 {
-  D->FrameHdr.ICoefA = AllocateArray(2,sizeof(**D->FrameHdr.ICoefA),D->FrameHdr.MaxNrOfFilters, (1<<SIZE_CODEDPREDORDER));
-
-  D->StrFilter.Coded = MemoryAllocate(D->FrameHdr.MaxNrOfFilters, sizeof(*D->StrFilter.Coded));
-  D->StrFilter.BestMethod = MemoryAllocate(D->FrameHdr.MaxNrOfFilters, sizeof(*D->StrFilter.BestMethod));
-  D->StrFilter.m = AllocateArray(2, sizeof(**D->StrFilter.m), D->FrameHdr.MaxNrOfFilters, NROFFRICEMETHODS);
-  D->StrFilter.Data = AllocateArray(2, sizeof(**D->StrFilter.Data), D->FrameHdr.MaxNrOfFilters, (1<<SIZE_CODEDPREDORDER) * SIZE_PREDCOEF);
-  D->StrFilter.DataLen = MemoryAllocate(D->FrameHdr.MaxNrOfFilters, sizeof(*D->StrFilter.DataLen));
-  D->StrFilter.CPredOrder = MemoryAllocate(NROFFRICEMETHODS, sizeof(*D->StrFilter.CPredOrder));
-  D->StrFilter.CPredCoef = AllocateArray(2, sizeof(**D->StrFilter.CPredCoef), NROFFRICEMETHODS, MAXCPREDORDER);
-  D->StrPtable.Coded = MemoryAllocate(D->FrameHdr.MaxNrOfPtables, sizeof(*D->StrPtable.Coded));
-  D->StrPtable.BestMethod = MemoryAllocate(D->FrameHdr.MaxNrOfPtables, sizeof(*D->StrPtable.BestMethod));
-  D->StrPtable.m  = AllocateArray(2, sizeof(**D->StrPtable.m), D->FrameHdr.MaxNrOfPtables, NROFPRICEMETHODS);
-  D->StrPtable.Data = AllocateArray(2, sizeof(**D->StrPtable.Data), D->FrameHdr.MaxNrOfPtables, AC_BITS * AC_HISMAX);
-  D->StrPtable.DataLen = MemoryAllocate(D->FrameHdr.MaxNrOfPtables, sizeof(*D->StrPtable.DataLen));
-  D->StrPtable.CPredOrder = MemoryAllocate(NROFPRICEMETHODS, sizeof(*D->StrPtable.CPredOrder));
-  D->StrPtable.CPredCoef = AllocateArray(2, sizeof(**D->StrPtable.CPredCoef), NROFPRICEMETHODS, MAXCPREDORDER);
-  D->P_one = AllocateArray(2, sizeof(**D->P_one), D->FrameHdr.MaxNrOfPtables, AC_HISMAX);
-  D->AData = MemoryAllocate(D->FrameHdr.BitStreamLen,  sizeof(*D->AData));
+  UseHugePages = Enable;
 }
 
 /***************************************************************************/
@@ -274,7 +304,7 @@ static void AllocateDecMemory (ebunch * D)
 /*                       .Length                                           */
 /*            D->StrFilter.TableType, D->StrPtable.TableType               */
 /*                                                                         */
-/*            Memory allocated for:                                        */
+/*            Memory allocated (in one arena, see LayoutDecMemory) for:    */
 /*              D->FirPtrs    : .Pnt,                                      */
 /*              D->FrameHdr   : .PredOrder, .ICoefA,                       */
 /*                              .FSeg.NrOfSegments, .FSeg.SegmentLen,      */
@@ -309,7 +339,7 @@ int DST_InitDecoder(ebunch * D, int NrOfChannels, int SampleRate)
 
   if (retval==0) 
   {
-    AllocateDecMemory(D);
+    retval = AllocateDecMemory(D);
   }
 
   if (retval==0) 
@@ -358,7 +388,8 @@ int DST_CloseDecoder(ebunch * D)
 {
   int retval = 0;
   /* Free the memory that was used for the arrays */
-  FreeDecMemory(D);
+  if (D->Arena != NULL)
+    FreeDecMemory(D);
 
   return(retval);
 }
@@ -69,6 +69,8 @@ Changes:
 
 int DST_InitDecoder(ebunch * D, int NrOfChannels, int SampleRate);
 int DST_CloseDecoder(ebunch * D);
+/* back the decoder arenas created from now on with transparent hugepages */
+void DST_SetHugePages(int Enable);
 
 #endif  /* __DST_INIT_H_INCLUDED */
 
@@ -168,7 +168,14 @@ typedef struct
     int          ADataLen;                                       /* Number of code bits contained in AData[]    */
     StrData      S;                                              /* DST data stream */
 
+    int16_t      (*LT_ICoefI)[16][256];                          /* LT_ICoefI[FilterNr][TableNr][8 bit status]: */
+                                                                 /* filter output per 8 taps, for the bit loop  */
+    void         *Arena;                                         /* one block holding all arrays above          */
+    int          ArenaHuge;                                      /* Arena is on transparent hugepages           */
+
     int          SSE2;
+    int          PlanarLSB;                                      /* 1: write each channel as its own LSB first  */
+                                                                 /* plane (DSF layout), 0: interleave MSB first */
 } ebunch;
 
 #endif  /* __TYPES_H_INCLUDED */
@@ -124,6 +124,44 @@ void ReadDSDframe(StrData      *S,
     FIO_BitGetChrUnsigned(S, 8,&DSDFrame[ByteNr]);
 }
 
+static __inline unsigned char ReverseBits(unsigned char b)
+{
+  b = (unsigned char)(((b & 0xf0) >> 4) | ((b & 0x0f) << 4));
+  b = (unsigned char)(((b & 0xcc) >> 2) | ((b & 0x33) << 2));
+  b = (unsigned char)(((b & 0xaa) >> 1) | ((b & 0x55) << 1));
+  return b;
+}
+
+/***************************************************************************/
+/*                                                                         */
+/* name     : ReadDSDframePlanarLSB                                        */
+/*                                                                         */
+/* function : As ReadDSDframe, but each channel goes to its own LSB first  */
+/*            plane of MaxFrameLen bytes (the layout of D->PlanarLSB).     */
+/*                                                                         */
+/* post     : DSDFrame[ChNr * MaxFrameLen + ByteNr]                        */
+/*                                                                         */
+/***************************************************************************/
+
+static void ReadDSDframePlanarLSB(StrData       *S,
+                                  long          MaxFrameLen, 
+                                  int           NrOfChannels, 
+                                  unsigned char *DSDFrame)
+{
+  int           ByteNr;
+  int           ChNr;
+  unsigned char Byte;
+
+  for (ByteNr = 0; ByteNr < MaxFrameLen; ByteNr++)
+  {
+    for (ChNr = 0; ChNr < NrOfChannels; ChNr++)
+    {
+      FIO_BitGetChrUnsigned(S, 8, &Byte);
+      DSDFrame[ChNr * MaxFrameLen + ByteNr] = ReverseBits(Byte);
+    }
+  }
+}
+
 /***************************************************************************/
 /*                                                                         */
 /* name     : RiceDecode                                                   */
@@ -913,7 +951,10 @@ int UnpackDSTframe(ebunch*  D,
       return DSTErr_InvalidStuffingPattern;
 
     /* Read DSD data and put in output stream */
-    ReadDSDframe(&D->S, D->FrameHdr.MaxFrameLen, D->FrameHdr.NrOfChannels, DSDdataframe);
+    if (D->PlanarLSB)
+      ReadDSDframePlanarLSB(&D->S, D->FrameHdr.MaxFrameLen, D->FrameHdr.NrOfChannels, DSDdataframe);
+    else
+      ReadDSDframe(&D->S, D->FrameHdr.MaxFrameLen, D->FrameHdr.NrOfChannels, DSDdataframe);
   }
   else
   {
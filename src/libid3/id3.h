@@ -353,6 +353,7 @@ char *id3_get_text(struct id3_frame *);
 char *id3_get_comment(struct id3_frame *);
 int id3_set_comment(struct id3_frame *, char *, char *);
 int id3_set_text__performer(struct id3_frame *, char *);
+int id3_set_text_txxx(struct id3_frame *, char *, char *);
 int id3_set_text__performer_UTF8(struct id3_frame *, char *);
 int id3_set_text__performer_UTF16(struct id3_frame *, char *);
 char *id3_get_text_desc(struct id3_frame *);
@@ -554,6 +554,44 @@ int id3_set_comment(struct id3_frame *frame, char* description, char *comment)
 	return 0;
 }
 
+/*
+ * Function id3_set_text_txxx (frame, description, text)
+ *   Set description and text of a user defined text frame (TXXX).
+ *   Both must be plain ASCII, e.g. REPLAYGAIN_TRACK_GAIN.
+ *   Return 0 upon success, or -1 if an error occured.
+ *         ISO_8859_1 encoding
+ */
+int id3_set_text_txxx(struct id3_frame *frame, char *description, char *text)
+{
+	// Type check
+	if (frame->fr_desc->fd_id != ID3_TXXX)
+		return -1;
+
+	// Release memory occupied by previous data.
+
+	id3_frame_clear_data(frame);
+
+	// Allocate memory for new data.
+
+	frame->fr_raw_size = strlen(description) + strlen(text) + 3; // 1 for encoding, 1 for null terminator of description and 1 for null terminator of text
+	frame->fr_raw_data = calloc(frame->fr_raw_size + 1, 1);
+
+	// Copy contents.
+
+	*(uint8_t *)frame->fr_raw_data = ID3_ENCODING_ISO_8859_1;
+
+	memcpy((uint8_t *)frame->fr_raw_data + 1, description, strlen(description));
+	memcpy((uint8_t *)frame->fr_raw_data + 1 + strlen(description) + 1, text, strlen(text));
+
+	frame->fr_altered = 1;
+	frame->fr_owner->id3_altered = 1;
+
+	frame->fr_data = frame->fr_raw_data;
+	frame->fr_size = frame->fr_raw_size;
+
+	return 0;
+}
+
 /*
  * Function id3_set_text__performer (frame, text)
  *	 Input text is allways UTF-8 encoded
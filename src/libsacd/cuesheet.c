@@ -34,9 +34,8 @@
 #include "cuesheet.h"
 #include "scarletbook_helpers.h"
 
-static char *cue_escape(const char *src) 
+static char *cue_escape(char *ret, const char *src) 
 {
-    static char ret[512];
     char *s = str_replace(src, "\"", "\\\"");
     strcpy(ret, s);
     free(s);
@@ -47,6 +46,7 @@ static char *cue_escape(const char *src)
 int write_cue_sheet(scarletbook_handle_t *handle, const char *filename, int area_idx, char *cue_filename)
 {
    FILE *fd;
+   char escaped[512];
 
 #if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
     char filename_long[1024];
@@ -97,30 +97,30 @@ int write_cue_sheet(scarletbook_handle_t *handle, const char *filename, int area
 
     if (handle->master_text.disc_artist)
     {
-        fprintf(fd, "PERFORMER \"%s\"\n", cue_escape(handle->master_text.disc_artist));
+        fprintf(fd, "PERFORMER \"%s\"\n", cue_escape(escaped, handle->master_text.disc_artist));
     }
     else if (handle->master_text.album_artist)
     {
-        fprintf(fd, "PERFORMER \"%s\"\n", cue_escape(handle->master_text.album_artist));
+        fprintf(fd, "PERFORMER \"%s\"\n", cue_escape(escaped, handle->master_text.album_artist));
     }
     
 
     if (handle->master_text.disc_title)
     {
-        fprintf(fd, "TITLE \"%s\"\n", cue_escape(handle->master_text.disc_title));
+        fprintf(fd, "TITLE \"%s\"\n", cue_escape(escaped, handle->master_text.disc_title));
     }
     else if (handle->master_text.album_title)
     {
-        fprintf(fd, "TITLE \"%s\"\n", cue_escape(handle->master_text.album_title));
+        fprintf(fd, "TITLE \"%s\"\n", cue_escape(escaped, handle->master_text.album_title));
     }
     
 
     if (strlen(handle->master_toc->disc_catalog_number) > 0)
     {
-        fprintf(fd, "CATALOG \"%s\"\n", cue_escape(substr(handle->master_toc->disc_catalog_number, 0, 16)));
+        fprintf(fd, "CATALOG \"%s\"\n", cue_escape(escaped, substr(handle->master_toc->disc_catalog_number, 0, 16)));
     }
 
-    fprintf(fd, "FILE \"%s\" WAVE\n", cue_escape(filename));
+    fprintf(fd, "FILE \"%s\" WAVE\n", cue_escape(escaped, filename));
     {
         int track, track_count = handle->area[area_idx].area_toc->track_count;
         uint64_t prev_abs_end = 0;
@@ -133,17 +133,17 @@ int write_cue_sheet(scarletbook_handle_t *handle, const char *filename, int area
             
             if (handle->area[area_idx].area_track_text[track].track_type_title)
             {
-                fprintf(fd, "      TITLE \"%s\"\n", cue_escape(handle->area[area_idx].area_track_text[track].track_type_title));
+                fprintf(fd, "      TITLE \"%s\"\n", cue_escape(escaped, handle->area[area_idx].area_track_text[track].track_type_title));
             }
 
             if (handle->area[area_idx].area_track_text[track].track_type_performer)
             {
-                fprintf(fd, "      PERFORMER \"%s\"\n", cue_escape(handle->area[area_idx].area_track_text[track].track_type_performer));
+                fprintf(fd, "      PERFORMER \"%s\"\n", cue_escape(escaped, handle->area[area_idx].area_track_text[track].track_type_performer));
             }
 
             if (*handle->area[area_idx].area_isrc_genre->isrc[track].country_code)
             {
-                fprintf(fd, "      ISRC %s\n", cue_escape(substr(handle->area[area_idx].area_isrc_genre->isrc[track].country_code, 0, 12)));
+                fprintf(fd, "      ISRC %s\n", cue_escape(escaped, substr(handle->area[area_idx].area_isrc_genre->isrc[track].country_code, 0, 12)));
             }
 
             if ((uint64_t) TIME_FRAMECOUNT(&handle->area[area_idx].area_tracklist_time->start[track]) > prev_abs_end)
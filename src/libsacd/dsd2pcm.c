@@ -0,0 +1,489 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef __lv2ppu__
+#include <pthread.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DSD2PCM_SSE 1
+#endif
+
+#include "dsd2pcm.h"
+
+// The first stage runs at 2.8224 MHz and produces one sample per DSD byte: its 128 taps are
+// split into 16 tables of 256 entries, each holding the contribution of one byte position
+// for every possible byte, so a sample costs 16 lookups instead of 128 multiplications.
+// The FIR stages after it decimate by 2 and only compute the samples they keep.
+//
+//   stage 1: 2.8224 MHz -> 352.8 kHz, 128 taps, cutoff 130 kHz
+//   stage 2:  352.8 kHz -> 176.4 kHz,  64 taps, cutoff 65 kHz
+//   stage 3:  176.4 kHz ->  88.2 kHz,  96 taps, cutoff 30 kHz (88.2 kHz output only)
+//
+// All filters are Kaiser windowed (beta 9, about 90 dB stop band) and linear phase, the
+// overall delay is about 0.4 ms. The gain is 1: a DSD stream of all ones is full scale.
+
+#define LUT_BYTES       16
+#define STAGE2_TAPS     64      // the FIR tap counts are multiples of 8 for dot_product()
+#define STAGE3_TAPS     96
+#define KAISER_BETA     9.0
+#define DSD_SILENCE     0x69    // idle pattern, the history before the first byte
+#define DSD2PCM_PI      3.14159265358979323846
+
+typedef struct
+{
+    int     taps;
+    float  *coefs;              // reversed, so the dot product runs forward over the input
+}
+fir_t;
+
+typedef struct
+{
+    uint8_t *bytes;             // LUT_BYTES - 1 bytes of history followed by the batch
+    float   *x1;                // stage 1 output, STAGE2_TAPS - 1 samples of history first
+    float   *x2;                // stage 2 output, STAGE3_TAPS - 1 samples of history first
+    float   *pcm;               // output of the last stage
+    size_t   alloc;             // batch size (in DSD bytes) the buffers can hold
+}
+channel_t;
+
+typedef struct
+{
+    dsd2pcm_t *dsd2pcm;
+    int        channel;
+}
+worker_t;
+
+struct dsd2pcm_s
+{
+    int             channel_count;
+    int             decimation;
+
+    float           lut[LUT_BYTES][256];
+    fir_t           stage2;
+    fir_t           stage3;
+
+    channel_t      *channel;
+
+    // the batch being converted
+    const uint8_t  *planes;
+    size_t          stride;
+    size_t          bytes;
+
+#ifndef __lv2ppu__
+    // channel 0 is converted by the caller, channel i by worker i - 1
+    worker_t       *workers;
+    pthread_t      *threads;
+    int             thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  done;
+    unsigned int    generation;
+    int             pending;
+    int             quit;
+#endif
+};
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    for (k = 1; k < 64; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-15)
+            break;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc low pass, cutoff relative to the sample rate, unity gain at DC
+static void design_lowpass(double *h, int taps, double cutoff)
+{
+    double center = (taps - 1) / 2.0, sum = 0.0;
+    int i;
+
+    for (i = 0; i < taps; i++)
+    {
+        double t = i - center;
+        double r = t / center;
+        double sinc = t == 0.0 ? 2.0 * cutoff : sin(2.0 * DSD2PCM_PI * cutoff * t) / (DSD2PCM_PI * t);
+
+        h[i] = sinc * bessel_i0(KAISER_BETA * sqrt(1.0 - r * r)) / bessel_i0(KAISER_BETA);
+        sum += h[i];
+    }
+    for (i = 0; i < taps; i++)
+        h[i] /= sum;
+}
+
+static int fir_init(fir_t *fir, int taps, double cutoff)
+{
+    double h[STAGE3_TAPS > STAGE2_TAPS ? STAGE3_TAPS : STAGE2_TAPS];
+    int i;
+
+    fir->taps = taps;
+    fir->coefs = (float *) malloc(taps * sizeof(float));
+    if (!fir->coefs)
+        return -1;
+    design_lowpass(h, taps, cutoff);
+    for (i = 0; i < taps; i++)
+        fir->coefs[i] = (float) h[taps - 1 - i];
+    return 0;
+}
+
+static void lut_init(dsd2pcm_t *dsd2pcm, int lsb_first)
+{
+    double h[LUT_BYTES * 8];
+    int k, b, j;
+
+    design_lowpass(h, LUT_BYTES * 8, 130000.0 / 2822400.0);
+
+    // table k is applied to the byte k bytes before the newest one, bit j of it is
+    // 8 * k + j samples old (MSB first) or 8 * k + 7 - j samples old (LSB first)
+    for (k = 0; k < LUT_BYTES; k++)
+    {
+        for (b = 0; b < 256; b++)
+        {
+            double acc = 0.0;
+            for (j = 0; j < 8; j++)
+            {
+                double tap = h[8 * k + (lsb_first ? 7 - j : j)];
+                acc += (b >> j) & 1 ? tap : -tap;
+            }
+            dsd2pcm->lut[k][b] = (float) acc;
+        }
+    }
+}
+
+static inline float dot_product(const float *a, const float *b, int n)
+{
+    int i;
+#ifdef DSD2PCM_SSE
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    float s[4];
+
+    for (i = 0; i < n; i += 8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+    return (s[0] + s[1]) + (s[2] + s[3]);
+#else
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+    for (i = 0; i < n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+// x holds fir->taps - 1 samples of history followed by n new ones, n / 2 samples go to y.
+// Afterwards the last fir->taps - 1 samples are moved to the front as the next history.
+static void fir_decimate(const fir_t *fir, float *x, size_t n, float *y)
+{
+    size_t m;
+
+    for (m = 0; m < n / 2; m++)
+        y[m] = dot_product(fir->coefs, x + 2 * m + 1, fir->taps);
+    memmove(x, x + n, (fir->taps - 1) * sizeof(float));
+}
+
+static void convert_channel(dsd2pcm_t *dsd2pcm, int c)
+{
+    channel_t *channel = &dsd2pcm->channel[c];
+    float *x1 = channel->x1 + STAGE2_TAPS - 1;
+    size_t n = dsd2pcm->bytes, i;
+    int k;
+
+    memcpy(channel->bytes + LUT_BYTES - 1, dsd2pcm->planes + c * dsd2pcm->stride, n);
+    for (i = 0; i < n; i++)
+    {
+        const uint8_t *p = channel->bytes + i + LUT_BYTES - 1;
+        float acc0 = 0.0f, acc1 = 0.0f;
+
+        for (k = 0; k < LUT_BYTES; k += 2)
+        {
+            acc0 += dsd2pcm->lut[k][p[-k]];
+            acc1 += dsd2pcm->lut[k + 1][p[-k - 1]];
+        }
+        x1[i] = acc0 + acc1;
+    }
+    memmove(channel->bytes, channel->bytes + n, LUT_BYTES - 1);
+
+    if (dsd2pcm->decimation == DSD2PCM_RATE_176400)
+    {
+        fir_decimate(&dsd2pcm->stage2, channel->x1, n, channel->pcm);
+    }
+    else
+    {
+        fir_decimate(&dsd2pcm->stage2, channel->x1, n, channel->x2 + STAGE3_TAPS - 1);
+        fir_decimate(&dsd2pcm->stage3, channel->x2, n / 2, channel->pcm);
+    }
+}
+
+#ifndef __lv2ppu__
+static void *worker_thread(void *arg)
+{
+    worker_t *worker = (worker_t *) arg;
+    dsd2pcm_t *dsd2pcm = worker->dsd2pcm;
+    unsigned int generation = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&dsd2pcm->lock);
+        while (!dsd2pcm->quit && dsd2pcm->generation == generation)
+            pthread_cond_wait(&dsd2pcm->start, &dsd2pcm->lock);
+        if (dsd2pcm->quit)
+        {
+            pthread_mutex_unlock(&dsd2pcm->lock);
+            break;
+        }
+        generation = dsd2pcm->generation;
+        pthread_mutex_unlock(&dsd2pcm->lock);
+
+        convert_channel(dsd2pcm, worker->channel);
+
+        pthread_mutex_lock(&dsd2pcm->lock);
+        if (--dsd2pcm->pending == 0)
+            pthread_cond_signal(&dsd2pcm->done);
+        pthread_mutex_unlock(&dsd2pcm->lock);
+    }
+    return NULL;
+}
+#endif
+
+static int channel_reserve(channel_t *channel, size_t bytes)
+{
+    uint8_t *b;
+    float *x1, *x2, *pcm;
+
+    if (bytes <= channel->alloc)
+        return 0;
+
+    // realloc keeps the history at the front of each buffer
+    b = (uint8_t *) realloc(channel->bytes, LUT_BYTES - 1 + bytes);
+    if (b) channel->bytes = b;
+    x1 = (float *) realloc(channel->x1, (STAGE2_TAPS - 1 + bytes) * sizeof(float));
+    if (x1) channel->x1 = x1;
+    x2 = (float *) realloc(channel->x2, (STAGE3_TAPS - 1 + bytes / 2) * sizeof(float));
+    if (x2) channel->x2 = x2;
+    pcm = (float *) realloc(channel->pcm, (bytes / 2 + 1) * sizeof(float));
+    if (pcm) channel->pcm = pcm;
+    if (!b || !x1 || !x2 || !pcm)
+        return -1;
+
+    channel->alloc = bytes;
+    return 0;
+}
+
+dsd2pcm_t *dsd2pcm_create(int channel_count, int decimation, int lsb_first)
+{
+    dsd2pcm_t *dsd2pcm;
+    int c;
+
+    if (channel_count < 1 || (decimation != DSD2PCM_RATE_176400 && decimation != DSD2PCM_RATE_88200))
+        return NULL;
+
+    dsd2pcm = (dsd2pcm_t *) calloc(1, sizeof(dsd2pcm_t));
+    if (!dsd2pcm)
+        return NULL;
+    dsd2pcm->channel_count = channel_count;
+    dsd2pcm->decimation = decimation;
+    dsd2pcm->channel = (channel_t *) calloc(channel_count, sizeof(channel_t));
+
+    lut_init(dsd2pcm, lsb_first);
+    if (!dsd2pcm->channel
+        || fir_init(&dsd2pcm->stage2, STAGE2_TAPS, 65000.0 / 352800.0) != 0
+        || fir_init(&dsd2pcm->stage3, STAGE3_TAPS, 30000.0 / 176400.0) != 0)
+    {
+        dsd2pcm_destroy(dsd2pcm);
+        return NULL;
+    }
+
+    for (c = 0; c < channel_count; c++)
+    {
+        channel_t *channel = &dsd2pcm->channel[c];
+
+        // start from silence
+        if (channel_reserve(channel, 4096) != 0)
+        {
+            dsd2pcm_destroy(dsd2pcm);
+            return NULL;
+        }
+        memset(channel->bytes, DSD_SILENCE, LUT_BYTES - 1);
+        memset(channel->x1, 0, (STAGE2_TAPS - 1) * sizeof(float));
+        memset(channel->x2, 0, (STAGE3_TAPS - 1) * sizeof(float));
+    }
+
+#ifndef __lv2ppu__
+    pthread_mutex_init(&dsd2pcm->lock, NULL);
+    pthread_cond_init(&dsd2pcm->start, NULL);
+    pthread_cond_init(&dsd2pcm->done, NULL);
+    if (channel_count > 1)
+    {
+        dsd2pcm->workers = (worker_t *) calloc(channel_count - 1, sizeof(worker_t));
+        dsd2pcm->threads = (pthread_t *) calloc(channel_count - 1, sizeof(pthread_t));
+        for (c = 0; dsd2pcm->workers && dsd2pcm->threads && c < channel_count - 1; c++)
+        {
+            dsd2pcm->workers[c].dsd2pcm = dsd2pcm;
+            dsd2pcm->workers[c].channel = c + 1;
+            if (pthread_create(&dsd2pcm->threads[c], NULL, worker_thread, &dsd2pcm->workers[c]) != 0)
+                break;
+            dsd2pcm->thread_count++;
+        }
+    }
+#endif
+
+    return dsd2pcm;
+}
+
+void dsd2pcm_destroy(dsd2pcm_t *dsd2pcm)
+{
+    int c;
+
+    if (!dsd2pcm)
+        return;
+
+#ifndef __lv2ppu__
+    pthread_mutex_lock(&dsd2pcm->lock);
+    dsd2pcm->quit = 1;
+    pthread_cond_broadcast(&dsd2pcm->start);
+    pthread_mutex_unlock(&dsd2pcm->lock);
+    for (c = 0; c < dsd2pcm->thread_count; c++)
+        pthread_join(dsd2pcm->threads[c], NULL);
+    pthread_cond_destroy(&dsd2pcm->done);
+    pthread_cond_destroy(&dsd2pcm->start);
+    pthread_mutex_destroy(&dsd2pcm->lock);
+    free(dsd2pcm->threads);
+    free(dsd2pcm->workers);
+#endif
+
+    for (c = 0; dsd2pcm->channel && c < dsd2pcm->channel_count; c++)
+    {
+        free(dsd2pcm->channel[c].bytes);
+        free(dsd2pcm->channel[c].x1);
+        free(dsd2pcm->channel[c].x2);
+        free(dsd2pcm->channel[c].pcm);
+    }
+    free(dsd2pcm->channel);
+    free(dsd2pcm->stage2.coefs);
+    free(dsd2pcm->stage3.coefs);
+    free(dsd2pcm);
+}
+
+// runs the filters over a batch, leaving the result in channel[].pcm
+static int convert_batch(dsd2pcm_t *dsd2pcm, const uint8_t *planes, size_t stride, size_t bytes_per_channel)
+{
+    int c, first;
+
+    for (c = 0; c < dsd2pcm->channel_count; c++)
+    {
+        if (channel_reserve(&dsd2pcm->channel[c], bytes_per_channel) != 0)
+            return -1;
+    }
+
+    dsd2pcm->planes = planes;
+    dsd2pcm->stride = stride;
+    dsd2pcm->bytes = bytes_per_channel;
+
+    first = 0;
+#ifndef __lv2ppu__
+    // hand the batch to the workers, the channels without one are done here
+    if (dsd2pcm->thread_count > 0)
+    {
+        pthread_mutex_lock(&dsd2pcm->lock);
+        dsd2pcm->pending = dsd2pcm->thread_count;
+        dsd2pcm->generation++;
+        pthread_cond_broadcast(&dsd2pcm->start);
+        pthread_mutex_unlock(&dsd2pcm->lock);
+    }
+    convert_channel(dsd2pcm, 0);
+    first = 1 + dsd2pcm->thread_count;
+#endif
+    for (c = first; c < dsd2pcm->channel_count; c++)
+        convert_channel(dsd2pcm, c);
+#ifndef __lv2ppu__
+    if (dsd2pcm->thread_count > 0)
+    {
+        pthread_mutex_lock(&dsd2pcm->lock);
+        while (dsd2pcm->pending > 0)
+            pthread_cond_wait(&dsd2pcm->done, &dsd2pcm->lock);
+        pthread_mutex_unlock(&dsd2pcm->lock);
+    }
+#endif
+    return 0;
+}
+
+size_t dsd2pcm_convert(dsd2pcm_t *dsd2pcm, const uint8_t *planes, size_t stride, size_t bytes_per_channel, uint8_t *out)
+{
+    size_t samples = bytes_per_channel * 8 / dsd2pcm->decimation, m;
+    int c;
+
+    if (convert_batch(dsd2pcm, planes, stride, bytes_per_channel) != 0)
+        return 0;
+
+    // interleave, round and clip to 24 bit
+    for (m = 0; m < samples; m++)
+    {
+        for (c = 0; c < dsd2pcm->channel_count; c++)
+        {
+            float v = dsd2pcm->channel[c].pcm[m] * 8388608.0f;
+            int32_t s;
+
+            if (v >= 8388607.0f)
+                s = 8388607;
+            else if (v <= -8388608.0f)
+                s = -8388608;
+            else
+                s = (int32_t) (v >= 0.0f ? v + 0.5f : v - 0.5f);
+
+            *out++ = (uint8_t) s;
+            *out++ = (uint8_t) (s >> 8);
+            *out++ = (uint8_t) (s >> 16);
+        }
+    }
+
+    return samples;
+}
+
+size_t dsd2pcm_convert_float(dsd2pcm_t *dsd2pcm, const uint8_t *planes, size_t stride, size_t bytes_per_channel, float **out)
+{
+    int c;
+
+    if (convert_batch(dsd2pcm, planes, stride, bytes_per_channel) != 0)
+        return 0;
+
+    for (c = 0; c < dsd2pcm->channel_count; c++)
+        out[c] = dsd2pcm->channel[c].pcm;
+    return bytes_per_channel * 8 / dsd2pcm->decimation;
+}
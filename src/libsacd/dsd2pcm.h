@@ -0,0 +1,50 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef DSD2PCM_H_INCLUDED
+#define DSD2PCM_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// DSD64 (2.8224 MHz) to 24 bit PCM. The first stage decimates by 8 with byte indexed
+// lookup tables, followed by one (176.4 kHz) or two (88.2 kHz) polyphase half rate FIR
+// stages. Channels are converted in parallel.
+
+#define DSD2PCM_RATE_176400     16      // decimation factors from 2.8224 MHz
+#define DSD2PCM_RATE_88200      32
+
+typedef struct dsd2pcm_s dsd2pcm_t;
+
+// lsb_first: the DSD bytes hold the oldest sample in bit 0 (DSF planes) instead of bit 7
+dsd2pcm_t *dsd2pcm_create(int channel_count, int decimation, int lsb_first);
+void dsd2pcm_destroy(dsd2pcm_t *dsd2pcm);
+
+// Converts bytes_per_channel DSD bytes of every channel, channel c starts at planes + c * stride.
+// bytes_per_channel must be a multiple of decimation / 8. Writes interleaved 24 bit little
+// endian samples to out and returns the number of samples per channel.
+size_t dsd2pcm_convert(dsd2pcm_t *dsd2pcm, const uint8_t *planes, size_t stride, size_t bytes_per_channel, uint8_t *out);
+
+// Same, but hands out the unclipped samples of channel c in out[c] (1.0 is full scale).
+// The buffers stay valid until the next call.
+size_t dsd2pcm_convert_float(dsd2pcm_t *dsd2pcm, const uint8_t *planes, size_t stride, size_t bytes_per_channel, float **out);
+
+#endif /* DSD2PCM_H_INCLUDED */
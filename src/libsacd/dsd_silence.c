@@ -0,0 +1,168 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DSD_SILENCE_SSE2 1
+#endif
+
+#include "dsd_silence.h"
+
+#define MAX_SCAN_CHANNELS 8
+
+static inline int idle_byte(uint8_t b)
+{
+    return b == 0x69 || b == 0x96 || b == 0x55 || b == 0xaa;
+}
+
+#ifdef DSD_SILENCE_SSE2
+// bit i set if p[i] is active, 16 bytes at a time
+static inline unsigned int active_mask16(const uint8_t *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i idle = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x69)), _mm_cmpeq_epi8(v, _mm_set1_epi8((char) 0x96))),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x55)), _mm_cmpeq_epi8(v, _mm_set1_epi8((char) 0xaa))));
+    return ~(unsigned int) _mm_movemask_epi8(idle) & 0xffff;
+}
+#endif
+
+size_t dsd_silence_first_active(const uint8_t *p, size_t n)
+{
+    size_t i = 0;
+
+#ifdef DSD_SILENCE_SSE2
+    for (; i + 64 <= n; i += 64)
+    {
+        // four vectors per test keep the loop at memory speed
+        if (active_mask16(p + i) | active_mask16(p + i + 16) | active_mask16(p + i + 32) | active_mask16(p + i + 48))
+            break;
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned int m = active_mask16(p + i);
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if (!idle_byte(p[i]))
+            return i;
+    }
+    return n;
+}
+
+#ifdef DSD_SILENCE_SSE2
+// bits of the 16 byte vector at offset o that belong to each channel
+static void channel_masks(int channel_count, size_t o, unsigned int *masks)
+{
+    int i;
+
+    memset(masks, 0, channel_count * sizeof(unsigned int));
+    for (i = 0; i < 16; i++)
+        masks[(o + i) % channel_count] |= 1u << i;
+}
+#endif
+
+void dsd_silence_scan_forward(const uint8_t *p, size_t n, int channel_count, uint32_t *pending, size_t *pos)
+{
+    size_t i = 0;
+
+    if (channel_count > MAX_SCAN_CHANNELS)
+        return;
+
+#ifdef DSD_SILENCE_SSE2
+    for (; i + 16 <= n && *pending; i += 16)
+    {
+        unsigned int masks[MAX_SCAN_CHANNELS], m = active_mask16(p + i);
+        int c;
+
+        if (!m)
+            continue;
+        channel_masks(channel_count, i, masks);
+        for (c = 0; c < channel_count; c++)
+        {
+            if ((*pending & (1u << c)) && (m & masks[c]))
+            {
+                pos[c] = (i + __builtin_ctz(m & masks[c])) / channel_count;
+                *pending &= ~(1u << c);
+            }
+        }
+    }
+#endif
+    for (; i < n && *pending; i++)
+    {
+        int c = (int) (i % channel_count);
+        if ((*pending & (1u << c)) && !idle_byte(p[i]))
+        {
+            pos[c] = i / channel_count;
+            *pending &= ~(1u << c);
+        }
+    }
+}
+
+void dsd_silence_scan_backward(const uint8_t *p, size_t n, int channel_count, uint32_t *pending, size_t *pos)
+{
+    size_t i = n;
+
+    if (channel_count > MAX_SCAN_CHANNELS)
+        return;
+
+    // the unaligned tail first, then whole vectors towards the start
+#ifdef DSD_SILENCE_SSE2
+    while (i % 16 && *pending)
+#else
+    while (i > 0 && *pending)
+#endif
+    {
+        int c;
+        i--;
+        c = (int) (i % channel_count);
+        if ((*pending & (1u << c)) && !idle_byte(p[i]))
+        {
+            pos[c] = i / channel_count;
+            *pending &= ~(1u << c);
+        }
+    }
+#ifdef DSD_SILENCE_SSE2
+    while (i >= 16 && *pending)
+    {
+        unsigned int masks[MAX_SCAN_CHANNELS], m;
+        int c;
+
+        i -= 16;
+        m = active_mask16(p + i);
+        if (!m)
+            continue;
+        channel_masks(channel_count, i, masks);
+        for (c = 0; c < channel_count; c++)
+        {
+            if ((*pending & (1u << c)) && (m & masks[c]))
+            {
+                pos[c] = (i + 31 - __builtin_clz(m & masks[c])) / channel_count;
+                *pending &= ~(1u << c);
+            }
+        }
+    }
+#endif
+}
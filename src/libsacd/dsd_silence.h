@@ -0,0 +1,42 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef DSD_SILENCE_H_INCLUDED
+#define DSD_SILENCE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Detection of DSD idle patterns (0x69, 0x55 and their bit reversed forms 0x96, 0xAA).
+// The set is closed under bit reversal, so the same scan works on MSB first (disc) and
+// LSB first (decoded planar) data. A byte is "active" if it is not an idle pattern.
+
+// index of the first active byte in p[0..n), n if there is none
+size_t dsd_silence_first_active(const uint8_t *p, size_t n);
+
+// Channel interleaved data, byte k belongs to channel k % channel_count (use 1 for a plane).
+// For every channel in *pending that has an active byte, stores the per channel byte index
+// of its first (forward) or last (backward) active byte in pos[channel] and clears it from
+// *pending. Stops as soon as *pending is empty.
+void dsd_silence_scan_forward(const uint8_t *p, size_t n, int channel_count, uint32_t *pending, size_t *pos);
+void dsd_silence_scan_backward(const uint8_t *p, size_t n, int channel_count, uint32_t *pending, size_t *pos);
+
+#endif /* DSD_SILENCE_H_INCLUDED */
@@ -48,6 +48,9 @@
 
 #define DSDFIFF_BUFFER_SIZE    (1024 * 128)
 
+// DST frame chunks (header, data and pad byte) are gathered here and written in one go
+#define DST_STAGING_SIZE       (1024 * 1024)
+
 typedef struct
 {
     uint8_t            *header;
@@ -61,6 +64,10 @@ typedef struct
     dst_frame_index_t  *frame_indexes;
     size_t              frame_indexes_allocated;
 
+    uint64_t            write_offset;       // file offset of the next byte handed to fwrite()
+    uint8_t            *staging;
+    size_t              staging_used;
+
     int                 edit_master;
 } 
 dsdiff_handle_t;
@@ -565,50 +572,162 @@ static int calculate_header_and_footer(scarletbook_output_format_t *ft)
     return 0;
 }
 
-static int dsdiff_create_edit_master(scarletbook_output_format_t *ft)
+// Reserve the DST frame index up front. The frame count is estimated from the average number
+// of frames per sector of the area, so the index only grows on unusually dense tracks.
+static void reserve_frame_indexes(scarletbook_output_format_t *ft)
+{
+    dsdiff_handle_t  *handle = (dsdiff_handle_t *) ft->priv;
+    area_toc_t *area_toc = ft->sb_handle->area[ft->area].area_toc;
+    uint64_t area_frames = TIME_FRAMECOUNT(&area_toc->total_playtime);
+    uint64_t area_sectors = area_toc->track_end - area_toc->track_start + 1;
+    size_t estimate;
+
+    if (ft->dsd_encoded_export || area_sectors == 0)
+        return;
+
+    estimate = (size_t) (ft->length_lsn * area_frames / area_sectors);
+    estimate += estimate / 50 + SACD_FRAME_RATE;
+
+    handle->frame_indexes = (dst_frame_index_t *) malloc(estimate * DST_FRAME_INDEX_SIZE);
+    handle->frame_indexes_allocated = handle->frame_indexes ? estimate : 0;
+}
+
+// A streamed file gets its final header up front, so the sizes the header (and the
+// frame index in the footer) describe are set from the counts gathered before writing.
+static int announce_stream_sizes(scarletbook_output_format_t *ft)
+{
+    dsdiff_handle_t  *handle = (dsdiff_handle_t *) ft->priv;
+    int channel_count = ft->sb_handle->area[ft->area].area_toc->channel_count;
+
+    handle->frame_count = (size_t) ft->stream_frame_count;
+    if (ft->dsd_encoded_export)
+    {
+        handle->audio_data_size = ft->stream_frame_count * FRAME_SIZE_64 * channel_count;
+    }
+    else
+    {
+        handle->audio_data_size = ft->stream_frame_count * DST_FRAME_DATA_CHUNK_SIZE + ft->stream_frame_bytes;
+        if (handle->frame_indexes_allocated < handle->frame_count)
+        {
+            free(handle->frame_indexes);
+            handle->frame_indexes = (dst_frame_index_t *) calloc(handle->frame_count, DST_FRAME_INDEX_SIZE);
+            if (!handle->frame_indexes)
+            {
+                handle->frame_indexes_allocated = 0;
+                LOG(lm_main, LOG_ERROR, ("announce_stream_sizes(): out of memory for the frame index of %s", ft->filename));
+                return -1;
+            }
+            handle->frame_indexes_allocated = handle->frame_count;
+        }
+    }
+    return 0;
+}
+
+static int write_header(scarletbook_output_format_t *ft)
 {
+    dsdiff_handle_t  *handle = (dsdiff_handle_t *) ft->priv;
     int ret;
-    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
-    handle->edit_master = 1;
+
+    reserve_frame_indexes(ft);
+    if (ft->stream && announce_stream_sizes(ft) != 0)
+        return -1;
     ret = calculate_header_and_footer(ft);
-    size_t nrw=fwrite(handle->header, 1, handle->header_size, ft->fd);
-	if(nrw !=  handle->header_size)
-	{ 		        
-		LOG(lm_main, LOG_ERROR, ("dsdiff_create_edit_master(): error writing in file %s", ft->filename));
-		return -1;               				
-	}
+    ft->sound_data_offset = handle->header_size;
+    if (fwrite(handle->header, 1, handle->header_size, ft->fd) != handle->header_size)
+    {
+        LOG(lm_main, LOG_ERROR, ("dsdiff write_header(): error writing in file %s", ft->filename));
+        return -1;
+    }
+    handle->write_offset = handle->header_size;
+
+    // from here on the counters track what was actually written
+    handle->frame_count = 0;
+    handle->audio_data_size = 0;
     return ret;
 }
 
+static int dsdiff_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len);
+
+static int flush_staging(scarletbook_output_format_t *ft)
+{
+    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    size_t len = handle->staging_used;
+
+    if (len == 0)
+        return 0;
+
+    handle->staging_used = 0;
+    if (fwrite(handle->staging, 1, len, ft->fd) != len)
+    {
+        LOG(lm_main, LOG_ERROR, ("flush_staging(): error writing in file %s", ft->filename));
+        return -1;
+    }
+    scarletbook_output_written(ft, handle->staging, len);
+    return 0;
+}
+
+static int dsdiff_create_edit_master(scarletbook_output_format_t *ft)
+{
+    dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    handle->edit_master = 1;
+    return write_header(ft);
+}
+
 static int dsdiff_create(scarletbook_output_format_t *ft)
 {
-    int ret = calculate_header_and_footer(ft);
-    dsdiff_handle_t  *handle = (dsdiff_handle_t *) ft->priv;
-    size_t nrw=fwrite(handle->header, 1, handle->header_size, ft->fd); 
-	if(nrw !=  handle->header_size)
-	{ 		        
-		LOG(lm_main, LOG_ERROR, ("dsdiff_create(0: error writing in file %s", ft->filename));
-		return -1;               				
-	}	
-    return ret;
+    return write_header(ft);
 }
 
 static int dsdiff_close(scarletbook_output_format_t *ft)
 {
     dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
+    size_t nrw;
+    int result = -1;
 
     if (!handle)
         return 0;
+
+    // a streamed file must hold exactly the frames announced in its header
+    if (ft->stream && !ft->stream_layout && handle->frame_count < ft->stream_frame_count)
+    {
+        if (ft->dsd_encoded_export)
+        {
+            size_t frame_size = FRAME_SIZE_64 * ft->sb_handle->area[ft->area].area_toc->channel_count;
+            uint8_t *silence = (uint8_t *) malloc(frame_size);
+
+            if (!silence)
+            {
+                LOG(lm_main, LOG_ERROR, ("dsdiff_close(): out of memory padding %s with silence", ft->filename));
+                goto cleanup;
+            }
+            LOG(lm_main, LOG_ERROR, ("dsdiff_close(): %s is %llu frames short, padding with silence", ft->filename, 
+                (unsigned long long) (ft->stream_frame_count - handle->frame_count)));
+            memset(silence, 0x69, frame_size);
+            while (handle->frame_count < ft->stream_frame_count)
+            {
+                if (dsdiff_write_frame(ft, silence, frame_size) < 0)
+                    break;
+            }
+            free(silence);
+        }
+        else
+        {
+            LOG(lm_main, LOG_ERROR, ("dsdiff_close(): %s is %llu DST frames short of its streamed header", ft->filename, 
+                (unsigned long long) (ft->stream_frame_count - handle->frame_count)));
+        }
+    }
+
+    if (flush_staging(ft) != 0)
+        goto cleanup;
     
     if (handle->audio_data_size % 2)
     {
         uint8_t dummy = 0;
-		size_t nrw;
         nrw=fwrite(&dummy, 1, 1, ft->fd);
 		if(nrw != 1)
 		{ 		        
 			LOG(lm_main, LOG_ERROR, ("dsdiff_close(0: error writing in file %s", ft->filename));
-			return -1;               				
+			goto cleanup;
 		}
 			
         handle->audio_data_size += 1;
@@ -618,36 +737,52 @@ static int dsdiff_close(scarletbook_output_format_t *ft)
     calculate_header_and_footer(ft);
 
     // append the footer
-    size_t nrw=fwrite(handle->footer, 1, handle->footer_size, ft->fd);
+    nrw=fwrite(handle->footer, 1, handle->footer_size, ft->fd);
 	if(nrw !=  handle->footer_size)
 	{ 		        
 		LOG(lm_main, LOG_ERROR, ("dsdiff_close(0: error writing in file %s", ft->filename));
-		return -1;               				
+		goto cleanup;
 	}
 		
-    // write the final header
-    fseek(ft->fd, 0, SEEK_SET);
-    nrw=fwrite(handle->header, 1, handle->header_size, ft->fd);
-	if(nrw !=  handle->header_size)
-	{ 		        
-		LOG(lm_main, LOG_ERROR, ("dsdiff_close(0: error writing in file %s", ft->filename));
-		return -1;               				
-	}	
+    // write the final header, a streamed header was final from the start
+    if (!ft->stream)
+    {
+        fseek(ft->fd, 0, SEEK_SET);
+        nrw=fwrite(handle->header, 1, handle->header_size, ft->fd);
+        if(nrw !=  handle->header_size)
+        { 		        
+            LOG(lm_main, LOG_ERROR, ("dsdiff_close(0: error writing in file %s", ft->filename));
+            goto cleanup;
+        }	
+    }
+    result = 0;
 
+    // the buffers are freed whether or not the file could be finished
+cleanup:
     if (handle->frame_indexes)
         free(handle->frame_indexes);
+    if (handle->staging)
+        free(handle->staging);
     if (handle->header)
         free(handle->header);
     if (handle->footer)
         free(handle->footer);
+    handle->frame_indexes = NULL;
+    handle->staging = NULL;
+    handle->header = NULL;
+    handle->footer = NULL;
 
-    return 0;
+    return result;
 }
 
 static int dsdiff_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
 {
     dsdiff_handle_t *handle = (dsdiff_handle_t *) ft->priv;
 
+    // never write past the length announced in a streamed header
+    if (ft->stream && handle->frame_count >= ft->stream_frame_count)
+        return 0;
+
     handle->frame_count++;
 
     if (ft->dsd_encoded_export)
@@ -659,71 +794,64 @@ static int dsdiff_write_frame(scarletbook_output_format_t *ft, const uint8_t *bu
 			LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(): error writing in file %s", ft->filename));
 			return -1;               				
 		}
+        scarletbook_output_written(ft, buf, nrw);
         handle->audio_data_size += nrw;
+        handle->write_offset += nrw;
         return (int)nrw;
     }
     else
     {
-        dst_frame_data_chunk_t dst_frame_data_chunk;
-        dst_frame_data_chunk.chunk_id = DSTF_MARKER;
-        dst_frame_data_chunk.chunk_data_size = hton64(len);
-        {
-            size_t nrw;
+        dst_frame_data_chunk_t *dst_frame_data_chunk;
+        size_t chunk_size = DST_FRAME_DATA_CHUNK_SIZE + CEIL_ODD_NUMBER(len);
 
-            if (handle->frame_count > handle->frame_indexes_allocated)
+        if (handle->frame_count > handle->frame_indexes_allocated)
+        {
+            dst_frame_index_t *frame_indexes = (dst_frame_index_t *) realloc(handle->frame_indexes, (handle->frame_indexes_allocated + 10000) * DST_FRAME_INDEX_SIZE);
+            if (!frame_indexes)
             {
-                handle->frame_indexes_allocated += 10000;
-                handle->frame_indexes = (dst_frame_index_t *) realloc(handle->frame_indexes, handle->frame_indexes_allocated * DST_FRAME_INDEX_SIZE);
+                LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(): out of memory for the frame index of %s", ft->filename));
+                handle->frame_count--;
+                return -1;
             }
+            handle->frame_indexes = frame_indexes;
+            handle->frame_indexes_allocated += 10000;
+        }
 
-            handle->frame_indexes[handle->frame_count - 1].length = len;
-
-#ifdef _WIN32
-            handle->frame_indexes[handle->frame_count - 1].offset = _ftelli64(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-#elif defined(__lv2ppu__) || defined(__APPLE__)
-            handle->frame_indexes[handle->frame_count - 1].offset = ftello(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-#else
-            
-            // off64_t ftello64 (FILE *stream) : If the sources are compiled with _FILE_OFFSET_BITS == 64 on a 32 bits machine this function is available under the name ftello and so transparently replaces the old interface.
-            //
-    #ifdef _FILE_OFFSET_BITS         
-            handle->frame_indexes[handle->frame_count - 1].offset = ftello(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-    #else
-            handle->frame_indexes[handle->frame_count - 1].offset = ftello64(ft->fd) + DST_FRAME_DATA_CHUNK_SIZE;
-    #endif
-#endif
+        // the offset is tracked arithmetically, asking the stream with ftello() costs a seek per frame
+        handle->frame_indexes[handle->frame_count - 1].length = len;
+        handle->frame_indexes[handle->frame_count - 1].offset = handle->write_offset + DST_FRAME_DATA_CHUNK_SIZE;
 
-            nrw = fwrite(&dst_frame_data_chunk, 1, DST_FRAME_DATA_CHUNK_SIZE, ft->fd);
-			
-			if(nrw !=DST_FRAME_DATA_CHUNK_SIZE)
-			{ 		        
-				LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(0: error writing in file %s", ft->filename));
-				return -1;               				
-			}
-			
-			size_t nrw1;
-			nrw1=fwrite(buf, 1, len, ft->fd);
-			if(nrw1 != len)
-			{ 		        
-				LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(0: error writing in file %s", ft->filename));
-				return -1;               				
-			}
-			
-            nrw += nrw1;
-            if (len % 2)
+        if (!handle->staging)
+        {
+            handle->staging = (uint8_t *) malloc(DST_STAGING_SIZE);
+            handle->staging_used = 0;
+            if (!handle->staging)
             {
-                uint8_t dummy = 0;
-				nrw1=fwrite(&dummy, 1, 1, ft->fd);
-				if(nrw1 != 1)
-				{ 		        
-					LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(0: error writing in file %s", ft->filename));
-					return -1;               				
-				}				
-                nrw += nrw1;
+                LOG(lm_main, LOG_ERROR, ("dsdiff_write_frame(): out of memory for the staging buffer of %s", ft->filename));
+                handle->frame_count--;
+                return -1;
             }
-            handle->audio_data_size += nrw;
-            return (int)nrw;
         }
+        if (handle->staging_used + chunk_size > DST_STAGING_SIZE)
+        {
+            if (flush_staging(ft) != 0)
+                return -1;
+        }
+
+        // header, frame data and pad byte end up as one contiguous chunk
+        dst_frame_data_chunk = (dst_frame_data_chunk_t *) (handle->staging + handle->staging_used);
+        dst_frame_data_chunk->chunk_id = DSTF_MARKER;
+        dst_frame_data_chunk->chunk_data_size = hton64(len);
+        memcpy(handle->staging + handle->staging_used + DST_FRAME_DATA_CHUNK_SIZE, buf, len);
+        if (len % 2)
+        {
+            handle->staging[handle->staging_used + DST_FRAME_DATA_CHUNK_SIZE + len] = 0;
+        }
+        handle->staging_used += chunk_size;
+
+        handle->write_offset += chunk_size;
+        handle->audio_data_size += chunk_size;
+        return (int)chunk_size;
     }
 }
 
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <logging.h>
+#include <utils.h>
 #ifdef __lv2ppu__
 #include <sys/file.h>
 #elif defined(WIN32) || defined(_WIN32)
@@ -58,6 +59,8 @@ typedef struct
     uint8_t buffer[MAX_CHANNEL_COUNT][SACD_BLOCK_SIZE_PER_CHANNEL];
     uint8_t *buffer_ptr[MAX_CHANNEL_COUNT];
 
+    uint64_t frames_written;        // streaming: frames accepted so far
+
 } dsf_handle_t;
 
 static const uint8_t bit_reverse_table[] =
@@ -80,10 +83,21 @@ static const uint8_t bit_reverse_table[] =
         0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
     };
 
-static uint8_t buffer_prev[MAX_CHANNEL_COUNT][SACD_BLOCK_SIZE_PER_CHANNEL]; // used for nopad option; keep the previus data copied form buffer[]
-static uint8_t *buffer_ptr_prev[MAX_CHANNEL_COUNT];
-#define NO_PREV_TRACK  -2
-static int prev_track_no = NO_PREV_TRACK;
+// nopad option: the previous data copied from buffer[] is kept in the scarletbook handle
+// (dsf_carry), so discs processed at the same time do not share it
+#define NO_PREV_TRACK  -1
+
+static int dsf_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len);
+
+static void dsf_render_footer(scarletbook_output_format_t *ft)
+{
+    dsf_handle_t  *handle = (dsf_handle_t *) ft->priv;
+
+    if(ft->sb_handle->id3_tag_mode != 0)
+        handle->footer_size = scarletbook_id3_tag_render(ft->sb_handle, handle->footer, ft->area, ft->track);
+    else       
+        handle->footer_size=0;  // no id_tag                    
+}
 
 static int dsf_create_header(scarletbook_output_format_t *ft)
 {
@@ -154,16 +168,13 @@ static int dsf_create_header(scarletbook_output_format_t *ft)
         handle->header_size += DATA_CHUNK_SIZE;
     }
 
-    {
-        if(ft->sb_handle->id3_tag_mode != 0)
-            handle->footer_size = scarletbook_id3_tag_render(sb_handle, handle->footer, ft->area, ft->track);
-        else       
-            handle->footer_size=0;  // no id_tag                    
-    }
+    dsf_render_footer(ft);
 
     dsd_chunk->total_file_size = htole64(handle->header_size + handle->audio_data_size + handle->footer_size);
     dsd_chunk->metadata_offset = htole64(handle->footer_size ? handle->header_size + handle->audio_data_size : 0);
 
+    ft->sound_data_offset = handle->header_size;
+
     size_t bytes_w;
     bytes_w=fwrite(handle->header, 1, handle->header_size, ft->fd);
     if(bytes_w != handle->header_size)
@@ -176,8 +187,24 @@ static int dsf_create_header(scarletbook_output_format_t *ft)
 static int dsf_create(scarletbook_output_format_t *ft)
 {
     dsf_handle_t *handle = (dsf_handle_t *)ft->priv;
+    int rez;
 
-    int rez = dsf_create_header(ft);
+    if (ft->stream)
+    {
+        // the header is final right away: announce the frames counted up front,
+        // the last block of each channel is zero padded as usual
+        int channel_count = ft->sb_handle->area[ft->area].area_toc->channel_count;
+        uint64_t bytes_per_channel = ft->stream_frame_count * FRAME_SIZE_64;
+
+        handle->sample_count = bytes_per_channel * channel_count;
+        handle->audio_data_size = (bytes_per_channel + SACD_BLOCK_SIZE_PER_CHANNEL - 1) / SACD_BLOCK_SIZE_PER_CHANNEL 
+                                  * SACD_BLOCK_SIZE_PER_CHANNEL * channel_count;
+        rez = dsf_create_header(ft);
+        handle->sample_count = 0;
+        handle->audio_data_size = 0;
+    }
+    else
+        rez = dsf_create_header(ft);
 
     ////// BUG - buffer_ptr[] where not initialized at all in original code!!!!!  Now initialized here!
     for (int i = 0; i < MAX_CHANNEL_COUNT; i++)
@@ -187,30 +214,39 @@ static int dsf_create(scarletbook_output_format_t *ft)
 
     // If this is not the first track, carry over the leftover samples from the tail of the previous track for no zero padding.
     // and leftovers must be from previous track (==track-1); To work with selected tracks.
-    if (ft->sb_handle->dsf_nopad && (ft->track > 0) && (ft->track == prev_track_no + 1))
+    if (ft->sb_handle->dsf_nopad && (ft->track > 0) && (ft->track == ft->sb_handle->dsf_carry_track + 1))
     {
+        scarletbook_handle_t *sb_handle = ft->sb_handle;
+
         for (int i = 0; i < handle->channel_count; i++)
         {
-            if (buffer_ptr_prev[i] > buffer_prev[i]) // if has something in buffer_prev[] to carry over
+            if (sb_handle->dsf_carry_size[i] > 0) // if has something in dsf_carry to carry over
             {
-                memcpy(handle->buffer[i], buffer_prev[i], SACD_BLOCK_SIZE_PER_CHANNEL);
-                handle->buffer_ptr[i] = handle->buffer[i] + (buffer_ptr_prev[i] - buffer_prev[i]);
+                memcpy(handle->buffer[i], sb_handle->dsf_carry + i * SACD_BLOCK_SIZE_PER_CHANNEL, SACD_BLOCK_SIZE_PER_CHANNEL);
+                handle->buffer_ptr[i] = handle->buffer[i] + sb_handle->dsf_carry_size[i];
 
                 // DEBUG
-                //LOG(lm_main, LOG_NOTICE, ("Dsf_create, nopad & track>0: prev_track_no=%d, track=%d, size_prev=%d ", prev_track_no, ft->track, (int)(buffer_ptr_prev[i] - buffer_prev[i])));
+                //LOG(lm_main, LOG_NOTICE, ("Dsf_create, nopad & track>0: prev_track_no=%d, track=%d, size_prev=%d ", sb_handle->dsf_carry_track, ft->track, (int)sb_handle->dsf_carry_size[i]));
                 // empty prev buffer
-                buffer_ptr_prev[i] = &buffer_prev[i][0];               
+                sb_handle->dsf_carry_size[i] = 0;
             }
         }
-        prev_track_no = NO_PREV_TRACK;
+        sb_handle->dsf_carry_track = NO_PREV_TRACK;
     }
 
     //DEBUG
-    //LOG(lm_main, LOG_NOTICE, ("Dsf_create: prev_track_no=%d, track=%d, size_buffer=%d ", prev_track_no, ft->track, (int)(handle->buffer_ptr[0] - handle->buffer[0])));    
+    //LOG(lm_main, LOG_NOTICE, ("Dsf_create: prev_track_no=%d, track=%d, size_buffer=%d ", ft->sb_handle->dsf_carry_track, ft->track, (int)(handle->buffer_ptr[0] - handle->buffer[0])));    
 
     return rez;
 }
 
+static int dsf_carry_alloc(scarletbook_handle_t *sb_handle)
+{
+    if (!sb_handle->dsf_carry)
+        sb_handle->dsf_carry = (uint8_t *) malloc(MAX_CHANNEL_COUNT * SACD_BLOCK_SIZE_PER_CHANNEL);
+    return sb_handle->dsf_carry != NULL;
+}
+
 static int dsf_close(scarletbook_output_format_t *ft)
 {
     dsf_handle_t *handle = (dsf_handle_t *)ft->priv;
@@ -219,9 +255,37 @@ static int dsf_close(scarletbook_output_format_t *ft)
 	size_t bytes_w;
 	int result=0;
 
+    // a streamed file must hold exactly the frames announced in its header; fill up with silence
+    if (ft->stream && !ft->stream_layout && handle->frames_written < ft->stream_frame_count)
+    {
+        size_t frame_size = FRAME_SIZE_64 * handle->channel_count;
+        uint8_t *silence = (uint8_t *) malloc(frame_size);
+
+        if (!silence)
+        {
+            LOG(lm_main, LOG_ERROR, ("dsf_close(): out of memory padding %s with silence", ft->filename));
+            result = -1;
+        }
+        else
+        {
+            LOG(lm_main, LOG_ERROR, ("dsf_close(): %s is %llu frames short, padding with silence", ft->filename, 
+                (unsigned long long) (ft->stream_frame_count - handle->frames_written)));
+            memset(silence, ft->dsd_planar_lsb ? 0x96 : 0x69, frame_size);
+            while (handle->frames_written < ft->stream_frame_count)
+            {
+                if (dsf_write_frame(ft, silence, frame_size) < 0)
+                {
+                    result = -1;
+                    break;
+                }
+            }
+            free(silence);
+        }
+    }
+
     // Save the remaining samples in the buffer to be attached to the beginning of the next track.  // This is mindset idea with nopad option !! Thank you!
     // This is needed for padding-less DSF generation.  This is for players that cannot handle zero-padding properly.
-    if (sb_handle->dsf_nopad && ft->track < sb_handle->area[ft->area].area_toc->track_count - 1)
+    if (sb_handle->dsf_nopad && !ft->stream && ft->track < sb_handle->area[ft->area].area_toc->track_count - 1 && dsf_carry_alloc(sb_handle))
     {
         if(sb_handle->concatenate ==0)
         {
@@ -230,13 +294,13 @@ static int dsf_close(scarletbook_output_format_t *ft)
                 // if it exists some data in buffers then copy it in a special buffers for use in next track
                 if (handle->buffer_ptr[i] > handle->buffer[i])
                 {
-                    memcpy(buffer_prev[i], handle->buffer[i], SACD_BLOCK_SIZE_PER_CHANNEL);
-                    buffer_ptr_prev[i] = buffer_prev[i] + (handle->buffer_ptr[i] - handle->buffer[i]);
-                    prev_track_no = ft->track;
+                    memcpy(sb_handle->dsf_carry + i * SACD_BLOCK_SIZE_PER_CHANNEL, handle->buffer[i], SACD_BLOCK_SIZE_PER_CHANNEL);
+                    sb_handle->dsf_carry_size[i] = handle->buffer_ptr[i] - handle->buffer[i];
+                    sb_handle->dsf_carry_track = ft->track;
                     
                     //DEBUG
-                    //int size_rezult=(int)(buffer_ptr_prev[i] - buffer_prev[i]);
-                    //LOG(lm_main, LOG_NOTICE, ("Dsf_close, nopad, memcopy: prev_track_no=track=%d, size_prev=%d, full=%d[%%]", prev_track_no,size_rezult, (int)size_rezult*100/SACD_BLOCK_SIZE_PER_CHANNEL ));
+                    //int size_rezult=(int)sb_handle->dsf_carry_size[i];
+                    //LOG(lm_main, LOG_NOTICE, ("Dsf_close, nopad, memcopy: prev_track_no=track=%d, size_prev=%d, full=%d[%%]", sb_handle->dsf_carry_track,size_rezult, (int)size_rezult*100/SACD_BLOCK_SIZE_PER_CHANNEL ));
 
                     // empty the main frame buffers
                     memset(handle->buffer[i], 0x00, SACD_BLOCK_SIZE_PER_CHANNEL); // Mandatory is 0x00. But tried with 0x99 (10011001) for reducing pop noise ( or 0x69)
@@ -244,15 +308,15 @@ static int dsf_close(scarletbook_output_format_t *ft)
                 }
                 else // very rare but happens
                 {
-                    buffer_ptr_prev[i] = &buffer_prev[i][0]; // emtpy, nothing to carry over to the next track
-                    prev_track_no = NO_PREV_TRACK;
+                    sb_handle->dsf_carry_size[i] = 0; // emtpy, nothing to carry over to the next track
+                    sb_handle->dsf_carry_track = NO_PREV_TRACK;
                     //DEBUG
-                    //LOG(lm_main, LOG_NOTICE, ("Dsf_close, nopad, memcopy, Buffer Empty: prev_track_no=%d, track=%d", prev_track_no, ft->track));
+                    //LOG(lm_main, LOG_NOTICE, ("Dsf_close, nopad, memcopy, Buffer Empty: prev_track_no=%d, track=%d", sb_handle->dsf_carry_track, ft->track));
                 }
             }
         }
         else // in concatenation mode do not keep these remaining samples
-            prev_track_no = NO_PREV_TRACK;
+            sb_handle->dsf_carry_track = NO_PREV_TRACK;
     }
     else // if dsf_nopad = 0 or is last track in dsf_nopad==1 case
     {
@@ -271,13 +335,14 @@ static int dsf_close(scarletbook_output_format_t *ft)
                     handle->audio_data_size += bytes_w;
                     break;
                 }
+                scarletbook_output_written(ft, handle->buffer[i], SACD_BLOCK_SIZE_PER_CHANNEL);
 
                 handle->sample_count += handle->buffer_ptr[i] - handle->buffer[i];
                 handle->audio_data_size += SACD_BLOCK_SIZE_PER_CHANNEL;
 
                 //DEBUG
                 //int size_rezult=(int)(handle->buffer_ptr[i] - handle->buffer[i]);
-                //LOG(lm_main, LOG_NOTICE, ("Dsf_close: nopad=0 or last track; prev_track_no=%d, track=%d, size_buffer=%d, full=%d[%%]", prev_track_no, ft->track, size_rezult,(int)size_rezult*100/SACD_BLOCK_SIZE_PER_CHANNEL));
+                //LOG(lm_main, LOG_NOTICE, ("Dsf_close: nopad=0 or last track; prev_track_no=%d, track=%d, size_buffer=%d, full=%d[%%]", sb_handle->dsf_carry_track, ft->track, size_rezult,(int)size_rezult*100/SACD_BLOCK_SIZE_PER_CHANNEL));
 
                 // empty the main frame buffers
                 memset(handle->buffer[i], 0x00, SACD_BLOCK_SIZE_PER_CHANNEL); // Mandatory is 0x00. But tried with 0x99 (10011001) for reducing pop noise ( or 0x69)
@@ -285,10 +350,12 @@ static int dsf_close(scarletbook_output_format_t *ft)
             }
         }
 
-        prev_track_no = NO_PREV_TRACK;
+        sb_handle->dsf_carry_track = NO_PREV_TRACK;
     }
 
-    // write the footer
+    // write the footer, rendered again as the tag may have gained the analysis results since the start
+    if (!ft->stream)
+        dsf_render_footer(ft);
     bytes_w=fwrite(handle->footer, 1, handle->footer_size, ft->fd);
 	if(bytes_w != handle->footer_size)
 	{
@@ -296,10 +363,14 @@ static int dsf_close(scarletbook_output_format_t *ft)
 		LOG(lm_main, LOG_ERROR, ("dsf_close(): error at write footer %s", ft->filename));
 	}
 	
-    fseek(ft->fd, 0, SEEK_SET);
-    
-    // write the final header
-    dsf_create_header(ft);
+    // a streamed header was final from the start
+    if (!ft->stream)
+    {
+        fseek(ft->fd, 0, SEEK_SET);
+
+        // write the final header
+        dsf_create_header(ft);
+    }
 
     if (handle->header)
         free(handle->header);
@@ -309,6 +380,50 @@ static int dsf_close(scarletbook_output_format_t *ft)
     return result;
 }
 
+// Frames decoded by the DST decoder in DST_DECODER_LAYOUT_PLANAR_LSB are already bit reversed
+// and split per channel, so whole spans can be copied into the channel blocks.
+static int dsf_write_planar_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
+{
+    dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
+    size_t bytes_per_channel = len / handle->channel_count;
+    size_t offset = 0;
+    uint64_t prev_audio_data_size = handle->audio_data_size;
+    int i;
+
+    while (offset < bytes_per_channel)
+    {
+        size_t span;
+
+        // all channel blocks fill up at the same time; flush them the same way dsf_write_frame does
+        if (handle->buffer_ptr[0] == &handle->buffer[0][SACD_BLOCK_SIZE_PER_CHANNEL])
+        {
+            for (i = 0; i < handle->channel_count; i++)
+            {
+                if (fwrite(handle->buffer[i], 1, SACD_BLOCK_SIZE_PER_CHANNEL, ft->fd) != SACD_BLOCK_SIZE_PER_CHANNEL)
+                {
+                    LOG(lm_main, LOG_ERROR, ("dsf_write_planar_frame(): error writting buffer in file: %s", ft->filename));
+                    return -1;
+                }
+                scarletbook_output_written(ft, handle->buffer[i], SACD_BLOCK_SIZE_PER_CHANNEL);
+                handle->sample_count += SACD_BLOCK_SIZE_PER_CHANNEL;
+                handle->audio_data_size += SACD_BLOCK_SIZE_PER_CHANNEL;
+                memset(handle->buffer[i], 0x00, SACD_BLOCK_SIZE_PER_CHANNEL);
+                handle->buffer_ptr[i] = handle->buffer[i];
+            }
+        }
+
+        span = min((size_t) (&handle->buffer[0][SACD_BLOCK_SIZE_PER_CHANNEL] - handle->buffer_ptr[0]), bytes_per_channel - offset);
+        for (i = 0; i < handle->channel_count; i++)
+        {
+            memcpy(handle->buffer_ptr[i], buf + i * bytes_per_channel + offset, span);
+            handle->buffer_ptr[i] += span;
+        }
+        offset += span;
+    }
+
+    return (int) (handle->audio_data_size - prev_audio_data_size);
+}
+
 static int dsf_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
 {
     dsf_handle_t *handle = (dsf_handle_t *) ft->priv;
@@ -318,6 +433,17 @@ static int dsf_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf,
     int i;
     uint8_t *buffer_row_start_ptr;
 
+    if (ft->stream)
+    {
+        // never write past the length announced in the streamed header
+        if (handle->frames_written >= ft->stream_frame_count)
+            return 0;
+        handle->frames_written++;
+    }
+
+    if (ft->dsd_planar_lsb)
+        return dsf_write_planar_frame(ft, buf, len);
+
     while(buf_ptr < buf_end_ptr)
     {
         for (i = 0; i < handle->channel_count; i++)
@@ -350,6 +476,7 @@ static int dsf_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf,
 					LOG(lm_main, LOG_ERROR, ("dsf_write_frame(): error writting buffer in file: %s", ft->filename));
 					return -1;
 				}
+                scarletbook_output_written(ft, buffer_row_start_ptr, SACD_BLOCK_SIZE_PER_CHANNEL);
 
                 handle->sample_count += SACD_BLOCK_SIZE_PER_CHANNEL;
                 handle->audio_data_size += SACD_BLOCK_SIZE_PER_CHANNEL;
@@ -373,7 +500,7 @@ scarletbook_format_handler_t const * dsf_format_fn(void)
         dsf_create, 
         dsf_write_frame,
         dsf_close, 
-        OUTPUT_FLAG_DSD,
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_DSD_PLANAR,
         sizeof(dsf_handle_t)
     };
     return &handler;
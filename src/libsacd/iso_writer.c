@@ -21,6 +21,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <logging.h>
 
 #ifdef __lv2ppu__
 #include <sys/file.h>
@@ -30,15 +35,117 @@
 
 #include "scarletbook_output.h"
 
+typedef struct
+{
+    int      sparse;            // all-zero sectors are skipped instead of written
+    uint64_t offset;            // logical size of the image written so far
+    uint64_t file_offset;       // where the next fwrite() lands
+    uint64_t skipped_sectors;
+} 
+iso_handle_t;
+
+static int iso_create(scarletbook_output_format_t *ft)
+{
+    iso_handle_t *handle = (iso_handle_t *) ft->priv;
+
+    handle->sparse = 0;
+#if !defined(__lv2ppu__) && !defined(WIN32) && !defined(_WIN32)
+    // holes need a regular file; pipes and devices get every sector written
+    if (ft->sb_handle->iso_sparse)
+    {
+        struct stat st;
+
+        handle->sparse = fstat(fileno(ft->fd), &st) == 0 && S_ISREG(st.st_mode);
+        if (!handle->sparse)
+            LOG(lm_main, LOG_NOTICE, ("iso_create(): %s is not a regular file, writing a non sparse image", ft->filename));
+    }
+#endif
+    return 0;
+}
+
+static inline int is_zero_sector(const uint8_t *sector)
+{
+    return sector[0] == 0 && memcmp(sector, sector + 1, SACD_LSN_SIZE - 1) == 0;
+}
+
 static int iso_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
 {
-    size_t result = fwrite(buf, 1, len * SACD_LSN_SIZE, ft->fd);
-	if(result != len * SACD_LSN_SIZE)
-	{ 		        
-		//LOG(lm_main, LOG_ERROR, ("iso_write_frame(): error writting in file.") );
-		return -1;               				
-	}
-	 return (int)result;
+    iso_handle_t *handle = (iso_handle_t *) ft->priv;
+    size_t sector = 0;
+
+    if (!handle->sparse)
+    {
+        size_t result = fwrite(buf, 1, len * SACD_LSN_SIZE, ft->fd);
+        if(result != len * SACD_LSN_SIZE)
+        { 		        
+            //LOG(lm_main, LOG_ERROR, ("iso_write_frame(): error writting in file.") );
+            return -1;               				
+        }
+        scarletbook_output_written(ft, buf, result);
+        handle->offset += result;
+        return (int)result;
+    }
+
+    // write runs of data sectors in one go, seek over runs of zero sectors
+    while (sector < len)
+    {
+        size_t run_start = sector;
+
+        if (is_zero_sector(buf + sector * SACD_LSN_SIZE))
+        {
+            while (sector < len && is_zero_sector(buf + sector * SACD_LSN_SIZE))
+                sector++;
+            handle->skipped_sectors += sector - run_start;
+            handle->offset += (uint64_t) (sector - run_start) * SACD_LSN_SIZE;
+            continue;
+        }
+
+        while (sector < len && !is_zero_sector(buf + sector * SACD_LSN_SIZE))
+            sector++;
+
+        if (handle->file_offset != handle->offset)
+        {
+            if (fseeko(ft->fd, (off_t) handle->offset, SEEK_SET) != 0)
+            {
+                LOG(lm_main, LOG_ERROR, ("iso_write_frame(): error seeking in file %s", ft->filename));
+                return -1;
+            }
+            handle->file_offset = handle->offset;
+        }
+        if (fwrite(buf + run_start * SACD_LSN_SIZE, 1, (sector - run_start) * SACD_LSN_SIZE, ft->fd) != (sector - run_start) * SACD_LSN_SIZE)
+        {
+            LOG(lm_main, LOG_ERROR, ("iso_write_frame(): error writting in file %s", ft->filename));
+            return -1;
+        }
+        handle->offset += (uint64_t) (sector - run_start) * SACD_LSN_SIZE;
+        handle->file_offset = handle->offset;
+    }
+
+    // the holes read back as zero sectors
+    scarletbook_output_written(ft, buf, len * SACD_LSN_SIZE);
+    return (int) (len * SACD_LSN_SIZE);
+}
+
+static int iso_close(scarletbook_output_format_t *ft)
+{
+    iso_handle_t *handle = (iso_handle_t *) ft->priv;
+
+    if (!handle || !handle->sparse)
+        return 0;
+
+    // a trailing hole is not part of the file until it is extended to its full size
+    if (handle->file_offset != handle->offset)
+    {
+        fflush(ft->fd);
+        if (ftruncate(fileno(ft->fd), (off_t) handle->offset) != 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("iso_close(): error extending %s", ft->filename));
+            return -1;
+        }
+    }
+
+    LOG(lm_main, LOG_NOTICE, ("iso_close(): %s, %llu zero sectors left as holes", ft->filename, (unsigned long long) handle->skipped_sectors));
+    return 0;
 }
 
 scarletbook_format_handler_t const * iso_format_fn(void) 
@@ -47,11 +154,11 @@ scarletbook_format_handler_t const * iso_format_fn(void)
     {
         "ISO Image", 
         "iso", 
-        0, 
+        iso_create, 
         iso_write_frame,
-        0, 
+        iso_close, 
         OUTPUT_FLAG_RAW,
-        0
+        sizeof(iso_handle_t)
     };
     return &handler;
 }
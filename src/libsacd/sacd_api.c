@@ -0,0 +1,448 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#define _GNU_SOURCE     // fopencookie
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+
+#include <logging.h>
+#include <fileutils.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "scarletbook_output.h"
+#include "scarletbook_helpers.h"
+#include "sacd_reader.h"
+#include "sacd_api.h"
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define HAVE_SINK_STREAMS   1
+#endif
+
+struct sacd_disc_s
+{
+    sacd_reader_t          *reader;
+    scarletbook_handle_t   *handle;
+    scarletbook_output_t   *output;         // running extraction, NULL otherwise
+    pthread_mutex_t         lock;           // guards output
+};
+
+// one extraction: the sink and events of the caller
+typedef struct
+{
+    const sacd_sink_t      *sink;
+    sacd_events_t           events;
+    int                     sink_error;
+}
+extract_job_t;
+
+// an output file of the extraction, the cookie of its FILE
+typedef struct
+{
+    extract_job_t          *job;
+    void                   *stream;
+    uint64_t                position;
+    uint64_t                size;
+}
+sink_file_t;
+
+static pthread_once_t api_once = PTHREAD_ONCE_INIT;
+
+static void api_init(void)
+{
+    // the library logs through lm_main, without a log file
+    if (lm_main == NULL)
+        init_logging(0);
+}
+
+// the console messages of the output, the caller gets events instead
+static int quiet_fwprintf(FILE *stream, const wchar_t *format, ...)
+{
+    return 0;
+}
+
+int sacd_api_version(void)
+{
+    return SACD_API_VERSION;
+}
+
+sacd_disc_t *sacd_disc_open(const char *path)
+{
+    sacd_disc_t *disc;
+
+    pthread_once(&api_once, api_init);
+
+    disc = calloc(1, sizeof(sacd_disc_t));
+    if (!disc)
+        return NULL;
+
+    disc->reader = sacd_open(path);
+    if (disc->reader)
+        disc->handle = scarletbook_open(disc->reader);
+    if (!disc->handle)
+    {
+        LOG(lm_main, LOG_ERROR, ("sacd_disc_open: cannot open %s", path));
+        if (disc->reader)
+            sacd_close(disc->reader);
+        free(disc);
+        return NULL;
+    }
+    pthread_mutex_init(&disc->lock, NULL);
+    return disc;
+}
+
+void sacd_disc_close(sacd_disc_t *disc)
+{
+    if (!disc)
+        return;
+    scarletbook_close(disc->handle);
+    sacd_close(disc->reader);
+    pthread_mutex_destroy(&disc->lock);
+    free(disc);
+}
+
+int sacd_disc_area_count(sacd_disc_t *disc)
+{
+    return disc->handle->area_count;
+}
+
+int sacd_disc_area_info(sacd_disc_t *disc, int area, sacd_area_info_t *info)
+{
+    area_toc_t *area_toc;
+
+    if (area < 0 || area >= disc->handle->area_count)
+        return SACD_ERROR_ARGUMENT;
+
+    area_toc = disc->handle->area[area].area_toc;
+    memset(info, 0, sizeof(*info));
+    info->channel_count = area_toc->channel_count;
+    info->track_count = area_toc->track_count;
+    info->dst_encoded = area_toc->frame_format == FRAME_FORMAT_DST;
+    info->total_frames = TIME_FRAMECOUNT(&area_toc->total_playtime);
+    info->description = disc->handle->area[area].description;
+    return SACD_OK;
+}
+
+int sacd_disc_track_info(sacd_disc_t *disc, int area, int track, sacd_track_info_t *info)
+{
+    scarletbook_area_t *sb_area;
+
+    if (area < 0 || area >= disc->handle->area_count)
+        return SACD_ERROR_ARGUMENT;
+    sb_area = &disc->handle->area[area];
+    if (track < 0 || track >= sb_area->area_toc->track_count)
+        return SACD_ERROR_ARGUMENT;
+
+    memset(info, 0, sizeof(*info));
+    info->start_frame = TIME_FRAMECOUNT(&sb_area->area_tracklist_time->start[track]);
+    info->frame_count = TIME_FRAMECOUNT(&sb_area->area_tracklist_time->duration[track]);
+    info->title = sb_area->area_track_text[track].track_type_title;
+    info->performer = sb_area->area_track_text[track].track_type_performer;
+    return SACD_OK;
+}
+
+const char *sacd_disc_title(sacd_disc_t *disc)
+{
+    master_text_t *master_text = &disc->handle->master_text;
+
+    return master_text->album_title ? master_text->album_title : master_text->disc_title;
+}
+
+const char *sacd_disc_artist(sacd_disc_t *disc)
+{
+    master_text_t *master_text = &disc->handle->master_text;
+
+    return master_text->album_artist ? master_text->album_artist : master_text->disc_artist;
+}
+
+#ifdef HAVE_SINK_STREAMS
+static int sink_file_write(sink_file_t *file, const char *buffer, size_t length)
+{
+    if (file->job->sink->write(file->stream, (const uint8_t *) buffer, length) != 0)
+    {
+        file->job->sink_error = 1;
+        return -1;
+    }
+    file->position += length;
+    if (file->position > file->size)
+        file->size = file->position;
+    return 0;
+}
+
+static int sink_file_seek(sink_file_t *file, int64_t offset, int whence)
+{
+    uint64_t position;
+
+    if (!file->job->sink->seek)
+        return -1;
+
+    if (whence == SEEK_CUR)
+        offset += (int64_t) file->position;
+    else if (whence == SEEK_END)
+        offset += (int64_t) file->size;
+    if (offset < 0)
+        return -1;
+    position = (uint64_t) offset;
+    if (position != file->position && file->job->sink->seek(file->stream, position) != 0)
+    {
+        file->job->sink_error = 1;
+        return -1;
+    }
+    file->position = position;
+    return 0;
+}
+
+static int sink_file_close(sink_file_t *file)
+{
+    int result = file->job->sink->close(file->stream);
+
+    if (result != 0)
+        file->job->sink_error = 1;
+    free(file);
+    return result != 0 ? -1 : 0;
+}
+
+#if defined(__GLIBC__)
+static ssize_t cookie_write(void *cookie, const char *buffer, size_t length)
+{
+    return sink_file_write((sink_file_t *) cookie, buffer, length) == 0 ? (ssize_t) length : 0;
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+    sink_file_t *file = (sink_file_t *) cookie;
+
+    if (sink_file_seek(file, *offset, whence) != 0)
+        return -1;
+    *offset = (off64_t) file->position;
+    return 0;
+}
+
+static int cookie_close(void *cookie)
+{
+    return sink_file_close((sink_file_t *) cookie);
+}
+#else
+static int cookie_write(void *cookie, const char *buffer, int length)
+{
+    return sink_file_write((sink_file_t *) cookie, buffer, (size_t) length) == 0 ? length : -1;
+}
+
+static fpos_t cookie_seek(void *cookie, fpos_t offset, int whence)
+{
+    sink_file_t *file = (sink_file_t *) cookie;
+
+    if (sink_file_seek(file, (int64_t) offset, whence) != 0)
+        return -1;
+    return (fpos_t) file->position;
+}
+
+static int cookie_close(void *cookie)
+{
+    return sink_file_close((sink_file_t *) cookie);
+}
+#endif
+
+// scarletbook_handle_t.open_output: the output files are FILE streams on top of the sink
+static FILE *open_sink_file(void *userdata, const char *filename)
+{
+    extract_job_t *job = (extract_job_t *) userdata;
+    sink_file_t *file;
+    FILE *fd;
+
+    file = calloc(1, sizeof(sink_file_t));
+    if (!file)
+        return NULL;
+    file->job = job;
+    file->stream = job->sink->open(job->sink->userdata, filename);
+    if (!file->stream)
+    {
+        job->sink_error = 1;
+        free(file);
+        return NULL;
+    }
+
+#if defined(__GLIBC__)
+    {
+        cookie_io_functions_t functions = { NULL, cookie_write, cookie_seek, cookie_close };
+        fd = fopencookie(file, "wb", functions);
+    }
+#else
+    fd = funopen(file, NULL, cookie_write, cookie_seek, cookie_close);
+#endif
+    if (!fd)
+    {
+        job->sink->close(file->stream);
+        job->sink_error = 1;
+        free(file);
+    }
+    return fd;
+}
+#endif
+
+static void event_track(void *userdata, const char *filename, int current_track, int total_tracks)
+{
+    extract_job_t *job = (extract_job_t *) userdata;
+
+    if (job->events.track)
+        job->events.track(job->events.userdata, filename, current_track, total_tracks);
+}
+
+static void event_progress(void *userdata, uint32_t total_sectors, uint32_t total_sectors_processed,
+                           uint32_t file_sectors, uint32_t file_sectors_processed)
+{
+    extract_job_t *job = (extract_job_t *) userdata;
+
+    if (job->events.progress)
+        job->events.progress(job->events.userdata, total_sectors_processed, total_sectors);
+}
+
+static void event_error(void *userdata, const char *filename, int code, const char *message)
+{
+    extract_job_t *job = (extract_job_t *) userdata;
+
+    // SACD_EVENT_ERROR_* have the values of OUTPUT_ERROR_*
+    if (job->events.error)
+        job->events.error(job->events.userdata, filename, code, message);
+}
+
+// the name the sink is offered for a file
+static char *sink_filename(scarletbook_handle_t *handle, int area, int track, const char *extension)
+{
+    char *name, *filename;
+
+    if (track < 0)
+        name = get_album_dir(handle, 0);
+    else
+        name = get_music_filename(handle, area, track, "", 0);
+    filename = make_filename(NULL, NULL, name, extension);
+    free(name);
+    return filename;
+}
+
+int sacd_disc_extract(sacd_disc_t *disc, const sacd_extract_options_t *options,
+                      const sacd_sink_t *sink, const sacd_events_t *events)
+{
+#ifdef HAVE_SINK_STREAMS
+    scarletbook_handle_t *handle = disc->handle;
+    scarletbook_output_events_t output_events;
+    scarletbook_output_t *output;
+    extract_job_t job;
+    area_toc_t *area_toc = NULL;
+    char *filename;
+    int track, first_track = 0, last_track = 0, errors, dst_export;
+
+    if (!options || !sink || !sink->open || !sink->write || !sink->close)
+        return SACD_ERROR_ARGUMENT;
+
+    if (options->format != SACD_FORMAT_ISO)
+    {
+        if (options->area < 0 || options->area >= handle->area_count)
+            return SACD_ERROR_ARGUMENT;
+        area_toc = handle->area[options->area].area_toc;
+        first_track = options->track < 0 ? 0 : options->track;
+        last_track = options->track < 0 ? area_toc->track_count - 1 : options->track;
+        if (last_track >= area_toc->track_count)
+            return SACD_ERROR_ARGUMENT;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.sink = sink;
+    if (events)
+        job.events = *events;
+
+    handle->audio_frame_trimming = !options->pauses;
+    handle->pcm_sample_rate = options->pcm_sample_rate == 176400 ? 176400 : 88200;
+    handle->stream_output = sink->seek == NULL;
+    handle->dsf_nopad = 0;
+    handle->concatenate = 0;
+    handle->open_output = open_sink_file;
+    handle->open_output_userdata = &job;
+
+    output = scarletbook_output_create(handle, NULL, NULL, quiet_fwprintf);
+    output_events.track = event_track;
+    output_events.progress = event_progress;
+    output_events.error = event_error;
+    output_events.userdata = &job;
+    scarletbook_output_set_events(output, &output_events);
+
+    switch (options->format)
+    {
+    case SACD_FORMAT_ISO:
+        filename = sink_filename(handle, 0, -1, "iso");
+        scarletbook_output_enqueue_raw_sectors(output, 0, sacd_get_total_sectors(disc->reader), filename, "iso");
+        free(filename);
+        break;
+    case SACD_FORMAT_DSDIFF_EDIT_MASTER:
+        filename = sink_filename(handle, options->area, -1, "dff");
+        scarletbook_output_enqueue_track(output, options->area, 0, filename, "dsdiff_edit_master",
+                                         options->convert_dst || area_toc->frame_format != FRAME_FORMAT_DST);
+        free(filename);
+        break;
+    default:
+        dst_export = options->format == SACD_FORMAT_DSDIFF && !options->convert_dst && area_toc->frame_format == FRAME_FORMAT_DST;
+        for (track = first_track; track <= last_track; track++)
+        {
+            const char *extension = options->format == SACD_FORMAT_DSF ? "dsf" : options->format == SACD_FORMAT_WAV ? "wav" : "dff";
+            const char *fmt = options->format == SACD_FORMAT_DSF ? "dsf" : options->format == SACD_FORMAT_WAV ? "wav" : "dsdiff";
+
+            filename = sink_filename(handle, options->area, track, extension);
+            scarletbook_output_enqueue_track(output, options->area, track, filename, (char *) fmt, !dst_export);
+            free(filename);
+        }
+        break;
+    }
+
+    pthread_mutex_lock(&disc->lock);
+    disc->output = output;
+    pthread_mutex_unlock(&disc->lock);
+
+    scarletbook_output_start(output);
+    errors = scarletbook_output_wait(output);
+
+    pthread_mutex_lock(&disc->lock);
+    disc->output = NULL;
+    pthread_mutex_unlock(&disc->lock);
+
+    scarletbook_output_destroy(output);
+    handle->open_output = NULL;
+    handle->open_output_userdata = NULL;
+
+    if (job.sink_error)
+        return SACD_ERROR_SINK;
+    return errors > 0 ? SACD_ERROR_EXTRACT : SACD_OK;
+#else
+    return SACD_ERROR_UNSUPPORTED;
+#endif
+}
+
+void sacd_disc_interrupt(sacd_disc_t *disc)
+{
+    pthread_mutex_lock(&disc->lock);
+    if (disc->output)
+        scarletbook_output_interrupt(disc->output);
+    pthread_mutex_unlock(&disc->lock);
+}
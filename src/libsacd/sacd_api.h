@@ -0,0 +1,173 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SACD_API_H_INCLUDED
+#define SACD_API_H_INCLUDED
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * embedding API of libsacd: open a disc, image or server, enumerate its areas and tracks
+ * and extract them to caller supplied sinks. Only plain C types cross this interface, the
+ * scarletbook structures stay private, so the API keeps working when they change.
+ *
+ * Link with -lsacd -ldstdec -lsacdcommon (static) or -lsacd (shared).
+ */
+
+#define SACD_API_VERSION        1
+
+typedef struct sacd_disc_s sacd_disc_t;
+
+// results, negative on errors
+enum
+{
+    SACD_OK                 =  0,
+    SACD_ERROR_OPEN         = -1,       // the input could not be opened or is not an SACD
+    SACD_ERROR_ARGUMENT     = -2,       // no such area or track, unknown format
+    SACD_ERROR_SINK         = -3,       // the sink could not open, write or close a file
+    SACD_ERROR_EXTRACT      = -4,       // see the error events
+    SACD_ERROR_UNSUPPORTED  = -5        // sinks are not available on this platform
+};
+
+typedef enum
+{
+    SACD_FORMAT_DSF,
+    SACD_FORMAT_DSDIFF,
+    SACD_FORMAT_DSDIFF_EDIT_MASTER,     // one file for the whole area
+    SACD_FORMAT_WAV,                    // 24 bit PCM
+    SACD_FORMAT_ISO                     // the whole disc, area and track are ignored
+}
+sacd_format_t;
+
+typedef struct
+{
+    int             channel_count;
+    int             track_count;
+    int             dst_encoded;        // the audio is DST compressed
+    uint32_t        total_frames;       // play time, 75 frames per second
+    const char     *description;        // may be NULL
+}
+sacd_area_info_t;
+
+typedef struct
+{
+    uint32_t        start_frame;        // 75 frames per second, from the start of the area
+    uint32_t        frame_count;
+    const char     *title;              // may be NULL
+    const char     *performer;          // may be NULL
+}
+sacd_track_info_t;
+
+/**
+ * where the extracted files go. open() gets a suggested file name (no directory) and
+ * returns the stream the other callbacks get, NULL on errors. write() and close() return 0
+ * on success. seek() may be NULL for forward only sinks (sockets, pipes): the headers are
+ * then calculated before the audio is written.
+ */
+typedef struct
+{
+    void           *(*open)(void *userdata, const char *name);
+    int             (*write)(void *stream, const uint8_t *buffer, size_t length);
+    int             (*seek)(void *stream, uint64_t offset);
+    int             (*close)(void *stream);
+    void           *userdata;
+}
+sacd_sink_t;
+
+/**
+ * progress and errors of an extraction, all callbacks may be NULL. They are called from
+ * the worker threads of the extraction, never from two threads at the same time for one
+ * extraction.
+ */
+typedef struct
+{
+    void            (*track)(void *userdata, const char *name, int current_file, int file_count);
+    void            (*progress)(void *userdata, uint32_t sectors_done, uint32_t sectors_total);
+    void            (*error)(void *userdata, const char *name, int code, const char *message);
+    void           *userdata;
+}
+sacd_events_t;
+
+// codes of the error event
+enum
+{
+    SACD_EVENT_ERROR_CREATE = 1,        // the sink did not open the file
+    SACD_EVENT_ERROR_WRITE,
+    SACD_EVENT_ERROR_READ,              // sectors could not be read
+    SACD_EVENT_ERROR_FRAMES,            // audio sectors with broken headers
+    SACD_EVENT_ERROR_DST,               // a DST frame could not be decoded
+    SACD_EVENT_ERROR_INTERRUPTED
+};
+
+typedef struct
+{
+    sacd_format_t   format;
+    int             area;               // index, see sacd_disc_area_count()
+    int             track;              // index, -1 for all tracks of the area
+    int             convert_dst;        // DSDIFF: decode DST to DSD (DSF and WAV are always decoded)
+    int             pauses;             // keep the pauses between the tracks
+    int             pcm_sample_rate;    // WAV: 88200 or 176400, 0 for 88200
+}
+sacd_extract_options_t;
+
+/**
+ * version of the library, compare with SACD_API_VERSION
+ */
+int sacd_api_version(void);
+
+/**
+ * opens an image file, a device or a server (host:port), NULL on errors
+ */
+sacd_disc_t *sacd_disc_open(const char *path);
+void sacd_disc_close(sacd_disc_t *disc);
+
+int sacd_disc_area_count(sacd_disc_t *disc);
+int sacd_disc_area_info(sacd_disc_t *disc, int area, sacd_area_info_t *info);
+int sacd_disc_track_info(sacd_disc_t *disc, int area, int track, sacd_track_info_t *info);
+
+/**
+ * album title and artist of the disc, NULL if not set
+ */
+const char *sacd_disc_title(sacd_disc_t *disc);
+const char *sacd_disc_artist(sacd_disc_t *disc);
+
+/**
+ * extracts to the sink, blocks until done. Several discs may be extracted at the same
+ * time from different threads, one extraction at a time per disc.
+ *   return SACD_OK or a SACD_ERROR_*
+ */
+int sacd_disc_extract(sacd_disc_t *disc, const sacd_extract_options_t *options,
+                      const sacd_sink_t *sink, const sacd_events_t *events);
+
+/**
+ * stops the running extraction of the disc, may be called from any thread
+ */
+void sacd_disc_interrupt(sacd_disc_t *disc);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SACD_API_H_INCLUDED */
@@ -59,6 +59,7 @@ char *       (*sacd_input_error)        (sacd_input_t);
 int          (*sacd_input_authenticate) (sacd_input_t);
 int          (*sacd_input_decrypt)      (sacd_input_t, uint8_t *, uint32_t);
 uint32_t     (*sacd_input_total_sectors)(sacd_input_t);
+int          (*sacd_input_fd)           (sacd_input_t);
 
 struct sacd_input_s
 {
@@ -329,6 +330,18 @@ static uint32_t sacd_dev_input_total_sectors(sacd_input_t dev)
 #endif
 }
 
+/**
+ * return the file descriptor of a local device or file
+ */
+static int sacd_dev_input_fd(sacd_input_t dev)
+{
+#if defined(__lv2ppu__)
+    return -1;
+#else
+    return dev ? dev->fd : -1;
+#endif
+}
+
 /**
  * initialize and open a SACD device or file.
  */
@@ -463,6 +476,11 @@ error:
     return 0;
 }
 
+static int sacd_net_input_fd(sacd_input_t dev)
+{
+    return -1;
+}
+
 static uint32_t sacd_net_input_total_sectors(sacd_input_t dev)
 {
     if (!dev)
@@ -611,6 +629,7 @@ int sacd_input_setup(const char* path)
         sacd_input_authenticate  = sacd_dev_input_authenticate;
         sacd_input_decrypt = sacd_dev_input_decrypt;
         sacd_input_total_sectors = sacd_net_input_total_sectors;
+        sacd_input_fd = sacd_net_input_fd;
 
         return 1;
     } 
@@ -622,6 +641,7 @@ int sacd_input_setup(const char* path)
     sacd_input_authenticate  = sacd_dev_input_authenticate;
     sacd_input_decrypt = sacd_dev_input_decrypt;
     sacd_input_total_sectors = sacd_dev_input_total_sectors;
+    sacd_input_fd = sacd_dev_input_fd;
 
     return 0;
 } 
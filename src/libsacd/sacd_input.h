@@ -68,6 +68,7 @@ extern char *       (*sacd_input_error)        (sacd_input_t);
 extern int          (*sacd_input_authenticate) (sacd_input_t);
 extern int          (*sacd_input_decrypt)      (sacd_input_t, uint8_t *, uint32_t);
 extern uint32_t     (*sacd_input_total_sectors)(sacd_input_t);
+extern int          (*sacd_input_fd)           (sacd_input_t);
 
 int sacd_input_setup(const char *); 
 
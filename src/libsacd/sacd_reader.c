@@ -436,3 +436,22 @@ uint32_t sacd_get_total_sectors(sacd_reader_t *sacd)
     return sacd_input_total_sectors(sacd->dev);
 }
 
+int sacd_get_image_fd(sacd_reader_t *sacd)
+{
+#if defined(__lv2ppu__)
+    return -1;
+#else
+    struct stat file_stat;
+    int fd;
+
+    if (!sacd->dev || !sacd->is_image_file)
+        return -1;
+
+    fd = sacd_input_fd(sacd->dev);
+    if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+        return -1;
+
+    return fd;
+#endif
+}
+
@@ -96,6 +96,11 @@ int sacd_authenticate(sacd_reader_t *);
  */
 uint32_t sacd_get_total_sectors(sacd_reader_t *);
 
+/**
+ * returns the file descriptor of a local image file, or -1 for discs, devices and network sources
+ */
+int sacd_get_image_fd(sacd_reader_t *);
+
 #ifdef __cplusplus
 };
 #endif
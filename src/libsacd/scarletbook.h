@@ -22,6 +22,7 @@
 #ifndef SCARLETBOOK_H_INCLUDED
 #define SCARLETBOOK_H_INCLUDED
 
+#include <stdio.h>
 #include <inttypes.h>
 #include <list.h>
 
@@ -546,6 +547,41 @@ typedef struct
 } 
 ATTRIBUTE_PACKED audio_sector_t;
 
+// where the audio frames of an area start, see scarletbook_index.h
+typedef struct scarletbook_time_index_s scarletbook_time_index_t;
+
+// per track fingerprint of the decoded DSD audio, see scarletbook_fingerprint.c
+typedef struct
+{
+    int                        valid;
+    uint64_t                   frame_count;
+    uint8_t                    sha256[32];
+}
+track_fingerprint_t;
+
+// per track loudness of the decoded DSD audio, see scarletbook_loudness.c
+typedef struct
+{
+    int                        valid;
+    double                     integrated;      // LUFS (ITU-R BS.1770), 1.0 is DSD full scale
+    double                     peak;            // sample peak, linear
+    double                   * blocks;          // mean square of every 400 ms block, for the album value
+    size_t                     block_count;
+}
+track_loudness_t;
+
+// silence (DSD idle patterns) at the edges of a track, see scarletbook_silence.c
+typedef struct
+{
+    int                        valid;
+    uint64_t                   length;          // bytes per channel written, 8 DSD samples each
+    uint64_t                   leading;         // bytes per channel before the first active byte of any channel
+    uint64_t                   trailing;        // bytes per channel after the last active byte of any channel
+    uint32_t                   trimmed_leading; // whole silent frames left out at the start
+    uint32_t                   trimmed_trailing;// and at the end
+}
+track_silence_t;
+
 typedef struct  
 {
     uint8_t                  * area_data;
@@ -560,6 +596,12 @@ typedef struct
     char                     * copyright;
     char                     * description_phonetic;
     char                     * copyright_phonetic;
+
+    track_fingerprint_t      * track_fingerprint;                         // allocated when the first track is fingerprinted
+    track_loudness_t         * track_loudness;                            // allocated when the first track is analysed
+    track_loudness_t           album_loudness;                            // over all analysed tracks of the area, blocks unused
+    track_silence_t          * track_silence;                             // allocated when the first track is scanned for silence
+    scarletbook_time_index_t * time_index;                                // NULL until built or loaded
 }
 scarletbook_area_t;
 
@@ -605,8 +647,26 @@ typedef struct
     int                        audio_frame_trimming;    // if No pauses included if 1.  Trimm out audioframes in trimecode interval [area_tracklist_time->start...+duration]
     uint32_t                   count_frames;                              // keep the number of audio frames in a track (for verification)
     int                        dsf_nopad;
+    uint8_t                   *dsf_carry;     // dsf_nopad: the last, partly filled block of each channel of a track, for the next track
+    size_t                     dsf_carry_size[MAX_CHANNEL_COUNT];
+    int                        dsf_carry_track; // track the carried samples belong to, -1 if none
     int                        concatenate;
     int                        id3_tag_mode;  // 0=no id3 inserted; 1=default id3 v2.3; 2=miminal id3v2.3 tag; 4=id3v2.4;5=id3v2.4 minimal
+    int                        stream_output; // if 1 write DSF/DSDIFF in one forward pass (final header first, no seeking back)
+    int                        stdout_fd;     // descriptor used for the output file named "-"
+    FILE                    *(*open_output)(void *userdata, const char *filename); // opens the output files instead of fopen() if set (library API)
+    void                      *open_output_userdata;
+    int                        iso_sparse;    // if 1 all-zero sectors of an ISO image are left as holes
+    int                        hash_output;   // if 1 CRC32C and SHA-256 of every output payload are computed while writing
+    int                        fingerprint;   // if 1 a container independent fingerprint of each extracted track is computed
+    int                        verify_dst;    // if 1 DST frames that are not decoded for the output are still run through the decoder to check them
+    int                        encode_dst;    // if 1 DSD areas are written to DSDIFF as DST encoded frames
+    int                        pcm_sample_rate; // sample rate of the wav output, 88200 or 176400
+    int                        loudness;      // if 1 the peak and loudness of each extracted track are measured for ReplayGain tags
+    int                        silence_report;// if 1 the silence at the edges of each extracted track is reported
+    int                        trim_silence;  // if 1 whole silent frames at the edges of each extracted track are left out
+    uint32_t                   clip_start;    // time range of each track to extract, in frames from the track start;
+    uint32_t                   clip_end;      //   clip_end 0 means the whole track
 } 
 scarletbook_handle_t;
 
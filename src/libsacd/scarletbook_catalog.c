@@ -0,0 +1,527 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(WIN32) || defined(_WIN32)
+#include <windows.h>
+#ifndef S_ISDIR
+#define S_ISDIR(m)  (((m) & _S_IFMT) == _S_IFDIR)
+#endif
+#else
+#include <dirent.h>
+#endif
+
+#include <logging.h>
+#include <yarn.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "scarletbook_helpers.h"
+#include "scarletbook_catalog.h"
+#include "sacd_reader.h"
+
+// entries of album_genre[] and album_category[]
+#define CATALOG_GENRE_COUNT     30
+#define CATALOG_CATEGORY_COUNT  3
+
+typedef struct
+{
+    char   *data;
+    size_t  length;
+    size_t  alloc;
+    int     error;
+}
+json_buffer_t;
+
+static void json_append(json_buffer_t *json, const char *str, size_t length)
+{
+    if (json->error)
+        return;
+    if (json->length + length + 1 > json->alloc)
+    {
+        size_t alloc = json->alloc ? json->alloc : 4096;
+        char *data;
+
+        while (json->length + length + 1 > alloc)
+            alloc *= 2;
+        data = (char *) realloc(json->data, alloc);
+        if (!data)
+        {
+            json->error = 1;
+            return;
+        }
+        json->data = data;
+        json->alloc = alloc;
+    }
+    memcpy(json->data + json->length, str, length);
+    json->length += length;
+    json->data[json->length] = '\0';
+}
+
+static void json_printf(json_buffer_t *json, const char *fmt, ...)
+{
+    char line[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        json_append(json, line, (size_t) n < sizeof(line) ? (size_t) n : sizeof(line) - 1);
+}
+
+// a JSON string (the disc texts are UTF-8 already), or null
+static void json_string(json_buffer_t *json, const char *str, size_t max_length)
+{
+    size_t i;
+
+    if (!str)
+    {
+        json_append(json, "null", 4);
+        return;
+    }
+    json_append(json, "\"", 1);
+    for (i = 0; i < max_length && str[i] != '\0'; i++)
+    {
+        unsigned char c = (unsigned char) str[i];
+
+        if (c == '"' || c == '\\')
+        {
+            char escaped[2] = { '\\', (char) c };
+            json_append(json, escaped, 2);
+        }
+        else if (c < 0x20)
+            json_printf(json, "\\u%04x", c);
+        else
+            json_append(json, (const char *) &c, 1);
+    }
+    json_append(json, "\"", 1);
+}
+
+static void json_member(json_buffer_t *json, const char *name, const char *str)
+{
+    json_printf(json, ",\"%s\":", name);
+    json_string(json, str, SIZE_MAX);
+}
+
+static void json_genres(json_buffer_t *json, const char *name, genre_table_t *genres)
+{
+    int i, first = 1;
+
+    json_printf(json, ",\"%s\":[", name);
+    for (i = 0; i < 4; i++)
+    {
+        genre_table_t *t = &genres[i];
+
+        if (!t->category)
+            continue;
+        json_append(json, first ? "{\"category\":" : ",{\"category\":", first ? 12 : 13);
+        json_string(json, t->category < CATALOG_CATEGORY_COUNT ? album_category[t->category] : "Unknown", SIZE_MAX);
+        json_append(json, ",\"genre\":", 9);
+        json_string(json, t->genre < CATALOG_GENRE_COUNT ? album_genre[t->genre] : "Unknown", SIZE_MAX);
+        json_append(json, "}", 1);
+        first = 0;
+    }
+    json_append(json, "]", 1);
+}
+
+static void json_time(json_buffer_t *json, const char *name, area_tracklist_time_t *time)
+{
+    json_printf(json, ",\"%s\":\"%02d:%02d:%02d\",\"%s_frames\":%u", name, time->minutes, time->seconds, time->frames,
+                name, TIME_FRAMECOUNT(time));
+}
+
+static void json_area(json_buffer_t *json, scarletbook_handle_t *handle, int area_idx)
+{
+    scarletbook_area_t *area = &handle->area[area_idx];
+    area_toc_t *area_toc = area->area_toc;
+    int i;
+
+    json_printf(json, "{\"channels\":%d", area_toc->channel_count);
+    json_member(json, "speaker_config", get_speaker_config_string(area_toc));
+    json_member(json, "frame_format", get_frame_format_string(area_toc));
+    json_printf(json, ",\"version\":\"%d.%02d\",\"track_count\":%d", area_toc->version.major, area_toc->version.minor, area_toc->track_count);
+    json_printf(json, ",\"total_playtime\":\"%02d:%02d:%02d\",\"total_playtime_frames\":%u", area_toc->total_playtime.minutes,
+                area_toc->total_playtime.seconds, area_toc->total_playtime.frames, TIME_FRAMECOUNT(&area_toc->total_playtime));
+    json_printf(json, ",\"track_start\":%u,\"track_end\":%u,\"size\":%" PRIu64, area_toc->track_start, area_toc->track_end,
+                (uint64_t) (area_toc->track_end + 1 - area_toc->track_start) * SACD_LSN_SIZE);
+    json_member(json, "copyright", area->copyright);
+    json_member(json, "description", area->description);
+
+    json_append(json, ",\"tracks\":[", 11);
+    for (i = 0; i < area_toc->track_count; i++)
+    {
+        area_track_text_t *track_text = &area->area_track_text[i];
+        isrc_t *isrc = &area->area_isrc_genre->isrc[i];
+        genre_table_t *genre = &area->area_isrc_genre->track_genre[i];
+
+        json_printf(json, "%s{\"number\":%d", i > 0 ? "," : "", i + 1);
+        json_member(json, "title", track_text->track_type_title);
+        json_member(json, "performer", track_text->track_type_performer);
+        json_member(json, "songwriter", track_text->track_type_songwriter);
+        json_member(json, "composer", track_text->track_type_composer);
+        json_member(json, "arranger", track_text->track_type_arranger);
+        json_member(json, "message", track_text->track_type_message);
+        if (genre->category)
+        {
+            json_append(json, ",\"genre\":", 9);
+            json_string(json, genre->genre < CATALOG_GENRE_COUNT ? album_genre[genre->genre] : "Unknown", SIZE_MAX);
+        }
+        if (*isrc->country_code)
+        {
+            json_append(json, ",\"isrc\":", 8);
+            json_string(json, isrc->country_code, sizeof(isrc_t));
+        }
+        json_time(json, "start", &area->area_tracklist_time->start[i]);
+        json_time(json, "duration", &area->area_tracklist_time->duration[i]);
+        json_append(json, "}", 1);
+    }
+    json_append(json, "]}", 2);
+}
+
+char *scarletbook_catalog_json(scarletbook_handle_t *handle, const char *path)
+{
+    master_toc_t *mtoc = handle->master_toc;
+    master_text_t *master_text = &handle->master_text;
+    json_buffer_t json;
+    int area_idx, first = 1;
+
+    memset(&json, 0, sizeof(json));
+    json_append(&json, "{\"file\":", 8);
+    json_string(&json, path, SIZE_MAX);
+    json_printf(&json, ",\"sectors\":%u", sacd_get_total_sectors((sacd_reader_t *) handle->sacd));
+    json_printf(&json, ",\"version\":\"%d.%02d\",\"date\":\"%04d-%02d-%02d\"", mtoc->version.major, mtoc->version.minor,
+                mtoc->disc_date_year, mtoc->disc_date_month, mtoc->disc_date_day);
+    json_append(&json, ",\"disc_catalog_number\":", 23);
+    json_string(&json, mtoc->disc_catalog_number, 16);
+    json_append(&json, ",\"album_catalog_number\":", 24);
+    json_string(&json, mtoc->album_catalog_number, 16);
+    json_printf(&json, ",\"album_sequence_number\":%d,\"album_set_size\":%d", mtoc->album_sequence_number, mtoc->album_set_size);
+    json_genres(&json, "disc_genres", mtoc->disc_genre);
+    json_genres(&json, "album_genres", mtoc->album_genre);
+
+    json_member(&json, "disc_title", master_text->disc_title);
+    json_member(&json, "disc_artist", master_text->disc_artist);
+    json_member(&json, "disc_publisher", master_text->disc_publisher);
+    json_member(&json, "disc_copyright", master_text->disc_copyright);
+    json_member(&json, "album_title", master_text->album_title);
+    json_member(&json, "album_artist", master_text->album_artist);
+    json_member(&json, "album_publisher", master_text->album_publisher);
+    json_member(&json, "album_copyright", master_text->album_copyright);
+
+    json_append(&json, ",\"areas\":[", 10);
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        if (!handle->area[area_idx].area_toc)
+            continue;
+        if (!first)
+            json_append(&json, ",", 1);
+        json_area(&json, handle, area_idx);
+        first = 0;
+    }
+    json_append(&json, "]}", 2);
+
+    if (json.error)
+    {
+        free(json.data);
+        return NULL;
+    }
+    return json.data;
+}
+
+static int has_iso_extension(const char *path)
+{
+    size_t length = strlen(path);
+
+    return length > 4 && path[length - 4] == '.' &&
+           (path[length - 3] | 0x20) == 'i' && (path[length - 2] | 0x20) == 's' && (path[length - 1] | 0x20) == 'o';
+}
+
+static int add_path(char ***paths, int *count, int *alloc, const char *path)
+{
+    if (*count == *alloc)
+    {
+        int new_alloc = *alloc ? *alloc * 2 : 256;
+        char **new_paths = (char **) realloc(*paths, new_alloc * sizeof(char *));
+        if (!new_paths)
+            return -1;
+        *paths = new_paths;
+        *alloc = new_alloc;
+    }
+    (*paths)[*count] = strdup(path);
+    if (!(*paths)[*count])
+        return -1;
+    (*count)++;
+    return 0;
+}
+
+#if defined(WIN32) || defined(_WIN32)
+static int collect_directory(const char *dir_path, char ***paths, int *count, int *alloc)
+{
+    WIN32_FIND_DATAA entry;
+    HANDLE find;
+    char *pattern;
+    int result = 0;
+
+    pattern = (char *) malloc(strlen(dir_path) + 3);
+    if (!pattern)
+        return -1;
+    sprintf(pattern, "%s\\*", dir_path);
+    find = FindFirstFileA(pattern, &entry);
+    free(pattern);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        LOG(lm_main, LOG_ERROR, ("catalog: cannot open directory %s", dir_path));
+        return 0;
+    }
+    do
+    {
+        char *path;
+
+        if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0)
+            continue;
+        path = (char *) malloc(strlen(dir_path) + strlen(entry.cFileName) + 2);
+        if (!path)
+        {
+            result = -1;
+            break;
+        }
+        sprintf(path, "%s\\%s", dir_path, entry.cFileName);
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            result = collect_directory(path, paths, count, alloc);
+        else if (has_iso_extension(path))
+            result = add_path(paths, count, alloc, path);
+        free(path);
+    }
+    while (result == 0 && FindNextFileA(find, &entry));
+    FindClose(find);
+    return result;
+}
+#else
+static int collect_directory(const char *dir_path, char ***paths, int *count, int *alloc)
+{
+    DIR *dir;
+    struct dirent *entry;
+    int result = 0;
+
+    dir = opendir(dir_path);
+    if (!dir)
+    {
+        LOG(lm_main, LOG_ERROR, ("catalog: cannot open directory %s", dir_path));
+        return 0;
+    }
+    while (result == 0 && (entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        char *path;
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        path = (char *) malloc(strlen(dir_path) + strlen(entry->d_name) + 2);
+        if (!path)
+        {
+            result = -1;
+            break;
+        }
+        sprintf(path, "%s/%s", dir_path, entry->d_name);
+        if (stat(path, &st) == 0)
+        {
+            if (S_ISDIR(st.st_mode))
+                result = collect_directory(path, paths, count, alloc);
+            else if (S_ISREG(st.st_mode) && has_iso_extension(path))
+                result = add_path(paths, count, alloc, path);
+        }
+        free(path);
+    }
+    closedir(dir);
+    return result;
+}
+#endif
+
+int scarletbook_catalog_collect(const char *path, char ***paths)
+{
+    struct stat st;
+    int count = 0, alloc = 0, result = 0;
+
+    *paths = NULL;
+    if (stat(path, &st) != 0)
+        return -1;
+
+    if (S_ISDIR(st.st_mode))
+    {
+        result = collect_directory(path, paths, &count, &alloc);
+    }
+    else if (has_iso_extension(path))
+    {
+        result = add_path(paths, &count, &alloc, path);
+    }
+    else
+    {
+        char line[4096];
+        FILE *fd = fopen(path, "r");
+
+        if (!fd)
+            return -1;
+        while (result == 0 && fgets(line, sizeof(line), fd))
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0' || line[0] == '#')
+                continue;
+            result = add_path(paths, &count, &alloc, line);
+        }
+        fclose(fd);
+    }
+
+    if (result != 0)
+    {
+        scarletbook_catalog_free(*paths, count);
+        *paths = NULL;
+        return -1;
+    }
+    return count;
+}
+
+void scarletbook_catalog_free(char **paths, int path_count)
+{
+    int i;
+
+    for (i = 0; i < path_count; i++)
+        free(paths[i]);
+    free(paths);
+}
+
+typedef struct
+{
+    char          **paths;
+    int             path_count;
+    int             next;               // next path to take, under lock
+    int             failed;
+    lock           *lock;
+    lock           *output_lock;
+    FILE           *out;
+}
+catalog_t;
+
+static char *catalog_disc(const char *path)
+{
+    sacd_reader_t *sacd_reader;
+    scarletbook_handle_t *handle;
+    char *line = NULL;
+
+    sacd_reader = sacd_open(path);
+    if (!sacd_reader)
+        return NULL;
+    handle = scarletbook_open(sacd_reader);
+    if (handle)
+    {
+        line = scarletbook_catalog_json(handle, path);
+        scarletbook_close(handle);
+    }
+    sacd_close(sacd_reader);
+    return line;
+}
+
+static void catalog_thread(void *arg)
+{
+    catalog_t *catalog = (catalog_t *) arg;
+
+    for (;;)
+    {
+        const char *path;
+        char *line;
+
+        possess(catalog->lock);
+        if (catalog->next == catalog->path_count)
+        {
+            release(catalog->lock);
+            break;
+        }
+        path = catalog->paths[catalog->next++];
+        release(catalog->lock);
+
+        line = catalog_disc(path);
+
+        possess(catalog->output_lock);
+        if (line)
+        {
+            fputs(line, catalog->out);
+        }
+        else
+        {
+            json_buffer_t json;
+
+            memset(&json, 0, sizeof(json));
+            json_append(&json, "{\"file\":", 8);
+            json_string(&json, path, SIZE_MAX);
+            json_append(&json, ",\"error\":\"cannot read the disc TOC\"}", 36);
+            if (json.data)
+                fputs(json.data, catalog->out);
+            free(json.data);
+            catalog->failed++;
+            LOG(lm_main, LOG_ERROR, ("catalog: cannot read %s", path));
+        }
+        fputc('\n', catalog->out);
+        release(catalog->output_lock);
+        free(line);
+    }
+}
+
+int scarletbook_catalog_run(char **paths, int path_count, int thread_count, FILE *out)
+{
+    catalog_t catalog;
+    thread **threads;
+    int i;
+
+    if (thread_count > path_count)
+        thread_count = path_count;
+    if (thread_count < 1)
+        return 0;
+
+    threads = (thread **) calloc(thread_count, sizeof(thread *));
+    if (!threads)
+        return path_count;
+
+    catalog.paths = paths;
+    catalog.path_count = path_count;
+    catalog.next = 0;
+    catalog.failed = 0;
+    catalog.lock = new_lock(0);
+    catalog.output_lock = new_lock(0);
+    catalog.out = out;
+
+    for (i = 0; i < thread_count; i++)
+        threads[i] = launch(catalog_thread, &catalog);
+    for (i = 0; i < thread_count; i++)
+        join(threads[i]);
+    fflush(out);
+
+    free_lock(catalog.lock);
+    free_lock(catalog.output_lock);
+    free(threads);
+    return catalog.failed;
+}
@@ -0,0 +1,62 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_CATALOG_H_INCLUDED
+#define SCARLETBOOK_CATALOG_H_INCLUDED
+
+#include <stdio.h>
+
+#include "scarletbook.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * catalog of many images: only the master TOC and the area TOCs of each image are read
+ * (scarletbook_open) and every disc becomes one JSON line
+ */
+
+/**
+ * the JSON line (without newline) of an opened disc, to be freed by the caller
+ */
+char *scarletbook_catalog_json(scarletbook_handle_t *handle, const char *path);
+
+/**
+ * collects the images to catalog: all *.iso files below a directory, the file itself for
+ * an .iso file, otherwise a text file with one path per line
+ *   return the number of paths, -1 on error
+ */
+int scarletbook_catalog_collect(const char *path, char ***paths);
+
+/**
+ * catalogs the images with up to thread_count threads, the lines are written to out in
+ * the order the discs are done
+ *   return the number of images that could not be read
+ */
+int scarletbook_catalog_run(char **paths, int path_count, int thread_count, FILE *out);
+
+void scarletbook_catalog_free(char **paths, int path_count);
+
+#ifdef __cplusplus
+};
+#endif
+#endif /* SCARLETBOOK_CATALOG_H_INCLUDED */
@@ -0,0 +1,169 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <logging.h>
+#include <sha256.h>
+
+#include "scarletbook.h"
+#include "scarletbook_output.h"
+#include "scarletbook_stage.h"
+
+// The fingerprint of a track is the SHA-256 of its DSD audio in the canonical order of
+// the disc: channel interleaved, MSB first, frame after frame. Decoded frames that reach
+// the writer in another layout are converted back first, so DSF, DSDIFF and DSDIFF
+// converted from DST all give the same fingerprint for the same audio. Container
+// headers, DSF block padding and tags never enter it.
+
+typedef struct
+{
+    sha256_ctx_t sha256;
+    uint64_t     frame_count;
+    int          channel_count;
+    int          planar_lsb;
+    size_t       frame_size;
+    size_t       frame_used;
+    uint8_t     *frame;
+    uint8_t     *canonical;
+}
+fingerprint_stage_t;
+
+static uint8_t bit_reverse[256];
+
+static void *fingerprint_start(scarletbook_output_format_t *ft)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    scarletbook_area_t *area = &handle->area[ft->area];
+    fingerprint_stage_t *fp;
+    int i;
+
+    // only decoded DSD of a single track can be fingerprinted
+    if (!handle->fingerprint || !ft->dsd_encoded_export || (ft->handler.flags & (OUTPUT_FLAG_RAW | OUTPUT_FLAG_EDIT_MASTER)) || handle->concatenate)
+        return NULL;
+
+    if (!area->track_fingerprint)
+        area->track_fingerprint = (track_fingerprint_t *) calloc(area->area_toc->track_count, sizeof(track_fingerprint_t));
+    if (!area->track_fingerprint)
+        return NULL;
+
+    for (i = 0; i < 256; i++)
+    {
+        int b;
+        uint8_t r = 0;
+        for (b = 0; b < 8; b++)
+            r |= ((i >> b) & 1) << (7 - b);
+        bit_reverse[i] = r;
+    }
+
+    fp = (fingerprint_stage_t *) calloc(1, sizeof(fingerprint_stage_t));
+    if (!fp)
+        return NULL;
+    fp->channel_count = area->area_toc->channel_count;
+    fp->planar_lsb = ft->dsd_planar_lsb;
+    fp->frame_size = FRAME_SIZE_64 * fp->channel_count;
+    fp->frame = (uint8_t *) malloc(fp->frame_size);
+    fp->canonical = (uint8_t *) malloc(fp->frame_size);
+    sha256_init(&fp->sha256);
+    return fp;
+}
+
+static void fingerprint_frame(fingerprint_stage_t *fp)
+{
+    if (fp->planar_lsb)
+    {
+        int ch;
+        size_t i;
+        for (ch = 0; ch < fp->channel_count; ch++)
+        {
+            const uint8_t *plane = fp->frame + ch * FRAME_SIZE_64;
+            uint8_t *out = fp->canonical + ch;
+            for (i = 0; i < FRAME_SIZE_64; i++)
+                out[i * fp->channel_count] = bit_reverse[plane[i]];
+        }
+        sha256_update(&fp->sha256, fp->canonical, fp->frame_size);
+    }
+    else
+    {
+        sha256_update(&fp->sha256, fp->frame, fp->frame_size);
+    }
+    fp->frame_count++;
+}
+
+static void fingerprint_process(void *priv, const uint8_t *buf, size_t len)
+{
+    fingerprint_stage_t *fp = (fingerprint_stage_t *) priv;
+
+    // the stage hands over arbitrary slices of the frame stream, collect whole frames
+    while (len > 0)
+    {
+        size_t n = fp->frame_size - fp->frame_used;
+        if (n > len)
+            n = len;
+        memcpy(fp->frame + fp->frame_used, buf, n);
+        fp->frame_used += n;
+        buf += n;
+        len -= n;
+        if (fp->frame_used == fp->frame_size)
+        {
+            fingerprint_frame(fp);
+            fp->frame_used = 0;
+        }
+    }
+}
+
+static void fingerprint_stop(void *priv, scarletbook_output_format_t *ft)
+{
+    fingerprint_stage_t *fp = (fingerprint_stage_t *) priv;
+    track_fingerprint_t *track_fingerprint = &ft->sb_handle->area[ft->area].track_fingerprint[ft->track];
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+    int i;
+
+    if (fp->frame_used != 0)
+        LOG(lm_main, LOG_ERROR, ("fingerprint: %s ends with a partial frame of %u bytes, not included", ft->filename, (unsigned int) fp->frame_used));
+
+    sha256_final(&fp->sha256, track_fingerprint->sha256);
+    track_fingerprint->frame_count = fp->frame_count;
+    track_fingerprint->valid = 1;
+
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        sprintf(hex + i * 2, "%02x", track_fingerprint->sha256[i]);
+    LOG(lm_main, LOG_NOTICE, ("fingerprint: area %d, track %d, frames: %" PRIu64 ", sha256: %s", ft->area, ft->track + 1, fp->frame_count, hex));
+
+    free(fp->frame);
+    free(fp->canonical);
+    free(fp);
+}
+
+scarletbook_stage_handler_t const * fingerprint_stage_fn(void)
+{
+    static scarletbook_stage_handler_t handler = 
+    {
+        "fingerprint",
+        fingerprint_start,
+        fingerprint_process,
+        fingerprint_stop
+    };
+    return &handler;
+}
@@ -0,0 +1,135 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <wchar.h>
+
+#include <logging.h>
+#include <crc32c.h>
+#include <sha256.h>
+
+#include "scarletbook_output.h"
+#include "scarletbook_stage.h"
+#include "version.h"
+
+// Digests of the sound data as the format handler stored it in the file, fed through
+// scarletbook_output_written(): the whole image of an ISO, the audio chunk of a track
+// including its padding. Headers and tags are not included, so a track keeps its digests
+// when it is re-tagged, and they can be recomputed from the file at the recorded offset.
+
+typedef struct
+{
+    uint32_t     crc32c;
+    sha256_ctx_t sha256;
+    uint64_t     length;
+}
+hash_stage_t;
+
+static const char *payload_description(scarletbook_output_format_t *ft)
+{
+    if (ft->handler.flags & OUTPUT_FLAG_RAW)
+        return "iso image";
+    if (!(ft->handler.flags & OUTPUT_FLAG_DST))
+        return "data chunk contents";
+    if (ft->dsd_encoded_export)
+        return "DSD chunk contents";
+    return "DSTF chunks of the DST chunk";
+}
+
+static void *hash_start(scarletbook_output_format_t *ft)
+{
+    hash_stage_t *hash;
+
+    if (!ft->sb_handle->hash_output)
+        return NULL;
+
+    hash = (hash_stage_t *) calloc(1, sizeof(hash_stage_t));
+    if (hash)
+        sha256_init(&hash->sha256);
+    return hash;
+}
+
+static void hash_process(void *priv, const uint8_t *buf, size_t len)
+{
+    hash_stage_t *hash = (hash_stage_t *) priv;
+
+    hash->crc32c = crc32c_update(hash->crc32c, buf, len);
+    sha256_update(&hash->sha256, buf, len);
+    hash->length += len;
+}
+
+static void hash_stop(void *priv, scarletbook_output_format_t *ft)
+{
+    hash_stage_t *hash = (hash_stage_t *) priv;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char sha256_hex[SHA256_DIGEST_SIZE * 2 + 1];
+    wchar_t wide_sha256_hex[SHA256_DIGEST_SIZE * 2 + 1];
+    const char *basename;
+    FILE *fd;
+    int i;
+
+    sha256_final(&hash->sha256, digest);
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        sprintf(sha256_hex + i * 2, "%02x", digest[i]);
+    for (i = 0; i <= SHA256_DIGEST_SIZE * 2; i++)
+        wide_sha256_hex[i] = (wchar_t) sha256_hex[i];
+
+    basename = strrchr(ft->filename, '/');
+#if defined(WIN32) || defined(_WIN32)
+    if (strrchr(ft->filename, '\\') > basename)
+        basename = strrchr(ft->filename, '\\');
+#endif
+    basename = basename ? basename + 1 : ft->filename;
+
+    LOG(lm_main, LOG_NOTICE, ("hash: %s, payload: %s, offset: %" PRIu64 ", bytes: %" PRIu64 ", crc32c: %08x, sha256: %s", 
+        ft->filename, payload_description(ft), ft->sound_data_offset, hash->length, hash->crc32c, sha256_hex));
+    ft->cb_fwprintf(stdout, L"\n crc32c: %08x  sha256: %ls\n", hash->crc32c, wide_sha256_hex);
+
+    fd = scarletbook_stage_open_sidecar(ft, "hash");
+    if (fd)
+    {
+        fprintf(fd, "# sacd_extract %s, digests of the file bytes [offset, offset + bytes) (headers and tags excluded)\n", SACD_RIPPER_VERSION_STRING);
+        fprintf(fd, "file: %s\n", basename);
+        fprintf(fd, "payload: %s\n", payload_description(ft));
+        fprintf(fd, "offset: %" PRIu64 "\n", ft->sound_data_offset);
+        fprintf(fd, "bytes: %" PRIu64 "\n", hash->length);
+        fprintf(fd, "crc32c: %08x\n", hash->crc32c);
+        fprintf(fd, "sha256: %s\n", sha256_hex);
+        fclose(fd);
+    }
+
+    free(hash);
+}
+
+scarletbook_stage_handler_t const * hash_stage_fn(void)
+{
+    static scarletbook_stage_handler_t handler = 
+    {
+        "hash",
+        hash_start,
+        hash_process,
+        hash_stop
+    };
+    return &handler;
+}
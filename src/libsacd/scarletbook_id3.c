@@ -264,6 +264,20 @@ int scarletbook_id3_tag_render(scarletbook_handle_t *handle, uint8_t *buffer, in
     frame = id3_add_frame(tag, ID3_TRCK);
     id3_set_text_wraper(frame, tmp, handle->id3_tag_mode);
 
+    // ReplayGain 2.0, the album values are only complete after the last track was written
+    if (handle->area[area].track_loudness && handle->area[area].track_loudness[track].valid)
+    {
+        track_loudness_t *track_loudness = &handle->area[area].track_loudness[track];
+
+        snprintf(tmp, 200, "%.2f dB", -18.0 - track_loudness->integrated);
+        frame = id3_add_frame(tag, ID3_TXXX);
+        id3_set_text_txxx(frame, "REPLAYGAIN_TRACK_GAIN", tmp);
+
+        snprintf(tmp, 200, "%.6f", track_loudness->peak);
+        frame = id3_add_frame(tag, ID3_TXXX);
+        id3_set_text_txxx(frame, "REPLAYGAIN_TRACK_PEAK", tmp);
+    }
+
     len = id3_write_tag(tag, buffer);
     id3_close(tag);
 
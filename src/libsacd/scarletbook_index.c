@@ -0,0 +1,319 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <logging.h>
+#include <crc32c.h>
+
+#include "scarletbook.h"
+#include "scarletbook_index.h"
+#include "sacd_reader.h"
+#include "utils.h"
+
+#define TIME_INDEX_MAGIC        "SACDTIDX"
+#define TIME_INDEX_VERSION      2
+#define TIME_INDEX_HEADER_SIZE  32
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+// The index lives under the name of the image, which says little about which disc it is:
+// it carries the size of the image and a checksum of the master and area TOCs. Images
+// that differ only in their audio (sacd_gen with another seed) share the TOCs, so the
+// first and last audio sector of each area go into the checksum as well.
+static uint32_t index_disc_checksum(scarletbook_handle_t *handle)
+{
+    uint32_t crc = crc32c_update(0, handle->master_data, MASTER_TOC_LEN * SACD_LSN_SIZE);
+    uint8_t sector[SACD_LSN_SIZE];
+    int area_idx;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        area_toc_t *area_toc = handle->area[area_idx].area_toc;
+        size_t sectors = area_idx == handle->twoch_area_idx ? handle->master_toc->area_1_toc_size : handle->master_toc->area_2_toc_size;
+
+        crc = crc32c_update(crc, handle->area[area_idx].area_data, sectors * SACD_LSN_SIZE);
+        if (sacd_read_block_raw(handle->sacd, area_toc->track_start, 1, sector) == 1)
+            crc = crc32c_update(crc, sector, SACD_LSN_SIZE);
+        if (sacd_read_block_raw(handle->sacd, area_toc->track_end, 1, sector) == 1)
+            crc = crc32c_update(crc, sector, SACD_LSN_SIZE);
+    }
+    return crc;
+}
+
+static int index_append(scarletbook_time_index_t *index, uint32_t timecode, uint32_t lsn, int packet)
+{
+    if (index->count == index->alloc)
+    {
+        uint32_t alloc = index->alloc ? index->alloc * 2 : 65536;
+        time_index_entry_t *entries = (time_index_entry_t *) realloc(index->entries, alloc * sizeof(time_index_entry_t));
+        if (!entries)
+            return -1;
+        index->entries = entries;
+        index->alloc = alloc;
+    }
+    index->entries[index->count].timecode = timecode;
+    index->entries[index->count].position = lsn << 3 | (uint32_t) packet;
+    index->count++;
+    return 0;
+}
+
+static void index_frame_callback(scarletbook_handle_t *handle, const scarletbook_frame_scan_t *frame, void *userdata)
+{
+    (void) handle;
+    index_append((scarletbook_time_index_t *) userdata, frame->timecode, frame->lsn, frame->packet);
+}
+
+void scarletbook_index_free(scarletbook_time_index_t *index)
+{
+    if (!index)
+        return;
+    free(index->entries);
+    free(index);
+}
+
+void scarletbook_index_begin(scarletbook_handle_t *handle)
+{
+    int area_idx;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_area_t *area = &handle->area[area_idx];
+
+        scarletbook_index_free(area->time_index);
+        area->time_index = (scarletbook_time_index_t *) calloc(1, sizeof(scarletbook_time_index_t));
+        if (!area->time_index)
+            continue;
+        area->time_index->track_start = area->area_toc->track_start;
+        area->time_index->track_end = area->area_toc->track_end;
+        area->time_index->next_lsn = area->area_toc->track_start;
+    }
+}
+
+void scarletbook_index_add_sectors(scarletbook_handle_t *handle, uint32_t lsn, const uint8_t *buffer, uint32_t count)
+{
+    int area_idx;
+    uint32_t first, blocks;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_time_index_t *index = handle->area[area_idx].time_index;
+
+        // sectors must arrive in order, a gap leaves the index incomplete
+        if (!index || index->complete)
+            continue;
+        if (index->next_lsn < lsn || index->next_lsn >= lsn + count)
+            continue;
+        first = index->next_lsn - lsn;
+        blocks = min(count - first, index->track_end + 1 - index->next_lsn);
+        index->next_lsn += blocks;
+        index->complete = index->next_lsn > index->track_end;
+        scarletbook_scan_frames(handle, &index->scan, lsn + first, buffer + (size_t) first * SACD_LSN_SIZE, (int) blocks,
+                                index->complete, index_frame_callback, index);
+    }
+}
+
+int scarletbook_index_build(scarletbook_handle_t *handle)
+{
+    int area_idx, result = 0;
+
+    scarletbook_index_begin(handle);
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_time_index_t *index = handle->area[area_idx].time_index;
+        scarletbook_area_scan_t report;
+
+        if (!index || scarletbook_scan_area(handle, area_idx, &report, index_frame_callback, index) != 0)
+        {
+            result = -1;
+            continue;
+        }
+        index->next_lsn = index->track_end + 1;
+        index->complete = 1;
+        LOG(lm_main, LOG_NOTICE, ("time index: area %d, %u frames in sectors %u..%u", area_idx, index->count, index->track_start, index->track_end));
+    }
+
+    return result;
+}
+
+int scarletbook_index_save(scarletbook_handle_t *handle, const char *path)
+{
+    uint8_t header[TIME_INDEX_HEADER_SIZE], entry[8];
+    FILE *fd;
+    int area_idx;
+    uint32_t i;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        if (!handle->area[area_idx].time_index || !handle->area[area_idx].time_index->complete)
+            return -1;
+    }
+
+    fd = fopen(path, "wb");
+    if (!fd)
+    {
+        LOG(lm_main, LOG_NOTICE, ("time index: cannot create %s", path));
+        return -1;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, TIME_INDEX_MAGIC, 8);
+    put_le32(header + 8, TIME_INDEX_VERSION);
+    put_le32(header + 12, (uint32_t) handle->area_count);
+    put_le32(header + 16, sacd_get_total_sectors(handle->sacd));
+    put_le32(header + 20, index_disc_checksum(handle));
+    fwrite(header, 1, TIME_INDEX_HEADER_SIZE, fd);
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_time_index_t *index = handle->area[area_idx].time_index;
+
+        put_le32(header, index->track_start);
+        put_le32(header + 4, index->track_end);
+        put_le32(header + 8, index->count);
+        put_le32(header + 12, 0);
+        fwrite(header, 1, 16, fd);
+        for (i = 0; i < index->count; i++)
+        {
+            put_le32(entry, index->entries[i].timecode);
+            put_le32(entry + 4, index->entries[i].position);
+            fwrite(entry, 1, 8, fd);
+        }
+    }
+
+    if (fclose(fd) != 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("time index: error writing %s", path));
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+int scarletbook_index_load(scarletbook_handle_t *handle, const char *path)
+{
+    uint8_t header[TIME_INDEX_HEADER_SIZE], entry[8];
+    FILE *fd;
+    int area_idx;
+    uint32_t i;
+
+    fd = fopen(path, "rb");
+    if (!fd)
+        return -1;
+
+    // an index of another disc (or another version of the image) is rebuilt
+    if (fread(header, 1, TIME_INDEX_HEADER_SIZE, fd) != TIME_INDEX_HEADER_SIZE || memcmp(header, TIME_INDEX_MAGIC, 8) != 0 ||
+        get_le32(header + 8) != TIME_INDEX_VERSION || get_le32(header + 12) != (uint32_t) handle->area_count ||
+        get_le32(header + 16) != sacd_get_total_sectors(handle->sacd) || get_le32(header + 20) != index_disc_checksum(handle))
+        goto stale;
+
+    scarletbook_index_begin(handle);
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_time_index_t *index = handle->area[area_idx].time_index;
+        uint32_t count;
+
+        if (!index || fread(header, 1, 16, fd) != 16 ||
+            get_le32(header) != index->track_start || get_le32(header + 4) != index->track_end)
+            goto stale;
+
+        count = get_le32(header + 8);
+        for (i = 0; i < count; i++)
+        {
+            if (fread(entry, 1, 8, fd) != 8 || index_append(index, get_le32(entry), get_le32(entry + 4) >> 3, get_le32(entry + 4) & 7) != 0)
+                goto stale;
+            if (TIME_INDEX_LSN(&index->entries[i]) < index->track_start || TIME_INDEX_LSN(&index->entries[i]) > index->track_end)
+                goto stale;
+        }
+        index->next_lsn = index->track_end + 1;
+        index->complete = 1;
+    }
+
+    fclose(fd);
+    return 0;
+
+stale:
+    LOG(lm_main, LOG_NOTICE, ("time index: %s does not match the disc", path));
+    fclose(fd);
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_index_free(handle->area[area_idx].time_index);
+        handle->area[area_idx].time_index = NULL;
+    }
+    return -1;
+}
+
+uint32_t scarletbook_index_start_lsn(scarletbook_handle_t *handle, int area, uint32_t timecode)
+{
+    scarletbook_time_index_t *index = handle->area[area].time_index;
+    uint32_t lo = 0, hi;
+
+    if (!index || !index->complete || index->count == 0)
+        return 0;
+
+    // the last frame starting at or before timecode
+    hi = index->count;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].timecode <= timecode)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return TIME_INDEX_LSN(&index->entries[lo]);
+}
+
+uint32_t scarletbook_index_end_lsn(scarletbook_handle_t *handle, int area, uint32_t timecode)
+{
+    scarletbook_time_index_t *index = handle->area[area].time_index;
+    uint32_t lo = 0, hi;
+
+    if (!index || !index->complete || index->count == 0)
+        return 0;
+
+    // the first frame at or after timecode, the frames before it end in its first sector
+    hi = index->count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].timecode < timecode)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == index->count)
+        return 0;
+    return TIME_INDEX_LSN(&index->entries[lo]);
+}
@@ -0,0 +1,76 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_INDEX_H_INCLUDED
+#define SCARLETBOOK_INDEX_H_INCLUDED
+
+#include <stdint.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+
+// A time index tells for every audio frame of an area in which sector (and packet of that
+// sector) it starts, so a time range is read without scanning from the start of its track.
+// It is filled by a header-only scan (scarletbook_scan_frames) in any pass that reads a whole
+// area in order (ISO output) or by scarletbook_index_build, and kept in a sidecar next to the image.
+
+typedef struct
+{
+    uint32_t timecode;                  // frames since the start of the area
+    uint32_t position;                  // lsn << 3 | index of the packet starting the frame
+}
+time_index_entry_t;
+
+#define TIME_INDEX_LSN(e)       ((e)->position >> 3)
+#define TIME_INDEX_PACKET(e)    ((e)->position & 7)
+
+struct scarletbook_time_index_s
+{
+    uint32_t            track_start;    // sector range of the area it was built for
+    uint32_t            track_end;
+    uint32_t            next_lsn;       // while building: the sector expected next
+    int                 complete;       // every sector of the area went in
+    scarletbook_frame_scan_t scan;      // while building: header scan of the sectors so far
+    uint32_t            count;
+    uint32_t            alloc;
+    time_index_entry_t *entries;        // in disc order, which is timecode order
+};
+
+// (re)starts the index of every area, sectors are then fed in order with scarletbook_index_add_sectors
+void scarletbook_index_begin(scarletbook_handle_t *handle);
+void scarletbook_index_add_sectors(scarletbook_handle_t *handle, uint32_t lsn, const uint8_t *buffer, uint32_t count);
+
+// scans all audio sectors, returns 0 if every area got a complete index
+int scarletbook_index_build(scarletbook_handle_t *handle);
+
+// index file of an image, load fails (-1) if it is missing or does not match the disc;
+// it is only a cache, a failed save is logged as a notice
+int scarletbook_index_load(scarletbook_handle_t *handle, const char *path);
+int scarletbook_index_save(scarletbook_handle_t *handle, const char *path);
+
+// the sector to start reading at for the frame with timecode, 0 if the index cannot tell
+uint32_t scarletbook_index_start_lsn(scarletbook_handle_t *handle, int area, uint32_t timecode);
+// the last sector to read for the frames before timecode, 0 if it is past the indexed frames
+uint32_t scarletbook_index_end_lsn(scarletbook_handle_t *handle, int area, uint32_t timecode);
+
+void scarletbook_index_free(scarletbook_time_index_t *index);
+
+#endif /* SCARLETBOOK_INDEX_H_INCLUDED */
@@ -0,0 +1,366 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <logging.h>
+
+#include "scarletbook.h"
+#include "scarletbook_output.h"
+#include "scarletbook_stage.h"
+#include "dsd2pcm.h"
+
+// Peak and loudness of a track, measured while it is written so no second pass over the
+// files is needed. The DSD is decimated to 88.2 kHz, K-weighted and gated as in ITU-R
+// BS.1770-4. Levels are relative to DSD full scale, the scale of the wav output, where
+// the SACD 0 dB reference (50% modulation) sits at -6 dBFS.
+
+#define LOUDNESS_BATCH_FRAMES       16
+#define LOUDNESS_SAMPLE_RATE        (SACD_SAMPLING_FREQUENCY / DSD2PCM_RATE_88200)
+#define LOUDNESS_SUB_BLOCK          (LOUDNESS_SAMPLE_RATE / 10)    // 100 ms, blocks are 4 of them
+#define LOUDNESS_ABSOLUTE_GATE      -70.0
+#define LOUDNESS_RELATIVE_GATE      -10.0
+#define LOUDNESS_PI                 3.14159265358979323846   // M_PI is not in MSVC's math.h by default
+
+typedef struct
+{
+    double b0, b1, b2, a1, a2;
+}
+biquad_t;
+
+typedef struct
+{
+    dsd2pcm_t   *dsd2pcm;
+    int          channel_count;
+    int          planar_lsb;
+    size_t       frame_size;
+    size_t       frame_used;
+    uint8_t     *frame;
+    uint8_t     *planes;            // LOUDNESS_BATCH_FRAMES frames, one plane per channel
+    size_t       plane_bytes;
+
+    biquad_t     shelf, highpass;   // the two stages of the K filter
+    double       state[MAX_CHANNEL_COUNT][4];
+    double       weight[MAX_CHANNEL_COUNT];
+
+    double       sub_sum[4];        // weighted sum of squares of the last four 100 ms sub blocks
+    int          sub_count;
+    double       sub_acc;
+    int          sub_samples;
+
+    double      *blocks;
+    size_t       block_count;
+    size_t       block_alloc;
+    double       peak;
+}
+loudness_stage_t;
+
+static void k_filter_design(loudness_stage_t *ls, double fs)
+{
+    double f0, q, k, vh, vb, a0;
+
+    // high shelf modelling the head, coefficients matched to the 48 kHz ones of the standard
+    f0 = 1681.974450955533;
+    q  = 0.7071752369554196;
+    k  = tan(LOUDNESS_PI * f0 / fs);
+    vh = pow(10.0, 3.999843853973347 / 20.0);
+    vb = pow(vh, 0.4996667741545416);
+    a0 = 1.0 + k / q + k * k;
+    ls->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    ls->shelf.b1 = 2.0 * (k * k - vh) / a0;
+    ls->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    ls->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    ls->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+    // RLB high pass
+    f0 = 38.13547087602444;
+    q  = 0.5003270373238773;
+    k  = tan(LOUDNESS_PI * f0 / fs);
+    a0 = 1.0 + k / q + k * k;
+    ls->highpass.b0 = 1.0;
+    ls->highpass.b1 = -2.0;
+    ls->highpass.b2 = 1.0;
+    ls->highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+    ls->highpass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static inline double biquad_run(const biquad_t *bq, double *s, double x)
+{
+    double y = bq->b0 * x + s[0];
+    s[0] = bq->b1 * x - bq->a1 * y + s[1];
+    s[1] = bq->b2 * x - bq->a2 * y;
+    return y;
+}
+
+static void *loudness_start(scarletbook_output_format_t *ft)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    scarletbook_area_t *area = &handle->area[ft->area];
+    loudness_stage_t *ls;
+    int c;
+
+    // only decoded DSD of a single track, and a streamed header has fixed the size of the tags already
+    if (!handle->loudness || !ft->dsd_encoded_export || (ft->handler.flags & (OUTPUT_FLAG_RAW | OUTPUT_FLAG_EDIT_MASTER)) || handle->concatenate || ft->stream)
+        return NULL;
+
+    if (!area->track_loudness)
+        area->track_loudness = (track_loudness_t *) calloc(area->area_toc->track_count, sizeof(track_loudness_t));
+    if (!area->track_loudness)
+        return NULL;
+
+    ls = (loudness_stage_t *) calloc(1, sizeof(loudness_stage_t));
+    if (!ls)
+        return NULL;
+    ls->channel_count = area->area_toc->channel_count;
+    ls->planar_lsb = ft->dsd_planar_lsb;
+    ls->frame_size = FRAME_SIZE_64 * ls->channel_count;
+    ls->frame = (uint8_t *) malloc(ls->frame_size);
+    ls->planes = (uint8_t *) malloc(LOUDNESS_BATCH_FRAMES * ls->frame_size);
+    ls->dsd2pcm = dsd2pcm_create(ls->channel_count, DSD2PCM_RATE_88200, ls->planar_lsb);
+    if (!ls->frame || !ls->planes || !ls->dsd2pcm)
+    {
+        LOG(lm_main, LOG_ERROR, ("loudness: out of memory for %s", ft->filename));
+        dsd2pcm_destroy(ls->dsd2pcm);
+        free(ls->frame);
+        free(ls->planes);
+        free(ls);
+        return NULL;
+    }
+
+    k_filter_design(ls, LOUDNESS_SAMPLE_RATE);
+
+    // L, R, C count fully, the surrounds a bit more and the LFE not at all
+    for (c = 0; c < ls->channel_count; c++)
+        ls->weight[c] = c < 3 ? 1.0 : 1.41;
+    if (ls->channel_count == 6 && area->area_toc->extra_settings == 4)
+        ls->weight[3] = 0.0;
+
+    return ls;
+}
+
+static void loudness_sub_block(loudness_stage_t *ls)
+{
+    ls->sub_sum[ls->sub_count++ & 3] = ls->sub_acc;
+    ls->sub_acc = 0.0;
+    ls->sub_samples = 0;
+
+    // a 400 ms block ends with every sub block, they overlap by 75%
+    if (ls->sub_count >= 4)
+    {
+        if (ls->block_count == ls->block_alloc)
+        {
+            size_t alloc = ls->block_alloc ? ls->block_alloc * 2 : 1024;
+            double *blocks = (double *) realloc(ls->blocks, alloc * sizeof(double));
+            if (!blocks)
+                return;
+            ls->blocks = blocks;
+            ls->block_alloc = alloc;
+        }
+        ls->blocks[ls->block_count++] = (ls->sub_sum[0] + ls->sub_sum[1] + ls->sub_sum[2] + ls->sub_sum[3]) / (4.0 * LOUDNESS_SUB_BLOCK);
+    }
+}
+
+static void loudness_flush(loudness_stage_t *ls)
+{
+    float *pcm[MAX_CHANNEL_COUNT];
+    size_t samples, m;
+    int c;
+
+    if (ls->plane_bytes == 0)
+        return;
+
+    samples = dsd2pcm_convert_float(ls->dsd2pcm, ls->planes, LOUDNESS_BATCH_FRAMES * FRAME_SIZE_64, ls->plane_bytes, pcm);
+    ls->plane_bytes = 0;
+
+    for (m = 0; m < samples; m++)
+    {
+        double sum = 0.0;
+        for (c = 0; c < ls->channel_count; c++)
+        {
+            double x = pcm[c][m], y;
+            if (fabs(x) > ls->peak)
+                ls->peak = fabs(x);
+            y = biquad_run(&ls->shelf, &ls->state[c][0], x);
+            y = biquad_run(&ls->highpass, &ls->state[c][2], y);
+            sum += ls->weight[c] * y * y;
+        }
+        ls->sub_acc += sum;
+        if (++ls->sub_samples == LOUDNESS_SUB_BLOCK)
+            loudness_sub_block(ls);
+    }
+}
+
+static void loudness_frame(loudness_stage_t *ls)
+{
+    size_t stride = LOUDNESS_BATCH_FRAMES * FRAME_SIZE_64;
+    int c;
+
+    for (c = 0; c < ls->channel_count; c++)
+    {
+        uint8_t *dst = ls->planes + c * stride + ls->plane_bytes;
+
+        if (ls->planar_lsb)
+        {
+            memcpy(dst, ls->frame + c * FRAME_SIZE_64, FRAME_SIZE_64);
+        }
+        else
+        {
+            const uint8_t *src = ls->frame + c;
+            size_t i;
+            for (i = 0; i < FRAME_SIZE_64; i++, src += ls->channel_count)
+                dst[i] = *src;
+        }
+    }
+    ls->plane_bytes += FRAME_SIZE_64;
+
+    if (ls->plane_bytes == stride)
+        loudness_flush(ls);
+}
+
+static void loudness_process(void *priv, const uint8_t *buf, size_t len)
+{
+    loudness_stage_t *ls = (loudness_stage_t *) priv;
+
+    // the stage hands over arbitrary slices of the frame stream, collect whole frames
+    while (len > 0)
+    {
+        size_t n = ls->frame_size - ls->frame_used;
+        if (n > len)
+            n = len;
+        memcpy(ls->frame + ls->frame_used, buf, n);
+        ls->frame_used += n;
+        buf += n;
+        len -= n;
+        if (ls->frame_used == ls->frame_size)
+        {
+            loudness_frame(ls);
+            ls->frame_used = 0;
+        }
+    }
+}
+
+static inline double block_loudness(double mean_square)
+{
+    return -0.691 + 10.0 * log10(mean_square);
+}
+
+// gated loudness over the blocks of count tracks, returns 0 if no block passes the gates
+static int gated_loudness(const track_loudness_t *tracks, int count, double *loudness)
+{
+    double sum = 0.0, relative_gate;
+    size_t n = 0, i;
+    int t;
+
+    for (t = 0; t < count; t++)
+    {
+        for (i = 0; i < tracks[t].block_count; i++)
+        {
+            if (tracks[t].blocks[i] > 0.0 && block_loudness(tracks[t].blocks[i]) > LOUDNESS_ABSOLUTE_GATE)
+            {
+                sum += tracks[t].blocks[i];
+                n++;
+            }
+        }
+    }
+    if (n == 0)
+        return 0;
+
+    relative_gate = block_loudness(sum / n) + LOUDNESS_RELATIVE_GATE;
+    sum = 0.0;
+    n = 0;
+    for (t = 0; t < count; t++)
+    {
+        for (i = 0; i < tracks[t].block_count; i++)
+        {
+            if (tracks[t].blocks[i] > 0.0)
+            {
+                double l = block_loudness(tracks[t].blocks[i]);
+                if (l > LOUDNESS_ABSOLUTE_GATE && l > relative_gate)
+                {
+                    sum += tracks[t].blocks[i];
+                    n++;
+                }
+            }
+        }
+    }
+    if (n == 0)
+        return 0;
+
+    *loudness = block_loudness(sum / n);
+    return 1;
+}
+
+static void loudness_stop(void *priv, scarletbook_output_format_t *ft)
+{
+    loudness_stage_t *ls = (loudness_stage_t *) priv;
+    scarletbook_area_t *area = &ft->sb_handle->area[ft->area];
+    track_loudness_t *track_loudness = &area->track_loudness[ft->track];
+    int track_count = area->area_toc->track_count;
+    int t;
+
+    if (ls->frame_used != 0)
+        LOG(lm_main, LOG_ERROR, ("loudness: %s ends with a partial frame of %u bytes, not included", ft->filename, (unsigned int) ls->frame_used));
+    loudness_flush(ls);
+
+    // the tracks keep their blocks, the album value gates them together
+    free(track_loudness->blocks);
+    track_loudness->blocks = ls->blocks;
+    track_loudness->block_count = ls->block_count;
+    track_loudness->peak = ls->peak;
+    track_loudness->valid = gated_loudness(track_loudness, 1, &track_loudness->integrated);
+
+    if (track_loudness->valid)
+    {
+        LOG(lm_main, LOG_NOTICE, ("loudness: area %d, track %d, integrated: %.2f LUFS, peak: %.6f", ft->area, ft->track + 1, track_loudness->integrated, track_loudness->peak));
+    }
+    else
+    {
+        LOG(lm_main, LOG_NOTICE, ("loudness: area %d, track %d is too short or silent to be measured", ft->area, ft->track + 1));
+    }
+
+    area->album_loudness.peak = 0.0;
+    for (t = 0; t < track_count; t++)
+    {
+        if (area->track_loudness[t].valid && area->track_loudness[t].peak > area->album_loudness.peak)
+            area->album_loudness.peak = area->track_loudness[t].peak;
+    }
+    area->album_loudness.valid = gated_loudness(area->track_loudness, track_count, &area->album_loudness.integrated);
+
+    dsd2pcm_destroy(ls->dsd2pcm);
+    free(ls->frame);
+    free(ls->planes);
+    free(ls);
+}
+
+scarletbook_stage_handler_t const * loudness_stage_fn(void)
+{
+    static scarletbook_stage_handler_t handler = 
+    {
+        "loudness",
+        loudness_start,
+        loudness_process,
+        loudness_stop
+    };
+    return &handler;
+}
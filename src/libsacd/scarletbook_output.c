@@ -19,6 +19,10 @@
  *
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // copy_file_range()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -29,6 +33,11 @@
 #endif
 #include <errno.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #ifdef __lv2ppu__
 #include <sys/file.h>
 #include <sys/thread.h>
@@ -44,10 +53,15 @@
 #include <charset.h>
 #include <utils.h>
 #include <logging.h>
+#ifndef __lv2ppu__
+#include <cpu.h>
+#endif
 
 #include "scarletbook_output.h"
 #include "scarletbook_read.h"
 #include "sacd_reader.h"
+#include "dsd_silence.h"
+#include "scarletbook_index.h"
 
 #if defined(WIN32) || defined(_WIN32)
 
@@ -59,10 +73,17 @@
 
 #define WRITE_CACHE_SIZE 1 * 1024 * 1024
 
+// sectors handed to the kernel per copy_file_range() call, small enough to keep the progress going
+#define COPY_RANGE_BLOCK_SIZE (64 * 1024 * 1024 / SACD_LSN_SIZE)
+
+// silent frames held back at most when trimming, longer silence at the end of a track stays in
+#define TRIM_HOLD_FRAMES (10 * SACD_FRAME_RATE)
+
 extern scarletbook_format_handler_t const * dsdiff_format_fn(void);
 extern scarletbook_format_handler_t const * dsdiff_edit_master_format_fn(void);
 extern scarletbook_format_handler_t const * dsf_format_fn(void);
 extern scarletbook_format_handler_t const * iso_format_fn(void);
+extern scarletbook_format_handler_t const * wav_format_fn(void);
 
 typedef const scarletbook_format_handler_t *(*sacd_output_format_fn_t)(void); 
 static sacd_output_format_fn_t s_sacd_output_format_fns[] = 
@@ -71,6 +92,21 @@ static sacd_output_format_fn_t s_sacd_output_format_fns[] =
     dsdiff_edit_master_format_fn,
     dsf_format_fn,
     iso_format_fn,
+    wav_format_fn,
+    NULL
+}; 
+
+extern scarletbook_stage_handler_t const * hash_stage_fn(void);
+extern scarletbook_stage_handler_t const * fingerprint_stage_fn(void);
+extern scarletbook_stage_handler_t const * loudness_stage_fn(void);
+extern scarletbook_stage_handler_t const * silence_stage_fn(void);
+
+typedef const scarletbook_stage_handler_t *(*sacd_stage_fn_t)(void); 
+static sacd_stage_fn_t s_sacd_stage_fns[] = 
+{
+    fingerprint_stage_fn,
+    loudness_stage_fn,
+    silence_stage_fn,
     NULL
 }; 
 
@@ -88,6 +124,9 @@ struct scarletbook_output_s
     atomic_t            stop_processing;            // indicates if the thread needs to stop or has stopped
     atomic_t            processing;
 
+    int                 non_encrypted_disc;
+    int                 checked_for_non_encrypted_disc;
+
     // stats
     int                 stats_total_tracks;
     int                 stats_current_track;
@@ -97,6 +136,9 @@ struct scarletbook_output_s
     uint32_t            stats_current_file_sectors_processed;
     stats_progress_callback_t stats_progress_callback;
     stats_track_callback_t stats_track_callback;
+    scarletbook_output_events_t events;
+    int                 error_count;                // error events sent
+    int                 started;                    // the processing thread runs or has to be joined
 
     fwprintf_callback_t fwprintf_callback;
 
@@ -132,6 +174,16 @@ static void destroy_ripping_queue(scarletbook_output_t *output)
     }
 }
 
+// DSD areas exported to a format that takes DST frames are encoded when asked for
+static void set_dst_encoded_export(scarletbook_output_format_t *ft)
+{
+    if (ft->sb_handle->encode_dst && ft->dsd_encoded_export && !ft->dst_encoded_import && (ft->handler.flags & OUTPUT_FLAG_DST))
+    {
+        ft->dst_encoded_export = 1;
+        ft->dsd_encoded_export = 0;
+    }
+}
+
 int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int track, char *file_path, char *fmt, int dsd_encoded_export)
 {
     scarletbook_format_handler_t const * handler;
@@ -142,6 +194,7 @@ int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int
     {
         output_format_ptr = calloc(sizeof(scarletbook_output_format_t), 1);
         output_format_ptr->sb_handle = sb_handle;
+        output_format_ptr->output = output;
         output_format_ptr->cb_fwprintf = output->fwprintf_callback;
         output_format_ptr->area = area;
         output_format_ptr->track = track;
@@ -150,6 +203,7 @@ int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int
         output_format_ptr->channel_count = sb_handle->area[area].area_toc->channel_count;
         output_format_ptr->dst_encoded_import = sb_handle->area[area].area_toc->frame_format == FRAME_FORMAT_DST;
         output_format_ptr->dsd_encoded_export = dsd_encoded_export;
+        set_dst_encoded_export(output_format_ptr);
         
 
         if (handler->flags & OUTPUT_FLAG_EDIT_MASTER)
@@ -220,7 +274,37 @@ int scarletbook_output_enqueue_track(scarletbook_output_t *output, int area, int
             }
         }
 
-        LOG(lm_main, LOG_NOTICE, ("Queuing: %s, area: %d, track %d, start_lsn: %d, length_lsn: %d, dst_encoded_import: %d, dsd_encoded_export: %d", file_path, area, track, output_format_ptr->start_lsn, output_format_ptr->length_lsn, output_format_ptr->dst_encoded_import, output_format_ptr->dsd_encoded_export));
+        // only part of the track: the time index points at the sectors holding it
+        if (!(handler->flags & OUTPUT_FLAG_EDIT_MASTER) && sb_handle->clip_end > 0)
+        {
+            uint32_t track_start = TIME_FRAMECOUNT(&sb_handle->area[area].area_tracklist_time->start[track]);
+            uint32_t duration = TIME_FRAMECOUNT(&sb_handle->area[area].area_tracklist_time->duration[track]);
+            uint32_t lsn;
+
+            // an open range (START-) ends at UINT32_MAX, clamp before adding the track start
+            if (sb_handle->clip_start >= min(sb_handle->clip_end, duration))
+            {
+                LOG(lm_main, LOG_NOTICE, ("Queuing: %s skipped, area: %d, track %d is %u frames, shorter than the start of the time range", file_path, area, track, duration));
+                output_format_ptr->cb_fwprintf(stderr, L"\n Track %d is shorter than the start of the time range, skipped.\n", track + 1);
+                free(output_format_ptr->filename);
+                free(output_format_ptr);
+                return -1;
+            }
+            output_format_ptr->clip_start = track_start + sb_handle->clip_start;
+            output_format_ptr->clip_end = track_start + min(sb_handle->clip_end, duration);
+
+            lsn = scarletbook_index_start_lsn(sb_handle, area, output_format_ptr->clip_start);
+            if (lsn > output_format_ptr->start_lsn && lsn < output_format_ptr->start_lsn + output_format_ptr->length_lsn)
+            {
+                output_format_ptr->length_lsn -= lsn - output_format_ptr->start_lsn;
+                output_format_ptr->start_lsn = lsn;
+            }
+            lsn = scarletbook_index_end_lsn(sb_handle, area, output_format_ptr->clip_end);
+            if (lsn >= output_format_ptr->start_lsn && lsn < output_format_ptr->start_lsn + output_format_ptr->length_lsn)
+                output_format_ptr->length_lsn = lsn - output_format_ptr->start_lsn + 1;
+        }
+
+        LOG(lm_main, LOG_NOTICE, ("Queuing: %s, area: %d, track %d, start_lsn: %d, length_lsn: %d, dst_encoded_import: %d, dsd_encoded_export: %d, dst_encoded_export: %d", file_path, area, track, output_format_ptr->start_lsn, output_format_ptr->length_lsn, output_format_ptr->dst_encoded_import, output_format_ptr->dsd_encoded_export, output_format_ptr->dst_encoded_export));
 
         list_add_tail(&output_format_ptr->siblings, &output->ripping_queue);
 
@@ -239,6 +323,7 @@ int scarletbook_output_enqueue_raw_sectors(scarletbook_output_t *output, int sta
     {
         output_format_ptr = calloc(sizeof(scarletbook_output_format_t), 1);
         output_format_ptr->sb_handle = sb_handle;
+        output_format_ptr->output = output;
         output_format_ptr->cb_fwprintf = output->fwprintf_callback;
         output_format_ptr->handler = *handler;
         output_format_ptr->filename = strdup(file_path);
@@ -265,6 +350,7 @@ int scarletbook_output_enqueue_concatenate_tracks(scarletbook_output_t *output,
     {
         output_format_ptr = calloc(sizeof(scarletbook_output_format_t), 1);
         output_format_ptr->sb_handle = sb_handle;
+        output_format_ptr->output = output;
         output_format_ptr->cb_fwprintf = output->fwprintf_callback;
         output_format_ptr->area = area;
         output_format_ptr->track = track;
@@ -273,6 +359,7 @@ int scarletbook_output_enqueue_concatenate_tracks(scarletbook_output_t *output,
         output_format_ptr->channel_count = sb_handle->area[area].area_toc->channel_count;
         output_format_ptr->dst_encoded_import = sb_handle->area[area].area_toc->frame_format == FRAME_FORMAT_DST;
         output_format_ptr->dsd_encoded_export = dsd_encoded_export;
+        set_dst_encoded_export(output_format_ptr);
 
         // read with pauses only
         // find the start lsn
@@ -327,7 +414,7 @@ int scarletbook_output_enqueue_concatenate_tracks(scarletbook_output_t *output,
             }
 
 
-        LOG(lm_main, LOG_NOTICE, ("Queuing: concatenation %s, area: %d, track %d, start_lsn: %d, length_lsn: %d, dst_encoded_import: %d, dsd_encoded_export: %d", file_path, area, track, output_format_ptr->start_lsn, output_format_ptr->length_lsn, output_format_ptr->dst_encoded_import, output_format_ptr->dsd_encoded_export));
+        LOG(lm_main, LOG_NOTICE, ("Queuing: concatenation %s, area: %d, track %d, start_lsn: %d, length_lsn: %d, dst_encoded_import: %d, dsd_encoded_export: %d, dst_encoded_export: %d", file_path, area, track, output_format_ptr->start_lsn, output_format_ptr->length_lsn, output_format_ptr->dst_encoded_import, output_format_ptr->dsd_encoded_export, output_format_ptr->dst_encoded_export));
 
         list_add_tail(&output_format_ptr->siblings, &output->ripping_queue);
 
@@ -336,24 +423,244 @@ int scarletbook_output_enqueue_concatenate_tracks(scarletbook_output_t *output,
     return -1;
 }
 
-static int create_output_file(scarletbook_output_format_t *ft)
+// returns 1 if the frame just assembled by scarletbook_process_frames belongs to the output,
+// with audio frame trimming only frames inside [start, start + duration) of the track do
+static int timecode_in_track(scarletbook_handle_t *handle, scarletbook_output_format_t *ft, uint32_t frame_timecode)
+{
+    uint32_t frame_count_time_start, frame_count_time_end;
+
+    if (ft->handler.flags & OUTPUT_FLAG_EDIT_MASTER)
+        return 1;
+
+    if (ft->clip_end > 0)
+        return frame_timecode >= ft->clip_start && frame_timecode < ft->clip_end;
+
+    if (handle->audio_frame_trimming == 0)
+        return 1;
+
+    frame_count_time_start = TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->start[ft->track]);
+    frame_count_time_end = frame_count_time_start + TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+
+    return frame_timecode >= frame_count_time_start && frame_timecode < frame_count_time_end;
+}
+
+static int frame_in_track(scarletbook_handle_t *handle, scarletbook_output_format_t *ft)
+{
+    return timecode_in_track(handle, ft, TIME_FRAMECOUNT(&handle->frame.timecode));
+}
+
+// reads (and decrypts) the next run of sectors starting at lsn, a run never crosses the
+// boundaries of the encrypted audio areas. Returns the number of sectors read.
+static uint32_t read_blocks(scarletbook_output_t *output, scarletbook_output_format_t *ft, uint32_t lsn, uint32_t end_lsn, uint8_t *buffer)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    uint32_t block_size, blocks_readed;
+    uint32_t encrypted_start_1 = 0;
+    uint32_t encrypted_start_2 = 0;
+    uint32_t encrypted_end_1 = 0;
+    uint32_t encrypted_end_2 = 0;
+    int encrypted;
+
+    // set the encryption range
+    if (handle->area[0].area_toc != 0)
+    {
+        encrypted_start_1 = handle->area[0].area_toc->track_start;
+        encrypted_end_1 = handle->area[0].area_toc->track_end;
+    }
+    if (handle->area[1].area_toc != 0)
+    {
+        encrypted_start_2 = handle->area[1].area_toc->track_start;
+        encrypted_end_2 = handle->area[1].area_toc->track_end;
+    }
+
+    // check what block ranges are encrypted..
+    if (lsn < encrypted_start_1)
+    {
+        block_size = min(encrypted_start_1 - lsn, MAX_PROCESSING_BLOCK_SIZE);
+        encrypted = 0;
+    }
+    else if (lsn >= encrypted_start_1 && lsn <= encrypted_end_1)
+    {
+        block_size = min(encrypted_end_1 + 1 - lsn, MAX_PROCESSING_BLOCK_SIZE);
+        encrypted = 1;
+    }
+    else if (lsn > encrypted_end_1 && lsn < encrypted_start_2)
+    {
+        block_size = min(encrypted_start_2 - lsn, MAX_PROCESSING_BLOCK_SIZE);
+        encrypted = 0;
+    }
+    else if (lsn >= encrypted_start_2 && lsn <= encrypted_end_2)
+    {
+        block_size = min(encrypted_end_2 + 1 - lsn, MAX_PROCESSING_BLOCK_SIZE);
+        encrypted = 1;
+    }
+    else
+    {
+        block_size = MAX_PROCESSING_BLOCK_SIZE;
+        encrypted = 0;
+    }
+    block_size = min(end_lsn - lsn, block_size);
+
+    // read some blocks
+    blocks_readed = sacd_read_block_raw(handle->sacd, lsn, block_size, buffer);
+    if (blocks_readed == 0)
+        return 0;
+
+    // the ATAPI call which returns the flag if the disc is encrypted or not is unknown at this point. 
+    // user reports tell me that the only non-encrypted discs out there are DSD 3 14/16 discs. 
+    // this is a quick hack/fix for these discs.
+    if (encrypted && output->checked_for_non_encrypted_disc == 0)
+    {
+        switch (handle->area[ft->area].area_toc->frame_format)
+        {
+        case FRAME_FORMAT_DSD_3_IN_14:
+        case FRAME_FORMAT_DSD_3_IN_16:
+            output->non_encrypted_disc = *(uint64_t *)(buffer + 16) == 0;
+            break;
+        }
+
+        output->checked_for_non_encrypted_disc = 1;
+    }
+
+    // encrypted blocks need to be decrypted first
+    if (encrypted && output->non_encrypted_disc == 0)
+    {
+        sacd_decrypt(handle->sacd, buffer, blocks_readed);
+    }
+
+    return blocks_readed;
+}
+
+static int output_is_seekable(FILE *fd)
+{
+#ifdef __lv2ppu__
+    return 1;
+#else
+    struct stat st;
+
+    if (fstat(fileno(fd), &st) != 0)
+        return 1;
+    return S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+#endif
+}
+
+static void stream_prepass_callback(scarletbook_handle_t *handle, const scarletbook_frame_scan_t *frame, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+
+    if (timecode_in_track(handle, ft, frame->timecode))
+    {
+        ft->stream_frame_count++;
+        ft->stream_frame_bytes += frame->size + (frame->size % 2);
+    }
+}
+
+// A streamed file cannot be patched afterwards, so the number of frames (and for DST
+// pass-through the number of bytes) must be known before the header is written. With
+// audio frame trimming the track duration from the TOC is exact, otherwise the frames
+// are counted in a pre-pass over the sector headers of the input.
+static int calculate_stream_sizes(scarletbook_output_t *output, scarletbook_output_format_t *ft)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    scarletbook_frame_scan_t scan;
+    uint32_t lsn, end_lsn, blocks_readed;
+
+    ft->stream_frame_count = 0;
+    ft->stream_frame_bytes = 0;
+
+    if (ft->dsd_encoded_export && ft->clip_end > ft->clip_start)
+    {
+        ft->stream_frame_count = ft->clip_end - ft->clip_start;
+        return 0;
+    }
+    if (ft->dsd_encoded_export && handle->audio_frame_trimming && !(ft->handler.flags & OUTPUT_FLAG_EDIT_MASTER))
+    {
+        ft->stream_frame_count = TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+        return 0;
+    }
+
+    memset(&scan, 0, sizeof(scan));
+    lsn = ft->start_lsn;
+    end_lsn = ft->start_lsn + ft->length_lsn;
+    while (lsn < end_lsn)
+    {
+        blocks_readed = read_blocks(output, ft, lsn, end_lsn, output->read_buffer);
+        if (blocks_readed == 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("stream pre-pass: read error at lsn: %u", lsn));
+            return -1;
+        }
+        lsn += blocks_readed;
+        scarletbook_scan_frames(handle, &scan, lsn - blocks_readed, output->read_buffer, blocks_readed, lsn >= end_lsn, stream_prepass_callback, ft);
+    }
+
+    LOG(lm_main, LOG_NOTICE, ("stream pre-pass: %s, frames: %llu, frame bytes: %llu", ft->filename, 
+        (unsigned long long) ft->stream_frame_count, (unsigned long long) ft->stream_frame_bytes));
+    return 0;
+}
+
+static void report_track(scarletbook_output_t *output, scarletbook_output_format_t *ft)
+{
+    if (output->stats_track_callback)
+        output->stats_track_callback(ft->filename, output->stats_current_track, output->stats_total_tracks);
+    if (output->events.track)
+        output->events.track(output->events.userdata, ft->filename, output->stats_current_track, output->stats_total_tracks);
+}
+
+static void report_progress(scarletbook_output_t *output)
+{
+    if (output->stats_progress_callback)
+    {
+        output->stats_progress_callback(output->stats_total_sectors, output->stats_total_sectors_processed, 
+            output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
+    }
+    if (output->events.progress)
+    {
+        output->events.progress(output->events.userdata, output->stats_total_sectors, output->stats_total_sectors_processed, 
+            output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
+    }
+}
+
+static void report_error(scarletbook_output_t *output, scarletbook_output_format_t *ft, int code, const char *message)
+{
+    output->error_count++;
+    if (output->events.error)
+        output->events.error(output->events.userdata, ft ? ft->filename : NULL, code, message);
+}
+
+static int create_output_file(scarletbook_output_t *output, scarletbook_output_format_t *ft)
 {
     int result;
 
+    if (ft->sb_handle->open_output)
+    {
+        ft->fd = ft->sb_handle->open_output(ft->sb_handle->open_output_userdata, ft->filename);
+    }
+    else if (strcmp(ft->filename, "-") == 0)
+    {
+#if defined(WIN32) || defined(_WIN32)
+        ft->fd = _fdopen(_dup(ft->sb_handle->stdout_fd), "wb");
+#else
+        ft->fd = fdopen(dup(ft->sb_handle->stdout_fd), "wb");
+#endif
+    }
+    else
+    {
 #if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
-    char filename_long[1024];
-	memset(filename_long, '\0', sizeof(filename_long));
-    strcpy(filename_long,"\\\\?\\");
-    strncat(filename_long,ft->filename, min(1016, strlen(ft->filename)));
-	
-    wchar_t *wide_filename;
-	wide_filename = (wchar_t *)charset_convert(filename_long, strlen(filename_long), "UTF-8", "UCS-2-INTERNAL");
-    ft->fd = _wfopen(wide_filename, L"wb");
-	
-    free(wide_filename);
+        char filename_long[1024];
+        memset(filename_long, '\0', sizeof(filename_long));
+        strcpy(filename_long,"\\\\?\\");
+        strncat(filename_long,ft->filename, min(1016, strlen(ft->filename)));
+
+        wchar_t *wide_filename;
+        wide_filename = (wchar_t *)charset_convert(filename_long, strlen(filename_long), "UTF-8", "UCS-2-INTERNAL");
+        ft->fd = _wfopen(wide_filename, L"wb");
+
+        free(wide_filename);
 #else
-    ft->fd = fopen(ft->filename, "wb");	
+        ft->fd = fopen(ft->filename, "wb");	
 #endif
+    }
     if (ft->fd == NULL)
     {   
         LOG(lm_main, LOG_ERROR, ("error creating %s, errno: %d, %s", ft->filename, errno, strerror(errno)));
@@ -369,7 +676,57 @@ static int create_output_file(scarletbook_output_format_t *ft)
 
     ft->priv = calloc(1, ft->handler.priv_size);
 
+    // pipes, sockets and explicit streaming get their final header up front
+    if (ft->handler.flags & (OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST))
+    {
+        // the size of an encoded frame is only known once it is encoded, so a streamed
+        // file gets the DSD frames
+        if (ft->dst_encoded_export && (ft->sb_handle->stream_output || !output_is_seekable(ft->fd)))
+        {
+            ft->cb_fwprintf(stderr, L"\n Warning: DST encoding needs a seekable output file, the frames are written as DSD\n");
+            LOG(lm_main, LOG_NOTICE, ("DST encoding needs a seekable output file, %s is written as DSD", ft->filename));
+            ft->dst_encoded_export = 0;
+            ft->dsd_encoded_export = 1;
+        }
+        ft->stream = ft->sb_handle->stream_output || !output_is_seekable(ft->fd);
+        if (ft->stream && calculate_stream_sizes(output, ft) != 0)
+            goto error;
+    }
+
+    // a streamed header has counted every frame, trimming works on decoded DSD of single tracks
+    if (ft->sb_handle->trim_silence && !ft->stream && ft->dsd_encoded_export && !ft->sb_handle->concatenate &&
+        !(ft->handler.flags & (OUTPUT_FLAG_RAW | OUTPUT_FLAG_EDIT_MASTER)))
+    {
+        ft->trim_silence = 1;
+        ft->trim_frame_size = FRAME_SIZE_64 * ft->sb_handle->area[ft->area].area_toc->channel_count;
+    }
+
     result = ft->handler.startwrite ? (*ft->handler.startwrite)(ft) : 0;
+
+    // attach the analysis stages that want to see this file
+    if (result == 0)
+    {
+        sacd_stage_fn_t *stage_fn;
+
+        ft->stage = scarletbook_stage_create(ft);
+        for (stage_fn = s_sacd_stage_fns; ft->stage && *stage_fn; stage_fn++)
+            scarletbook_stage_add(ft->stage, (*stage_fn)());
+        if (ft->stage && scarletbook_stage_start(ft->stage) != 0)
+        {
+            scarletbook_stage_destroy(ft->stage);
+            ft->stage = NULL;
+        }
+
+        // the digests follow the bytes the handler writes, see scarletbook_output_written()
+        ft->hash_stage = scarletbook_stage_create(ft);
+        if (ft->hash_stage)
+            scarletbook_stage_add(ft->hash_stage, hash_stage_fn());
+        if (ft->hash_stage && scarletbook_stage_start(ft->hash_stage) != 0)
+        {
+            scarletbook_stage_destroy(ft->hash_stage);
+            ft->hash_stage = NULL;
+        }
+    }
    
     return result;
 
@@ -379,22 +736,89 @@ error:
     return -1;
 }
 
+// prints the silence found at the edges of the track, the silent frames still held back by
+// trim_silence_block() are dropped
+static void report_silence(scarletbook_output_format_t *ft)
+{
+    scarletbook_area_t *area = &ft->sb_handle->area[ft->area];
+    track_silence_t *track_silence;
+
+    if (!area->track_silence || !area->track_silence[ft->track].valid || (ft->handler.flags & (OUTPUT_FLAG_RAW | OUTPUT_FLAG_EDIT_MASTER)) || ft->sb_handle->concatenate)
+        return;
+
+    track_silence = &area->track_silence[ft->track];
+    track_silence->trimmed_leading = ft->trimmed_leading;
+    track_silence->trimmed_trailing = ft->trim_hold_count;
+
+    ft->cb_fwprintf(stdout, L"\n Silence in track %02d: leading %.3f s, trailing %.3f s", ft->track + 1,
+                    (double) track_silence->leading * 8 / SACD_SAMPLING_FREQUENCY, (double) track_silence->trailing * 8 / SACD_SAMPLING_FREQUENCY);
+    if (ft->trim_silence)
+        ft->cb_fwprintf(stdout, L", trimmed %u + %u frames", track_silence->trimmed_leading, track_silence->trimmed_trailing);
+    ft->cb_fwprintf(stdout, L"\n");
+    LOG(lm_main, LOG_NOTICE, ("silence: %s, leading: %" PRIu64 ", trailing: %" PRIu64 " of %" PRIu64 " bytes per channel, trimmed frames: %u + %u", ft->filename,
+        track_silence->leading, track_silence->trailing, track_silence->length, track_silence->trimmed_leading, track_silence->trimmed_trailing));
+}
+
+static int time_index_complete(scarletbook_handle_t *handle)
+{
+    int area_idx;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        if (!handle->area[area_idx].time_index || !handle->area[area_idx].time_index->complete)
+            return 0;
+    }
+    return 1;
+}
+
+// an image written in full gets the time index of its areas next to it
+static void save_time_index(scarletbook_output_format_t *ft)
+{
+    char *path;
+
+    if (!(ft->handler.flags & OUTPUT_FLAG_RAW) || strcmp(ft->filename, "-") == 0 || !time_index_complete(ft->sb_handle))
+        return;
+
+    path = (char *) malloc(strlen(ft->filename) + 5);
+    if (!path)
+        return;
+    sprintf(path, "%s.idx", ft->filename);
+    if (scarletbook_index_save(ft->sb_handle, path) == 0)
+        LOG(lm_main, LOG_NOTICE, ("time index saved in %s", path));
+    free(path);
+}
+
 static inline int close_output_file(scarletbook_output_format_t * ft)
 {
     int result;
+
+    // drains the analysis stages and writes their results, first so the handler can put them in its tags
+    scarletbook_stage_destroy(ft->stage);
+    ft->stage = NULL;
+
+    report_silence(ft);
 	
 	if(ft->fd != NULL){
 		result = ft->handler.stopwrite ? (*ft->handler.stopwrite)(ft) : 0;
 		if(result ==-1)
 			LOG(lm_main, LOG_ERROR, ("error closing %s", ft->filename));
 	} 
-    	
+
+    // after stopwrite, which may still write padding
+    scarletbook_stage_destroy(ft->hash_stage);
+    ft->hash_stage = NULL;
+
     if (ft->fd != NULL)
     {
         fclose(ft->fd);
     }	
-	
+
+    save_time_index(ft);
+
     if(ft->write_cache)free(ft->write_cache);	
+    if(ft->dst_frame_timecodes)free(ft->dst_frame_timecodes);
+    if(ft->dst_errors)free(ft->dst_errors);
+    if(ft->trim_hold)free(ft->trim_hold);
     if(ft->filename)free(ft->filename);	
     if(ft->priv)free(ft->priv);
     free(ft);
@@ -422,14 +846,80 @@ static void scarletbook_output_init_stats(scarletbook_output_t *output)
     }
 }
 
-static inline int write_block(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
+void scarletbook_output_written(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
+{
+    if (ft->hash_stage)
+        scarletbook_stage_push(ft->hash_stage, buf, len);
+}
+
+static inline int write_payload(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
 {
     int actual = ft->handler.write? (*ft->handler.write)(ft, buf, len) : 0;
     if (actual < 0 ) return -1;
     ft->write_length += actual;
+    if (ft->stage)
+        scarletbook_stage_push(ft->stage, buf, (ft->handler.flags & OUTPUT_FLAG_RAW) ? len * SACD_LSN_SIZE : len);
     return actual;
 }
 
+// Frames made of DSD idle patterns only are left out before the first frame with audio. After
+// it they are held back, written once audio follows (a pause inside the track) and dropped if
+// the track ends first. At most TRIM_HOLD_FRAMES are held, older ones are written.
+static int trim_silence_block(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
+{
+    int written = 0, result;
+
+    if (len != ft->trim_frame_size)
+        return write_payload(ft, buf, len);
+
+    if (dsd_silence_first_active(buf, len) == len)
+    {
+        if (!ft->trim_audio_seen)
+        {
+            ft->trimmed_leading++;
+            return 0;
+        }
+        if (!ft->trim_hold)
+            ft->trim_hold = (uint8_t *) malloc(TRIM_HOLD_FRAMES * len);
+        if (!ft->trim_hold)
+            return write_payload(ft, buf, len);
+        if (ft->trim_hold_count == TRIM_HOLD_FRAMES)
+        {
+            result = write_payload(ft, ft->trim_hold + ft->trim_hold_first * len, len);
+            if (result < 0)
+                return -1;
+            written += result;
+            ft->trim_hold_first = (ft->trim_hold_first + 1) % TRIM_HOLD_FRAMES;
+            ft->trim_hold_count--;
+        }
+        memcpy(ft->trim_hold + ((ft->trim_hold_first + ft->trim_hold_count) % TRIM_HOLD_FRAMES) * len, buf, len);
+        ft->trim_hold_count++;
+        return written;
+    }
+
+    ft->trim_audio_seen = 1;
+    while (ft->trim_hold_count > 0)
+    {
+        result = write_payload(ft, ft->trim_hold + ft->trim_hold_first * len, len);
+        if (result < 0)
+            return -1;
+        written += result;
+        ft->trim_hold_first = (ft->trim_hold_first + 1) % TRIM_HOLD_FRAMES;
+        ft->trim_hold_count--;
+    }
+    result = write_payload(ft, buf, len);
+    if (result < 0)
+        return -1;
+    return written + result;
+}
+
+static inline int write_block(scarletbook_output_format_t * ft, const uint8_t *buf, size_t len)
+{
+    if (ft->trim_silence)
+        return trim_silence_block(ft, buf, len);
+    return write_payload(ft, buf, len);
+}
+
 static void frame_decoded_callback(uint8_t* frame_data, size_t frame_size, void *userdata)
 {
     scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
@@ -438,100 +928,237 @@ static void frame_decoded_callback(uint8_t* frame_data, size_t frame_size, void
     {
 	 ft->cb_fwprintf(stderr, L"\n ERROR in frame_decoded_callback():write_block()...at writting in file.\n");
 	 LOG(lm_main, LOG_ERROR, ("ERROR in frame_decoded_callback():write_block()...writting in file: %s  ",ft->filename) );
-	 raise(SIGINT);
+	 report_error(ft->output, ft, OUTPUT_ERROR_WRITE, "cannot write the output file");
+	 scarletbook_output_interrupt(ft->output);
 	}
 }
 
+// the decoded frames of a verify only decoder are thrown away
+static void frame_verified_callback(uint8_t* frame_data, size_t frame_size, void *userdata)
+{
+}
+
+// called from the decoder's write thread in frame order, the errors are located in the
+// track by report_dst_errors once the decoder is destroyed
 static void frame_error_callback(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata)
 {
     scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
 
-    wchar_t *wide_frame_error_mesage;
-    CHAR2WCHAR(wide_frame_error_mesage, frame_error_message);
-    ft->cb_fwprintf(stderr, L"\n ERROR in dst_decoder: %s in frame: %d\n", wide_frame_error_mesage, frame_count); //frame_error_message
-    free(wide_frame_error_mesage);
+    if (ft->dst_error_count == ft->dst_error_alloc)
+    {
+        int alloc = ft->dst_error_alloc ? ft->dst_error_alloc * 2 : 16;
+        dst_frame_error_t *errors = (dst_frame_error_t *) realloc(ft->dst_errors, alloc * sizeof(dst_frame_error_t));
+        if (errors != NULL)
+        {
+            ft->dst_errors = errors;
+            ft->dst_error_alloc = alloc;
+        }
+    }
+    if (ft->dst_error_count < ft->dst_error_alloc)
+    {
+        ft->dst_errors[ft->dst_error_count].frame = frame_count;
+        ft->dst_errors[ft->dst_error_count].error_code = frame_error_code;
+        ft->dst_errors[ft->dst_error_count].error_message = frame_error_message;
+    }
+    ft->dst_error_count++;
+
     LOG(lm_main, LOG_ERROR, ("ERROR in dst_decoder: %s in frame: %d", frame_error_message, frame_count));
 }
 
-static void frame_read_callback(scarletbook_handle_t *handle, uint8_t* frame_data, size_t frame_size, void *userdata)
+// remembers the timecode of a frame passed to dst_decoder, its sequence number is the index
+static void add_dst_frame_timecode(scarletbook_output_format_t *ft, uint32_t timecode)
 {
-    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+    if (ft->dst_frame_count == ft->dst_frame_alloc)
+    {
+        int alloc = ft->dst_frame_alloc ? ft->dst_frame_alloc * 2 : 4096;
+        uint32_t *timecodes = (uint32_t *) realloc(ft->dst_frame_timecodes, alloc * sizeof(uint32_t));
+        if (timecodes == NULL)
+            return;
+        ft->dst_frame_timecodes = timecodes;
+        ft->dst_frame_alloc = alloc;
+    }
+    ft->dst_frame_timecodes[ft->dst_frame_count++] = timecode;
+}
 
+// returns the track of the area that plays at timecode (in frames), -1 if it is in a pause
+static int track_at_timecode(scarletbook_handle_t *handle, int area, uint32_t timecode)
+{
+    int i;
 
-    if (ft->handler.flags & OUTPUT_FLAG_EDIT_MASTER) //  only for DSDIFF master
+    for (i = 0; i < handle->area[area].area_toc->track_count; i++)
     {
-        if (ft->dsd_encoded_export && ft->dst_encoded_import) 
+        uint32_t start = TIME_FRAMECOUNT(&handle->area[area].area_tracklist_time->start[i]);
+        uint32_t duration = TIME_FRAMECOUNT(&handle->area[area].area_tracklist_time->duration[i]);
+
+        if (timecode >= start && timecode < start + duration)
+            return i;
+    }
+    return -1;
+}
+
+// prints the frames dst_decoder rejected with their track and timecode, must be called after
+// dst_decoder_destroy. Returns the number of corrupt frames.
+static int report_dst_errors(scarletbook_output_t *output, scarletbook_output_format_t *ft)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    int i;
+
+    for (i = 0; i < min(ft->dst_error_count, ft->dst_error_alloc); i++)
+    {
+        dst_frame_error_t *error = &ft->dst_errors[i];
+        wchar_t *wide_error_message;
+        uint32_t timecode, start = 0;
+        int track = -1, offset;
+
+        if (error->frame >= 0 && error->frame < ft->dst_frame_count)
         {
-            dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
-			ft->sb_handle->count_frames++;
+            timecode = ft->dst_frame_timecodes[error->frame];
+            track = track_at_timecode(handle, ft->area, timecode);
         }
         else
         {
-            int rezult;
-            rezult = write_block(ft, frame_data, frame_size);
-            if (rezult == -1)
-            {
-                ft->cb_fwprintf(stderr, L"\n ERROR in frame_read_callback():write_block()..at writting in dsdiff master file. \n");
-                LOG(lm_main, LOG_ERROR, ("ERROR in frame_read_callback:write_block()...writting in file: %s  ", ft->filename));
-                raise(SIGINT);
-            }
-			ft->sb_handle->count_frames++;
+            timecode = 0;
         }
+        if (track >= 0)
+            start = TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->start[track]);
+        offset = (int)(timecode - start);
+
+        CHAR2WCHAR(wide_error_message, error->error_message);
+        output->fwprintf_callback(stderr, L"\n ERROR in dst_decoder: %ls in frame %d, track %02d at %02d:%02d:%02d [mins:secs:frames]\n",
+                                  wide_error_message, error->frame, track + 1,
+                                  offset / SACD_FRAME_RATE / 60, offset / SACD_FRAME_RATE % 60, offset % SACD_FRAME_RATE);
+        free(wide_error_message);
+        report_error(output, ft, OUTPUT_ERROR_DST, error->error_message);
+        LOG(lm_main, LOG_ERROR, ("ERROR in dst_decoder: %s (%d) in frame %d, track %02d at %02d:%02d:%02d, area timecode %u",
+                                  error->error_message, error->error_code, error->frame, track + 1,
+                                  offset / SACD_FRAME_RATE / 60, offset / SACD_FRAME_RATE % 60, offset % SACD_FRAME_RATE,
+                                  timecode));
     }
-    else   // DSF, DSDIFF
+
+    if (ft->dst_verify_only)
     {
-        if (ft->sb_handle->audio_frame_trimming > 0)  // (pausese will not be included)
+        output->fwprintf_callback(stdout, L"\n Verified %d DST frames: %d corrupt\n", ft->dst_frame_count, ft->dst_error_count);
+        LOG(lm_main, LOG_NOTICE, ("Verified %d DST frames of %s: %d corrupt", ft->dst_frame_count, ft->filename, ft->dst_error_count));
+    }
+
+    return ft->dst_error_count;
+}
+
+static void frame_encoded_callback(uint8_t* frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+    if (write_block(ft, frame_data, frame_size) == -1)
+    {
+        ft->cb_fwprintf(stderr, L"\n ERROR in frame_encoded_callback():write_block()...at writting in file.\n");
+        LOG(lm_main, LOG_ERROR, ("ERROR in frame_encoded_callback():write_block()...writting in file: %s  ", ft->filename));
+        report_error(ft->output, ft, OUTPUT_ERROR_WRITE, "cannot write the output file");
+        scarletbook_output_interrupt(ft->output);
+    }
+}
+
+static void frame_read_callback(scarletbook_handle_t *handle, uint8_t* frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_output_format_t *ft = (scarletbook_output_format_t *) userdata;
+
+    if (!frame_in_track(handle, ft))  // pauses are trimmed out
+        return;
+
+    if (ft->dst_decoder)
+    {
+        add_dst_frame_timecode(ft, TIME_FRAMECOUNT(&handle->frame.timecode));
+    }
+
+    if (ft->dsd_encoded_export && ft->dst_encoded_import)
+    {
+        dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
+    }
+    else if (ft->dst_encoder)
+    {
+        dst_encoder_encode(ft->dst_encoder, frame_data, frame_size);
+    }
+    else
+    {
+        // pass-through frames are checked next to being written
+        if (ft->dst_verify_only)
+            dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
+
+        if (write_block(ft, frame_data, frame_size) == -1)
         {
-            uint32_t frame_count_time_start = TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->start[ft->track]);
-            uint32_t frame_count_time_end = frame_count_time_start +
-                                            TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->duration[ft->track]);
-            //uint32_t frame_timecode = TIME_FRAMECOUNT(&handle->audio_sector.frame[handle->frame_info_idx].timecode);
-            uint32_t frame_timecode = TIME_FRAMECOUNT(&handle->frame.timecode);
-
-            if (frame_timecode >= frame_count_time_start &&
-                frame_timecode < frame_count_time_end)
-            {
-                if (ft->dsd_encoded_export && ft->dst_encoded_import)
-                {
-                    dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
-                    ft->sb_handle->count_frames++;
-                }
-                else
-                {
-                    int rezult;
-                    rezult = write_block(ft, frame_data, frame_size);
-                    if (rezult == -1)
-                    {
-                        ft->cb_fwprintf(stderr, L"\n ERROR in frame_read_callback():write_block()..at writting in dsf/dsdiff file. \n");
-                        LOG(lm_main, LOG_ERROR, ("ERROR in frame_read_callback:write_block()...writting in file: %s  ", ft->filename));
-                        raise(SIGINT);
-                    }
-                    ft->sb_handle->count_frames++;
-                }
-            }
+            ft->cb_fwprintf(stderr, L"\n ERROR in frame_read_callback():write_block()..at writting in file. \n");
+            LOG(lm_main, LOG_ERROR, ("ERROR in frame_read_callback:write_block()...writting in file: %s  ", ft->filename));
+            report_error(ft->output, ft, OUTPUT_ERROR_WRITE, "cannot write the output file");
+            scarletbook_output_interrupt(ft->output);
+        }
+    }
+    ft->sb_handle->count_frames++;
+}
+
+// Raw sectors of a local image file need no decryption, so an ISO (or a sector range of
+// it) can be copied by the kernel without passing through read_buffer. Filesystems that
+// support it (XFS, btrfs) turn the copy into a reflink. Returns the number of sectors
+// copied; whatever is left is done by the regular read/write loop.
+static uint32_t copy_raw_sectors(scarletbook_output_t *output, scarletbook_output_format_t *ft, uint32_t end_lsn)
+{
+#if defined(__linux__)
+    scarletbook_handle_t *handle = ft->sb_handle;
+    uint32_t copied = 0;
+    struct stat st;
+    off_t off_in, off_out, off_out_start;
+    int fd_in, fd_out;
+
+    // sparse output and the analysis stages need to look at every sector
+    if (handle->iso_sparse || ft->stage || ft->hash_stage)
+        return 0;
+
+    fd_in = sacd_get_image_fd(handle->sacd);
+    fd_out = fileno(ft->fd);
+    if (fd_in < 0 || fstat(fd_out, &st) != 0 || !S_ISREG(st.st_mode))
+        return 0;
+
+    if (fflush(ft->fd) != 0)
+        return 0;
+    off_in = (off_t) ft->current_lsn * SACD_LSN_SIZE;
+    off_out_start = off_out = ftello(ft->fd);
+    if (off_out < 0)
+        return 0;
+
+    while (ft->current_lsn < end_lsn && sysAtomicRead(&output->stop_processing) == 0)
+    {
+        uint32_t block_size = min(end_lsn - ft->current_lsn, COPY_RANGE_BLOCK_SIZE);
+        size_t len = (size_t) block_size * SACD_LSN_SIZE;
+
+        // the kernel may copy less than asked for, only whole blocks are accounted
+        while (len > 0)
+        {
+            ssize_t ret = copy_file_range(fd_in, &off_in, fd_out, &off_out, len, 0);
+            if (ret <= 0)
+                break;
+            len -= (size_t) ret;
         }
-        else  // no audioframe trimming (pauses will be included)
+        if (len > 0)
         {
-            if (ft->dsd_encoded_export && ft->dst_encoded_import)
-            {
-                dst_decoder_decode(ft->dst_decoder, frame_data, frame_size);
-                ft->sb_handle->count_frames++;
-            }
-            else
-            {
-                int rezult;
-                rezult = write_block(ft, frame_data, frame_size);
-                if (rezult == -1)
-                {
-                    ft->cb_fwprintf(stderr, L"\n ERROR in frame_read_callback():write_block()..at writting in file. \n");
-                    LOG(lm_main, LOG_ERROR, ("ERROR in frame_read_callback:write_block()...writting in file: %s  ", ft->filename));
-                    raise(SIGINT);
-                }
-                ft->sb_handle->count_frames++;
-            }
+            LOG(lm_main, LOG_NOTICE, ("copy_file_range stopped at lsn %u (%s), falling back to read/write", ft->current_lsn, strerror(errno)));
+            break;
         }
 
+        ft->current_lsn += block_size;
+        ft->write_length += (uint64_t) block_size * SACD_LSN_SIZE;
+        copied += block_size;
+        output->stats_total_sectors_processed += block_size;
+        output->stats_current_file_sectors_processed += block_size;
+        report_progress(output);
     }
+
+    // a fallback continues with fwrite() right after the last block copied
+    fseeko(ft->fd, off_out_start + (off_t) copied * SACD_LSN_SIZE, SEEK_SET);
+
+    return copied;
+#else
+    (void) output;
+    (void) ft;
+    (void) end_lsn;
+    return 0;
+#endif
 }
 
 #ifdef __lv2ppu__
@@ -544,10 +1171,12 @@ static void *processing_thread(void *arg)
     scarletbook_handle_t *handle = output->sb_handle;
     struct list_head * node_ptr;
     scarletbook_output_format_t *ft = NULL;
-    int non_encrypted_disc = 0;
-    int checked_for_non_encrypted_disc = 0;
 	int no_tracks_with_errors = 0;
 
+#ifndef __lv2ppu__
+    // reads, parses and writes, next to the memory of the buffers (--io-node)
+    cpu_place_io_thread();
+#endif
     sysAtomicSet(&output->processing, 1);
     while (!list_empty(&output->ripping_queue))
     {
@@ -559,40 +1188,38 @@ static void *processing_thread(void *arg)
         if (ft->dsd_encoded_export && ft->dst_encoded_import)
         {
             ft->dst_decoder = dst_decoder_create(ft->channel_count, frame_decoded_callback, frame_error_callback, ft);
+#ifndef __lv2ppu__
+            // let the decoder write straight into the layout of the output format
+            if (ft->handler.flags & OUTPUT_FLAG_DSD_PLANAR)
+            {
+                dst_decoder_set_layout(ft->dst_decoder, DST_DECODER_LAYOUT_PLANAR_LSB);
+                ft->dsd_planar_lsb = 1;
+            }
+#endif
+        }
+        else if (handle->verify_dst && ft->dst_encoded_import && (ft->handler.flags & (OUTPUT_FLAG_DSD | OUTPUT_FLAG_DST)))
+        {
+            // DST frames written as they are, decode them anyway to catch corrupt ones
+            ft->dst_decoder = dst_decoder_create(ft->channel_count, frame_verified_callback, frame_error_callback, ft);
+            ft->dst_verify_only = 1;
         }
 
         output->stats_current_file_total_sectors = ft->length_lsn;
         output->stats_current_file_sectors_processed = 0;
         output->stats_current_track++;
 
-        if (output->stats_track_callback)
-        {
-            output->stats_track_callback(ft->filename, output->stats_current_track, output->stats_total_tracks);
-        }
+        report_track(output, ft);
 
         scarletbook_frame_init(handle);
         handle->count_frames = 0;
 
-        if (create_output_file(ft) == 0)
+        if (create_output_file(output, ft) == 0)
         {
             uint32_t block_size=0, end_lsn=0, blocks_readed = 0;
-            uint32_t encrypted_start_1 = 0;
-            uint32_t encrypted_start_2 = 0;
-            uint32_t encrypted_end_1 = 0;
-            uint32_t encrypted_end_2 = 0;
-            int encrypted;
-
-            // set the encryption range
-            if (handle->area[0].area_toc != 0)
-            {
-                encrypted_start_1 = handle->area[0].area_toc->track_start;
-                encrypted_end_1 = handle->area[0].area_toc->track_end;
-            }
-            if (handle->area[1].area_toc != 0)
-            {
-                encrypted_start_2 = handle->area[1].area_toc->track_start;
-                encrypted_end_2 = handle->area[1].area_toc->track_end;
-            }
+
+            // the encode threads follow --decoder-cpus and -j like the decoder
+            if (ft->dst_encoded_export)
+                ft->dst_encoder = dst_encoder_create(ft->channel_count, 0, frame_encoded_callback, ft);
 
             // what blocks do we need to process?
             ft->current_lsn = ft->start_lsn;
@@ -602,45 +1229,29 @@ static void *processing_thread(void *arg)
 
             sysAtomicSet(&output->stop_processing, 0);
 
+            // image to image copies are left to the kernel
+            if (ft->handler.flags & OUTPUT_FLAG_RAW)
+            {
+                copy_raw_sectors(output, ft, end_lsn);
+
+                // the sectors that pass through read_buffer give the time index for free
+                if (!time_index_complete(handle))
+                    scarletbook_index_begin(handle);
+            }
+
             while (sysAtomicRead(&output->stop_processing) == 0)
             {
                 if (ft->current_lsn < end_lsn)
                 {
-                    // check what block ranges are encrypted..
-                    if (ft->current_lsn < encrypted_start_1)
-                    {
-                        block_size = min(encrypted_start_1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 0;
-                    }
-                    else if (ft->current_lsn >= encrypted_start_1 && ft->current_lsn <= encrypted_end_1)
-                    {
-                        block_size = min(encrypted_end_1 + 1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 1;
-                    }
-                    else if (ft->current_lsn > encrypted_end_1 && ft->current_lsn < encrypted_start_2)
-                    {
-                        block_size = min(encrypted_start_2 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 0;
-                    }
-                    else if (ft->current_lsn >= encrypted_start_2 && ft->current_lsn <= encrypted_end_2)
-                    {
-                        block_size = min(encrypted_end_2 + 1 - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
-                        encrypted = 1;
-                    }
-                    else
-                    {
-                        block_size = MAX_PROCESSING_BLOCK_SIZE;
-                        encrypted = 0;
-                    }
-                    block_size = min(end_lsn - ft->current_lsn, block_size);
-
-                    // read some blocks
-                    blocks_readed = sacd_read_block_raw(ft->sb_handle->sacd, ft->current_lsn, block_size, output->read_buffer);
+                    // read (and decrypt) some blocks
+                    blocks_readed = read_blocks(output, ft, ft->current_lsn, end_lsn, output->read_buffer);
 
                     if (blocks_readed == 0)
                     {
+                        block_size = min(end_lsn - ft->current_lsn, MAX_PROCESSING_BLOCK_SIZE);
                         output->fwprintf_callback(stdout, L"\n \n Error:blocks_readed =0, current_lsn:%d, end_lsn:%d, block_size:%d \n", ft->current_lsn, end_lsn, block_size);
                         LOG(lm_main, LOG_ERROR, ("Error:blocks_readed = 0, current_lsn:%d, end_lsn:%d, block_size:%d", ft->current_lsn, end_lsn, block_size));                        
+                        report_error(output, ft, OUTPUT_ERROR_READ, "cannot read the disc");
                         sysAtomicSet(&output->stop_processing, 1);
                     }
 
@@ -650,28 +1261,6 @@ static void *processing_thread(void *arg)
                     output->stats_total_sectors_processed += block_size;
                     output->stats_current_file_sectors_processed += block_size;
 
-                    // the ATAPI call which returns the flag if the disc is encrypted or not is unknown at this point. 
-                    // user reports tell me that the only non-encrypted discs out there are DSD 3 14/16 discs. 
-                    // this is a quick hack/fix for these discs.
-                    if (encrypted && checked_for_non_encrypted_disc == 0)
-                    {
-                        switch (handle->area[ft->area].area_toc->frame_format)
-                        {
-                        case FRAME_FORMAT_DSD_3_IN_14:
-                        case FRAME_FORMAT_DSD_3_IN_16:
-                            non_encrypted_disc = *(uint64_t *)(output->read_buffer + 16) == 0;
-                            break;
-                        }
-
-                        checked_for_non_encrypted_disc = 1;
-                    }
-
-                    // encrypted blocks need to be decrypted first
-                    if (encrypted && non_encrypted_disc == 0)
-                    {
-                        sacd_decrypt(ft->sb_handle->sacd, output->read_buffer, block_size);
-                    }
-
                     //debug
                     //output->fwprintf_callback(stdout, L"\n \n Debug - scarletbook_process_frames(): block_size %d, last bloc=%d \n", block_size, ft->current_lsn == end_lsn);
 
@@ -682,6 +1271,7 @@ static void *processing_thread(void *arg)
                        if (rezult_proc_frames < 0){
                            LOG(lm_main, LOG_ERROR, ("Error in return of scarlet_process_frames!, current_lsn:%d, end_lsn:%d, block_size:%d", ft->current_lsn, end_lsn, block_size));
                            output->fwprintf_callback(stdout, L"\n \n Error in processing frames! \n");
+                           report_error(output, ft, OUTPUT_ERROR_FRAMES, "broken audio sectors");
                        }
                        if (ft->current_lsn >= end_lsn){
                            LOG(lm_main, LOG_NOTICE, ("End track no. %d. After last call to scarletbook_process_frames. current_lsn >= end_lsn, current_lsn:%d, end_lsn:%d, block_size:%d", ft->track, ft->current_lsn, end_lsn, block_size));
@@ -693,10 +1283,12 @@ static void *processing_thread(void *arg)
                     // ISO output is written without frame processing                        
                     else if (ft->handler.flags & OUTPUT_FLAG_RAW)
                     {
+                       scarletbook_index_add_sectors(handle, ft->current_lsn - block_size, output->read_buffer, block_size);
                        size_t rezult=  write_block(ft, output->read_buffer, block_size);
 					   if (rezult ==(size_t) -1) 
 					   {
 						   output->fwprintf_callback(stdout, L"\n \n Error in writting ISO in file. \n");
+						   report_error(output, ft, OUTPUT_ERROR_WRITE, "cannot write the output file");
 						   sysAtomicSet(&output->stop_processing, 1);
 					   }
 					    
@@ -706,11 +1298,7 @@ static void *processing_thread(void *arg)
                     //output->fwprintf_callback(stdout, L"\n \n After scarlet_processe_frames. Processed: %d audioframes\n", ft->count_frames);
 
                     // update statistics
-                    if (output->stats_progress_callback)
-                    {
-                        output->stats_progress_callback(output->stats_total_sectors, output->stats_total_sectors_processed, 
-                            output->stats_current_file_total_sectors, output->stats_current_file_sectors_processed);
-                    }
+                    report_progress(output);
                 }
                 else
                 {
@@ -725,6 +1313,7 @@ static void *processing_thread(void *arg)
 			no_tracks_with_errors++;
             output->fwprintf_callback(stdout, L"\n \n ERROR: Cannot create output file for current track number %d of total %d !!", output->stats_current_track, output->stats_total_tracks);
             LOG(lm_main, LOG_ERROR, ("ERROR: Cannot create output file for current track number %d of total %d !!", output->stats_current_track, output->stats_total_tracks));
+            report_error(output, ft, OUTPUT_ERROR_CREATE, "cannot create the output file");
         }
 
         // Show statistics only for DFF-edit-master : print Error if nr of processed frames < of duration (nr of frames)
@@ -753,13 +1342,27 @@ static void *processing_thread(void *arg)
         {
             if(handle->concatenate == 0)
             {
-                uint32_t duration = (uint32_t)TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+                uint32_t duration;
 
-                output->fwprintf_callback(stdout, L"\n \n Processed %d audioframes. Duration specified: %d (%02d:%02d:%02d [mins:secs:frames])\n",
-                                          handle->count_frames, duration,
-                                          handle->area[ft->area].area_tracklist_time->duration[ft->track].minutes,
-                                          handle->area[ft->area].area_tracklist_time->duration[ft->track].seconds,
-                                          handle->area[ft->area].area_tracklist_time->duration[ft->track].frames);
+                if (ft->clip_end > ft->clip_start)
+                {
+                    // -T: only the frames of the time range were read
+                    duration = ft->clip_end - ft->clip_start;
+                    output->fwprintf_callback(stdout, L"\n \n Processed %d audioframes. Time range specified: %d (%02d:%02d:%02d [mins:secs:frames])\n",
+                                              handle->count_frames, duration,
+                                              (int)(duration / (60 * SACD_FRAME_RATE)),
+                                              (int)(duration / SACD_FRAME_RATE % 60),
+                                              (int)(duration % SACD_FRAME_RATE));
+                }
+                else
+                {
+                    duration = (uint32_t)TIME_FRAMECOUNT(&handle->area[ft->area].area_tracklist_time->duration[ft->track]);
+                    output->fwprintf_callback(stdout, L"\n \n Processed %d audioframes. Duration specified: %d (%02d:%02d:%02d [mins:secs:frames])\n",
+                                              handle->count_frames, duration,
+                                              handle->area[ft->area].area_tracklist_time->duration[ft->track].minutes,
+                                              handle->area[ft->area].area_tracklist_time->duration[ft->track].seconds,
+                                              handle->area[ft->area].area_tracklist_time->duration[ft->track].frames);
+                }
                 if (handle->count_frames < duration) //output->stats_current_count_frames
                 {
                     LOG(lm_main, LOG_NOTICE, ("Warning: Number of processed audioframes (%d) is smaller than number of frames in duration (%d)", handle->count_frames, duration));
@@ -782,15 +1385,19 @@ static void *processing_thread(void *arg)
         {
             output->fwprintf_callback(stdout, L"\n ...stop processing\n");
             LOG(lm_main, LOG_NOTICE, ("...stop processing"));
+            report_error(output, ft, OUTPUT_ERROR_INTERRUPTED, "stopped before the end of the file");
             // make a copy of the filename
             //char *file_to_remove = strdup(ft->filename);
 
             sysAtomicSet(&output->processing, 0);
 
-            if (ft->dsd_encoded_export && ft->dst_encoded_import)
+            if (ft->dst_decoder)
             {
                 dst_decoder_destroy(ft->dst_decoder);
+                report_dst_errors(output, ft);
             }
+            if (ft->dst_encoder)
+                dst_encoder_destroy(ft->dst_encoder);
 
             close_output_file(ft);
 			
@@ -822,10 +1429,16 @@ static void *processing_thread(void *arg)
 		
 		//DEBUG LOG(lm_main, LOG_ERROR, ("before dsd_encoded_export"));
 
-        if (ft->dsd_encoded_export && ft->dst_encoded_import)
+        if (ft->dst_decoder)
         {
             dst_decoder_destroy(ft->dst_decoder);
+            if (report_dst_errors(output, ft) > 0)
+                no_tracks_with_errors++;
         }
+
+        // writes the frames still being encoded
+        if (ft->dst_encoder)
+            dst_encoder_destroy(ft->dst_encoder);
 		
 		//DEBUG LOG(lm_main, LOG_ERROR, ("before close_output_file"));
 
@@ -891,10 +1504,37 @@ int scarletbook_output_start(scarletbook_output_t *output)
     {
         LOG(lm_main, LOG_ERROR, ("return code from processing thread creation is %d\n", ret));
     }
+    else
+        output->started = 1;
 
     return ret;
 }
 
+void scarletbook_output_set_events(scarletbook_output_t *output, const scarletbook_output_events_t *events)
+{
+    output->events = *events;
+}
+
+int scarletbook_output_wait(scarletbook_output_t *output)
+{
+#ifdef __lv2ppu__
+    uint64_t thr_exit_code;
+#else
+    void *thr_exit_code;
+#endif
+
+    if (output->started)
+    {
+#ifdef __lv2ppu__
+        sysThreadJoin(output->processing_thread_id, &thr_exit_code);
+#else
+        pthread_join(output->processing_thread_id, &thr_exit_code);
+#endif
+        output->started = 0;
+    }
+    return output->error_count;
+}
+
 void scarletbook_output_interrupt(scarletbook_output_t *output)
 {
     sysAtomicSet(&output->stop_processing, 1);
@@ -912,16 +1552,20 @@ int scarletbook_output_destroy(scarletbook_output_t *output)
     if (!output)
         return -1;
 
+    // not waited for, or never started
+    if (output->started)
+    {
 #ifdef __lv2ppu__
-    scarletbook_output_interrupt(output);
-    ret = sysThreadJoin(output->processing_thread_id, &thr_exit_code);
+        scarletbook_output_interrupt(output);
+        ret = sysThreadJoin(output->processing_thread_id, &thr_exit_code);
 #else
-    scarletbook_output_interrupt(output);
-    ret = pthread_join(output->processing_thread_id, &thr_exit_code);
+        scarletbook_output_interrupt(output);
+        ret = pthread_join(output->processing_thread_id, &thr_exit_code);
 #endif    
-    if (ret != 0)
-    {
-        LOG(lm_main, LOG_ERROR, ("processing thread didn't close properly... %x", thr_exit_code));
+        if (ret != 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("processing thread didn't close properly... %x", thr_exit_code));
+        }
     }
 
     // If decoding is aborted (eg. ctrl+C), then free() buffers after the decoder has been destroyed,
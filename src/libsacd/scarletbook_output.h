@@ -26,9 +26,11 @@
 #include "dst_decoder_ps3.h"
 #else
 #include <dst_decoder.h>
+#include <dst_encoder.h>
 #endif
 
 #include "scarletbook.h"
+#include "scarletbook_stage.h"
 
 // forward declaration
 typedef struct scarletbook_output_format_t scarletbook_output_format_t;
@@ -39,7 +41,8 @@ enum
     OUTPUT_FLAG_RAW         = 1 << 0,
     OUTPUT_FLAG_DSD         = 1 << 1,
     OUTPUT_FLAG_DST         = 1 << 2,
-    OUTPUT_FLAG_EDIT_MASTER = 1 << 3
+    OUTPUT_FLAG_EDIT_MASTER = 1 << 3,
+    OUTPUT_FLAG_DSD_PLANAR  = 1 << 4     // accepts decoded DST frames as per channel LSB first planes
 };
 
 // Handler structure defined by each output format.
@@ -57,6 +60,38 @@ scarletbook_format_handler_t;
 
 typedef int (*fwprintf_callback_t)(FILE *stream, const wchar_t *format, ...);
 
+// codes of the error event
+enum
+{
+    OUTPUT_ERROR_CREATE = 1,            // the output file could not be created
+    OUTPUT_ERROR_WRITE,
+    OUTPUT_ERROR_READ,                  // sectors could not be read
+    OUTPUT_ERROR_FRAMES,                // audio sectors with broken headers
+    OUTPUT_ERROR_DST,                   // a DST frame could not be decoded
+    OUTPUT_ERROR_INTERRUPTED
+};
+
+// structured progress and errors for library users, next to the console callbacks. The
+// events come from the processing thread and, for DST output, from the decoder.
+typedef struct
+{
+    void (*track)(void *userdata, const char *filename, int current_track, int total_tracks);
+    void (*progress)(void *userdata, uint32_t total_sectors, uint32_t total_sectors_processed,
+                     uint32_t file_sectors, uint32_t file_sectors_processed);
+    void (*error)(void *userdata, const char *filename, int code, const char *message);
+    void *userdata;
+}
+scarletbook_output_events_t;
+
+// a DST frame the decoder rejected, reported after the output is done
+typedef struct
+{
+    int                             frame;              // sequence number of the frame passed to dst_decoder
+    int                             error_code;         // DSTErr_*
+    const char                     *error_message;
+}
+dst_frame_error_t;
+
 struct scarletbook_output_format_t 
 {
     int                             area;
@@ -75,6 +110,18 @@ struct scarletbook_output_format_t
 
     int                             dst_encoded_import;
     int                             dsd_encoded_export;
+    int                             dst_encoded_export; // DSD frames are DST encoded for the output (--encode-dst)
+    int                             dsd_planar_lsb;     // decoded frames arrive as per channel LSB first planes
+
+    // time range of the area to write (frames, end exclusive), clip_end 0 for the whole track
+    uint32_t                        clip_start;
+    uint32_t                        clip_end;
+
+    // streaming (forward only) output: the sizes are known before the header is written
+    int                             stream;
+    uint64_t                        stream_frame_count; // number of frames the header announces
+    uint64_t                        stream_frame_bytes; // sum of the frame sizes, each rounded up to even
+    int                             stream_layout;      // only the header and footer are written, the audio comes from elsewhere
 
     scarletbook_format_handler_t    handler;
     void                           *priv;
@@ -83,10 +130,33 @@ struct scarletbook_output_format_t
     char                            error_str[256];
 
     dst_decoder_t                  *dst_decoder;
+    int                             dst_verify_only;    // dst_decoder checks pass-through frames, its output is discarded
+    uint32_t                       *dst_frame_timecodes;// timecode (in frames) of every frame passed to dst_decoder
+    int                             dst_frame_count;
+    int                             dst_frame_alloc;
+    dst_frame_error_t              *dst_errors;         // only touched by the decoder's write thread until it is destroyed
+    int                             dst_error_count;
+    int                             dst_error_alloc;
+
+    dst_encoder_t                  *dst_encoder;
 
     scarletbook_handle_t           *sb_handle;
+    scarletbook_output_t           *output;
     fwprintf_callback_t             cb_fwprintf;
 
+    // leaving out the silent frames at the edges of a track, see trim_silence_block()
+    int                             trim_silence;
+    int                             trim_audio_seen;    // a frame with audio was written
+    size_t                          trim_frame_size;
+    uint8_t                        *trim_hold;          // ring of silent frames held back until audio follows
+    int                             trim_hold_first;
+    int                             trim_hold_count;
+    uint32_t                        trimmed_leading;
+
+    scarletbook_stage_t            *stage;              // analysis of the written payload, NULL if none
+    scarletbook_stage_t            *hash_stage;         // digests of the sound data as stored in the file, NULL if none
+    uint64_t                        sound_data_offset;  // file offset of the first byte passed to scarletbook_output_written()
+
     struct list_head                siblings;
 }; 
 
@@ -100,8 +170,14 @@ int scarletbook_output_destroy(scarletbook_output_t *);
 int scarletbook_output_enqueue_track(scarletbook_output_t *, int, int, char *, char *, int);
 int scarletbook_output_enqueue_raw_sectors(scarletbook_output_t *, int, int, char *, char *);
 int scarletbook_output_enqueue_concatenate_tracks(scarletbook_output_t *output, int area, int track, char *file_path, char *fmt, int dsd_encoded_export, int last_track);
+void scarletbook_output_set_events(scarletbook_output_t *, const scarletbook_output_events_t *);
 int scarletbook_output_start(scarletbook_output_t *);
+// waits until all queued files are written, returns the number of error events
+int scarletbook_output_wait(scarletbook_output_t *);
 void scarletbook_output_interrupt(scarletbook_output_t *);
+
+// called by the format handlers with the sound data they just wrote to the file, in file order
+void scarletbook_output_written(scarletbook_output_format_t *, const uint8_t *, size_t);
 int scarletbook_output_is_busy(scarletbook_output_t *);
 
 #endif /* SCARLETBOOK_OUTPUT_H_INCLUDED */
@@ -35,6 +35,7 @@
 #include "scarletbook.h"
 #include "scarletbook_read.h"
 #include "scarletbook_helpers.h"
+#include "scarletbook_index.h"
 #include "sacd_reader.h"
 #include "sacd_read_internal.h"
 #include "utils.h"
@@ -85,6 +86,7 @@ scarletbook_handle_t *scarletbook_open(sacd_reader_t *sacd)
     sb->sacd      = sacd;
     sb->twoch_area_idx = -1;
     sb->mulch_area_idx = -1;
+    sb->dsf_carry_track = -1;
 
     if (scarletbook_read_master_toc(sb)==0)
     {
@@ -269,6 +271,15 @@ static void free_area(scarletbook_area_t *area)
     free(area->copyright);
     free(area->description_phonetic);
     free(area->copyright_phonetic);
+    free(area->track_fingerprint);
+    if (area->track_loudness)
+    {
+        for (i = 0; i < area->area_toc->track_count; i++)
+            free(area->track_loudness[i].blocks);
+        free(area->track_loudness);
+    }
+    free(area->track_silence);
+    scarletbook_index_free(area->time_index);
 }
 
 void scarletbook_close(scarletbook_handle_t *handle)
@@ -314,6 +325,8 @@ void scarletbook_close(scarletbook_handle_t *handle)
     if (handle->frame.data)
         free((void *) handle->frame.data);
 
+    free(handle->dsf_carry);
+
     memset(handle, 0, sizeof(scarletbook_handle_t));
 
     free(handle);
@@ -921,3 +934,246 @@ int scarletbook_process_frames(scarletbook_handle_t *handle, uint8_t *read_buffe
 }
 
 
+// a started frame is complete when all its DST packets or the full DSD frame arrived
+static inline int scan_frame_complete(scarletbook_frame_scan_t *scan)
+{
+    return scan->started && scan->size > 0 &&
+           ((scan->dst_encoded && scan->sector_count == 0) ||
+            (!scan->dst_encoded && scan->size == (uint32_t) scan->channel_count * FRAME_SIZE_64));
+}
+
+//       Same frame detection as scarletbook_process_frames, from the headers only. The payload is
+//       skipped, so frame counting, timecode checks and index building run at raw read speed.
+//       return nr of frames found >=0 succes
+//              -1 error (has sectors with broken headers)
+//
+int scarletbook_scan_frames(scarletbook_handle_t *handle, scarletbook_frame_scan_t *scan, uint32_t lsn, const uint8_t *read_buffer, int blocks_read_in, int last_block, frame_scan_callback_t frame_scan_callback, void *userdata)
+{
+    int sector_bad_reads = 0;
+    int nr_frames_found = 0;
+
+    for (int j = 0; j < blocks_read_in; j++)
+    {
+        const uint8_t *sector = read_buffer + (size_t) j * SACD_LSN_SIZE;
+        const uint8_t *packet_info, *frame_info;
+        audio_frame_header_t header;
+        int packet_info_idx, frame_info_idx = 0, frame_info_size;
+        uint32_t offset;
+
+        memcpy(&header, sector, AUDIO_SECTOR_HEADER_SIZE);
+        if (header.packet_info_count > 7)  // max 7 packets must contain an audio sector
+        {
+            sector_bad_reads = 1;
+            scan->bad_sectors++;
+            scan->started = 0;
+            LOG(lm_main, LOG_ERROR, ("Error : scarletbook_scan_frames(), > Max 7 packets in sector %u", lsn + j));
+            continue;
+        }
+
+        // packet and frame info are read in place, frame info is 3 bytes for DSD (no channel bits)
+        packet_info = sector + AUDIO_SECTOR_HEADER_SIZE;
+        frame_info = packet_info + AUDIO_PACKET_INFO_SIZE * header.packet_info_count;
+        frame_info_size = header.dst_encoded ? AUDIO_FRAME_INFO_SIZE : AUDIO_FRAME_INFO_SIZE - 1;
+        offset = AUDIO_SECTOR_HEADER_SIZE + AUDIO_PACKET_INFO_SIZE * header.packet_info_count + frame_info_size * header.frame_info_count;
+
+        for (packet_info_idx = 0; packet_info_idx < header.packet_info_count; packet_info_idx++)
+        {
+            const uint8_t *p = packet_info + packet_info_idx * AUDIO_PACKET_INFO_SIZE;
+            uint32_t packet_length = (uint32_t) (p[0] & 7) << 8 | p[1];
+
+            if (packet_length > MAX_PACKET_SIZE || offset + packet_length > SACD_LSN_SIZE)
+            {
+                sector_bad_reads = 1;
+                scan->bad_sectors++;
+                scan->started = 0;
+                break;
+            }
+            offset += packet_length;
+            if (((p[0] >> 3) & 7) != DATA_TYPE_AUDIO)
+                continue;
+
+            if (p[0] & 0x80)  // frame_start
+            {
+                const uint8_t *f;
+                uint32_t timecode;
+
+                if (frame_info_idx >= header.frame_info_count)
+                {
+                    sector_bad_reads = 1;
+                    scan->bad_sectors++;
+                    scan->started = 0;
+                    break;
+                }
+                if (scan_frame_complete(scan))
+                {
+                    scan->started = 0;
+                    frame_scan_callback(handle, scan, userdata);
+                    nr_frames_found++;
+                }
+
+                f = frame_info + frame_info_idx * frame_info_size;
+                timecode = (uint32_t) f[0] * 60 * SACD_FRAME_RATE + (uint32_t) f[1] * SACD_FRAME_RATE + f[2];
+
+                // check if timecode is consecutive (didn't miss a frame)
+                if (scan->frames_started > 0 && timecode != scan->timecode + 1)
+                {
+                    scan->discontinuities++;
+                    LOG(lm_main, LOG_ERROR, ("Error : scarletbook_scan_frames(), frametimecode not succesive! frametimecode_current:%u, frametimecode_prev:%u", timecode, scan->timecode));
+                }
+
+                scan->timecode = timecode;
+                scan->lsn = lsn + j;
+                scan->packet = packet_info_idx;
+                scan->size = 0;
+                scan->dst_encoded = header.dst_encoded;
+                scan->sector_count = header.dst_encoded ? (f[3] >> 2) & 0x1f : 0;
+                if (header.dst_encoded && (f[3] & 0x02))
+                    scan->channel_count = 6;
+                else if (header.dst_encoded && (f[3] & 0x01))
+                    scan->channel_count = 5;
+                else
+                    scan->channel_count = 2;
+                scan->started = 1;
+                scan->frames_started++;
+                frame_info_idx++;
+            }
+            if (scan->started)
+            {
+                if (scan->size + packet_length <= MAX_DST_SIZE)
+                {
+                    scan->size += packet_length;
+                    if (scan->dst_encoded)
+                    {
+                        scan->sector_count--;
+                    }
+                }
+                else
+                {
+                    sector_bad_reads = 1;
+                    scan->started = 0;
+                    LOG(lm_main, LOG_ERROR, ("Error : scarletbook_scan_frames(), frame overflow in sector %u", lsn + j));
+                }
+            }
+        }
+    }
+
+    if (last_block && scan_frame_complete(scan))
+    {
+        scan->started = 0;
+        frame_scan_callback(handle, scan, userdata);
+        nr_frames_found++;
+    }
+
+    if (sector_bad_reads > 0)
+        return -1;
+    else
+        return nr_frames_found;
+}
+
+// the drive and the network server answer reads of MAX_PROCESSING_BLOCK_SIZE, an image is
+// read in larger chunks
+#ifdef __lv2ppu__
+#define SCAN_AREA_READ_SIZE     MAX_PROCESSING_BLOCK_SIZE
+#else
+#define SCAN_AREA_READ_SIZE     4096
+#endif
+
+typedef struct
+{
+    scarletbook_area_scan_t    *report;
+    int                         channel_count;
+    frame_scan_callback_t       frame_scan_callback;
+    void                       *userdata;
+}
+area_scan_t;
+
+static void area_scan_callback(scarletbook_handle_t *handle, const scarletbook_frame_scan_t *frame, void *userdata)
+{
+    area_scan_t *area_scan = (area_scan_t *) userdata;
+    scarletbook_area_scan_t *report = area_scan->report;
+
+    if (report->frames == 0)
+        report->first_timecode = frame->timecode;
+    report->last_timecode = frame->timecode;
+    report->frames++;
+    if (frame->dst_encoded)
+        report->dst_frames++;
+    if (frame->channel_count != area_scan->channel_count)
+        report->channel_mismatches++;
+
+    if (area_scan->frame_scan_callback)
+        area_scan->frame_scan_callback(handle, frame, area_scan->userdata);
+}
+
+int scarletbook_scan_area(scarletbook_handle_t *handle, int area_idx, scarletbook_area_scan_t *report, frame_scan_callback_t frame_scan_callback, void *userdata)
+{
+    sacd_reader_t *sacd = (sacd_reader_t *) handle->sacd;
+    scarletbook_area_t *area = &handle->area[area_idx];
+    scarletbook_frame_scan_t scan;
+    area_scan_t area_scan;
+    uint32_t lsn, end_lsn, read_size;
+    uint8_t *buffer;
+    int checked_for_non_encrypted_disc = 0, non_encrypted_disc = 0;
+    int result = 0;
+
+    memset(report, 0, sizeof(scarletbook_area_scan_t));
+    memset(&scan, 0, sizeof(scarletbook_frame_scan_t));
+    if (!area->area_toc)
+        return -1;
+
+    read_size = sacd_get_image_fd(sacd) >= 0 ? SCAN_AREA_READ_SIZE : MAX_PROCESSING_BLOCK_SIZE;
+    buffer = (uint8_t *) malloc((size_t) read_size * SACD_LSN_SIZE);
+    if (!buffer)
+        return -1;
+
+    area_scan.report = report;
+    area_scan.channel_count = area->area_toc->channel_count;
+    area_scan.frame_scan_callback = frame_scan_callback;
+    area_scan.userdata = userdata;
+
+    lsn = area->area_toc->track_start;
+    end_lsn = area->area_toc->track_end + 1;
+    while (lsn < end_lsn)
+    {
+        uint32_t block_size = min(end_lsn - lsn, read_size);
+        uint32_t blocks_read = sacd_read_block_raw(sacd, lsn, block_size, buffer);
+
+        if (blocks_read == 0)
+        {
+            // go on after the chunk, the frame around it is lost
+            LOG(lm_main, LOG_ERROR, ("Error : scarletbook_scan_area(), read error at sector %u", lsn));
+            report->read_errors += block_size;
+            scan.started = 0;
+            lsn += block_size;
+            result = -1;
+            continue;
+        }
+
+        // the whole area is encrypted, except on the DSD 3 14/16 discs that are not (see read_blocks)
+        if (!checked_for_non_encrypted_disc)
+        {
+            switch (area->area_toc->frame_format)
+            {
+            case FRAME_FORMAT_DSD_3_IN_14:
+            case FRAME_FORMAT_DSD_3_IN_16:
+                non_encrypted_disc = *(uint64_t *)(buffer + 16) == 0;
+                break;
+            }
+            checked_for_non_encrypted_disc = 1;
+        }
+        if (!non_encrypted_disc)
+        {
+            sacd_decrypt(sacd, buffer, blocks_read);
+        }
+
+        report->sectors += blocks_read;
+        lsn += blocks_read;
+        scarletbook_scan_frames(handle, &scan, lsn - blocks_read, buffer, (int) blocks_read, lsn >= end_lsn, area_scan_callback, &area_scan);
+    }
+
+    report->bad_sectors = scan.bad_sectors;
+    report->discontinuities = scan.discontinuities;
+
+    free(buffer);
+    return result;
+}
@@ -54,6 +54,62 @@ typedef void (*frame_read_callback_t)(scarletbook_handle_t *handle, uint8_t* fra
  */
 int scarletbook_process_frames(scarletbook_handle_t *, uint8_t *, int, int, frame_read_callback_t, void *);
 
+/**
+ * header-only scan of audio sectors: the frames are found like scarletbook_process_frames
+ * does, from the sector header, packet info and frame info, but the payload is never copied
+ */
+typedef struct
+{
+    // the frame found, valid in the callback
+    uint32_t    timecode;               // frames since the start of the area
+    uint32_t    lsn;                    // sector holding the first packet of the frame
+    int         packet;                 // index of that packet in the sector
+    uint32_t    size;                   // payload bytes
+    int         dst_encoded;
+    int         channel_count;
+
+    // scan state, zeroed before the first sector
+    int         started;
+    int         sector_count;           // DST packets still to come
+    uint32_t    frames_started;
+    uint32_t    discontinuities;        // frames whose timecode does not follow the previous one
+    uint32_t    bad_sectors;            // sectors with broken headers
+}
+scarletbook_frame_scan_t;
+
+typedef void (*frame_scan_callback_t)(scarletbook_handle_t *handle, const scarletbook_frame_scan_t *frame, void *userdata);
+
+/**
+ * scans blocks sectors starting at lsn and does a callback for every complete frame
+ *   return -1 if the sectors have broken headers
+ *          nr of frames found otherwise
+ */
+int scarletbook_scan_frames(scarletbook_handle_t *, scarletbook_frame_scan_t *, uint32_t, const uint8_t *, int, int, frame_scan_callback_t, void *);
+
+/**
+ * disc sanity report of an area
+ */
+typedef struct
+{
+    uint32_t    sectors;                // sectors read
+    uint32_t    read_errors;            // sectors that could not be read
+    uint32_t    bad_sectors;
+    uint32_t    frames;                 // complete frames
+    uint32_t    dst_frames;
+    uint32_t    channel_mismatches;     // frames with another channel count than the area
+    uint32_t    discontinuities;
+    uint32_t    first_timecode;
+    uint32_t    last_timecode;
+}
+scarletbook_area_scan_t;
+
+/**
+ * reads all audio sectors of an area in large chunks and scans them, callback may be NULL
+ *   return -1 if sectors could not be read
+ *          0 succes
+ */
+int scarletbook_scan_area(scarletbook_handle_t *, int, scarletbook_area_scan_t *, frame_scan_callback_t, void *);
+
 /**
  * scarletbook_close(ifofile);
  * Cleans up the scarletbook information. This will free all data allocated for the
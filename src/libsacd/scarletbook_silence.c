@@ -0,0 +1,201 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <logging.h>
+
+#include "scarletbook.h"
+#include "scarletbook_output.h"
+#include "scarletbook_stage.h"
+#include "dsd_silence.h"
+
+// Finds where the audio of a track starts and ends by scanning for DSD idle patterns.
+// While some channel has not started yet the frames are scanned forward; after that
+// only the tail of each frame is looked at backwards, which in music stops after a few
+// bytes, so the stage costs next to nothing on top of the copy into the stage.
+
+typedef struct
+{
+    int          channel_count;
+    int          planar_lsb;
+    size_t       frame_size;
+    size_t       frame_used;
+    uint8_t     *frame;
+    uint64_t     length;                        // bytes per channel seen
+    uint32_t     pending_first;                 // channels without an active byte so far
+    uint64_t     first[MAX_CHANNEL_COUNT];
+    uint64_t     last[MAX_CHANNEL_COUNT];       // one past the last active byte
+    uint32_t     seen_last;                     // channels with a valid last[]
+}
+silence_stage_t;
+
+static void *silence_start(scarletbook_output_format_t *ft)
+{
+    scarletbook_handle_t *handle = ft->sb_handle;
+    scarletbook_area_t *area = &handle->area[ft->area];
+    silence_stage_t *ss;
+
+    // only decoded DSD of a single track
+    if (!(handle->silence_report || handle->trim_silence) || !ft->dsd_encoded_export || (ft->handler.flags & (OUTPUT_FLAG_RAW | OUTPUT_FLAG_EDIT_MASTER)) || handle->concatenate)
+        return NULL;
+
+    if (!area->track_silence)
+        area->track_silence = (track_silence_t *) calloc(area->area_toc->track_count, sizeof(track_silence_t));
+    if (!area->track_silence)
+        return NULL;
+
+    ss = (silence_stage_t *) calloc(1, sizeof(silence_stage_t));
+    if (!ss)
+        return NULL;
+    ss->channel_count = area->area_toc->channel_count;
+    ss->planar_lsb = ft->dsd_planar_lsb;
+    ss->frame_size = FRAME_SIZE_64 * ss->channel_count;
+    ss->frame = (uint8_t *) malloc(ss->frame_size);
+    if (!ss->frame)
+    {
+        free(ss);
+        return NULL;
+    }
+    ss->pending_first = (1u << ss->channel_count) - 1;
+    return ss;
+}
+
+static void silence_frame(silence_stage_t *ss)
+{
+    size_t pos[MAX_CHANNEL_COUNT];
+    uint32_t pending;
+    int c;
+
+    if (ss->planar_lsb)
+    {
+        for (c = 0; c < ss->channel_count; c++)
+        {
+            const uint8_t *plane = ss->frame + c * FRAME_SIZE_64;
+
+            if (ss->pending_first & (1u << c))
+            {
+                pending = 1;
+                dsd_silence_scan_forward(plane, FRAME_SIZE_64, 1, &pending, &pos[c]);
+                if (!pending)
+                {
+                    ss->first[c] = ss->length + pos[c];
+                    ss->pending_first &= ~(1u << c);
+                }
+            }
+            pending = 1;
+            dsd_silence_scan_backward(plane, FRAME_SIZE_64, 1, &pending, &pos[c]);
+            if (!pending)
+            {
+                ss->last[c] = ss->length + pos[c] + 1;
+                ss->seen_last |= 1u << c;
+            }
+        }
+    }
+    else
+    {
+        if (ss->pending_first)
+        {
+            pending = ss->pending_first;
+            dsd_silence_scan_forward(ss->frame, ss->frame_size, ss->channel_count, &pending, pos);
+            for (c = 0; c < ss->channel_count; c++)
+            {
+                if ((ss->pending_first & ~pending) & (1u << c))
+                    ss->first[c] = ss->length + pos[c];
+            }
+            ss->pending_first = pending;
+        }
+        pending = (1u << ss->channel_count) - 1;
+        dsd_silence_scan_backward(ss->frame, ss->frame_size, ss->channel_count, &pending, pos);
+        for (c = 0; c < ss->channel_count; c++)
+        {
+            if (!(pending & (1u << c)))
+            {
+                ss->last[c] = ss->length + pos[c] + 1;
+                ss->seen_last |= 1u << c;
+            }
+        }
+    }
+    ss->length += FRAME_SIZE_64;
+}
+
+static void silence_process(void *priv, const uint8_t *buf, size_t len)
+{
+    silence_stage_t *ss = (silence_stage_t *) priv;
+
+    // the stage hands over arbitrary slices of the frame stream, collect whole frames
+    while (len > 0)
+    {
+        size_t n = ss->frame_size - ss->frame_used;
+        if (n > len)
+            n = len;
+        memcpy(ss->frame + ss->frame_used, buf, n);
+        ss->frame_used += n;
+        buf += n;
+        len -= n;
+        if (ss->frame_used == ss->frame_size)
+        {
+            silence_frame(ss);
+            ss->frame_used = 0;
+        }
+    }
+}
+
+static void silence_stop(void *priv, scarletbook_output_format_t *ft)
+{
+    silence_stage_t *ss = (silence_stage_t *) priv;
+    track_silence_t *track_silence = &ft->sb_handle->area[ft->area].track_silence[ft->track];
+    uint64_t first = ss->length, last = 0;
+    int c;
+
+    for (c = 0; c < ss->channel_count; c++)
+    {
+        if (!(ss->pending_first & (1u << c)) && ss->first[c] < first)
+            first = ss->first[c];
+        if ((ss->seen_last & (1u << c)) && ss->last[c] > last)
+            last = ss->last[c];
+        LOG(lm_main, LOG_NOTICE, ("silence: area %d, track %d, channel %d, leading: %" PRIu64 ", trailing: %" PRIu64 " bytes", ft->area, ft->track + 1, c,
+            (ss->pending_first & (1u << c)) ? ss->length : ss->first[c], (ss->seen_last & (1u << c)) ? ss->length - ss->last[c] : ss->length));
+    }
+
+    track_silence->length = ss->length;
+    track_silence->leading = first;
+    track_silence->trailing = last > 0 ? ss->length - last : ss->length;
+    track_silence->valid = 1;
+
+    free(ss->frame);
+    free(ss);
+}
+
+scarletbook_stage_handler_t const * silence_stage_fn(void)
+{
+    static scarletbook_stage_handler_t handler = 
+    {
+        "silence",
+        silence_start,
+        silence_process,
+        silence_stop
+    };
+    return &handler;
+}
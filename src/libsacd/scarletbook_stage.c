@@ -0,0 +1,286 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __lv2ppu__
+#include <pthread.h>
+#endif
+
+#include <utils.h>
+#include <logging.h>
+#include <charset.h>
+#ifndef __lv2ppu__
+#include <cpu.h>
+#endif
+
+#include "scarletbook_output.h"
+#include "scarletbook_stage.h"
+
+#define MAX_STAGE_HANDLERS      8
+#define STAGE_CHUNK_SIZE        (1024 * 1024)
+#define STAGE_QUEUE_LIMIT       64              // chunks in flight before the writer waits
+
+typedef struct stage_chunk_s
+{
+    struct stage_chunk_s *next;
+    size_t                used;
+    uint8_t               data[STAGE_CHUNK_SIZE];
+}
+stage_chunk_t;
+
+struct scarletbook_stage_s
+{
+    scarletbook_output_format_t        *ft;
+    scarletbook_stage_handler_t const  *handler[MAX_STAGE_HANDLERS];
+    void                               *priv[MAX_STAGE_HANDLERS];
+    int                                 handler_count;
+
+    stage_chunk_t                      *filling;        // owned by the writer
+    stage_chunk_t                      *head, *tail;    // queued for the stage thread
+    int                                 queued;
+    int                                 done;
+    int                                 running;
+
+#ifndef __lv2ppu__
+    pthread_t                           thread;
+    pthread_mutex_t                     mutex;
+    pthread_cond_t                      have;
+    pthread_cond_t                      room;
+#endif
+};
+
+scarletbook_stage_t *scarletbook_stage_create(scarletbook_output_format_t *ft)
+{
+    scarletbook_stage_t *stage = (scarletbook_stage_t *) calloc(1, sizeof(scarletbook_stage_t));
+    if (!stage)
+        return NULL;
+    stage->ft = ft;
+#ifndef __lv2ppu__
+    pthread_mutex_init(&stage->mutex, NULL);
+    pthread_cond_init(&stage->have, NULL);
+    pthread_cond_init(&stage->room, NULL);
+#endif
+    return stage;
+}
+
+int scarletbook_stage_add(scarletbook_stage_t *stage, scarletbook_stage_handler_t const *handler)
+{
+    void *priv;
+
+    if (stage->running || stage->handler_count == MAX_STAGE_HANDLERS)
+        return -1;
+
+    priv = handler->start ? handler->start(stage->ft) : NULL;
+    if (!priv)
+        return 0;
+
+    stage->handler[stage->handler_count] = handler;
+    stage->priv[stage->handler_count] = priv;
+    stage->handler_count++;
+    return 1;
+}
+
+static void process_chunk(scarletbook_stage_t *stage, stage_chunk_t *chunk)
+{
+    int i;
+    for (i = 0; i < stage->handler_count; i++)
+        stage->handler[i]->process(stage->priv[i], chunk->data, chunk->used);
+}
+
+#ifndef __lv2ppu__
+static void *stage_thread(void *arg)
+{
+    scarletbook_stage_t *stage = (scarletbook_stage_t *) arg;
+    stage_chunk_t *chunk;
+
+    cpu_place_io_thread();
+    for (;;)
+    {
+        pthread_mutex_lock(&stage->mutex);
+        while (!stage->head && !stage->done)
+            pthread_cond_wait(&stage->have, &stage->mutex);
+        chunk = stage->head;
+        if (chunk)
+        {
+            stage->head = chunk->next;
+            if (!stage->head)
+                stage->tail = NULL;
+        }
+        pthread_mutex_unlock(&stage->mutex);
+
+        if (!chunk)
+            break;
+
+        process_chunk(stage, chunk);
+        free(chunk);
+
+        pthread_mutex_lock(&stage->mutex);
+        stage->queued--;
+        pthread_cond_signal(&stage->room);
+        pthread_mutex_unlock(&stage->mutex);
+    }
+    return NULL;
+}
+#endif
+
+int scarletbook_stage_start(scarletbook_stage_t *stage)
+{
+    if (stage->handler_count == 0)
+        return -1;
+#ifndef __lv2ppu__
+    if (pthread_create(&stage->thread, NULL, stage_thread, stage) != 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("scarletbook_stage_start(): cannot create the stage thread"));
+        return -1;
+    }
+#endif
+    stage->running = 1;
+    return 0;
+}
+
+static void queue_chunk(scarletbook_stage_t *stage, stage_chunk_t *chunk)
+{
+#ifdef __lv2ppu__
+    process_chunk(stage, chunk);
+    free(chunk);
+#else
+    pthread_mutex_lock(&stage->mutex);
+    while (stage->queued >= STAGE_QUEUE_LIMIT)
+        pthread_cond_wait(&stage->room, &stage->mutex);
+    chunk->next = NULL;
+    if (stage->tail)
+        stage->tail->next = chunk;
+    else
+        stage->head = chunk;
+    stage->tail = chunk;
+    stage->queued++;
+    pthread_cond_signal(&stage->have);
+    pthread_mutex_unlock(&stage->mutex);
+#endif
+}
+
+void scarletbook_stage_push(scarletbook_stage_t *stage, const uint8_t *buf, size_t len)
+{
+    if (!stage || !stage->running)
+        return;
+
+    // small writes (DST frames) are gathered, so the thread hand-off happens once per chunk
+    while (len > 0)
+    {
+        size_t n;
+
+        if (!stage->filling)
+        {
+            stage->filling = (stage_chunk_t *) malloc(sizeof(stage_chunk_t));
+            if (!stage->filling)
+                return;
+            stage->filling->used = 0;
+        }
+
+        n = min(len, STAGE_CHUNK_SIZE - stage->filling->used);
+        memcpy(stage->filling->data + stage->filling->used, buf, n);
+        stage->filling->used += n;
+        buf += n;
+        len -= n;
+
+        if (stage->filling->used == STAGE_CHUNK_SIZE)
+        {
+            queue_chunk(stage, stage->filling);
+            stage->filling = NULL;
+        }
+    }
+}
+
+void scarletbook_stage_destroy(scarletbook_stage_t *stage)
+{
+    int i;
+
+    if (!stage)
+        return;
+
+    if (stage->running)
+    {
+        if (stage->filling && stage->filling->used > 0)
+        {
+            queue_chunk(stage, stage->filling);
+            stage->filling = NULL;
+        }
+#ifndef __lv2ppu__
+        pthread_mutex_lock(&stage->mutex);
+        stage->done = 1;
+        pthread_cond_signal(&stage->have);
+        pthread_mutex_unlock(&stage->mutex);
+        pthread_join(stage->thread, NULL);
+#endif
+    }
+    free(stage->filling);
+
+    for (i = 0; i < stage->handler_count; i++)
+    {
+        if (stage->handler[i]->stop)
+            stage->handler[i]->stop(stage->priv[i], stage->ft);
+    }
+
+#ifndef __lv2ppu__
+    pthread_mutex_destroy(&stage->mutex);
+    pthread_cond_destroy(&stage->have);
+    pthread_cond_destroy(&stage->room);
+#endif
+    free(stage);
+}
+
+FILE *scarletbook_stage_open_sidecar(scarletbook_output_format_t *ft, const char *extension)
+{
+    FILE *fd;
+    char *sidecar_filename;
+    size_t len;
+
+    if (strcmp(ft->filename, "-") == 0)
+        return NULL;
+
+    len = strlen(ft->filename) + 1 + strlen(extension) + 1;
+    sidecar_filename = (char *) malloc(len);
+    snprintf(sidecar_filename, len, "%s.%s", ft->filename, extension);
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    {
+        char filename_long[1024];
+        wchar_t *wide_filename;
+
+        memset(filename_long, '\0', sizeof(filename_long));
+        strcpy(filename_long,"\\\\?\\");
+        strncat(filename_long, sidecar_filename, min(1016, strlen(sidecar_filename)));
+
+        wide_filename = (wchar_t *)charset_convert(filename_long, strlen(filename_long), "UTF-8", "UCS-2-INTERNAL");
+        fd = _wfopen(wide_filename, L"wb");
+        free(wide_filename);
+    }
+#else
+    fd = fopen(sidecar_filename, "wb");
+#endif
+    if (fd == NULL)
+        LOG(lm_main, LOG_ERROR, ("cannot create %s", sidecar_filename));
+
+    free(sidecar_filename);
+    return fd;
+}
@@ -0,0 +1,55 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_STAGE_H_INCLUDED
+#define SCARLETBOOK_STAGE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// A stage taps the payload handed to an output format and analyses it on a thread of
+// its own, so the writer only pays for a memcpy. All handlers of a stage see the same
+// bytes in the same order.
+
+typedef struct scarletbook_output_format_t scarletbook_output_format_t;
+typedef struct scarletbook_stage_s scarletbook_stage_t;
+
+// Handler structure defined by each analysis.
+typedef struct scarletbook_stage_handler_t
+{
+    char const *name;
+    void *(*start)(scarletbook_output_format_t *ft);                   // NULL result: not interested in this file
+    void  (*process)(void *priv, const uint8_t *buf, size_t len);      // runs on the stage thread
+    void  (*stop)(void *priv, scarletbook_output_format_t *ft);        // after the last byte, frees priv
+}
+scarletbook_stage_handler_t;
+
+scarletbook_stage_t *scarletbook_stage_create(scarletbook_output_format_t *);
+int scarletbook_stage_add(scarletbook_stage_t *, scarletbook_stage_handler_t const *);
+int scarletbook_stage_start(scarletbook_stage_t *);
+void scarletbook_stage_push(scarletbook_stage_t *, const uint8_t *, size_t);
+void scarletbook_stage_destroy(scarletbook_stage_t *);
+
+// opens "<output file>.<extension>" for writing, NULL when the output goes to stdout
+FILE *scarletbook_stage_open_sidecar(scarletbook_output_format_t *, const char *extension);
+
+#endif /* SCARLETBOOK_STAGE_H_INCLUDED */
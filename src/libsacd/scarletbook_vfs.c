@@ -0,0 +1,503 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <logging.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "scarletbook_index.h"
+#include "scarletbook_output.h"
+#include "scarletbook_vfs.h"
+#include "sacd_reader.h"
+#include "utils.h"
+
+#define VFS_CHUNK_FRAMES        32      // frames decoded at once, about 0.4 seconds
+#define VFS_CACHE_CHUNKS        16
+
+#define DSF_BLOCK_SIZE          4096    // bytes per channel of a DSF block, see dsf.h
+
+extern scarletbook_format_handler_t const * dsdiff_format_fn(void);
+extern scarletbook_format_handler_t const * dsf_format_fn(void);
+
+typedef struct
+{
+    int                     index;              // chunk of the track it holds, -1 if none
+    uint64_t                used;               // LRU clock of the last read
+    uint8_t                *data;
+}
+vfs_chunk_t;
+
+struct scarletbook_vfs_file_s
+{
+    scarletbook_handle_t   *handle;
+    int                     area;
+    int                     track;
+    int                     dsf;                // chunks hold one LSB first plane per channel, otherwise interleaved MSB frames
+    int                     channel_count;
+    uint32_t                first_timecode;
+    uint32_t                frame_count;
+
+    uint8_t                *header;
+    size_t                  header_size;
+    uint8_t                *footer;
+    size_t                  footer_size;
+    uint64_t                audio_size;
+
+    vfs_chunk_t            *cache;
+    int                     cache_size;
+    uint64_t                clock;
+    uint8_t                *read_buffer;
+    int                     checked_for_non_encrypted_disc;
+    int                     non_encrypted_disc;
+
+    // the chunk being filled
+    vfs_chunk_t            *fill;
+    uint32_t                fill_start;         // timecode of its first frame
+    uint32_t                fill_count;
+    dst_decoder_t          *dst_decoder;
+    int                    *fill_slots;         // slot of every frame passed to dst_decoder, -1 if it failed
+    int                     fill_submitted;
+    int                     fill_decoded;
+};
+
+static inline uint8_t reverse_bits(uint8_t b)
+{
+    b = (uint8_t) ((b & 0xf0) >> 4 | (b & 0x0f) << 4);
+    b = (uint8_t) ((b & 0xcc) >> 2 | (b & 0x33) << 2);
+    return (uint8_t) ((b & 0xaa) >> 1 | (b & 0x55) << 1);
+}
+
+static size_t chunk_size(scarletbook_vfs_file_t *file)
+{
+    return (size_t) VFS_CHUNK_FRAMES * FRAME_SIZE_64 * file->channel_count;
+}
+
+// The format handler writes a streamed file of frame_count frames, with stream_layout it
+// leaves out the audio, so the temporary file holds the header followed by the footer.
+static int render_layout(scarletbook_vfs_file_t *file, scarletbook_format_handler_t const *handler)
+{
+    scarletbook_handle_t *handle = file->handle;
+    scarletbook_output_format_t ft;
+    int dsf_nopad = handle->dsf_nopad;
+    long header_end, file_end;
+    int result = -1;
+
+    memset(&ft, 0, sizeof(ft));
+    ft.fd = tmpfile();
+    ft.priv = calloc(1, handler->priv_size);
+    if (!ft.fd || !ft.priv)
+        goto end;
+
+    ft.area = file->area;
+    ft.track = file->track;
+    ft.start_lsn = handle->area[file->area].area_tracklist_offset->track_start_lsn[file->track];
+    ft.length_lsn = handle->area[file->area].area_tracklist_offset->track_length_lsn[file->track];
+    ft.filename = "virtual file";
+    ft.channel_count = file->channel_count;
+    ft.dsd_encoded_export = 1;
+    ft.dsd_planar_lsb = file->dsf;
+    ft.stream = 1;
+    ft.stream_layout = 1;
+    ft.stream_frame_count = file->frame_count;
+    ft.handler = *handler;
+    ft.sb_handle = handle;
+
+    // every virtual file stands alone, no samples are carried over from the previous track
+    handle->dsf_nopad = 0;
+    result = handler->startwrite(&ft);
+    header_end = ftell(ft.fd);
+    if (handler->stopwrite(&ft) != 0)
+        result = -1;
+    file_end = ftell(ft.fd);
+    handle->dsf_nopad = dsf_nopad;
+
+    if (result != 0 || header_end <= 0 || file_end < header_end)
+    {
+        result = -1;
+        goto end;
+    }
+
+    file->header_size = (size_t) header_end;
+    file->footer_size = (size_t) (file_end - header_end);
+    file->header = (uint8_t *) malloc(file->header_size);
+    file->footer = (uint8_t *) malloc(file->footer_size + 1);
+    rewind(ft.fd);
+    if (!file->header || !file->footer ||
+        fread(file->header, 1, file->header_size, ft.fd) != file->header_size ||
+        fread(file->footer, 1, file->footer_size, ft.fd) != file->footer_size)
+    {
+        result = -1;
+    }
+
+end:
+    if (ft.fd)
+        fclose(ft.fd);
+    free(ft.priv);
+    return result;
+}
+
+static void place_frame(scarletbook_vfs_file_t *file, int slot, const uint8_t *frame_data, int planar_lsb)
+{
+    size_t plane_size = (size_t) VFS_CHUNK_FRAMES * FRAME_SIZE_64;
+    uint8_t *chunk_data = file->fill->data;
+    int c, i;
+
+    if (!file->dsf)
+    {
+        memcpy(chunk_data + (size_t) slot * FRAME_SIZE_64 * file->channel_count, frame_data, FRAME_SIZE_64 * file->channel_count);
+    }
+    else if (planar_lsb)
+    {
+        for (c = 0; c < file->channel_count; c++)
+            memcpy(chunk_data + c * plane_size + (size_t) slot * FRAME_SIZE_64, frame_data + c * FRAME_SIZE_64, FRAME_SIZE_64);
+    }
+    else
+    {
+        for (c = 0; c < file->channel_count; c++)
+        {
+            uint8_t *plane = chunk_data + c * plane_size + (size_t) slot * FRAME_SIZE_64;
+            for (i = 0; i < FRAME_SIZE_64; i++)
+                plane[i] = reverse_bits(frame_data[i * file->channel_count + c]);
+        }
+    }
+}
+
+// the decoder hands back the frames in the order they were passed
+static void frame_decoded_callback(uint8_t *frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_vfs_file_t *file = (scarletbook_vfs_file_t *) userdata;
+    int slot = file->fill_slots[file->fill_decoded++];
+
+    if (slot >= 0 && frame_size == (size_t) FRAME_SIZE_64 * file->channel_count)
+        place_frame(file, slot, frame_data, file->dsf);
+}
+
+static void frame_error_callback(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata)
+{
+    scarletbook_vfs_file_t *file = (scarletbook_vfs_file_t *) userdata;
+
+    LOG(lm_main, LOG_ERROR, ("virtual file: area %d, track %d, frame %u: %s, read as silence", file->area, file->track,
+        file->fill_start + file->fill_slots[frame_count], frame_error_message));
+    file->fill_slots[frame_count] = -1;
+}
+
+static void frame_read_callback(scarletbook_handle_t *handle, uint8_t *frame_data, size_t frame_size, void *userdata)
+{
+    scarletbook_vfs_file_t *file = (scarletbook_vfs_file_t *) userdata;
+    uint32_t timecode = TIME_FRAMECOUNT(&handle->frame.timecode);
+    int slot;
+
+    // the first sectors may also hold the end of the frames before the chunk
+    if (timecode < file->fill_start || timecode >= file->fill_start + file->fill_count)
+        return;
+    slot = (int) (timecode - file->fill_start);
+
+    if (handle->frame.dst_encoded)
+    {
+        if (file->fill_submitted == VFS_CHUNK_FRAMES)
+            return;
+        if (!file->dst_decoder)
+        {
+            file->dst_decoder = dst_decoder_create(file->channel_count, frame_decoded_callback, frame_error_callback, file);
+            if (file->dsf)
+                dst_decoder_set_layout(file->dst_decoder, DST_DECODER_LAYOUT_PLANAR_LSB);
+        }
+        file->fill_slots[file->fill_submitted++] = slot;
+        dst_decoder_decode(file->dst_decoder, frame_data, frame_size);
+    }
+    else if (frame_size == (size_t) FRAME_SIZE_64 * file->channel_count)
+    {
+        place_frame(file, slot, frame_data, 0);
+    }
+}
+
+// reads the sectors holding the frames of a chunk, from the time index, and decodes them
+static int fill_chunk(scarletbook_vfs_file_t *file, vfs_chunk_t *chunk, uint32_t index)
+{
+    scarletbook_handle_t *handle = file->handle;
+    area_toc_t *area_toc = handle->area[file->area].area_toc;
+    uint32_t lsn, end_lsn, blocks_readed;
+    int result = 0;
+
+    file->fill = chunk;
+    file->fill_start = file->first_timecode + index * VFS_CHUNK_FRAMES;
+    file->fill_count = min((uint32_t) VFS_CHUNK_FRAMES, file->frame_count - index * VFS_CHUNK_FRAMES);
+    file->fill_submitted = 0;
+    file->fill_decoded = 0;
+    chunk->index = -1;
+
+    // frames that are missing or fail to decode stay silent
+    memset(chunk->data, file->dsf ? 0x96 : 0x69, chunk_size(file));
+
+    lsn = scarletbook_index_start_lsn(handle, file->area, file->fill_start);
+    end_lsn = scarletbook_index_end_lsn(handle, file->area, file->fill_start + file->fill_count);
+    if (lsn == 0)
+        return -1;
+    if (end_lsn == 0 || end_lsn > area_toc->track_end)
+        end_lsn = area_toc->track_end;
+
+    scarletbook_frame_init(handle);
+    while (lsn <= end_lsn)
+    {
+        blocks_readed = sacd_read_block_raw(handle->sacd, lsn, min(end_lsn + 1 - lsn, MAX_PROCESSING_BLOCK_SIZE), file->read_buffer);
+        if (blocks_readed == 0)
+        {
+            LOG(lm_main, LOG_ERROR, ("virtual file: area %d, track %d, read error at lsn: %u", file->area, file->track, lsn));
+            result = -1;
+            break;
+        }
+
+        // as in the output: DSD 3 in 14/16 discs are not encrypted
+        if (!file->checked_for_non_encrypted_disc)
+        {
+            if (area_toc->frame_format == FRAME_FORMAT_DSD_3_IN_14 || area_toc->frame_format == FRAME_FORMAT_DSD_3_IN_16)
+                file->non_encrypted_disc = *(uint64_t *) (file->read_buffer + 16) == 0;
+            file->checked_for_non_encrypted_disc = 1;
+        }
+        if (!file->non_encrypted_disc)
+            sacd_decrypt(handle->sacd, file->read_buffer, blocks_readed);
+
+        lsn += blocks_readed;
+        scarletbook_process_frames(handle, file->read_buffer, blocks_readed, lsn > end_lsn, frame_read_callback, file);
+    }
+
+    // waits for the frames still in the decoder
+    if (file->dst_decoder)
+    {
+        dst_decoder_destroy(file->dst_decoder);
+        file->dst_decoder = NULL;
+    }
+
+    if (result == 0)
+        chunk->index = (int) index;
+    return result;
+}
+
+static vfs_chunk_t *get_chunk(scarletbook_vfs_file_t *file, uint32_t index)
+{
+    vfs_chunk_t *chunk = NULL;
+    int i;
+
+    for (i = 0; i < file->cache_size; i++)
+    {
+        if (file->cache[i].index == (int) index)
+        {
+            chunk = &file->cache[i];
+            break;
+        }
+    }
+
+    if (!chunk)
+    {
+        // the least recently used chunk makes room
+        chunk = &file->cache[0];
+        for (i = 1; i < file->cache_size; i++)
+        {
+            if (file->cache[i].used < chunk->used)
+                chunk = &file->cache[i];
+        }
+
+        if (!chunk->data)
+            chunk->data = (uint8_t *) malloc(chunk_size(file));
+        if (!file->read_buffer)
+            file->read_buffer = (uint8_t *) malloc(MAX_PROCESSING_BLOCK_SIZE * SACD_LSN_SIZE);
+        if (!chunk->data || !file->read_buffer || fill_chunk(file, chunk, index) != 0)
+            return NULL;
+    }
+
+    chunk->used = ++file->clock;
+    return chunk;
+}
+
+// DSF: blocks of DSF_BLOCK_SIZE bytes per channel, the last one zero padded
+static int read_dsf_audio(scarletbook_vfs_file_t *file, uint8_t *buf, size_t size, uint64_t offset)
+{
+    uint64_t group_size = (uint64_t) DSF_BLOCK_SIZE * file->channel_count;
+    uint64_t channel_size = (uint64_t) file->frame_count * FRAME_SIZE_64;
+    uint64_t chunk_plane_size = (uint64_t) VFS_CHUNK_FRAMES * FRAME_SIZE_64;
+    uint64_t group = offset / group_size;
+    int channel = (int) (offset % group_size / DSF_BLOCK_SIZE);
+    uint64_t block_offset = offset % DSF_BLOCK_SIZE;
+    uint64_t position = group * DSF_BLOCK_SIZE + block_offset;      // in the data of the channel
+    vfs_chunk_t *chunk;
+    size_t len;
+
+    len = (size_t) min(size, DSF_BLOCK_SIZE - block_offset);
+    if (position >= channel_size)
+    {
+        memset(buf, 0, len);
+        return (int) len;
+    }
+
+    len = (size_t) min(len, min(chunk_plane_size - position % chunk_plane_size, channel_size - position));
+    chunk = get_chunk(file, (uint32_t) (position / chunk_plane_size));
+    if (!chunk)
+        return -1;
+    memcpy(buf, chunk->data + channel * chunk_plane_size + position % chunk_plane_size, len);
+    return (int) len;
+}
+
+// DSDIFF: the frames one after the other
+static int read_dsdiff_audio(scarletbook_vfs_file_t *file, uint8_t *buf, size_t size, uint64_t offset)
+{
+    uint64_t chunk_bytes = chunk_size(file);
+    vfs_chunk_t *chunk;
+    size_t len;
+
+    len = (size_t) min(size, min(chunk_bytes - offset % chunk_bytes, file->audio_size - offset));
+    chunk = get_chunk(file, (uint32_t) (offset / chunk_bytes));
+    if (!chunk)
+        return -1;
+    memcpy(buf, chunk->data + offset % chunk_bytes, len);
+    return (int) len;
+}
+
+scarletbook_vfs_file_t *scarletbook_vfs_open(scarletbook_handle_t *handle, int area, int track, const char *fmt, int cache_chunks)
+{
+    scarletbook_format_handler_t const *handler;
+    scarletbook_vfs_file_t *file;
+    area_toc_t *area_toc;
+    int i;
+
+    if (strcasecmp(fmt, "dsf") == 0)
+        handler = dsf_format_fn();
+    else if (strcasecmp(fmt, "dsdiff") == 0)
+        handler = dsdiff_format_fn();
+    else
+        return NULL;
+
+    if (area < 0 || area >= handle->area_count || !handle->area[area].area_toc)
+        return NULL;
+    area_toc = handle->area[area].area_toc;
+    if (track < 0 || track >= area_toc->track_count)
+        return NULL;
+    if (!handle->area[area].time_index || !handle->area[area].time_index->complete)
+    {
+        LOG(lm_main, LOG_ERROR, ("virtual file: area %d has no complete time index", area));
+        return NULL;
+    }
+
+    file = (scarletbook_vfs_file_t *) calloc(1, sizeof(scarletbook_vfs_file_t));
+    if (!file)
+        return NULL;
+    file->handle = handle;
+    file->area = area;
+    file->track = track;
+    file->dsf = handler == dsf_format_fn();
+    file->channel_count = area_toc->channel_count;
+    file->first_timecode = TIME_FRAMECOUNT(&handle->area[area].area_tracklist_time->start[track]);
+    file->frame_count = TIME_FRAMECOUNT(&handle->area[area].area_tracklist_time->duration[track]);
+    if (file->dsf)
+        file->audio_size = ((uint64_t) file->frame_count * FRAME_SIZE_64 + DSF_BLOCK_SIZE - 1) / DSF_BLOCK_SIZE * DSF_BLOCK_SIZE * file->channel_count;
+    else
+        file->audio_size = (uint64_t) file->frame_count * FRAME_SIZE_64 * file->channel_count;
+
+    file->cache_size = cache_chunks > 0 ? cache_chunks : VFS_CACHE_CHUNKS;
+    file->cache = (vfs_chunk_t *) calloc(file->cache_size, sizeof(vfs_chunk_t));
+    file->fill_slots = (int *) malloc(VFS_CHUNK_FRAMES * sizeof(int));
+    if (!file->cache || !file->fill_slots || render_layout(file, handler) != 0)
+    {
+        LOG(lm_main, LOG_ERROR, ("virtual file: cannot render the %s layout of area %d, track %d", fmt, area, track));
+        scarletbook_vfs_close(file);
+        return NULL;
+    }
+    for (i = 0; i < file->cache_size; i++)
+        file->cache[i].index = -1;
+
+    return file;
+}
+
+void scarletbook_vfs_drop_cache(scarletbook_vfs_file_t *file)
+{
+    int i;
+
+    for (i = 0; file->cache && i < file->cache_size; i++)
+    {
+        free(file->cache[i].data);
+        file->cache[i].data = NULL;
+        file->cache[i].index = -1;
+        file->cache[i].used = 0;
+    }
+    free(file->read_buffer);
+    file->read_buffer = NULL;
+}
+
+void scarletbook_vfs_close(scarletbook_vfs_file_t *file)
+{
+    if (!file)
+        return;
+    scarletbook_vfs_drop_cache(file);
+    free(file->cache);
+    free(file->fill_slots);
+    free(file->header);
+    free(file->footer);
+    free(file);
+}
+
+uint64_t scarletbook_vfs_size(scarletbook_vfs_file_t *file)
+{
+    return file->header_size + file->audio_size + file->footer_size;
+}
+
+int scarletbook_vfs_read(scarletbook_vfs_file_t *file, uint8_t *buf, size_t size, uint64_t offset)
+{
+    uint64_t file_size = scarletbook_vfs_size(file);
+    size_t done = 0;
+    int len;
+
+    if (offset >= file_size)
+        return 0;
+    size = (size_t) min(size, file_size - offset);
+
+    while (done < size)
+    {
+        uint64_t position = offset + done;
+
+        if (position < file->header_size)
+        {
+            len = (int) min(size - done, file->header_size - position);
+            memcpy(buf + done, file->header + position, len);
+        }
+        else if (position < file->header_size + file->audio_size)
+        {
+            position -= file->header_size;
+            if (file->dsf)
+                len = read_dsf_audio(file, buf + done, size - done, position);
+            else
+                len = read_dsdiff_audio(file, buf + done, size - done, position);
+            if (len < 0)
+                return done > 0 ? (int) done : -1;
+        }
+        else
+        {
+            position -= file->header_size + file->audio_size;
+            len = (int) min(size - done, file->footer_size - position);
+            memcpy(buf + done, file->footer + position, len);
+        }
+        done += len;
+    }
+
+    return (int) done;
+}
@@ -0,0 +1,55 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef SCARLETBOOK_VFS_H_INCLUDED
+#define SCARLETBOOK_VFS_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "scarletbook.h"
+
+// A virtual file is the DSF or DSDIFF (decoded DSD) file of one track, produced on demand.
+// Its header and footer are rendered up front by the output format handler, the audio in
+// between is only read and decoded for the frames a read covers. Decoded frames are kept
+// in chunks in a small LRU cache per file. The frames of the track are found through the
+// time index of the area (see scarletbook_index.h), which must be complete.
+//
+// The file holds the frames [start, start + duration) of the track, as extracted with audio
+// frame trimming and without dsf_nopad. Calls on the virtual files of one handle must be
+// serialized, the reads share the sector reader and the frame state of the handle.
+
+typedef struct scarletbook_vfs_file_s scarletbook_vfs_file_t;
+
+// fmt is "dsf" or "dsdiff", cache_chunks the number of decoded chunks kept (0 for the default)
+scarletbook_vfs_file_t *scarletbook_vfs_open(scarletbook_handle_t *handle, int area, int track, const char *fmt, int cache_chunks);
+void scarletbook_vfs_close(scarletbook_vfs_file_t *file);
+
+uint64_t scarletbook_vfs_size(scarletbook_vfs_file_t *file);
+
+// reads up to size bytes at offset, returns the number of bytes read (0 at the end) or -1
+// if the sectors could not be read. Frames that fail to decode read as silence.
+int scarletbook_vfs_read(scarletbook_vfs_file_t *file, uint8_t *buf, size_t size, uint64_t offset);
+
+// frees the decoded chunks, e.g. when the last reader closed the file
+void scarletbook_vfs_drop_cache(scarletbook_vfs_file_t *file);
+
+#endif /* SCARLETBOOK_VFS_H_INCLUDED */
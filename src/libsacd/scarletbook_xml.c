@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include <charset.h>
 #include <version.h>
 #include <libxml/xmlreader.h>
@@ -14,6 +15,9 @@
 static void streamFile(const char *filename);
 void sacdXmlwriterFilename(scarletbook_handle_t *handle, const char *path_file);
 
+// xmlCleanupParser() must not run while another thread uses libxml2 (batch extraction)
+static pthread_mutex_t xml_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void read_metadata_xml(const char *filename)
 {
     /*
@@ -21,6 +25,7 @@ void read_metadata_xml(const char *filename)
      * between the version it was compiled for and the actual shared
      * library used.
      */
+    pthread_mutex_lock(&xml_lock);
     LIBXML_TEST_VERSION
 
     streamFile(filename);
@@ -33,6 +38,7 @@ void read_metadata_xml(const char *filename)
      * this is to debug memory for regression tests
      */
     xmlMemoryDump();
+    pthread_mutex_unlock(&xml_lock);
 }
 
 /***
@@ -111,6 +117,7 @@ int write_metadata_xml(scarletbook_handle_t *handle, const char *path_file)
      * between the version it was compiled for and the actual shared
      * library used.
      */
+    pthread_mutex_lock(&xml_lock);
     LIBXML_TEST_VERSION
 
     /* first, the file version */
@@ -124,9 +131,39 @@ int write_metadata_xml(scarletbook_handle_t *handle, const char *path_file)
      * this is to debug memory for regression tests
      */
     //xmlMemoryDump();
+    pthread_mutex_unlock(&xml_lock);
     return 0;
 }
 
+/**
+ * Writes an element "meta" with the ReplayGain values measured while extracting,
+ * as <meta name="..." value="gain" peak="..." loudness="..."/>.
+ */
+static int writeLoudnessMeta(xmlTextWriterPtr writer, const char *name, const track_loudness_t *loudness)
+{
+    int rc;
+
+    rc = xmlTextWriterStartElement(writer, BAD_CAST "meta");
+    if (rc < 0)
+        return rc;
+    rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "name", BAD_CAST name);
+    if (rc < 0)
+        return rc;
+    rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "value", "%.2f dB", -18.0 - loudness->integrated);
+    if (rc < 0)
+        return rc;
+    rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "peak", "%.6f", loudness->peak);
+    if (rc < 0)
+        return rc;
+    rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "loudness", "%.2f LUFS", loudness->integrated);
+    if (rc < 0)
+        return rc;
+    rc = xmlTextWriterWriteComment(writer, BAD_CAST "[ReplayGain 2.0, -18 LUFS reference, DSD full scale]");
+    if (rc < 0)
+        return rc;
+    return xmlTextWriterEndElement(writer);
+}
+
 /**
  * testXmlwriterFilename:
  * @uri: the output URI
@@ -478,6 +515,17 @@ void sacdXmlwriterFilename(scarletbook_handle_t *handle, const char *uri)
             return;
         }
 
+        /* Add an element "meta" with the album ReplayGain, if the tracks were analysed. */
+        if (handle->area[area_idx].album_loudness.valid)
+        {
+            rc = writeLoudnessMeta(writer, "ReplayGain_Album", &handle->area[area_idx].album_loudness);
+            if (rc < 0)
+            {
+                printf("testXmlwriterFilename: Error at writeLoudnessMeta\n");
+                return;
+            }
+        }
+
 
         /*  list all tracks  */
 
@@ -1006,6 +1054,115 @@ void sacdXmlwriterFilename(scarletbook_handle_t *handle, const char *uri)
                 return;
             }
 
+            /* Add an element "meta" with the DSD fingerprint, if the track was extracted with one. */
+            if (handle->area[area_idx].track_fingerprint != NULL && handle->area[area_idx].track_fingerprint[t].valid)
+            {
+                track_fingerprint_t *track_fingerprint = &handle->area[area_idx].track_fingerprint[t];
+                char fingerprint[2 * 32 + 8];
+                int i;
+
+                strcpy(fingerprint, "sha256:");
+                for (i = 0; i < 32; i++)
+                    sprintf(fingerprint + 7 + i * 2, "%02x", track_fingerprint->sha256[i]);
+
+                rc = xmlTextWriterStartElement(writer, BAD_CAST "meta");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterStartElement\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "name", BAD_CAST "DSD_Fingerprint");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "value", BAD_CAST fingerprint);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "frames", "%llu", (unsigned long long) track_fingerprint->frame_count);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteFormatAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteComment(writer, BAD_CAST "[decoded DSD, channel interleaved, MSB first]");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteComment\n");
+                    return;
+                }
+                rc = xmlTextWriterEndElement(writer);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterEndElement\n");
+                    return;
+                }
+            }
+
+            /* Add an element "meta" with the track ReplayGain, if the track was analysed. */
+            if (handle->area[area_idx].track_loudness != NULL && handle->area[area_idx].track_loudness[t].valid)
+            {
+                rc = writeLoudnessMeta(writer, "ReplayGain_Track", &handle->area[area_idx].track_loudness[t]);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at writeLoudnessMeta\n");
+                    return;
+                }
+            }
+
+            /* Add an element "meta" with the silence at the track edges, if the track was scanned. */
+            if (handle->area[area_idx].track_silence != NULL && handle->area[area_idx].track_silence[t].valid)
+            {
+                track_silence_t *track_silence = &handle->area[area_idx].track_silence[t];
+
+                rc = xmlTextWriterStartElement(writer, BAD_CAST "meta");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterStartElement\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteAttribute(writer, BAD_CAST "name", BAD_CAST "Silence");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "leading", "%.6f", (double) track_silence->leading * 8 / SACD_SAMPLING_FREQUENCY);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteFormatAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "trailing", "%.6f", (double) track_silence->trailing * 8 / SACD_SAMPLING_FREQUENCY);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteFormatAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "trimmed_frames", "%u+%u", track_silence->trimmed_leading, track_silence->trimmed_trailing);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteFormatAttribute\n");
+                    return;
+                }
+                rc = xmlTextWriterWriteComment(writer, BAD_CAST "[seconds of DSD idle pattern in the written track, whole frames trimmed at start+end]");
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterWriteComment\n");
+                    return;
+                }
+                rc = xmlTextWriterEndElement(writer);
+                if (rc < 0)
+                {
+                    printf("testXmlwriterFilename: Error at xmlTextWriterEndElement\n");
+                    return;
+                }
+            }
+
             /* Close the element 'track' */
             rc = xmlTextWriterEndElement(writer);
             if (rc < 0)
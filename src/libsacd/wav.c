@@ -0,0 +1,364 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <logging.h>
+#include <utils.h>
+
+#include "scarletbook_id3.h"
+#include "scarletbook_output.h"
+#include "scarletbook.h"
+#include "dsd2pcm.h"
+
+// 24 bit PCM in WAVE_FORMAT_EXTENSIBLE. A JUNK chunk reserves the room of a ds64 chunk, so a
+// file that outgrows 4 GiB becomes RF64 by rewriting the header only.
+
+#define WAV_HEADER_SIZE         104     // RIFF + JUNK/ds64 + fmt + data chunk headers
+#define WAV_FOOTER_SIZE         (8 + 2048)   // chunk header + tag
+#define WAV_BITS_PER_SAMPLE     24
+#define WAV_BATCH_FRAMES        16      // DSD frames converted at once
+
+typedef struct
+{
+    dsd2pcm_t *dsd2pcm;
+    int        channel_count;
+    int        sample_rate;
+
+    uint8_t   *planes;                  // DSD waiting for conversion, one plane per channel
+    size_t     plane_bytes;             // bytes per channel in planes
+    uint8_t   *pcm;
+
+    uint64_t   data_size;
+    uint64_t   frames_written;          // streaming: frames accepted so far
+
+    uint8_t   *footer;                  // "id3 " chunk holding the ID3 tag
+    size_t     footer_size;
+}
+wav_handle_t;
+
+static int wav_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len);
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v)
+{
+    p = put_le16(p, (uint16_t) v);
+    return put_le16(p, (uint16_t) (v >> 16));
+}
+
+static uint8_t *put_le64(uint8_t *p, uint64_t v)
+{
+    p = put_le32(p, (uint32_t) v);
+    return put_le32(p, (uint32_t) (v >> 32));
+}
+
+static uint8_t *put_id(uint8_t *p, const char *id)
+{
+    memcpy(p, id, 4);
+    return p + 4;
+}
+
+static uint32_t wav_channel_mask(area_toc_t *area_toc)
+{
+    switch (area_toc->channel_count)
+    {
+    case 1:
+        return 0x4;                     // FC
+    case 2:
+        return 0x3;                     // FL FR
+    case 5:
+        return 0x37;                    // FL FR FC BL BR
+    case 6:
+        return area_toc->extra_settings == 4 ? 0x3f : 0;   // FL FR FC LFE BL BR
+    default:
+        return 0;
+    }
+}
+
+static int wav_write_header(scarletbook_output_format_t *ft)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    area_toc_t *area_toc = ft->sb_handle->area[ft->area].area_toc;
+    uint8_t header[WAV_HEADER_SIZE];
+    uint8_t *p = header;
+    uint32_t block_align = handle->channel_count * WAV_BITS_PER_SAMPLE / 8;
+    uint64_t riff_size = WAV_HEADER_SIZE - 8 + handle->data_size + (handle->data_size & 1) + handle->footer_size;
+    int rf64 = riff_size > UINT32_MAX;
+
+    p = put_id(p, rf64 ? "RF64" : "RIFF");
+    p = put_le32(p, rf64 ? UINT32_MAX : (uint32_t) riff_size);
+    p = put_id(p, "WAVE");
+
+    p = put_id(p, rf64 ? "ds64" : "JUNK");
+    p = put_le32(p, 28);
+    if (rf64)
+    {
+        p = put_le64(p, riff_size);
+        p = put_le64(p, handle->data_size);
+        p = put_le64(p, handle->data_size / block_align);
+        p = put_le32(p, 0);             // no table
+    }
+    else
+    {
+        memset(p, 0, 28);
+        p += 28;
+    }
+
+    p = put_id(p, "fmt ");
+    p = put_le32(p, 40);
+    p = put_le16(p, 0xfffe);            // WAVE_FORMAT_EXTENSIBLE
+    p = put_le16(p, (uint16_t) handle->channel_count);
+    p = put_le32(p, handle->sample_rate);
+    p = put_le32(p, handle->sample_rate * block_align);
+    p = put_le16(p, (uint16_t) block_align);
+    p = put_le16(p, WAV_BITS_PER_SAMPLE);
+    p = put_le16(p, 22);
+    p = put_le16(p, WAV_BITS_PER_SAMPLE);
+    p = put_le32(p, wav_channel_mask(area_toc));
+    memcpy(p, "\x01\x00\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 16);  // KSDATAFORMAT_SUBTYPE_PCM
+    p += 16;
+
+    p = put_id(p, "data");
+    p = put_le32(p, rf64 ? UINT32_MAX : (uint32_t) handle->data_size);
+
+    ft->sound_data_offset = WAV_HEADER_SIZE;
+    if (fwrite(header, 1, WAV_HEADER_SIZE, ft->fd) != WAV_HEADER_SIZE)
+        return -1;
+    return 0;
+}
+
+// the tag goes in an "id3 " chunk after the audio
+static void wav_render_footer(scarletbook_output_format_t *ft)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    scarletbook_handle_t *sb_handle = ft->sb_handle;
+
+    handle->footer_size = 0;
+    if (sb_handle->id3_tag_mode != 0)
+    {
+        int tag_size = scarletbook_id3_tag_render(sb_handle, handle->footer + 8, ft->area, ft->track);
+        if (tag_size > 0)
+        {
+            put_id(handle->footer, "id3 ");
+            put_le32(handle->footer + 4, tag_size);
+            handle->footer_size = 8 + tag_size + (tag_size & 1);
+        }
+    }
+}
+
+static int wav_create(scarletbook_output_format_t *ft)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    scarletbook_handle_t *sb_handle = ft->sb_handle;
+    int decimation;
+
+    handle->channel_count = sb_handle->area[ft->area].area_toc->channel_count;
+    handle->sample_rate = sb_handle->pcm_sample_rate == 176400 ? 176400 : 88200;
+    decimation = SACD_SAMPLING_FREQUENCY / handle->sample_rate;
+
+    handle->dsd2pcm = dsd2pcm_create(handle->channel_count, decimation, ft->dsd_planar_lsb);
+    handle->planes = (uint8_t *) malloc(WAV_BATCH_FRAMES * FRAME_SIZE_64 * handle->channel_count);
+    handle->pcm = (uint8_t *) malloc(WAV_BATCH_FRAMES * FRAME_SIZE_64 * 8 / decimation * handle->channel_count * WAV_BITS_PER_SAMPLE / 8);
+    handle->footer = (uint8_t *) calloc(WAV_FOOTER_SIZE, 1);
+    if (!handle->dsd2pcm || !handle->planes || !handle->pcm || !handle->footer)
+    {
+        LOG(lm_main, LOG_ERROR, ("wav_create(): out of memory for %s", ft->filename));
+        return -1;
+    }
+
+    wav_render_footer(ft);
+
+    if (ft->stream)
+    {
+        // the header is final right away, the frames counted up front convert to a known length
+        handle->data_size = ft->stream_frame_count * (FRAME_SIZE_64 * 8 / decimation) * handle->channel_count * WAV_BITS_PER_SAMPLE / 8;
+        if (wav_write_header(ft) != 0)
+            return -1;
+        handle->data_size = 0;
+        return 0;
+    }
+
+    return wav_write_header(ft);
+}
+
+// converts the collected DSD and appends the PCM to the data chunk
+static int wav_flush(scarletbook_output_format_t *ft)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    size_t samples, bytes;
+
+    if (handle->plane_bytes == 0)
+        return 0;
+
+    samples = dsd2pcm_convert(handle->dsd2pcm, handle->planes, WAV_BATCH_FRAMES * FRAME_SIZE_64, handle->plane_bytes, handle->pcm);
+    bytes = samples * handle->channel_count * WAV_BITS_PER_SAMPLE / 8;
+    handle->plane_bytes = 0;
+
+    if (fwrite(handle->pcm, 1, bytes, ft->fd) != bytes)
+    {
+        LOG(lm_main, LOG_ERROR, ("wav_flush(): error writting in file: %s", ft->filename));
+        return -1;
+    }
+    scarletbook_output_written(ft, handle->pcm, bytes);
+    handle->data_size += bytes;
+    return (int) bytes;
+}
+
+static int wav_close(scarletbook_output_format_t *ft)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    int result = 0;
+
+    // a streamed file must hold exactly the samples announced in its header; fill up with silence
+    if (ft->stream && handle->dsd2pcm && handle->frames_written < ft->stream_frame_count)
+    {
+        size_t frame_size = FRAME_SIZE_64 * handle->channel_count;
+        uint8_t *silence = (uint8_t *) malloc(frame_size);
+
+        if (!silence)
+        {
+            LOG(lm_main, LOG_ERROR, ("wav_close(): out of memory padding %s with silence", ft->filename));
+            result = -1;
+        }
+        else
+        {
+            LOG(lm_main, LOG_ERROR, ("wav_close(): %s is %llu frames short, padding with silence", ft->filename, 
+                (unsigned long long) (ft->stream_frame_count - handle->frames_written)));
+            memset(silence, ft->dsd_planar_lsb ? 0x96 : 0x69, frame_size);
+            while (handle->frames_written < ft->stream_frame_count)
+            {
+                if (wav_write_frame(ft, silence, frame_size) < 0)
+                {
+                    result = -1;
+                    break;
+                }
+            }
+            free(silence);
+        }
+    }
+
+    if (handle->dsd2pcm && wav_flush(ft) < 0)
+        result = -1;
+
+    if (handle->data_size & 1)
+        fputc(0, ft->fd);
+
+    // the tag may have gained the analysis results since wav_create, a streamed header fixed its size
+    if (!ft->stream && handle->footer)
+        wav_render_footer(ft);
+
+    if (handle->footer_size && fwrite(handle->footer, 1, handle->footer_size, ft->fd) != handle->footer_size)
+    {
+        result = -1;
+        LOG(lm_main, LOG_ERROR, ("wav_close(): error at write id3 chunk %s", ft->filename));
+    }
+
+    // a streamed header was final from the start
+    if (!ft->stream && handle->dsd2pcm)
+    {
+        fseek(ft->fd, 0, SEEK_SET);
+        if (wav_write_header(ft) != 0)
+        {
+            result = -1;
+            LOG(lm_main, LOG_ERROR, ("wav_close(): error at write header %s", ft->filename));
+        }
+    }
+
+    dsd2pcm_destroy(handle->dsd2pcm);
+    free(handle->planes);
+    free(handle->pcm);
+    free(handle->footer);
+
+    return result;
+}
+
+static int wav_write_frame(scarletbook_output_format_t *ft, const uint8_t *buf, size_t len)
+{
+    wav_handle_t *handle = (wav_handle_t *) ft->priv;
+    size_t bytes_per_channel = len / handle->channel_count;
+    size_t stride = WAV_BATCH_FRAMES * FRAME_SIZE_64;
+    size_t offset = 0, i;
+    int c, written = 0;
+
+    if (ft->stream)
+    {
+        // never write past the length announced in the streamed header
+        if (handle->frames_written >= ft->stream_frame_count)
+            return 0;
+        handle->frames_written++;
+    }
+
+    while (offset < bytes_per_channel)
+    {
+        size_t span = min(stride - handle->plane_bytes, bytes_per_channel - offset);
+
+        for (c = 0; c < handle->channel_count; c++)
+        {
+            uint8_t *dst = handle->planes + c * stride + handle->plane_bytes;
+
+            if (ft->dsd_planar_lsb)
+            {
+                memcpy(dst, buf + c * bytes_per_channel + offset, span);
+            }
+            else
+            {
+                const uint8_t *src = buf + offset * handle->channel_count + c;
+                for (i = 0; i < span; i++, src += handle->channel_count)
+                    dst[i] = *src;
+            }
+        }
+        handle->plane_bytes += span;
+        offset += span;
+
+        if (handle->plane_bytes == stride)
+        {
+            int bytes = wav_flush(ft);
+            if (bytes < 0)
+                return -1;
+            written += bytes;
+        }
+    }
+
+    return written;
+}
+
+scarletbook_format_handler_t const * wav_format_fn(void) 
+{
+    static scarletbook_format_handler_t handler = 
+    {
+        "WAVE/RF64 24 bit PCM (wav)", 
+        "wav", 
+        wav_create, 
+        wav_write_frame,
+        wav_close, 
+        OUTPUT_FLAG_DSD | OUTPUT_FLAG_DSD_PLANAR,
+        sizeof(wav_handle_t)
+    };
+    return &handler;
+}
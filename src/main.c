@@ -36,11 +36,20 @@
 #endif
 #if defined(WIN32) || defined(_WIN32)
 #include <io.h>
+#include <ctype.h>
+#endif
+
+#include <errno.h>
+#if !defined(WIN32) && !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
 #endif
 
 #include <pthread.h>
 #include <charset.h>
 #include <logging.h>
+#include <cpu.h>
 
 #include "getopt.h"
 #include "sacd_reader.h"
@@ -57,6 +66,8 @@
 #include "yarn.h"
 #include "version.h"
 #include "scarletbook_xml.h"
+#include "scarletbook_index.h"
+#include "scarletbook_catalog.h"
 
 
 
@@ -77,6 +88,7 @@ static struct opts_s
     int            output_dsdiff_em;
     int            output_dsdiff;
     int            output_iso;
+    int            output_wav;
     int            convert_dst;
     int            export_cue_sheet;
     int            print;
@@ -92,14 +104,217 @@ static struct opts_s
     int            concatenate;  // concatenate consecutive tracks specified in selected_tracks
     int            logging;  // if 1 save logs in a file
     int            id3_tag_mode; // id3_tag_mode;  // 0=no id3 inserted; 1 or 3 =default id3 v2.3; 2=miminal id3v2.3 tag; 4=id3v2.4;5=id3v2.4 minimal
+    int            stream_output; // if 1 write DSF/DSDIFF headers up front and never seek back
+    int            to_stdout;     // if 1 the single output file is written to stdout
+    int            stdout_fd;     // the original stdout, console messages are moved to stderr
+    int            iso_sparse;    // if 1 all-zero sectors of the ISO are left as holes
+    int            hash_output;   // if 1 CRC32C and SHA-256 of each output are written to a .hash sidecar
+    int            fingerprint;   // if 1 each extracted track gets a container independent DSD fingerprint in the XML
+    int            verify_dst;    // if 1 DST frames exported without -c are decoded anyway to detect corrupt frames
+    int            encode_dst;    // if 1 DSD areas are exported to DSDIFF as DST encoded frames
+    int            loudness;      // if 1 peak and loudness of each extracted track are measured for ReplayGain tags
+    int            silence_report;// if 1 the silence at the start and end of each extracted track is reported
+    int            trim_silence;  // if 1 whole silent frames at the start and end of each extracted track are left out
+    uint32_t       clip_start;    // -T: time range of each track, in frames from the track start
+    uint32_t       clip_end;      //     0 if not set
+    int            pcm_sample_rate; // sample rate of the wav output, 88200 or 176400
+    int            scan_disc;     // if 1 the audio sectors are scanned for a disc sanity report
+    char           *catalog_path; // --catalog: directory or list of images, one JSON line per disc on stdout
+    char           *batch_path;   // --batch: job file, one disc per line
+    char           *daemon_path;  // --daemon: Unix domain socket the jobs arrive on
+    int            daemon_queue;  // jobs waiting for a slot at most, more are refused
+    int            batch_jobs;    // discs extracted at the same time, 0 for one per processor
+    int            batch_io;      // discs read at the same time from one device
+    int            decode_threads;// DST decoder threads shared by all outputs, 0 for one per processor
+    int            threads;       // processors to use (-j), 0 for those the affinity mask and cgroup quota allow
+    int            hugepages;     // DST decoder state on transparent hugepages
+    char          *decoder_cpus;  // --decoder-cpus: processors of the DST decode threads, NULL for any
+    int            io_node;       // --io-node: NUMA node of the reading and writing threads, -1 for any
     int            version;
 } opts;
 
-scarletbook_handle_t *handle;
-scarletbook_output_t *output;
+// mm:ss[:ff] in frames, returns the number of characters used or 0
+static int parse_timecode(const char *s, uint32_t *frames)
+{
+    unsigned int minutes, seconds, f = 0;
+    int n = 0;
+
+    if (sscanf(s, "%u:%u%n", &minutes, &seconds, &n) != 2 || seconds >= 60)
+        return 0;
+    if (s[n] == ':')
+    {
+        int m = 0;
+        if (sscanf(s + n + 1, "%u%n", &f, &m) != 1 || f >= SACD_FRAME_RATE)
+            return 0;
+        n += 1 + m;
+    }
+    *frames = (minutes * 60 + seconds) * SACD_FRAME_RATE + f;
+    return n;
+}
+
+// START-END or START- (until the end of the track)
+static int parse_time_range(const char *s, uint32_t *start, uint32_t *end)
+{
+    int n = parse_timecode(s, start);
+
+    if (n == 0 || s[n] != '-')
+        return -1;
+    s += n + 1;
+    if (*s == '\0')
+    {
+        *end = UINT32_MAX;
+        return 0;
+    }
+    n = parse_timecode(s, end);
+    if (n == 0 || s[n] != '\0' || *end <= *start)
+        return -1;
+    return 0;
+}
+
+// -T: the time index of an image is kept in the output directory, the first use builds it
+// with a scan of the sector headers. An index next to the image (sacd_mount keeps it there)
+// is used when present, the image itself may well be on read-only media.
+static void prepare_time_index(scarletbook_handle_t *handle, sacd_reader_t *sacd_reader, const char *input, const char *output_dir)
+{
+    const char *name;
+    char *path;
+
+    // a disc or server is scanned each time, there is no place to keep its index
+    if (sacd_get_image_fd(sacd_reader) < 0)
+    {
+        fwprintf(stdout, L"\n Building the time index of the disc...\n");
+        if (scarletbook_index_build(handle) != 0)
+            fwprintf(stdout, L" Could not build the time index, tracks are read from their start.\n");
+        return;
+    }
+
+    path = (char *) malloc(strlen(input) + (output_dir ? strlen(output_dir) : 0) + 6);
+    if (!path)
+        return;
+    sprintf(path, "%s.idx", input);
+    if (scarletbook_index_load(handle, path) == 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("NOTICE in main: time index %s", path));
+        free(path);
+        return;
+    }
+
+    name = strrchr(input, '/');
+#if defined(WIN32) || defined(_WIN32)
+    if (strrchr(input, '\\') > name)
+        name = strrchr(input, '\\');
+#endif
+    name = name ? name + 1 : input;
+    if (output_dir && output_dir[0] != '\0')
+        sprintf(path, "%s%s%s.idx", output_dir, 
+            (output_dir[strlen(output_dir) - 1] == '/' || output_dir[strlen(output_dir) - 1] == '\\') ? "" : "/", name);
+    else
+        sprintf(path, "%s.idx", name);
+
+    if (scarletbook_index_load(handle, path) != 0)
+    {
+        fwprintf(stdout, L"\n Building the time index of the image...\n");
+        if (scarletbook_index_build(handle) != 0)
+            fwprintf(stdout, L" Could not build the time index, tracks are read from their start.\n");
+        else if (scarletbook_index_save(handle, path) != 0)
+        {
+            // only a cache, the next run builds it again
+            fwprintf(stdout, L" Could not save the time index in the output directory.\n");
+            LOG(lm_main, LOG_NOTICE, ("NOTICE in main: time index not saved in %s", path));
+        }
+    }
+    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: time index %s", path));
+    free(path);
+}
+
+// --scan: every audio sector is read once and only its headers are parsed, the frames
+// found are checked against the TOC
+static int scan_disc(scarletbook_handle_t *handle)
+{
+    int area_idx, errors = 0;
+
+    for (area_idx = 0; area_idx < handle->area_count; area_idx++)
+    {
+        scarletbook_area_t *area = &handle->area[area_idx];
+        scarletbook_area_scan_t report;
+        uint32_t toc_frames;
+        time_t started;
+        double seconds;
+        int result;
+
+        if (!area->area_toc)
+            continue;
+
+        fwprintf(stdout, L"\n Scanning area %d (%d channels, sectors %u..%u)...\n", area_idx, area->area_toc->channel_count,
+                 area->area_toc->track_start, area->area_toc->track_end);
+        started = time(0);
+        result = scarletbook_scan_area(handle, area_idx, &report, NULL, NULL);
+        seconds = difftime(time(0), started);
+
+        toc_frames = TIME_FRAMECOUNT(&area->area_toc->total_playtime);
+        fwprintf(stdout, L"\tSectors read: %u, unreadable: %u, broken headers: %u\n", report.sectors, report.read_errors, report.bad_sectors);
+        fwprintf(stdout, L"\tFrames: %u (%u DST, %u DSD), TOC play time: %u frames\n", report.frames, report.dst_frames,
+                 report.frames - report.dst_frames, toc_frames);
+        if (report.frames > 0)
+            fwprintf(stdout, L"\tTimecodes: %u..%u\n", report.first_timecode, report.last_timecode);
+        fwprintf(stdout, L"\tTimecode discontinuities: %u, frames with another channel count: %u\n", report.discontinuities, report.channel_mismatches);
+        if (seconds > 0)
+            fwprintf(stdout, L"\tScanned in %.0f s, %.1f MB/s\n", seconds, (double) report.sectors * SACD_LSN_SIZE / 1048576.0 / seconds);
+
+        if (result != 0 || report.bad_sectors > 0 || report.discontinuities > 0 || report.channel_mismatches > 0 || report.frames < toc_frames)
+        {
+            fwprintf(stdout, L"\tArea %d: PROBLEMS FOUND\n", area_idx);
+            errors++;
+        }
+        else
+        {
+            fwprintf(stdout, L"\tArea %d: OK\n", area_idx);
+        }
+        LOG(lm_main, LOG_NOTICE, ("NOTICE in main: scan of area %d, sectors: %u, unreadable: %u, broken: %u, frames: %u (toc %u), discontinuities: %u, channel mismatches: %u",
+            area_idx, report.sectors, report.read_errors, report.bad_sectors, report.frames, toc_frames, report.discontinuities, report.channel_mismatches));
+    }
+    return errors;
+}
+
+// --catalog: the images are opened in parallel, reading their TOCs only. Opening is I/O
+// bound, so one thread per processor keeps a local disk or a NAS busy.
+static int run_catalog(void)
+{
+    char **paths;
+    int path_count, failed, thread_count;
+    FILE *out;
+
+    thread_count = cpu_count();
+    if (thread_count < 2)
+        thread_count = 2;
+
+    path_count = scarletbook_catalog_collect(opts.catalog_path, &paths);
+    if (path_count < 0)
+    {
+        fwprintf(stdout, L"\n Error: cannot read the catalog input.\n");
+        return -1;
+    }
+
+    out = fdopen(opts.stdout_fd, "w");
+    if (!out)
+    {
+        scarletbook_catalog_free(paths, path_count);
+        return -1;
+    }
+    opts.stdout_fd = -1;
+
+    fwprintf(stdout, L"\n Cataloging %d images with %d threads...\n", path_count, thread_count);
+    failed = scarletbook_catalog_run(paths, path_count, thread_count, out);
+    fclose(out);
+    fwprintf(stdout, L" Done, %d of %d images could not be read.\n", failed, path_count);
+    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: catalog of %s, %d images, %d failed", opts.catalog_path, path_count, failed));
+
+    scarletbook_catalog_free(paths, path_count);
+    return failed > 0 ? -1 : 0;
+}
 
 /* Parse all options. */
-static int parse_options(int argc, char *argv[]) 
+static int parse_options(int argc, char *argv[], struct opts_s *o)
 {
     int opt; /* used for argument parsing */
     char *program_name = NULL;
@@ -114,19 +329,55 @@ static int parse_options(int argc, char *argv[])
         "  -s, --output-dsf                : output as Sony DSF file\n"
         "  -z, --dsf-nopad                 : Do not zero pad DSF (cannot be used with -t)\n"
         "  -t, --select-track              : only output selected track(s) (ex. -t 1,5,13)\n"
+        "  -T, --time-range                : only output this part of each track, mm:ss[:ff]-[mm:ss[:ff]]\n"
+        "                                    (ex. -T 12:30-15:00). The time index of an image is kept in the output\n"
+        "                                    directory as <image name>.idx, or read from <image>.idx if present\n"
         "  -k, --concatenate               : concatenate consecutive selected track(s) (ex. -k -t 2,3,4)\n"
         "  -I, --output-iso                : output as RAW ISO\n"
+        "  --sparse                        : leave all-zero sectors of the ISO as holes (sparse file)\n"
 #ifndef SECTOR_LIMIT
         "  -w, --concurrent                : Concurrent ISO+DSF/DSDIFF processing mode\n"
 #endif
         "  -c, --convert-dst               : convert DST to DSD\n"
         "  -C, --export-cue                : Export a CUE Sheet\n"
+        "  --output-wav                    : output 24 bit PCM wav files (RF64 above 4 GiB) converted from DSD\n"
+        "  --pcm-rate=RATE                 : sample rate of the wav files, 88200 (default) or 176400\n"
         "  -o, --output-dir[=DIR]          : Output directory for ISO or DSDIFF Edit Master\n"
         "  -y, --output-dir-conc[=DIR]     : Output directory for DSF or DSDIFF \n"
         "  -P, --print                     : display disc and track information\n"
+        "  --scan                          : check the audio frames of each area against the TOC (sector headers only)\n"
+        "  --catalog=PATH                  : write one JSON line per image to stdout, PATH is a directory (searched\n"
+        "                                    for *.iso), an .iso file or a text file with one image per line\n"
+        "  --batch=FILE                    : extract many discs, FILE has one job per line: <input> [options]\n"
+        "                                    (the options are added to those of the command line)\n"
+        "  --batch-jobs=N                  : discs extracted at the same time (default: one per processor)\n"
+        "  --batch-io=N                    : discs read at the same time from one drive, disk or server (default 1)\n"
+#if !defined(WIN32) && !defined(_WIN32)
+        "  --daemon=SOCKET                 : keep running and take jobs (lines like --batch) on a Unix domain socket,\n"
+        "                                    --batch-jobs and --batch-io limit them\n"
+        "  --daemon-queue=N                : jobs waiting for a free slot at most, more are refused (default 64)\n"
+#endif
+        "  --decode-threads=N              : DST decoder threads shared by all discs (default: one per processor)\n"
+        "  -j, --threads=N                 : processors to use, sets the defaults of --batch-jobs and --decode-threads\n"
+        "                                    (default: those allowed by the CPU affinity and the cgroup CPU quota)\n"
+        "  --hugepages                     : keep the state of each DST decode thread on transparent hugepages\n"
+        "  --decoder-cpus=LIST             : run the DST decode threads on these processors only (like 0-7,16-23)\n"
+        "  --io-node=N                     : keep the threads that read and write, and their buffers, on NUMA node N\n"
         "  -A, --artist                    : artist name is added in folder name. Default is disabled\n"
         "  -a, --performer                 : performer name is added in track filename. Default is disabled\n"
         "  -b, --pauses                    : all pauses will be included. Default is disabled\n"
+        "  --hash                          : compute CRC32C and SHA-256 of each output while writing (.hash sidecar)\n"
+        "  --fingerprint                   : add a container independent DSD fingerprint of each track to the XML\n"
+        "  --verify-dst                    : decode DST frames written without -c to report corrupt ones\n"
+        "  --encode-dst                    : DST encode the DSDIFF output of DSD areas (3-in-14/16 discs),\n"
+        "                                    not with --stream\n"
+        "  --loudness                      : measure each track while writing, add ReplayGain to the tags and the XML\n"
+        "                                    (needs -c for DST, not with --stream or concatenation)\n"
+        "  --silence                       : report the digital silence at the start and end of each track\n"
+        "  --trim-silence                  : leave out the silent frames at the start and end of each track\n"
+        "                                    (needs -c for DST, not with --stream or concatenation)\n"
+        "  -S, --stream                    : write DSF/DSDIFF in one forward pass (no seeking, no nopad)\n"
+        "  --stdout                        : write the (single) output file to stdout, implies --stream\n"
         "  -v, --version                   : Display version\n"
         "\n"
         "  -i, --input[=FILE]              : set source and determine if \"iso\" image, \n"
@@ -144,13 +395,19 @@ static int parse_options(int argc, char *argv[])
         "        [-e|--output-dsdiff-em] [-s|--output-dsf] [-I|--output-iso] [-w|--concurrent]\n"
 #endif
         "        [-c|--convert-dst] [-C|--export-cue] [-i|--input FILE] [-o|--output-dir DIR] [-y|--output-dir-conc DIR] [-P|--print]\n"
+        "        [-S|--stream] [--stdout] [--sparse] [--hash] [--fingerprint] [--verify-dst] [--encode-dst]\n"
+        "        [--output-wav] [--pcm-rate RATE] [--loudness] [--silence] [--trim-silence]\n"
+        "        [-T|--time-range START-END] [--scan] [--catalog PATH]\n"
+        "        [--batch FILE] [--batch-jobs N] [--batch-io N] [--decode-threads N] [-j|--threads N] [--hugepages]\n"
+        "        [--decoder-cpus LIST] [--io-node N]\n"
+        "        [--daemon SOCKET] [--daemon-queue N]\n"
         "        [-?|--help] [--usage]\n";
 
 
 #ifdef SECTOR_LIMIT
-    static const char options_string[] = "2mepszkaAbIcCvi:o:y:t:P?";
+    static const char options_string[] = "2mepszkaAbIcCSvi:o:y:t:T:j:P?";
 #else
-    static const char options_string[] = "2mepszkaAbIwcCvi:o:y:t:P?";
+    static const char options_string[] = "2mepszkaAbIwcCSvi:o:y:t:T:j:P?";
 #endif
 
     static const struct option options_table[] = {
@@ -174,7 +431,32 @@ static int parse_options(int argc, char *argv[])
         {"input", required_argument, NULL, 'i'},
         {"output-dir", required_argument, NULL, 'o'},
         {"output-dir-conc", required_argument, NULL, 'y'},
+        {"time-range", required_argument, NULL, 'T'},
         {"print", no_argument, NULL, 'P'},
+        {"scan", no_argument, NULL, 'X'},
+        {"catalog", required_argument, NULL, 'G'},
+        {"batch", required_argument, NULL, 'B'},
+        {"batch-jobs", required_argument, NULL, 'J'},
+        {"batch-io", required_argument, NULL, 'N'},
+        {"decode-threads", required_argument, NULL, 'D'},
+        {"threads", required_argument, NULL, 'j'},
+        {"hugepages", no_argument, NULL, 'g'},
+        {"decoder-cpus", required_argument, NULL, 'Y'},
+        {"io-node", required_argument, NULL, 'M'},
+        {"daemon", required_argument, NULL, 'E'},
+        {"daemon-queue", required_argument, NULL, 'U'},
+        {"stream", no_argument, NULL, 'S'},
+        {"stdout", no_argument, NULL, 'O'},
+        {"sparse", no_argument, NULL, 'Z'},
+        {"hash", no_argument, NULL, 'H'},
+        {"fingerprint", no_argument, NULL, 'F'},
+        {"verify-dst", no_argument, NULL, 'V'},
+        {"encode-dst", no_argument, NULL, 'x'},
+        {"loudness", no_argument, NULL, 'L'},
+        {"silence", no_argument, NULL, 'Q'},
+        {"trim-silence", no_argument, NULL, 'K'},
+        {"output-wav", no_argument, NULL, 'W'},
+        {"pcm-rate", required_argument, NULL, 'R'},
         {"help", no_argument, NULL, '?'},
         {"usage", no_argument, NULL, 'u'},
         {NULL, 0, NULL, 0}};
@@ -185,33 +467,33 @@ static int parse_options(int argc, char *argv[])
     while ((opt = getopt_long(argc, argv, options_string, options_table, NULL)) >= 0) {
         switch (opt) {
         case '2': 
-            opts.two_channel = 1; 
+            o->two_channel = 1; 
             break;
         case 'm': 
-            opts.multi_channel = 1; 
+            o->multi_channel = 1; 
             break;
         case 'e': 
-            opts.output_dsdiff_em = 1;
-            //opts.output_dsdiff = 0;
-            //opts.output_dsf = 0; 
-            //opts.output_iso = 0;
-            opts.export_cue_sheet = 1;
+            o->output_dsdiff_em = 1;
+            //o->output_dsdiff = 0;
+            //o->output_dsf = 0; 
+            //o->output_iso = 0;
+            o->export_cue_sheet = 1;
             break;
         case 'p': 
-            //opts.output_dsdiff_em = 0; 
-            opts.output_dsdiff = 1; 
-            //opts.output_dsf = 0; 
-            //opts.output_iso = 0;
+            //o->output_dsdiff_em = 0; 
+            o->output_dsdiff = 1; 
+            //o->output_dsf = 0; 
+            //o->output_iso = 0;
             break;
         case 's': 
-            //opts.output_dsdiff_em = 0; 
-            //opts.output_dsdiff = 0; 
-            opts.output_dsf = 1; 
-            //opts.output_iso = 0;
+            //o->output_dsdiff_em = 0; 
+            //o->output_dsdiff = 0; 
+            o->output_dsf = 1; 
+            //o->output_iso = 0;
             break;
         case 't': 
             {
-                for(int m=0;m<255;m++)opts.selected_tracks[m]=0x00;
+                for(int m=0;m<255;m++)o->selected_tracks[m]=0x00;
                 int track_nr, count = 0;
                 char *track = strtok(optarg, " ,");
                 while (track != 0)
@@ -221,41 +503,48 @@ static int parse_options(int argc, char *argv[])
                     if (!track_nr)
                         continue;
                     track_nr = (track_nr - 1) & 0xff;
-                    opts.selected_tracks[track_nr] = 0x01;
+                    o->selected_tracks[track_nr] = 0x01;
                     count++;
                 }
-                opts.select_tracks = count != 0;
+                o->select_tracks = count != 0;
+            }
+            break;
+        case 'T':
+            if (parse_time_range(optarg, &o->clip_start, &o->clip_end) != 0)
+            {
+                fprintf(stderr, "\n Warning: invalid time range '%s', the whole tracks are extracted.\n", optarg);
+                o->clip_start = o->clip_end = 0;
             }
             break;
         case 'z':
-            opts.dsf_nopad = 1;
+            o->dsf_nopad = 1;
             break;
         case 'b':
-            opts.audio_frame_trimming = 0;
+            o->audio_frame_trimming = 0;
             break;
         case 'A':
-            opts.artist_flag = 1;
+            o->artist_flag = 1;
             break;
         case 'a':
-            opts.performer_flag = 1;
+            o->performer_flag = 1;
             break;
         case 'k': // concatenate consecutive tracks specified in selected_tracks
-            opts.concatenate = 1;
+            o->concatenate = 1;
             // must enable include pauses
-            if (opts.audio_frame_trimming == 1)opts.audio_frame_trimming = 0;        
+            if (o->audio_frame_trimming == 1)o->audio_frame_trimming = 0;        
             break;
         case 'I': 
-            //opts.output_dsdiff_em = 0; 
-            //opts.output_dsdiff = 0; 
-            //opts.output_dsf = 0; 
-            opts.output_iso = 1;
+            //o->output_dsdiff_em = 0; 
+            //o->output_dsdiff = 0; 
+            //o->output_dsf = 0; 
+            o->output_iso = 1;
             break;
 		case 'w':
-            //opts.concurrent = 1;  // do nothing. The program already makes all required operations in multiple steps
+            //o->concurrent = 1;  // do nothing. The program already makes all required operations in multiple steps
             break;	
-        case 'c': opts.convert_dst = 1; break;
-        case 'C': opts.export_cue_sheet = 1; break;
-        case 'i': opts.input_device = strdup(optarg); break;
+        case 'c': o->convert_dst = 1; break;
+        case 'C': o->export_cue_sheet = 1; break;
+        case 'i': o->input_device = strdup(optarg); break;
         case 'o':
         {
 			size_t n = strlen(optarg);
@@ -279,9 +568,9 @@ static int parse_options(int argc, char *argv[])
                 // {
 				// 	n=n-1;
                 // }
-                //opts.output_dir = strndup(start_dir, n - 1); //  strndup didn't exist in Windows
-                opts.output_dir = calloc(n+1, sizeof(char));
-                memcpy(opts.output_dir, start_dir, n);                               
+                //o->output_dir = strndup(start_dir, n - 1); //  strndup didn't exist in Windows
+                o->output_dir = calloc(n+1, sizeof(char));
+                memcpy(o->output_dir, start_dir, n);                               
             }
             break;
         }
@@ -308,14 +597,60 @@ static int parse_options(int argc, char *argv[])
                 // {
 				// 	n=n-1;
                 // }
-                //opts.output_dir_conc = strndup(start_dir, n - 1); //  strndup didn't exist in Windows
-                opts.output_dir_conc = calloc(n+1, sizeof(char));
-                memcpy(opts.output_dir_conc, start_dir, n);                               
+                //o->output_dir_conc = strndup(start_dir, n - 1); //  strndup didn't exist in Windows
+                o->output_dir_conc = calloc(n+1, sizeof(char));
+                memcpy(o->output_dir_conc, start_dir, n);                               
             }		
             break;
         }
-        case 'P': opts.print = 1; break;
-        case 'v': opts.version = 1; break;
+        case 'P': o->print = 1; break;
+        case 'X': o->scan_disc = 1; break;
+        case 'G': 
+            free(o->catalog_path);
+            o->catalog_path = strdup(optarg); 
+            break;
+        case 'B': 
+            free(o->batch_path);
+            o->batch_path = strdup(optarg); 
+            break;
+        case 'J': o->batch_jobs = atoi(optarg) > 0 ? atoi(optarg) : 0; break;
+        case 'N': o->batch_io = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 'D': o->decode_threads = atoi(optarg) > 0 ? atoi(optarg) : 0; break;
+        case 'j': o->threads = atoi(optarg) > 0 ? atoi(optarg) : 0; break;
+        case 'g': o->hugepages = 1; break;
+        case 'Y': 
+            free(o->decoder_cpus);
+            o->decoder_cpus = strdup(optarg); 
+            break;
+        case 'M': o->io_node = atoi(optarg) >= 0 ? atoi(optarg) : -1; break;
+        case 'E': 
+            free(o->daemon_path);
+            o->daemon_path = strdup(optarg); 
+            break;
+        case 'U': o->daemon_queue = atoi(optarg) >= 0 ? atoi(optarg) : 64; break;
+        case 'S': o->stream_output = 1; break;
+        case 'O': 
+            o->to_stdout = 1;
+            o->stream_output = 1;
+            break;
+        case 'Z': o->iso_sparse = 1; break;
+        case 'H': o->hash_output = 1; break;
+        case 'F': o->fingerprint = 1; break;
+        case 'V': o->verify_dst = 1; break;
+        case 'x': o->encode_dst = 1; break;
+        case 'L': o->loudness = 1; break;
+        case 'Q': o->silence_report = 1; break;
+        case 'K': o->trim_silence = 1; break;
+        case 'W': o->output_wav = 1; break;
+        case 'R': 
+            o->pcm_sample_rate = atoi(optarg);
+            if (o->pcm_sample_rate != 88200 && o->pcm_sample_rate != 176400)
+            {
+                fprintf(stderr, "\n Warning: unsupported PCM sample rate %d, using 88200.\n", o->pcm_sample_rate);
+                o->pcm_sample_rate = 88200;
+            }
+            break;
+        case 'v': o->version = 1; break;
 
         case '?':
             fprintf(stdout, help_text, program_name);
@@ -335,6 +670,12 @@ static int parse_options(int argc, char *argv[])
     return 1;
 }
 
+// with --stdout every output file goes to "-", the original stdout
+static char *output_path(struct opts_s *o, char *file_path)
+{
+    return o->to_stdout ? "-" : file_path;
+}
+
 static lock *g_fwprintf_lock = 0;
 
 static int safe_fwprintf(FILE *stream, const wchar_t *format, ...)
@@ -355,10 +696,24 @@ static int safe_fwprintf(FILE *stream, const wchar_t *format, ...)
     return retval;
 }
 
+// outputs being written, all of them are interrupted on SIGINT
+#define MAX_RUNNING_OUTPUTS 64
+static scarletbook_output_t *running_outputs[MAX_RUNNING_OUTPUTS];
+static lock *g_outputs_lock = 0;
+static volatile sig_atomic_t interrupted = 0;
+
 static void handle_sigint(int sig_no)
 {
+    int i;
+
+    interrupted = 1;
     safe_fwprintf(stdout, L"\n\n Program interrupted...                                                      \n");
-    scarletbook_output_interrupt(output);
+    for (i = 0; i < MAX_RUNNING_OUTPUTS; i++)
+    {
+        scarletbook_output_t *output = running_outputs[i];
+        if (output)
+            scarletbook_output_interrupt(output);
+    }
 }
 
 
@@ -402,6 +757,49 @@ static void handle_status_update_progress_callback(uint32_t stats_total_sectors,
 
 }
 
+static scarletbook_output_t *create_output(scarletbook_handle_t *handle, int quiet, const scarletbook_output_events_t *events)
+{
+    scarletbook_output_t *output;
+    int i;
+
+    if (quiet)
+        output = scarletbook_output_create(handle, NULL, NULL, safe_fwprintf);
+    else
+        output = scarletbook_output_create(handle, handle_status_update_track_callback, handle_status_update_progress_callback, safe_fwprintf);
+    if (events)
+        scarletbook_output_set_events(output, events);
+
+    possess(g_outputs_lock);
+    for (i = 0; i < MAX_RUNNING_OUTPUTS; i++)
+    {
+        if (running_outputs[i] == NULL)
+        {
+            running_outputs[i] = output;
+            break;
+        }
+    }
+    release(g_outputs_lock);
+
+    return output;
+}
+
+static void destroy_output(scarletbook_output_t *output)
+{
+    int i;
+
+    scarletbook_output_wait(output);
+
+    possess(g_outputs_lock);
+    for (i = 0; i < MAX_RUNNING_OUTPUTS; i++)
+    {
+        if (running_outputs[i] == output)
+            running_outputs[i] = NULL;
+    }
+    release(g_outputs_lock);
+
+    scarletbook_output_destroy(output);
+}
+
 /* Initialize global variables. */
 static void init(void) 
 {
@@ -412,9 +810,22 @@ static void init(void)
     opts.output_iso         = 0;
     opts.output_dsdiff      = 0;
     opts.output_dsdiff_em   = 0;
+    opts.output_wav         = 0;
     opts.convert_dst        = 0;
     opts.export_cue_sheet   = 0;
     opts.print              = 0;
+    opts.scan_disc          = 0;
+    opts.catalog_path       = NULL;
+    opts.batch_path         = NULL;
+    opts.batch_jobs         = 0;
+    opts.batch_io           = 1;
+    opts.decode_threads     = 0;
+    opts.threads            = 0;
+    opts.hugepages          = 0;
+    opts.decoder_cpus       = NULL;
+    opts.io_node            = -1;
+    opts.daemon_path        = NULL;
+    opts.daemon_queue       = 64;
     opts.output_dir         = NULL;
     opts.output_dir_conc	= NULL;
     opts.input_device       = NULL; //"/dev/cdrom";
@@ -427,6 +838,20 @@ static void init(void)
     opts.select_tracks      = 0;
     opts.logging            = 0;
     opts.id3_tag_mode       = 4; // default id3v2. tag and UTF8 encoding
+    opts.stream_output      = 0;
+    opts.to_stdout          = 0;
+    opts.stdout_fd          = -1;
+    opts.iso_sparse         = 0;
+    opts.hash_output        = 0;
+    opts.fingerprint        = 0;
+    opts.verify_dst         = 0;
+    opts.encode_dst         = 0;
+    opts.loudness           = 0;
+    opts.silence_report     = 0;
+    opts.trim_silence       = 0;
+    opts.clip_start         = 0;
+    opts.clip_end           = 0;
+    opts.pcm_sample_rate    = 88200;
 
 #if defined(WIN32) || defined(_WIN32)
     signal(SIGINT, handle_sigint);
@@ -436,10 +861,12 @@ static void init(void)
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = &handle_sigint;
     sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 #endif
 
         //init_logging(1);   //init_logging(0); 0 = not create a log file
         g_fwprintf_lock = new_lock(0);
+        g_outputs_lock = new_lock(0);
 }
 
 void print_start_time()
@@ -487,6 +914,12 @@ char ** convert_wargv_to_UTF8(int argc,wchar_t *wargv[])
 #endif
 
 
+// value of an on/off key of sacd_extract.cfg
+static int config_yes(const char *value)
+{
+    return strcmp(value, "1") == 0 || strcmp(value, "yes") == 0;
+}
+
 //   read from file sacd_extract.cfg
 //   if artist=1 then artist name will be added to the name of folder
 //   if sacd_extract.cfg didn't exist then return 0 
@@ -517,41 +950,89 @@ int read_config()
     {
         FILE *fp;
         char content[100]; // content to be read
+        char *key, *value;
+        size_t n;
 
         fp = fopen(filename_cfg, "r");
         if (!fp)
             return 0;
 
+        // one key=value per line, keys match as a whole (silence is not trim_silence)
         while (fgets(content, 100, fp) != NULL)
         {
-            if ((strstr(content, "artist=1") != NULL) ||(strstr(content, "artist=yes") != NULL))
+            key = content + strspn(content, " \t");
+            value = strchr(key, '=');
+            if (value == NULL)
+                continue;
+            for (n = value - key; n > 0 && (key[n - 1] == ' ' || key[n - 1] == '\t'); n--)
+                ;
+            key[n] = '\0';
+            value++;
+            value += strspn(value, " \t");
+            for (n = strcspn(value, "\r\n"); n > 0 && (value[n - 1] == ' ' || value[n - 1] == '\t'); n--)
+                ;
+            value[n] = '\0';
+
+            if (strcmp(key, "artist") == 0 && config_yes(value))
                 opts.artist_flag = 1;
-            if ((strstr(content, "performer=1") != NULL) || (strstr(content, "performer=yes") != NULL))
+            if (strcmp(key, "performer") == 0 && config_yes(value))
                 opts.performer_flag = 1;
-            if ((strstr(content, "pauses=1") != NULL) || (strstr(content, "pauses=yes") != NULL))
+            if (strcmp(key, "pauses") == 0 && config_yes(value))
                 opts.audio_frame_trimming = 0;
-            if ((strstr(content, "nopad=1") != NULL) || (strstr(content, "nopad=yes") != NULL))
+            if (strcmp(key, "nopad") == 0 && config_yes(value))
                 opts.dsf_nopad = 1;
-            if ((strstr(content, "concatenate=1") != NULL) || (strstr(content, "concatenate=yes") != NULL))
+            if (strcmp(key, "concatenate") == 0 && config_yes(value))
             {
                 opts.concatenate = 1;
                 opts.audio_frame_trimming = 0; // when concatenate must include all pausese and disable dsf_pad !!!
             }  
-            if ((strstr(content, "logging=1") != NULL) || (strstr(content, "logging=yes") != NULL))
+            if (strcmp(key, "logging") == 0 && config_yes(value))
                     opts.logging = 1;
-
-            if ((strstr(content, "id3tag=0") != NULL) || (strstr(content, "id3tag=no") != NULL)) // 0=no id3 inserted
-                opts.id3_tag_mode=0;
-            if (strstr(content, "id3tag=1") != NULL) // 1=id3 v2.3;  UTF-16 encoding
-                opts.id3_tag_mode = 1;
-            if (strstr(content, "id3tag=2") != NULL)   // 2=miminal id3v2.3 tag; UTF-16 encoding
-                opts.id3_tag_mode = 2;
-            if (strstr(content, "id3tag=3") != NULL) // 4=id3v2.3 ; ISO_8859_1 encoding
-                opts.id3_tag_mode = 3;
-            if (strstr(content, "id3tag=4") != NULL) // 4=id3v2.4; UTF-8 encoding
-                opts.id3_tag_mode = 4;
-            if (strstr(content, "id3tag=5") != NULL) // 5=id3v2.4 minimal;UTF-8 encoding
-                opts.id3_tag_mode = 5;
+            if (strcmp(key, "stream") == 0 && config_yes(value))
+                opts.stream_output = 1;
+            if (strcmp(key, "sparse") == 0 && config_yes(value))
+                opts.iso_sparse = 1;
+            if (strcmp(key, "hash") == 0 && config_yes(value))
+                opts.hash_output = 1;
+            if (strcmp(key, "fingerprint") == 0 && config_yes(value))
+                opts.fingerprint = 1;
+            if (strcmp(key, "verify_dst") == 0 && config_yes(value))
+                opts.verify_dst = 1;
+            if (strcmp(key, "encode_dst") == 0 && config_yes(value))
+                opts.encode_dst = 1;
+            if (strcmp(key, "loudness") == 0 && config_yes(value))
+                opts.loudness = 1;
+            if (strcmp(key, "silence") == 0 && config_yes(value))
+                opts.silence_report = 1;
+            if (strcmp(key, "trim_silence") == 0 && config_yes(value))
+                opts.trim_silence = 1;
+            if (strcmp(key, "pcm_rate") == 0 && strcmp(value, "176400") == 0)
+                opts.pcm_sample_rate = 176400;
+            if (strcmp(key, "hugepages") == 0 && config_yes(value))
+                opts.hugepages = 1;
+            // -j on the command line wins over the file
+            if (strcmp(key, "threads") == 0 && opts.threads == 0 && atoi(value) > 0)
+                opts.threads = atoi(value);
+            if (strcmp(key, "decoder_cpus") == 0 && opts.decoder_cpus == NULL && value[0] != '\0')
+                opts.decoder_cpus = strdup(value);
+            if (strcmp(key, "io_node") == 0 && opts.io_node < 0 && value[0] != '\0' && atoi(value) >= 0)
+                opts.io_node = atoi(value);
+
+            if (strcmp(key, "id3tag") == 0)
+            {
+                if (strcmp(value, "0") == 0 || strcmp(value, "no") == 0) // 0=no id3 inserted
+                    opts.id3_tag_mode = 0;
+                if (strcmp(value, "1") == 0) // 1=id3 v2.3;  UTF-16 encoding
+                    opts.id3_tag_mode = 1;
+                if (strcmp(value, "2") == 0)   // 2=miminal id3v2.3 tag; UTF-16 encoding
+                    opts.id3_tag_mode = 2;
+                if (strcmp(value, "3") == 0) // 4=id3v2.3 ; ISO_8859_1 encoding
+                    opts.id3_tag_mode = 3;
+                if (strcmp(value, "4") == 0) // 4=id3v2.4; UTF-8 encoding
+                    opts.id3_tag_mode = 4;
+                if (strcmp(value, "5") == 0) // 5=id3v2.4 minimal;UTF-8 encoding
+                    opts.id3_tag_mode = 5;
+            }
         }
         fclose(fp);
         fwprintf(stdout, L"\nFound configuration 'sacd_extract.cfg' file...\n" );
@@ -579,6 +1060,20 @@ int read_config()
             break;
         }
         fwprintf(stdout, L"\tLogging (logging = %d) %ls\n", opts.logging, opts.logging != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tStreaming output (stream = %d) %ls\n", opts.stream_output, opts.stream_output != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tSparse ISO (sparse = %d) %ls\n", opts.iso_sparse, opts.iso_sparse != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tHash outputs (hash = %d) %ls\n", opts.hash_output, opts.hash_output != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tDSD fingerprints (fingerprint = %d) %ls\n", opts.fingerprint, opts.fingerprint != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tVerify DST frames (verify_dst = %d) %ls\n", opts.verify_dst, opts.verify_dst != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tDST encode DSD areas (encode_dst = %d) %ls\n", opts.encode_dst, opts.encode_dst != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tReplayGain analysis (loudness = %d) %ls\n", opts.loudness, opts.loudness != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tSilence report (silence = %d) %ls\n", opts.silence_report, opts.silence_report != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tTrim silence (trim_silence = %d) %ls\n", opts.trim_silence, opts.trim_silence != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tPCM sample rate of wav output (pcm_rate = %d)\n", opts.pcm_sample_rate);
+        fwprintf(stdout, L"\tProcessors used (threads = %d) %ls\n", opts.threads, opts.threads > 0 ? L"" : L"auto");
+        fwprintf(stdout, L"\tDST decoder state on hugepages (hugepages = %d) %ls\n", opts.hugepages, opts.hugepages != 0 ? L"yes" : L"no");
+        fwprintf(stdout, L"\tDST decoder processors (decoder_cpus = %s)\n", opts.decoder_cpus ? opts.decoder_cpus : "any");
+        fwprintf(stdout, L"\tNUMA node for reading and writing (io_node = %d) %ls\n", opts.io_node, opts.io_node >= 0 ? L"" : L"any");
         return 1;
     }
     else
@@ -596,8 +1091,9 @@ int read_config()
 //            area_idx
 //            If there is not multichannel area then it did not add \Stereo..or Multich 
 //            base_output_dir = directory from where to start creating new directory tree
+//            make_dir = 0 only computes the path (all audio goes to stdout)
 //
-char *create_path_output(scarletbook_handle_t *handle, int area_idx, char * base_output_dir)
+char *create_path_output(scarletbook_handle_t *handle, int area_idx, char * base_output_dir, int make_dir)
 {
 #if defined(WIN32) || defined(_WIN32)
 char PATH_TRAILING_SLASH[2]= {'\\','\0'};
@@ -630,6 +1126,9 @@ char PATH_TRAILING_SLASH[2] = {'/', '\0'};
         strcat(path_output, get_speaker_config_string(handle->area[area_idx].area_toc));
     }
 
+    if (!make_dir)
+        return path_output;
+
     int ret_mkdir = recursive_mkdir(path_output, base_output_dir, 0774);
 
     if (ret_mkdir != 0)
@@ -688,551 +1187,1419 @@ char * return_current_directory()
 }
 
 
-#if defined(WIN32) || defined(_WIN32)
-    int wmain(int argc, wchar_t *wargv[])      
-#else
-    int main(int argc, char *argv[])
-#endif
+// checks (and completes) the options of one disc, returns 0 if it can be extracted
+static int check_disc_options(struct opts_s *o)
 {
-    char *album_filename = NULL, *musicfilename = NULL, *file_path = NULL;
-    int i, area_idx;
-    sacd_reader_t *sacd_reader = NULL;
-	int exit_main_flag=0; //0=succes; -1 failed
+    int i;
 
-#ifdef PTW32_STATIC_LIB
-    pthread_win32_process_attach_np();
-    pthread_win32_thread_attach_np();
-#endif
+    // default to 2 channel
+    if (o->two_channel == 0 && o->multi_channel == 0) 
+    {
+        o->two_channel = 1;
+    }
 
-    init();
-   
-#if defined(WIN32) || defined(_WIN32)
-    char **argvw_utf8 = convert_wargv_to_UTF8(argc,wargv);
-    if (parse_options(argc, argvw_utf8))
-#else
-    if (parse_options(argc, argv))
-#endif
+    if (o->stream_output && o->dsf_nopad)
     {
-        setlocale(LC_ALL, "");
-        if (fwide(stdout, 1) < 0)
-        {
-            fprintf(stderr, "\nERROR: Output not set to wide.\n");
-			exit_main_flag=-1;
-            goto exit_main_1;
-        }
-        fwprintf(stdout, L"\nsacd_extract client " SACD_RIPPER_VERSION_STRING "\n");
-        fwprintf(stdout, L"\nEnhanced by euflo ....starting!\n");
-        // Get the current (working) directory:
-        char *buffer;
-        if ((buffer = return_current_directory() ) != NULL)   
-        {
-            char *wide_filename;
-            CHAR2WCHAR(wide_filename, buffer);
-            fwprintf(stdout, L"\nCurrent (working) directory (for the app and 'sacd_extract.cfg' file): %ls\n", (wchar_t *)wide_filename);
-            free(wide_filename);
-            free(buffer);
-        }
+        fwprintf(stdout, L"\n Warning: padding-less DSF (nopad) needs to rewrite finished files; it is disabled when streaming.\n");
+        o->dsf_nopad = 0;
+    }
 
+    if (o->stream_output && o->encode_dst)
+    {
+        fwprintf(stdout, L"\n Warning: DST encoding needs to rewrite finished files; it is disabled when streaming.\n");
+        o->encode_dst = 0;
+    }
 
-        int exist_cfg = read_config();
-        init_logging(opts.logging); //init_logging(0); 1= write logs in a file
+    // stdout can only carry one file
+    if (o->to_stdout)
+    {
+        int selected_count = 0;
 
-        LOG(lm_main, LOG_NOTICE, ("sacd_extract Version: %s  ", SACD_RIPPER_VERSION_STRING));
+        for (i = 0; i < 256; i++)
+            selected_count += o->selected_tracks[i] == 0x01;
 
-        if (opts.version==1)
+        if (o->output_iso + o->output_dsdiff_em + (o->output_dsf || o->output_dsdiff || o->output_wav) != 1
+            || o->two_channel + o->multi_channel != 1
+            || o->output_dsf + o->output_dsdiff + o->output_wav > 1
+            || ((o->output_dsf || o->output_dsdiff || o->output_wav) && !(o->select_tracks && (o->concatenate || selected_count == 1))))
         {
-            //fwprintf(stdout, L"\n" SACD_RIPPER_VERSION_INFO "\n");
-            fwprintf(stdout, L"git repository: " SACD_RIPPER_REPO "\n");
-
-            if(!exist_cfg)  // do not repeat again the same text...as in read-config()
-            {
-                    fwprintf(stdout, L"Configuration settings:\n");
-                    fwprintf(stdout, L"\tArtist will be added in folder name (artist=%d) %ls\n", opts.artist_flag, opts.artist_flag > 0 ? L"yes" : L"no");
-                    fwprintf(stdout, L"\tPerformer will be added in filename of track (performer=%d) %ls\n", opts.performer_flag, opts.performer_flag > 0 ? L"yes" : L"no");
-                    fwprintf(stdout, L"\tPadding-less (nopad=%d) %ls\n", opts.dsf_nopad, opts.dsf_nopad != 0 ? L"yes" : L"no");
-                    fwprintf(stdout, L"\tPauses included (pauses=%d) %ls\n", !opts.audio_frame_trimming, opts.audio_frame_trimming == 0 ? L"yes" : L"no");
-                    fwprintf(stdout, L"\tConcatenate (concatenate=%d) %ls\n", opts.concatenate, opts.concatenate > 0 ? L"yes" : L"no");
-                    fwprintf(stdout, L"\tID3tag (id3tag = %d)\n", opts.id3_tag_mode);
-            }
-            
-            goto exit_main;
+            fwprintf(stdout, L"\n Error: --stdout needs exactly one output file: -I, -e, or -s/-p/--output-wav with one track (-t) or concatenated tracks (-k -t).\n");
+            return -1;
         }
 
-        // default to 2 channel
-        if (opts.two_channel == 0 && opts.multi_channel == 0) 
-        {
-            opts.two_channel = 1;
-        }
+        // nothing is written to the output directory: the cue sheet -e adds would name a file that does not exist
+        if (o->output_dsdiff_em)
+            o->export_cue_sheet = 0;
+    }
 
 #if defined(WIN32) || defined(_WIN32)
-        if ((opts.output_dir == NULL) && (opts.output_dir_conc == NULL))
+    if ((o->output_dir == NULL) && (o->output_dir_conc == NULL))
+    {
+        // Get the current working directory:
+        char *buffer;          
+        if ((buffer = return_current_directory()) != NULL)
         {
-            // Get the current working directory:
-            char *buffer;          
-            if ((buffer = return_current_directory()) != NULL)
-            {
-                opts.output_dir = strdup(buffer);
-                free(buffer);
-            }                                
-        }
+            o->output_dir = strdup(buffer);
+            free(buffer);
+        }                                
+    }
 #endif
 
-        if (opts.output_dir != NULL   ) // test if exists 
+    if (o->output_dir != NULL   ) // test if exists 
+    {
+        if (path_dir_exists(o->output_dir) == 0)
         {
-            if (path_dir_exists(opts.output_dir) == 0)
-            {
-                wchar_t *wide_filename;
-                CHAR2WCHAR(wide_filename, opts.output_dir);
-                fwprintf(stdout, L"%ls doesn't exist or is not a directory.\n",wide_filename);
-                free(wide_filename);
+            wchar_t *wide_filename;
+            CHAR2WCHAR(wide_filename, o->output_dir);
+            fwprintf(stdout, L"%ls doesn't exist or is not a directory.\n",wide_filename);
+            free(wide_filename);
 
-				exit_main_flag=-1;
-                goto exit_main;
-            }
-            if (opts.output_dir_conc == NULL)
-                opts.output_dir_conc = strdup(opts.output_dir);
+            return -1;
         }
+        if (o->output_dir_conc == NULL)
+            o->output_dir_conc = strdup(o->output_dir);
+    }
 		
-		if (opts.output_dir_conc != NULL   ) // test if exists 
+		if (o->output_dir_conc != NULL   ) // test if exists 
+    {
+        if (path_dir_exists(o->output_dir_conc) == 0)
         {
-            if (path_dir_exists(opts.output_dir_conc) == 0)
-            {
-                wchar_t *wide_filename;
-                CHAR2WCHAR(wide_filename, opts.output_dir_conc);
-                fwprintf(stdout, L"%ls doesn't exist or is not a directory.\n", opts.output_dir_conc);
-                free(wide_filename);
+            wchar_t *wide_filename;
+            CHAR2WCHAR(wide_filename, o->output_dir_conc);
+            fwprintf(stdout, L"%ls doesn't exist or is not a directory.\n", o->output_dir_conc);
+            free(wide_filename);
 
-                exit_main_flag=-1;
-                goto exit_main;
-            }
-            if (opts.output_dir == NULL)
-                opts.output_dir = strdup(opts.output_dir_conc);
+            return -1;
         }
+        if (o->output_dir == NULL)
+            o->output_dir = strdup(o->output_dir_conc);
+    }
 
-        if(opts.input_device == NULL)
-        {
-            opts.input_device = strdup("/dev/cdrom");
-        }
+    if(o->input_device == NULL)
+    {
+        o->input_device = strdup("/dev/cdrom");
+    }
 
-        sacd_reader = sacd_open(opts.input_device);
-        if (sacd_reader != NULL) 
+    return 0;
+}
+
+// extracts one disc, quiet leaves out the progress of each file, events may be NULL
+static int extract_disc(struct opts_s *o, int quiet, const scarletbook_output_events_t *events)
+{
+    char *album_filename = NULL, *musicfilename = NULL, *file_path = NULL;
+    char *metadata_xml_path = NULL;
+    int i, area_idx;
+    sacd_reader_t *sacd_reader = NULL;
+    scarletbook_handle_t *handle;
+    scarletbook_output_t *output;
+    int ret = 0;
+
+    sacd_reader = sacd_open(o->input_device);
+    if (sacd_reader != NULL) 
+    {
+
+        handle = scarletbook_open(sacd_reader);
+        if (handle)
         {
+            handle->concatenate = o->concatenate;
+            handle->audio_frame_trimming = o->audio_frame_trimming;  
+            handle->dsf_nopad = o->dsf_nopad;
+            handle->id3_tag_mode=o->id3_tag_mode;
+            handle->stream_output = o->stream_output;
+            handle->stdout_fd = o->stdout_fd;
+            handle->iso_sparse = o->iso_sparse;
+            handle->hash_output = o->hash_output;
+            handle->fingerprint = o->fingerprint;
+            handle->verify_dst = o->verify_dst;
+            handle->encode_dst = o->encode_dst;
+            handle->loudness = o->loudness;
+            handle->silence_report = o->silence_report;
+            handle->trim_silence = o->trim_silence;
+            handle->clip_start = o->clip_start;
+            handle->clip_end = o->clip_end;
+            if (o->clip_end > 0)
+                prepare_time_index(handle, sacd_reader, o->input_device, o->output_dir ? o->output_dir : o->output_dir_conc);
+            handle->pcm_sample_rate = o->pcm_sample_rate;
+
+
+            album_filename = get_album_dir(handle, o->artist_flag);
+            LOG(lm_main, LOG_NOTICE, ("NOTICE in main:get_album_dir()...album_filename: %s", album_filename));
+
+            if (o->print)
+            {
+                // discs of a batch print at the same time
+                possess(g_fwprintf_lock);
+                scarletbook_print(handle);
+                release(g_fwprintf_lock);
+            }
 
-            handle = scarletbook_open(sacd_reader);
-            if (handle)
+            if (o->scan_disc)
             {
-                handle->concatenate = opts.concatenate;
-                handle->audio_frame_trimming = opts.audio_frame_trimming;  
-                handle->dsf_nopad = opts.dsf_nopad;
-                handle->id3_tag_mode=opts.id3_tag_mode;
+                if (scan_disc(handle) > 0)
+                    ret = -1;
+            }
 
+            uint32_t total_sectors = sacd_get_total_sectors(sacd_reader); // get the real full size of disc [number of sectors] or file [number of SACD_LSN_SIZE]
 
-                album_filename = get_album_dir(handle, opts.artist_flag);
-                LOG(lm_main, LOG_NOTICE, ("NOTICE in main:get_album_dir()...album_filename: %s", album_filename));
+            // made some checks on the total size of iso/disc
+            uint32_t area1_sectors_max = handle->master_toc->area_1_toc_2_start + handle->master_toc->area_1_toc_size;
+            uint32_t area2_sectors_max = handle->master_toc->area_2_toc_2_start + handle->master_toc->area_2_toc_size;
+            uint32_t max_sectors = area2_sectors_max > area1_sectors_max ? area2_sectors_max : area1_sectors_max;
 
-                if (opts.print)
-                {
-                    scarletbook_print(handle);
-                }
+            if (max_sectors <= total_sectors)
+            {
+
+                fwprintf(stdout, L"\nThe size of sacd is ok (sectors=%d). Size is: %llu bytes, %.3f GB (gigabyte) \n", total_sectors, (uint64_t)total_sectors * SACD_LSN_SIZE, (double)total_sectors * SACD_LSN_SIZE / (1000 * 1000 * 1000));
+            }
+            else
+            {
+                fwprintf(stdout, L"\nWarning: the reported size (sectors) of sacd is not ok (sectors=%u) < (max_sectors=%u) !\n", total_sectors, max_sectors);
+            }
+
+            // genereate the main output folder
+#if defined(WIN32) || defined(_WIN32)
+            char PATH_TRAILING_SLASH[2] = {'\\', '\0'};
+#else
+            char PATH_TRAILING_SLASH[2] = {'/', '\0'};
+#endif
+            char *album_path = get_path_disc_album(handle, o->artist_flag);
+            char *output_dir;
+            if (o->output_dir != NULL)
+            {
+                size_t size_output_dir = strlen(o->output_dir);
+                output_dir = calloc(size_output_dir + 1 + strlen(album_path) + 1, sizeof(char));
+                strncpy(output_dir, o->output_dir, size_output_dir);
+                if (o->output_dir[size_output_dir - 1] != '/' && o->output_dir[size_output_dir - 1] != '\\')
+                    strncat(output_dir, PATH_TRAILING_SLASH, 1);
+            }
+            else
+                output_dir = calloc(strlen(album_path) + 1, sizeof(char));
+
+            strncat(output_dir, album_path, strlen(album_path));
+            free(album_path);
+            LOG(lm_main, LOG_NOTICE, ("NOTICE in main: after get_path_disc_album()...output_dir: %s", output_dir));
 
-                uint32_t total_sectors = sacd_get_total_sectors(sacd_reader); // get the real full size of disc [number of sectors] or file [number of SACD_LSN_SIZE]
+            if (o->export_cue_sheet)  // in fact,  export XML metadata at first
+            {
 
-                // made some checks on the total size of iso/disc
-                uint32_t area1_sectors_max = handle->master_toc->area_1_toc_2_start + handle->master_toc->area_1_toc_size;
-                uint32_t area2_sectors_max = handle->master_toc->area_2_toc_2_start + handle->master_toc->area_2_toc_size;
-                uint32_t max_sectors = area2_sectors_max > area1_sectors_max ? area2_sectors_max : area1_sectors_max;
+                int ret_mkdir = recursive_mkdir(output_dir, o->output_dir, 0774);
 
-                if (max_sectors <= total_sectors)
+                if (ret_mkdir != 0)
                 {
-
-                    fwprintf(stdout, L"\nThe size of sacd is ok (sectors=%d). Size is: %llu bytes, %.3f GB (gigabyte) \n", total_sectors, (uint64_t)total_sectors * SACD_LSN_SIZE, (double)total_sectors * SACD_LSN_SIZE / (1000 * 1000 * 1000));
+                    LOG(lm_main, LOG_ERROR, ("ERROR in main: exporting XML, after recursive_mkdir...output_dir: %s; ret=%d;", output_dir, ret_mkdir));
+                    free(album_filename);
+                    free(output_dir);
+                    scarletbook_close(handle);
+                    sacd_close(sacd_reader);
+                    return -1;
                 }
+
+                // create file XML metadata file
+                char *metadata_file_path_unique = get_unique_filename(NULL, output_dir, album_filename, "xml");
+                if (metadata_file_path_unique == NULL)
+                    fwprintf(stderr, L"\n ERROR: cannot create get_unique_filename XML for metadata (==NULL) !!\n");
                 else
                 {
-                    fwprintf(stdout, L"\nWarning: the reported size (sectors) of sacd is not ok (sectors=%u) < (max_sectors=%u) !\n", total_sectors, max_sectors);
-                }
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+                    char filename_long[1024];
+                    memset(filename_long, '\0', sizeof(filename_long));
+                    strcpy(filename_long, "\\\\?\\");
+                    strncat(filename_long, metadata_file_path_unique, min(1016, strlen(metadata_file_path_unique)));
+#endif
+                    wchar_t *wide_filename;
+                    CHAR2WCHAR(wide_filename, metadata_file_path_unique);
+                    fwprintf(stdout, L"\n\n Exporting metadata in XML file: [%ls] ... \n", wide_filename);
+                    free(wide_filename);
 
-                // genereate the main output folder
-#if defined(WIN32) || defined(_WIN32)
-                char PATH_TRAILING_SLASH[2] = {'\\', '\0'};
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+                    write_metadata_xml(handle, filename_long);
+                    metadata_xml_path = strdup(filename_long);
 #else
-                char PATH_TRAILING_SLASH[2] = {'/', '\0'};
+                    write_metadata_xml(handle, metadata_file_path_unique);
+                    metadata_xml_path = strdup(metadata_file_path_unique);
 #endif
-                char *album_path = get_path_disc_album(handle, opts.artist_flag);
-                char *output_dir;
-                if (opts.output_dir != NULL)
-                {
-                    size_t size_output_dir = strlen(opts.output_dir);
-                    output_dir = calloc(size_output_dir + 1 + strlen(album_path) + 1, sizeof(char));
-                    strncpy(output_dir, opts.output_dir, size_output_dir);
-                    if (opts.output_dir[size_output_dir - 1] != '/' && opts.output_dir[size_output_dir - 1] != '\\')
-                        strncat(output_dir, PATH_TRAILING_SLASH, 1);
+
+                    free(metadata_file_path_unique);
+                    fwprintf(stdout, L"\n\n We are done exporting metadata in XML file. \n");
+                    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: done exporting metadata in XML file."));
                 }
-                else
-                    output_dir = calloc(strlen(album_path) + 1, sizeof(char));
+            }         // end if XML export       
 
-                strncat(output_dir, album_path, strlen(album_path));
-                free(album_path);
-                LOG(lm_main, LOG_NOTICE, ("NOTICE in main: after get_path_disc_album()...output_dir: %s", output_dir));
+            if (o->output_iso)
+            {
+                // create the output folder
+                
+                LOG(lm_main, LOG_NOTICE, ("NOTICE in main: extracting ISO, before recursive_mkdir(output_dir,..)...output_dir: %s", output_dir));
 
-                if (opts.export_cue_sheet)  // in fact,  export XML metadata at first
+                if (!o->to_stdout && path_dir_exists(output_dir) == 0)
                 {
+                    // not exists, then create it
 
-                    int ret_mkdir = recursive_mkdir(output_dir, opts.output_dir, 0774);
+                    int ret_mkdir = recursive_mkdir(output_dir, o->output_dir, 0774);
 
                     if (ret_mkdir != 0)
                     {
+                        LOG(lm_main, LOG_ERROR, ("ERROR in main: ISO, after recursive_mkdir...output_dir: %s; ret=%d;", output_dir, ret_mkdir));
                         free(album_filename);
                         free(output_dir);
                         scarletbook_close(handle);
                         sacd_close(sacd_reader);
-                        exit_main_flag = -1;
-                        LOG(lm_main, LOG_ERROR, ("ERROR in main: exporting XML, after recursive_mkdir...output_dir: %s; ret=%d;", output_dir, ret_mkdir));
-                        goto exit_main;
+                        return -1;
                     }
+                }
 
-                    // create file XML metadata file
-                    char *metadata_file_path_unique = get_unique_filename(NULL, output_dir, album_filename, "xml");
-                    if (metadata_file_path_unique == NULL)
-                        fwprintf(stderr, L"\n ERROR: cannot create get_unique_filename XML for metadata (==NULL) !!\n");
-                    else
+                output = create_output(handle, quiet, events);
+
+                
+#ifdef SECTOR_LIMIT
+#define FAT32_SECTOR_LIMIT 2090000
+                uint32_t sector_size = FAT32_SECTOR_LIMIT;
+                uint32_t sector_offset = 0;
+                if (total_sectors > FAT32_SECTOR_LIMIT)
+                {
+                    musicfilename = (char *) malloc(512);
+                    file_path = make_filename(NULL, output_dir, album_filename, "iso");
+                    for (i = 1; total_sectors != 0; i++)
                     {
-#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
-                        char filename_long[1024];
-                        memset(filename_long, '\0', sizeof(filename_long));
-                        strcpy(filename_long, "\\\\?\\");
-                        strncat(filename_long, metadata_file_path_unique, min(1016, strlen(metadata_file_path_unique)));
+                        sector_size = min(total_sectors, FAT32_SECTOR_LIMIT);
+                        snprintf(musicfilename, 512, "%s.%03d", file_path, i);
+                        scarletbook_output_enqueue_raw_sectors(output, sector_offset, sector_size, musicfilename, "iso");
+                        sector_offset += sector_size;
+                        total_sectors -= sector_size;
+                    }
+                    free(file_path);
+                    free(musicfilename);
+                    
+                }
+                else
 #endif
-                        wchar_t *wide_filename;
-                        CHAR2WCHAR(wide_filename, metadata_file_path_unique);
-                        fwprintf(stdout, L"\n\n Exporting metadata in XML file: [%ls] ... \n", wide_filename);
-                        free(wide_filename);
-
-#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
-                        write_metadata_xml(handle, filename_long);
+                {
+                    char *file_path_iso_unique = get_unique_filename(NULL, output_dir, album_filename, "iso");
 
-#else
-                        write_metadata_xml(handle, metadata_file_path_unique);
+                    wchar_t *wide_filename;
+                    CHAR2WCHAR(wide_filename, file_path_iso_unique);
+                    fwprintf(stdout, L"\n Exporting ISO output in file: %ls\n", wide_filename);
+                    free(wide_filename);
 
-#endif
+                    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: exporting ISO, before scarletbook_output_enqueue_raw_sectors()...file_path_iso_unique: %s; total_sectors:%d;", file_path_iso_unique,total_sectors));
 
-                        free(metadata_file_path_unique);
-                        fwprintf(stdout, L"\n\n We are done exporting metadata in XML file. \n");
-                        LOG(lm_main, LOG_NOTICE, ("NOTICE in main: done exporting metadata in XML file."));
-                    }
-                }         // end if XML export       
+                    scarletbook_output_enqueue_raw_sectors(output, 0, total_sectors, output_path(o, file_path_iso_unique), "iso");
 
-                if (opts.output_iso)
-                {
-                    // create the output folder
+                    free(file_path_iso_unique);
                     
-                    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: extracting ISO, before recursive_mkdir(output_dir,..)...output_dir: %s", output_dir));
+                }
+                
+                
+                print_start_time();
+                scarletbook_output_start(output);
+                destroy_output(output);
+                print_end_time();
 
-                    if (path_dir_exists(output_dir) == 0)
-                    {
-                        // not exists, then create it
+                fwprintf(stdout, L"\n We are done exporting ISO.                                                          \n");
 
-                        int ret_mkdir = recursive_mkdir(output_dir, opts.output_dir, 0774);
+            } // end if (o->output_iso)
 
-                        if (ret_mkdir != 0)
-                        {
-                            free(album_filename);
-                            free(output_dir);
-                            scarletbook_close(handle);
-                            sacd_close(sacd_reader);
-                            exit_main_flag=-1;
-                            LOG(lm_main, LOG_ERROR, ("ERROR in main: ISO, after recursive_mkdir...output_dir: %s; ret=%d;", output_dir, ret_mkdir));
-                            goto exit_main;
-                        }
-                    }
-
-                    output = scarletbook_output_create(handle, handle_status_update_track_callback, handle_status_update_progress_callback, safe_fwprintf);
+            if (o->output_dsf || o->output_dsdiff || o->output_wav || o->output_dsdiff_em || o->export_cue_sheet)
+            {
 
-                    
-#ifdef SECTOR_LIMIT
-#define FAT32_SECTOR_LIMIT 2090000
-                    uint32_t sector_size = FAT32_SECTOR_LIMIT;
-                    uint32_t sector_offset = 0;
-                    if (total_sectors > FAT32_SECTOR_LIMIT)
-                    {
-                        musicfilename = (char *) malloc(512);
-                        file_path = make_filename(NULL, output_dir, album_filename, "iso");
-                        for (i = 1; total_sectors != 0; i++)
-                        {
-                            sector_size = min(total_sectors, FAT32_SECTOR_LIMIT);
-                            snprintf(musicfilename, 512, "%s.%03d", file_path, i);
-                            scarletbook_output_enqueue_raw_sectors(output, sector_offset, sector_size, musicfilename, "iso");
-                            sector_offset += sector_size;
-                            total_sectors -= sector_size;
-                        }
-                        free(file_path);
-                        free(musicfilename);
-                        
-                    }
-                    else
-#endif
+                while (o->two_channel + o->multi_channel > 0)
+                {
+                    if (o->multi_channel && (!has_multi_channel(handle))) // skip if we want multich but disc have no multich area
                     {
-                        char *file_path_iso_unique = get_unique_filename(NULL, output_dir, album_filename, "iso");
-
-                        wchar_t *wide_filename;
-                        CHAR2WCHAR(wide_filename, file_path_iso_unique);
-                        fwprintf(stdout, L"\n Exporting ISO output in file: %ls\n", wide_filename);
-                        free(wide_filename);
-
-                        LOG(lm_main, LOG_NOTICE, ("NOTICE in main: exporting ISO, before scarletbook_output_enqueue_raw_sectors()...file_path_iso_unique: %s; total_sectors:%d;", file_path_iso_unique,total_sectors));
-
-                        scarletbook_output_enqueue_raw_sectors(output, 0, total_sectors, file_path_iso_unique, "iso");
-
-                        free(file_path_iso_unique);
-                        
+                        fwprintf(stdout, L"\n Asked multichannel format but disc has no multichannel area. So skip processing...                                            \n");
+                        o->multi_channel = 0;
+                        continue;
                     }
-                    
-                    
-                    print_start_time();
-                    scarletbook_output_start(output);
-                    scarletbook_output_destroy(output);
-                    print_end_time();
 
-                    fwprintf(stdout, L"\n We are done exporting ISO.                                                          \n");
-
-                } // end if (opts.output_iso)
-
-                if (opts.output_dsf || opts.output_dsdiff || opts.output_dsdiff_em || opts.export_cue_sheet)
-                {
-
-                    while (opts.two_channel + opts.multi_channel > 0)
+                    if (o->two_channel && (!has_two_channel(handle) )) // skip;   if want 2ch but disc have no 2 ch area (YES !!! Exists these type of discs  - e.g Rubinstein - Grieg..only multich area)                                                    
                     {
-                        if (opts.multi_channel && (!has_multi_channel(handle))) // skip if we want multich but disc have no multich area
-                        {
-                            fwprintf(stdout, L"\n Asked multichannel format but disc has no multichannel area. So skip processing...                                            \n");
-                            opts.multi_channel = 0;
+                            fwprintf(stdout, L"\n Asked for stereo format but disc has no stereo area. So skip processing...                                            \n");
+                            o->two_channel = 0;
                             continue;
-                        }
-
-                        if (opts.two_channel && (!has_two_channel(handle) )) // skip;   if want 2ch but disc have no 2 ch area (YES !!! Exists these type of discs  - e.g Rubinstein - Grieg..only multich area)                                                    
-                        {
-                                fwprintf(stdout, L"\n Asked for stereo format but disc has no stereo area. So skip processing...                                            \n");
-                                opts.two_channel = 0;
-                                continue;
-                        }
+                    }
 
-                        // select the channel area
-                        area_idx = has_multi_channel(handle) && opts.multi_channel ? handle->mulch_area_idx : handle->twoch_area_idx;
-                        
+                    // select the channel area
+                    area_idx = has_multi_channel(handle) && o->multi_channel ? handle->mulch_area_idx : handle->twoch_area_idx;
+                    
 
-                        // create the output folder with Stereo/MulCh
-                        char *output_dir_dsd = create_path_output(handle, area_idx, opts.output_dir);
-                        if (output_dir_dsd == NULL)
-                        {
-                            free(album_filename);
-                            free(output_dir);
-                            scarletbook_close(handle);
-                            sacd_close(sacd_reader);
-                            exit_main_flag = -1;
-                            LOG(lm_main, LOG_ERROR, ("ERROR in main: DSF.., after create_path_output()"));
-                            goto exit_main;
-                        }
+                    // create the output folder with Stereo/MulCh, not needed when the audio goes to stdout
+                    char *output_dir_dsd = create_path_output(handle, area_idx, o->output_dir, !o->to_stdout || o->export_cue_sheet);
+                    if (output_dir_dsd == NULL)
+                    {
+                        LOG(lm_main, LOG_ERROR, ("ERROR in main: DSF.., after create_path_output()"));
+                        free(album_filename);
+                        free(output_dir);
+                        scarletbook_close(handle);
+                        sacd_close(sacd_reader);
+                        return -1;
+                    }
 
-                        if (opts.output_dsdiff_em)
-                        {
+                    if (o->output_dsdiff_em)
+                    {
 
-                            char *file_path_dsdiff_unique = get_unique_filename(NULL, output_dir_dsd, album_filename, "dff");   
+                        char *file_path_dsdiff_unique = get_unique_filename(NULL, output_dir_dsd, album_filename, "dff");   
 
-                            wchar_t *wide_filename;
-                            CHAR2WCHAR(wide_filename, file_path_dsdiff_unique);
-                            fwprintf(stdout, L"\n Exporting DFF edit master output in file: %ls\n", wide_filename);
-                            free(wide_filename);
+                        wchar_t *wide_filename;
+                        CHAR2WCHAR(wide_filename, file_path_dsdiff_unique);
+                        fwprintf(stdout, L"\n Exporting DFF edit master output in file: %ls\n", wide_filename);
+                        free(wide_filename);
 
-                            output = scarletbook_output_create(handle, handle_status_update_track_callback, handle_status_update_progress_callback, safe_fwprintf);
+                        output = create_output(handle, quiet, events);
 
-                            scarletbook_output_enqueue_track(output, area_idx, 0, file_path_dsdiff_unique, "dsdiff_edit_master",
-                                                            (opts.convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST));
+                        scarletbook_output_enqueue_track(output, area_idx, 0, output_path(o, file_path_dsdiff_unique), "dsdiff_edit_master",
+                                                        (o->convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST));
 
-                            free(file_path_dsdiff_unique);
+                        free(file_path_dsdiff_unique);
 
-                            print_start_time();
-                            
-                            scarletbook_output_start(output);
-                            scarletbook_output_destroy(output);
-                            
-                            print_end_time();						
+                        print_start_time();
+                        
+                        scarletbook_output_start(output);
+                        destroy_output(output);
+                        
+                        print_end_time();						
 
-                            fwprintf(stdout, L"\n\n We are done exporting DFF edit master.                                                          \n");
+                        fwprintf(stdout, L"\n\n We are done exporting DFF edit master.                                                          \n");
 
-                            // Must generate cue sheet
-                            opts.export_cue_sheet=1;
+                        // Must generate cue sheet, unless the file went to stdout
+                        if (!o->to_stdout)
+                            o->export_cue_sheet=1;
 
-                        } // end if  opts.output_dsdiff_em
+                    } // end if  o->output_dsdiff_em
 
-                        if (opts.export_cue_sheet)
-                        {
+                    if (o->export_cue_sheet)
+                    {
 
-                            char *cue_file_path_unique = get_unique_filename(NULL, output_dir_dsd, album_filename, "cue");
+                        char *cue_file_path_unique = get_unique_filename(NULL, output_dir_dsd, album_filename, "cue");
 
-                            wchar_t *wide_filename;
-                            CHAR2WCHAR(wide_filename, cue_file_path_unique);
-                            fwprintf(stdout, L"\n\n Exporting CUE sheet: [%ls] ... \n", wide_filename);
-                            free(wide_filename);
+                        wchar_t *wide_filename;
+                        CHAR2WCHAR(wide_filename, cue_file_path_unique);
+                        fwprintf(stdout, L"\n\n Exporting CUE sheet: [%ls] ... \n", wide_filename);
+                        free(wide_filename);
 
-                            file_path = make_filename(NULL, NULL, album_filename, "dff");
+                        file_path = make_filename(NULL, NULL, album_filename, "dff");
 
 							int rez_cuesheet= write_cue_sheet(handle, file_path, area_idx, cue_file_path_unique);
 							if(rez_cuesheet != -1)
 								fwprintf(stdout, L"\n\n We are done exporting CUE sheet. \n");
 							else
 								fwprintf(stdout, L"\n\n ERROR: Cannot create CUE sheet file. \n");    
-                            
-                            free(cue_file_path_unique);
-                            free(file_path);                                
+                        
+                        free(cue_file_path_unique);
+                        free(file_path);                                
 
-                        }
+                    }
 
-                        if (opts.output_dsf || opts.output_dsdiff)
+                    if (o->output_dsf || o->output_dsdiff || o->output_wav)
+                    {
+
+                        wchar_t *wide_folder;
+                        CHAR2WCHAR(wide_folder, output_dir_dsd);
+                        if (o->output_dsf)
+                        {
+                            fwprintf(stdout, L"\n Exporting DSF output in folder: %ls\n", wide_folder);
+                        }
+                        else if (o->output_dsdiff)
+                        {
+                            fwprintf(stdout, L"\n Exporting DSDIFF output in folder: %ls\n", wide_folder);
+                        }
+                        else
                         {
+                            fwprintf(stdout, L"\n Exporting WAV output (%d Hz) in folder: %ls\n", o->pcm_sample_rate, wide_folder);
+                        }
+                        free(wide_folder);
+
+                        output = create_output(handle, quiet, events);
 
-                            wchar_t *wide_folder;
-                            CHAR2WCHAR(wide_folder, output_dir_dsd);
-                            if (opts.output_dsf)
+                        if(o->concatenate == 0)
+                        {
+                            int no_of_enqued_tracks=0;
+                            int no_total_tracks = handle->area[area_idx].area_toc->track_count;
+                            // fill the queue with items to rip
+                            for (i = 0; i < no_total_tracks; i++)
                             {
-                                fwprintf(stdout, L"\n Exporting DSF output in folder: %ls\n", wide_folder);
+                                if (o->select_tracks && o->selected_tracks[i] == 0x0)
+                                    continue;
+
+                                musicfilename = get_music_filename(handle, area_idx, i, "", o->performer_flag);
+
+                                if (o->output_dsf)
+                                {
+                                    file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dsf");
+                                    scarletbook_output_enqueue_track(output, area_idx, i, output_path(o, file_path), "dsf",
+                                                                     1 /* always decode to DSD */);
+                                    no_of_enqued_tracks++;                                       
+                                }
+                                else if (o->output_dsdiff)
+                                {
+                                    file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dff");
+                                    scarletbook_output_enqueue_track(output, area_idx, i, output_path(o, file_path), "dsdiff",
+                                                                     (o->convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST));
+                                    no_of_enqued_tracks++;
+                                }
+                                else if (o->output_wav)
+                                {
+                                    file_path = make_filename(NULL, output_dir_dsd, musicfilename, "wav");
+                                    scarletbook_output_enqueue_track(output, area_idx, i, output_path(o, file_path), "wav",
+                                                                     1 /* always decode to DSD */);
+                                    no_of_enqued_tracks++;
+                                }
+                                free(file_path);
+                                free(musicfilename);
                             }
-                            else
+                            if ((no_of_enqued_tracks < no_total_tracks) && !o->select_tracks)
                             {
-                                fwprintf(stdout, L"\n Exporting DSDIFF output in folder: %ls\n", wide_folder);
+                                fwprintf(stdout, L"\n Error: Number of processed tracks %d will be smaller than total tracks %d !!\n", no_of_enqued_tracks, no_total_tracks);
                             }
-                            free(wide_folder);
+                        }
+                        else  // made concatenation
+                        {
+                            // fill the queue with item to rip
+                            if (o->select_tracks)
+                            {
+                                int first_track = handle->area[area_idx].area_toc->track_count-1;
+                                int last_track  = 0;
+                                // find first track and last track in list
+                                for (i = 0; i < handle->area[area_idx].area_toc->track_count; i++)
+                                {
+                                    if (o->selected_tracks[i] == 0x01)
+                                    {
+                                        if (first_track > i)
+                                            first_track = i;
+                                        if (last_track <  i)
+                                            last_track = i;
+                                    }                                         
+                                }
 
-                            output = scarletbook_output_create(handle, handle_status_update_track_callback, handle_status_update_progress_callback, safe_fwprintf);
 
-                            if(opts.concatenate == 0)
-                            {
-                                int no_of_enqued_tracks=0;
-                                int no_total_tracks = handle->area[area_idx].area_toc->track_count;
-                                // fill the queue with items to rip
-                                for (i = 0; i < no_total_tracks; i++)
+                                if ((first_track < handle->area[area_idx].area_toc->track_count)&&
+                                    (last_track < handle->area[area_idx].area_toc->track_count) )
                                 {
-                                    if (opts.select_tracks && opts.selected_tracks[i] == 0x0)
-                                        continue;
+                                    char conc_string[10];
+                                    snprintf(conc_string, sizeof(conc_string), "[%02d-%02d]",first_track + 1, last_track + 1);
 
-                                    musicfilename = get_music_filename(handle, area_idx, i, "", opts.performer_flag);
+                                    musicfilename = get_music_filename(handle, area_idx, first_track, conc_string, o->performer_flag);
 
-                                    if (opts.output_dsf)
+                                    fwprintf(stdout, L"\n Concatenate tracks: %d to %d\n", first_track+1,last_track+1);
+                                    if (o->output_dsf)
                                     {
                                         file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dsf");
-                                        scarletbook_output_enqueue_track(output, area_idx, i, file_path, "dsf",
-                                                                         1 /* always decode to DSD */);
-                                        no_of_enqued_tracks++;                                       
+                                        scarletbook_output_enqueue_concatenate_tracks(output, area_idx, first_track, output_path(o, file_path), "dsf",
+                                                                                      1 /* always decode to DSD */, last_track);
                                     }
-                                    else if (opts.output_dsdiff)
+                                    else if (o->output_dsdiff)
                                     {
                                         file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dff");
-                                        scarletbook_output_enqueue_track(output, area_idx, i, file_path, "dsdiff",
-                                                                         (opts.convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST));
-                                        no_of_enqued_tracks++;
+                                        scarletbook_output_enqueue_concatenate_tracks(output, area_idx, first_track, output_path(o, file_path), "dsdiff",
+                                                                                      (o->convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST), last_track);
+                                    }
+                                    else if (o->output_wav)
+                                    {
+                                        file_path = make_filename(NULL, output_dir_dsd, musicfilename, "wav");
+                                        scarletbook_output_enqueue_concatenate_tracks(output, area_idx, first_track, output_path(o, file_path), "wav",
+                                                                                      1 /* always decode to DSD */, last_track);
                                     }
                                     free(file_path);
                                     free(musicfilename);
-                                }
-                                if ((no_of_enqued_tracks < no_total_tracks) && !opts.select_tracks)
-                                {
-                                    fwprintf(stdout, L"\n Error: Number of processed tracks %d will be smaller than total tracks %d !!\n", no_of_enqued_tracks, no_total_tracks);
+                                
                                 }
                             }
-                            else  // made concatenation
+                            else  // no tracks specified
                             {
-                                // fill the queue with item to rip
-                                if (opts.select_tracks)
-                                {
-                                    int first_track = handle->area[area_idx].area_toc->track_count-1;
-                                    int last_track  = 0;
-                                    // find first track and last track in list
-                                    for (i = 0; i < handle->area[area_idx].area_toc->track_count; i++)
-                                    {
-                                        if (opts.selected_tracks[i] == 0x01)
-                                        {
-                                            if (first_track > i)
-                                                first_track = i;
-                                            if (last_track <  i)
-                                                last_track = i;
-                                        }                                         
-                                    }
+                                fwprintf(stdout, L"\n\n Warning! Concatenation activated but no tracks selected!\n");
+                            }                                                                                                  
+                        }                          
 
+                       
 
-                                    if ((first_track < handle->area[area_idx].area_toc->track_count)&&
-                                        (last_track < handle->area[area_idx].area_toc->track_count) )
-                                    {
-                                        char conc_string[10];
-                                        snprintf(conc_string, sizeof(conc_string), "[%02d-%02d]",first_track + 1, last_track + 1);
-
-                                        musicfilename = get_music_filename(handle, area_idx, first_track, conc_string, opts.performer_flag);
-
-                                        fwprintf(stdout, L"\n Concatenate tracks: %d to %d\n", first_track+1,last_track+1);
-                                        if (opts.output_dsf)
-                                        {
-                                            file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dsf");
-                                            scarletbook_output_enqueue_concatenate_tracks(output, area_idx, first_track, file_path, "dsf",
-                                                                                          1 /* always decode to DSD */, last_track);
-                                        }
-                                        else if (opts.output_dsdiff)
-                                        {
-                                            file_path = make_filename(NULL, output_dir_dsd, musicfilename, "dff");
-                                            scarletbook_output_enqueue_concatenate_tracks(output, area_idx, first_track, file_path, "dsdiff",
-                                                                                          (opts.convert_dst ? 1 : handle->area[area_idx].area_toc->frame_format != FRAME_FORMAT_DST), last_track);
-                                        }
-                                        free(file_path);
-                                        free(musicfilename);
-                                    
-                                    }
-                                }
-                                else  // no tracks specified
-                                {
-                                    fwprintf(stdout, L"\n\n Warning! Concatenation activated but no tracks selected!\n");
-                                }                                                                                                  
-                            }                          
+                        print_start_time();
 
-                           
-
-                            print_start_time();
+                        LOG(lm_main, LOG_NOTICE, ("Start processing dsf/dff files"));
+                        scarletbook_output_start(output);
+                        LOG(lm_main, LOG_NOTICE, ("Start destroy dsf/dff"));
+                        destroy_output(output);
+                        LOG(lm_main, LOG_NOTICE, ("Finish destroy dsf/dff"));
+                        
+                        print_end_time();
 
-                            LOG(lm_main, LOG_NOTICE, ("Start processing dsf/dff files"));
-                            scarletbook_output_start(output);
-                            LOG(lm_main, LOG_NOTICE, ("Start destroy dsf/dff"));
-                            scarletbook_output_destroy(output);
-                            LOG(lm_main, LOG_NOTICE, ("Finish destroy dsf/dff"));
-                            
-                            print_end_time();
+                        if (o->output_dsf)
+                            fwprintf(stdout, L"\n\n We are done exporting DSF..                                                          \n");                       
+                        else if (o->output_dsdiff)
+                            fwprintf(stdout, L"\n\n We are done exporting DSDIFF..                                                          \n");
+                        else
+                            fwprintf(stdout, L"\n\n We are done exporting WAV..                                                          \n");
 
-                            if (opts.output_dsf)
-                                fwprintf(stdout, L"\n\n We are done exporting DSF..                                                          \n");                       
-                            else
-                                fwprintf(stdout, L"\n\n We are done exporting DSDIFF..                                                          \n");
+                    } // end if (o->output_dsf || o->output_dsdiff || o->output_wav)
 
-                        } // end if (opts.output_dsf || opts.output_dsdiff)
+                    
+                    if (o->multi_channel == 1)
+                        o->multi_channel = 0;
+                    else if(o->two_channel == 1)
+                        o->two_channel = 0;
 
-                        
-                        if (opts.multi_channel == 1)
-                            opts.multi_channel = 0;
-                        else if(opts.two_channel == 1)
-                            opts.two_channel = 0;
+                    free(output_dir_dsd);
 
-                        free(output_dir_dsd);
+                } // end while o->two_channel + o->multi_channel
 
-                    } // end while opts.two_channel + opts.multi_channel
+            }  // end if o->...
 
-                }  // end if opts....
+            // fingerprints, loudness and silence are only known after extraction, export the XML metadata (again) to include them
+            if ((o->fingerprint || o->loudness || o->silence_report || o->trim_silence) && (o->output_dsf || o->output_dsdiff || o->output_wav))
+            {
+                if (metadata_xml_path == NULL && recursive_mkdir(output_dir, o->output_dir, 0774) == 0)
+                {
+                    char *metadata_file_path_unique = get_unique_filename(NULL, output_dir, album_filename, "xml");
+                    if (metadata_file_path_unique != NULL)
+                    {
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+                        char filename_long[1024];
+                        memset(filename_long, '\0', sizeof(filename_long));
+                        strcpy(filename_long, "\\\\?\\");
+                        strncat(filename_long, metadata_file_path_unique, min(1016, strlen(metadata_file_path_unique)));
+                        metadata_xml_path = strdup(filename_long);
+#else
+                        metadata_xml_path = strdup(metadata_file_path_unique);
+#endif
+                        free(metadata_file_path_unique);
+                    }
+                }
+                if (metadata_xml_path != NULL)
+                {
+                    write_metadata_xml(handle, metadata_xml_path);
+                    fwprintf(stdout, L"\n\n We are done exporting the measured track data in XML file. \n");
+                    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: done exporting measured track data in XML file %s.", metadata_xml_path));
+                }
+            }
+            free(metadata_xml_path);
 
-                free(output_dir);
-                free(album_filename);
-                scarletbook_close(handle);
+            free(output_dir);
+            free(album_filename);
+            scarletbook_close(handle);
 
-            }  // end if handle
+        }  // end if handle
 			else
-				exit_main_flag=-1;
-            
+				ret = -1;
+        
 			sacd_close(sacd_reader);
-        }
+    }
 		else
+			ret = -1;
+
+    return ret;
+}
+
+// --batch: the discs of the job file are extracted in this process, so they share the DST
+// decoder threads (--decode-threads) and their buffers. At most --batch-jobs discs run at
+// the same time, and at most --batch-io of them read from the same device. A disc that
+// fails is reported and counted, the other jobs go on.
+#define BATCH_MAX_WORDS 64
+
+enum
+{
+    BATCH_JOB_WAITING,
+    BATCH_JOB_RUNNING,
+    BATCH_JOB_DONE
+};
+
+typedef struct
+{
+    struct opts_s   opts;
+    int             line_nr;
+    int             device;         // index in the device table
+    int             state;          // BATCH_JOB_*
+    int             result;
+}
+batch_job_t;
+
+// the discs being read from each device
+typedef struct
+{
+    char          **keys;           // see batch_device_key()
+    int            *running;
+    int             count;
+}
+device_table_t;
+
+typedef struct
+{
+    batch_job_t    *jobs;
+    int             job_count;
+    device_table_t  devices;
+    int             io_limit;
+    int             failed;
+    lock           *state;          // guards the states above, its value counts the finished jobs
+}
+batch_t;
+
+// discs on one device compete for its heads: block devices by rdev, image files by the
+// filesystem they live on, servers by host
+static char *batch_device_key(const char *input)
+{
+    struct stat st;
+    char key[64];
+    const char *colon;
+
+    if (stat(input, &st) == 0)
+    {
+#if defined(WIN32) || defined(_WIN32)
+        // no st_rdev here, so drives and images are keyed by their volume:
+        // the drive letter, or \\server\share for UNC paths
+        char full[_MAX_PATH];
+
+        if (!_fullpath(full, input, sizeof(full)))
+            snprintf(key, sizeof(key), "vol:%s", input);
+        else if (isalpha((unsigned char) full[0]) && full[1] == ':')
+            snprintf(key, sizeof(key), "vol:%c", toupper((unsigned char) full[0]));
+        else
+        {
+            char *share = full[0] == '\\' && full[1] == '\\' ? strchr(full + 2, '\\') : NULL;
+            char *end = share ? strchr(share + 1, '\\') : NULL;
+
+            if (end)
+                *end = '\0';
+            snprintf(key, sizeof(key), "vol:%s", full);
+        }
+#else
+        if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode))
+            snprintf(key, sizeof(key), "rdev:%llx", (unsigned long long) st.st_rdev);
+        else
+            snprintf(key, sizeof(key), "dev:%llx", (unsigned long long) st.st_dev);
+#endif
+        return strdup(key);
+    }
+
+    colon = strrchr(input, ':');
+    if (colon && colon != input)
+    {
+        char *host = calloc(colon - input + 1, sizeof(char));
+        memcpy(host, input, colon - input);
+        return host;
+    }
+    return strdup(input);
+}
+
+static int device_index(device_table_t *devices, const char *input)
+{
+    char *key = batch_device_key(input);
+    int i;
+
+    for (i = 0; i < devices->count; i++)
+    {
+        if (strcmp(devices->keys[i], key) == 0)
+        {
+            free(key);
+            return i;
+        }
+    }
+    devices->keys = realloc(devices->keys, (devices->count + 1) * sizeof(char *));
+    devices->running = realloc(devices->running, (devices->count + 1) * sizeof(int));
+    devices->keys[devices->count] = key;
+    devices->running[devices->count] = 0;
+    return devices->count++;
+}
+
+static void device_table_free(device_table_t *devices)
+{
+    int i;
+
+    for (i = 0; i < devices->count; i++)
+        free(devices->keys[i]);
+    free(devices->keys);
+    free(devices->running);
+}
+
+// splits a job line in place, "quoted words" may hold blanks
+static int batch_split_line(char *line, char **words, int max_words)
+{
+    int count = 0;
+    char *p = line;
+
+    while (*p && count < max_words)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            break;
+        if (*p == '"')
+        {
+            words[count++] = ++p;
+            while (*p && *p != '"')
+                p++;
+        }
+        else
+        {
+            words[count++] = p;
+            while (*p && *p != ' ' && *p != '\t')
+                p++;
+        }
+        if (*p)
+            *p++ = '\0';
+    }
+    return count;
+}
+
+static void batch_free_opts(struct opts_s *o)
+{
+    free(o->input_device);
+    free(o->output_dir);
+    free(o->output_dir_conc);
+    free(o->catalog_path);
+    free(o->batch_path);
+    free(o->daemon_path);
+    free(o->decoder_cpus);
+}
+
+// a job starts with the options of the command line, the words of its line are parsed on top
+static int batch_parse_job(batch_job_t *job, char *line)
+{
+    char *words[BATCH_MAX_WORDS + 2];
+    char **argv = words;
+    int argc;
+
+    memcpy(&job->opts, &opts, sizeof(opts));
+    job->opts.input_device = NULL;
+    job->opts.output_dir = opts.output_dir ? strdup(opts.output_dir) : NULL;
+    job->opts.output_dir_conc = opts.output_dir_conc ? strdup(opts.output_dir_conc) : NULL;
+    job->opts.catalog_path = NULL;
+    job->opts.batch_path = NULL;
+    job->opts.daemon_path = NULL;
+    job->opts.decoder_cpus = NULL;
+
+    words[0] = "batch";
+    argc = batch_split_line(line, words + 1, BATCH_MAX_WORDS) + 1;
+    if (argc == 1 || words[1][0] == '#')
+        return 0;
+
+    if (words[1][0] != '-')
+    {
+        job->opts.input_device = strdup(words[1]);
+        words[1] = words[0];
+        argv++;
+        argc--;
+    }
+    words[argc + (argv - words)] = NULL;
+
+    optind = 0;
+    if (!parse_options(argc, argv, &job->opts))
+        return -1;
+
+    if (job->opts.to_stdout || job->opts.catalog_path || job->opts.batch_path || job->opts.daemon_path || job->opts.version)
+    {
+        fwprintf(stdout, L"\n Error: --stdout, --catalog, --batch, --daemon and -v cannot be used in a job.\n");
+        return -1;
+    }
+
+    return check_disc_options(&job->opts) == 0 ? 1 : -1;
+}
+
+static void batch_worker(void *arg)
+{
+    batch_t *batch = (batch_t *) arg;
+    batch_job_t *job;
+    int i, waiting;
+    wchar_t *wide_filename;
+
+    for (;;)
+    {
+        possess(batch->state);
+        for (;;)
+        {
+            job = NULL;
+            waiting = 0;
+            for (i = 0; i < batch->job_count && !interrupted; i++)
+            {
+                if (batch->jobs[i].state != BATCH_JOB_WAITING)
+                    continue;
+                waiting++;
+                if (batch->devices.running[batch->jobs[i].device] < batch->io_limit)
+                {
+                    job = &batch->jobs[i];
+                    break;
+                }
+            }
+            if (job || waiting == 0)
+                break;
+
+            // the devices of all waiting discs are busy, wait for a job to finish
+            wait_for(batch->state, NOT_TO_BE, peek_lock(batch->state));
+        }
+        if (job == NULL)
+        {
+            release(batch->state);
+            return;
+        }
+        job->state = BATCH_JOB_RUNNING;
+        batch->devices.running[job->device]++;
+        release(batch->state);
+
+        CHAR2WCHAR(wide_filename, job->opts.input_device);
+        safe_fwprintf(stdout, L"\n Batch job (line %d) started: %ls\n", job->line_nr, wide_filename);
+
+        job->result = extract_disc(&job->opts, 1, NULL);
+
+        safe_fwprintf(stdout, L"\n Batch job (line %d) %ls: %ls\n", job->line_nr, job->result == 0 ? L"done" : L"FAILED", wide_filename);
+        free(wide_filename);
+        LOG(lm_main, job->result == 0 ? LOG_NOTICE : LOG_ERROR, ("batch job line %d, %s: %d", job->line_nr, job->opts.input_device, job->result));
+
+        possess(batch->state);
+        job->state = BATCH_JOB_DONE;
+        batch->devices.running[job->device]--;
+        if (job->result != 0)
+            batch->failed++;
+        twist(batch->state, BY, 1);
+    }
+}
+
+static int run_batch(void)
+{
+    batch_t batch;
+    thread **workers;
+    FILE *fd;
+    char line[4096];
+    int i, result, line_nr = 0, thread_count = opts.batch_jobs;
+
+    if (opts.to_stdout)
+    {
+        fwprintf(stdout, L"\n Error: --stdout cannot be used with --batch.\n");
+        return -1;
+    }
+
+    fd = fopen(opts.batch_path, "r");
+    if (!fd)
+    {
+        fwprintf(stdout, L"\n Error: cannot read the batch file.\n");
+        return -1;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.io_limit = opts.batch_io > 0 ? opts.batch_io : 1;
+
+    while (fgets(line, sizeof(line), fd))
+    {
+        batch_job_t *job;
+
+        line_nr++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        batch.jobs = realloc(batch.jobs, (batch.job_count + 1) * sizeof(batch_job_t));
+        job = &batch.jobs[batch.job_count];
+        memset(job, 0, sizeof(*job));
+        job->line_nr = line_nr;
+
+        result = batch_parse_job(job, line);
+        if (result == 0)
+        {
+            batch_free_opts(&job->opts);
+            continue;
+        }
+        if (result < 0)
+        {
+            fwprintf(stdout, L"\n Error: batch job (line %d) is skipped.\n", line_nr);
+            job->state = BATCH_JOB_DONE;
+            job->result = -1;
+            batch.failed++;
+        }
+        else
+            job->device = device_index(&batch.devices, job->opts.input_device);
+        batch.job_count++;
+    }
+    fclose(fd);
+
+    if (thread_count <= 0)
+        thread_count = cpu_count();
+    if (thread_count > batch.job_count)
+        thread_count = batch.job_count;
+    if (thread_count > MAX_RUNNING_OUTPUTS)
+        thread_count = MAX_RUNNING_OUTPUTS;
+    if (thread_count < 1)
+        thread_count = 1;
+
+    fwprintf(stdout, L"\n Batch of %d discs on %d devices, %d at the same time (%d per device)...\n",
+             batch.job_count, batch.devices.count, thread_count, batch.io_limit);
+    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: batch %s, %d jobs, %d threads", opts.batch_path, batch.job_count, thread_count));
+
+    batch.state = new_lock(0);
+    workers = calloc(thread_count, sizeof(thread *));
+    for (i = 0; i < thread_count; i++)
+        workers[i] = launch(batch_worker, &batch);
+    for (i = 0; i < thread_count; i++)
+        join(workers[i]);
+    free(workers);
+    free_lock(batch.state);
+
+    // jobs left after an interrupt
+    for (i = 0; i < batch.job_count; i++)
+    {
+        if (batch.jobs[i].state != BATCH_JOB_DONE)
+            batch.failed++;
+        batch_free_opts(&batch.jobs[i].opts);
+    }
+
+    fwprintf(stdout, L"\n Batch done, %d of %d discs failed.\n", batch.failed, batch.job_count);
+    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: batch done, %d of %d failed", batch.failed, batch.job_count));
+
+    result = batch.failed > 0 ? -1 : 0;
+    device_table_free(&batch.devices);
+    free(batch.jobs);
+    return result;
+}
+
+#if !defined(WIN32) && !defined(_WIN32)
+// --daemon: the jobs arrive on a Unix domain socket, one connection per job. The process
+// stays up, so the configuration, the logging, libxml2 and the DST decoder threads with
+// their buffers are set up once for all jobs. The client sends one line like a --batch
+// line, "<input> [options]", and reads lines until the daemon closes the connection:
+//   QUEUED                    waiting for a free slot (--batch-jobs, --batch-io)
+//   STARTED
+//   FILE n/total name
+//   PROGRESS done total       sectors of the job
+//   ERROR code message        see OUTPUT_ERROR_*
+//   DONE | FAILED [reason]
+// BUSY is sent instead when --daemon-queue jobs are waiting already.
+
+#define DAEMON_READ_TIMEOUT 30      // seconds a client has to send its job line
+
+typedef struct
+{
+    int             max_jobs;
+    int             io_limit;
+    int             max_waiting;
+    int             running;
+    int             waiting;
+    int             connections;
+    device_table_t  devices;
+    lock           *state;          // guards the counters, its value counts the finished jobs
+    lock           *parse;          // getopt is not reentrant
+}
+daemon_t;
+
+typedef struct
+{
+    daemon_t       *daemon;
+    int             fd;
+    pthread_mutex_t write_lock;     // guards fd, progress_percent and failed, the events come from several threads
+    int             progress_percent;
+    int             failed;         // error events seen
+}
+daemon_connection_t;
+
+static daemon_t daemon_state;
+
+static void daemon_send(daemon_connection_t *conn, const char *format, ...)
+{
+    char line[1024];
+    va_list arglist;
+    int length;
+
+    va_start(arglist, format);
+    length = vsnprintf(line, sizeof(line) - 1, format, arglist);
+    va_end(arglist);
+    if (length < 0)
+        return;
+    if (length > (int) sizeof(line) - 2)
+        length = sizeof(line) - 2;
+    line[length++] = '\n';
+
+    pthread_mutex_lock(&conn->write_lock);
+    if (conn->fd >= 0 && write(conn->fd, line, length) != length)
+    {
+        // the client is gone, the job goes on
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    pthread_mutex_unlock(&conn->write_lock);
+}
+
+static void daemon_event_track(void *userdata, const char *filename, int current_track, int total_tracks)
+{
+    daemon_send((daemon_connection_t *) userdata, "FILE %d/%d %s", current_track, total_tracks, filename);
+}
+
+static void daemon_event_progress(void *userdata, uint32_t total_sectors, uint32_t total_sectors_processed,
+                                  uint32_t file_sectors, uint32_t file_sectors_processed)
+{
+    daemon_connection_t *conn = (daemon_connection_t *) userdata;
+    int percent = total_sectors ? (int) ((uint64_t) total_sectors_processed * 100 / total_sectors) : 100;
+    int changed;
+
+    // whole percents are enough for a progress bar
+    pthread_mutex_lock(&conn->write_lock);
+    changed = percent != conn->progress_percent;
+    conn->progress_percent = percent;
+    pthread_mutex_unlock(&conn->write_lock);
+    if (changed)
+        daemon_send(conn, "PROGRESS %u %u", total_sectors_processed, total_sectors);
+}
+
+static void daemon_event_error(void *userdata, const char *filename, int code, const char *message)
+{
+    daemon_connection_t *conn = (daemon_connection_t *) userdata;
+
+    pthread_mutex_lock(&conn->write_lock);
+    conn->failed++;
+    pthread_mutex_unlock(&conn->write_lock);
+    daemon_send(conn, "ERROR %d %s%s%s", code, message, filename ? ": " : "", filename ? filename : "");
+}
+
+// reads the job line, NULL if the client closed the connection first, sent nothing
+// for DAEMON_READ_TIMEOUT seconds or the daemon is stopping
+static char *daemon_read_line(int fd, char *line, size_t size)
+{
+    size_t length = 0;
+    int idle = 0;
+
+    while (length < size - 1)
+    {
+        ssize_t ret = read(fd, line + length, 1);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            // SO_RCVTIMEO wakes the read every second to see the interrupt
+            if (interrupted || (errno != EINTR && ++idle >= DAEMON_READ_TIMEOUT))
+                return NULL;
+            continue;
+        }
+        if (ret <= 0)
+            return NULL;
+        idle = 0;
+        if (line[length] == '\n')
+            break;
+        length++;
+    }
+    line[length] = '\0';
+    if (length > 0 && line[length - 1] == '\r')
+        line[length - 1] = '\0';
+    return line;
+}
+
+static void *daemon_connection(void *arg)
+{
+    daemon_connection_t *conn = (daemon_connection_t *) arg;
+    daemon_t *daemon = conn->daemon;
+    scarletbook_output_events_t events;
+    batch_job_t job;
+    char line[4096];
+    int device = -1, result = -1;
+
+    memset(&job, 0, sizeof(job));
+    if (daemon_read_line(conn->fd, line, sizeof(line)) == NULL)
+        goto done;
+
+    possess(daemon->parse);
+    result = batch_parse_job(&job, line);
+    release(daemon->parse);
+    if (result <= 0)
+    {
+        daemon_send(conn, "FAILED invalid job");
+        result = -1;
+        goto done;
+    }
+
+    // admission: at most max_jobs running, io_limit per device and max_waiting in line
+    possess(daemon->state);
+    device = device_index(&daemon->devices, job.opts.input_device);
+    if (daemon->waiting >= daemon->max_waiting)
+    {
+        release(daemon->state);
+        daemon_send(conn, "BUSY");
+        device = -1;
+        result = -1;
+        goto done;
+    }
+    if (daemon->running >= daemon->max_jobs || daemon->devices.running[device] >= daemon->io_limit)
+    {
+        daemon_send(conn, "QUEUED");
+        daemon->waiting++;
+        while (!interrupted && (daemon->running >= daemon->max_jobs || daemon->devices.running[device] >= daemon->io_limit))
+            wait_for(daemon->state, NOT_TO_BE, peek_lock(daemon->state));
+        daemon->waiting--;
+    }
+    if (interrupted)
+    {
+        release(daemon->state);
+        daemon_send(conn, "FAILED interrupted");
+        device = -1;
+        result = -1;
+        goto done;
+    }
+    daemon->running++;
+    daemon->devices.running[device]++;
+    release(daemon->state);
+
+    daemon_send(conn, "STARTED");
+    conn->progress_percent = -1;
+    events.track = daemon_event_track;
+    events.progress = daemon_event_progress;
+    events.error = daemon_event_error;
+    events.userdata = conn;
+    result = extract_disc(&job.opts, 1, &events);
+    if (result == 0 && conn->failed == 0)
+        daemon_send(conn, "DONE");
+    else
+        daemon_send(conn, "FAILED");
+    LOG(lm_main, result == 0 ? LOG_NOTICE : LOG_ERROR, ("daemon job %s: %d", job.opts.input_device, result));
+
+done:
+    batch_free_opts(&job.opts);
+    if (conn->fd >= 0)
+        close(conn->fd);
+    pthread_mutex_destroy(&conn->write_lock);
+    free(conn);
+
+    possess(daemon->state);
+    if (device >= 0)
+    {
+        daemon->running--;
+        daemon->devices.running[device]--;
+    }
+    daemon->connections--;
+    twist(daemon->state, BY, 1);
+    return NULL;
+}
+
+static int run_daemon(void)
+{
+    daemon_t *daemon = &daemon_state;
+    struct sockaddr_un address;
+    struct stat st;
+    int fd;
+
+    if (strlen(opts.daemon_path) >= sizeof(address.sun_path))
+    {
+        fwprintf(stdout, L"\n Error: the socket path is too long.\n");
+        return -1;
+    }
+
+    // a socket left behind by a daemon that did not stop cleanly
+    if (lstat(opts.daemon_path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(opts.daemon_path);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, opts.daemon_path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, 64) != 0)
+    {
+        fwprintf(stdout, L"\n Error: cannot listen on the socket (%s).\n", strerror(errno));
+        LOG(lm_main, LOG_ERROR, ("ERROR in main: daemon socket %s: %s", opts.daemon_path, strerror(errno)));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    memset(daemon, 0, sizeof(*daemon));
+    daemon->max_jobs = opts.batch_jobs;
+    if (daemon->max_jobs <= 0)
+        daemon->max_jobs = cpu_count();
+    if (daemon->max_jobs > MAX_RUNNING_OUTPUTS)
+        daemon->max_jobs = MAX_RUNNING_OUTPUTS;
+    if (daemon->max_jobs < 1)
+        daemon->max_jobs = 1;
+    daemon->io_limit = opts.batch_io > 0 ? opts.batch_io : 1;
+    daemon->max_waiting = opts.daemon_queue;
+    daemon->state = new_lock(0);
+    daemon->parse = new_lock(0);
+
+    // a client that hangs up must not end the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    fwprintf(stdout, L"\n Daemon listening, %d jobs at the same time (%d per device), %d waiting at most...\n",
+             daemon->max_jobs, daemon->io_limit, daemon->max_waiting);
+    LOG(lm_main, LOG_NOTICE, ("NOTICE in main: daemon on %s, %d jobs", opts.daemon_path, daemon->max_jobs));
+
+    while (!interrupted)
+    {
+        daemon_connection_t *conn;
+        pthread_attr_t attr;
+        pthread_t thread_id;
+        struct timeval timeout;
+        int client = accept(fd, NULL, NULL);
+
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            LOG(lm_main, LOG_ERROR, ("ERROR in main: daemon accept: %s", strerror(errno)));
+            break;
+        }
+
+        // an idle client must not keep the daemon from stopping, see daemon_read_line()
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        conn = calloc(1, sizeof(daemon_connection_t));
+        conn->daemon = daemon;
+        conn->fd = client;
+        pthread_mutex_init(&conn->write_lock, NULL);
+
+        possess(daemon->state);
+        daemon->connections++;
+        release(daemon->state);
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread_id, &attr, daemon_connection, conn) != 0)
+        {
+            close(client);
+            pthread_mutex_destroy(&conn->write_lock);
+            free(conn);
+            possess(daemon->state);
+            daemon->connections--;
+            release(daemon->state);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    close(fd);
+    unlink(opts.daemon_path);
+
+    // wake the waiting jobs, they see the interrupt, and wait for the running ones
+    fwprintf(stdout, L"\n Daemon stopping...\n");
+    possess(daemon->state);
+    twist(daemon->state, BY, 1);
+    possess(daemon->state);
+    while (daemon->connections > 0)
+        wait_for(daemon->state, NOT_TO_BE, peek_lock(daemon->state));
+    release(daemon->state);
+
+    free_lock(daemon->parse);
+    free_lock(daemon->state);
+    device_table_free(&daemon->devices);
+    return 0;
+}
+#endif
+
+#if defined(WIN32) || defined(_WIN32)
+    int wmain(int argc, wchar_t *wargv[])      
+#else
+    int main(int argc, char *argv[])
+#endif
+{
+	int exit_main_flag=0; //0=succes; -1 failed
+
+#ifdef PTW32_STATIC_LIB
+    pthread_win32_process_attach_np();
+    pthread_win32_thread_attach_np();
+#endif
+
+    init();
+   
+#if defined(WIN32) || defined(_WIN32)
+    char **argvw_utf8 = convert_wargv_to_UTF8(argc,wargv);
+    if (parse_options(argc, argvw_utf8, &opts))
+#else
+    if (parse_options(argc, argv, &opts))
+#endif
+    {
+        // keep the real stdout for the audio data (or the catalog) and send all console output to stderr
+        if (opts.to_stdout || opts.catalog_path)
+        {
+            fflush(stdout);
+            opts.stdout_fd = dup(fileno(stdout));
+            if (opts.stdout_fd < 0 || dup2(fileno(stderr), fileno(stdout)) < 0)
+            {
+                fprintf(stderr, "\nERROR: cannot redirect stdout.\n");
+                exit_main_flag=-1;
+                goto exit_main_1;
+            }
+#if defined(WIN32) || defined(_WIN32)
+            _setmode(opts.stdout_fd, _O_BINARY);
+#endif
+        }
+
+        setlocale(LC_ALL, "");
+        if (fwide(stdout, 1) < 0)
+        {
+            fprintf(stderr, "\nERROR: Output not set to wide.\n");
 			exit_main_flag=-1;
+            goto exit_main_1;
+        }
+        fwprintf(stdout, L"\nsacd_extract client " SACD_RIPPER_VERSION_STRING "\n");
+        fwprintf(stdout, L"\nEnhanced by euflo ....starting!\n");
+        // Get the current (working) directory:
+        char *buffer;
+        if ((buffer = return_current_directory() ) != NULL)   
+        {
+            char *wide_filename;
+            CHAR2WCHAR(wide_filename, buffer);
+            fwprintf(stdout, L"\nCurrent (working) directory (for the app and 'sacd_extract.cfg' file): %ls\n", (wchar_t *)wide_filename);
+            free(wide_filename);
+            free(buffer);
+        }
+
+
+        int exist_cfg = read_config();
+        init_logging(opts.logging); //init_logging(0); 1= write logs in a file
+        if (opts.threads > 0)
+            cpu_set_limit(opts.threads);
+        if (opts.decoder_cpus && cpu_set_decoder_cpus(opts.decoder_cpus) != 0)
+        {
+            fwprintf(stdout, L"\nERROR: invalid processor list (decoder-cpus): %s\n", opts.decoder_cpus);
+            LOG(lm_main, LOG_ERROR, ("ERROR in main: invalid processor list (decoder-cpus): %s", opts.decoder_cpus));
+            exit_main_flag = -1;
+            goto exit_main;
+        }
+        if (opts.io_node >= 0 && cpu_set_io_node(opts.io_node) != 0)
+        {
+            fwprintf(stdout, L"\nERROR: no NUMA node %d (io-node)\n", opts.io_node);
+            LOG(lm_main, LOG_ERROR, ("ERROR in main: no NUMA node %d (io-node)", opts.io_node));
+            exit_main_flag = -1;
+            goto exit_main;
+        }
+
+        LOG(lm_main, LOG_NOTICE, ("sacd_extract Version: %s  ", SACD_RIPPER_VERSION_STRING));
+
+        if (opts.version==1)
+        {
+            //fwprintf(stdout, L"\n" SACD_RIPPER_VERSION_INFO "\n");
+            fwprintf(stdout, L"git repository: " SACD_RIPPER_REPO "\n");
+
+            if(!exist_cfg)  // do not repeat again the same text...as in read-config()
+            {
+                    fwprintf(stdout, L"Configuration settings:\n");
+                    fwprintf(stdout, L"\tArtist will be added in folder name (artist=%d) %ls\n", opts.artist_flag, opts.artist_flag > 0 ? L"yes" : L"no");
+                    fwprintf(stdout, L"\tPerformer will be added in filename of track (performer=%d) %ls\n", opts.performer_flag, opts.performer_flag > 0 ? L"yes" : L"no");
+                    fwprintf(stdout, L"\tPadding-less (nopad=%d) %ls\n", opts.dsf_nopad, opts.dsf_nopad != 0 ? L"yes" : L"no");
+                    fwprintf(stdout, L"\tPauses included (pauses=%d) %ls\n", !opts.audio_frame_trimming, opts.audio_frame_trimming == 0 ? L"yes" : L"no");
+                    fwprintf(stdout, L"\tConcatenate (concatenate=%d) %ls\n", opts.concatenate, opts.concatenate > 0 ? L"yes" : L"no");
+                    fwprintf(stdout, L"\tID3tag (id3tag = %d)\n", opts.id3_tag_mode);
+            }
+            
+            goto exit_main;
+        }
+
+        if (opts.catalog_path)
+        {
+            exit_main_flag = run_catalog();
+            goto exit_main;
+        }
+
+#ifndef __lv2ppu__
+        if (opts.decode_threads > 0)
+            dst_decoder_pool_init(opts.decode_threads);
+        if (opts.hugepages)
+            dst_decoder_pool_hugepages(1);
+#endif
+
+        if (opts.batch_path)
+        {
+            exit_main_flag = run_batch();
+            goto exit_main;
+        }
+
+#if !defined(WIN32) && !defined(_WIN32)
+        if (opts.daemon_path)
+        {
+            exit_main_flag = run_daemon();
+            goto exit_main;
+        }
+#endif
+
+        if (check_disc_options(&opts) != 0)
+        {
+            exit_main_flag=-1;
+            goto exit_main;
+        }
+
+        exit_main_flag = extract_disc(&opts, 0, NULL);
 
         
 
@@ -1247,6 +2614,10 @@ exit_main:
         }
     }
 exit_main_1:
+#ifndef __lv2ppu__
+    dst_decoder_pool_destroy();
+#endif
+    free_lock(g_outputs_lock);
     free_lock(g_fwprintf_lock);
     destroy_logging();
 
@@ -1256,6 +2627,14 @@ exit_main_1:
 
     if (opts.input_device != NULL) free(opts.input_device);
 
+    if (opts.catalog_path != NULL) free(opts.catalog_path);
+
+    if (opts.batch_path != NULL) free(opts.batch_path);
+
+    if (opts.daemon_path != NULL) free(opts.daemon_path);
+
+    if (opts.decoder_cpus != NULL) free(opts.decoder_cpus);
+
 #ifdef PTW32_STATIC_LIB
     pthread_win32_process_detach_np();
     pthread_win32_thread_detach_np();
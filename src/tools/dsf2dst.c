@@ -0,0 +1,493 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+// dsf2dst: converts a DSF file (DSD64, 2, 5 or 6 channels) into a DST encoded DSDIFF file.
+// The DSF blocks (4096 bytes per channel, LSB or MSB first) are regrouped into 1/75 second
+// frames, channel interleaved MSB first as on a disc, and encoded on all processors with
+// the dst_encoder_t pool. The last frame is filled up with the DSD idle pattern. The ID3
+// tag of the DSF file is carried over as an ID3 chunk, like sacd_extract writes it.
+//
+//   dsf2dst [--threads=N] <input.dsf> <output.dff>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logging.h>
+#include <utils.h>
+#include <dst_encoder.h>
+
+#include "endianess.h"
+#include "scarletbook.h"
+#include "dsdiff.h"
+
+#define DSF_DSD_CHUNK_SIZE      28
+#define DSF_FMT_CHUNK_SIZE      52
+#define DSF_BLOCK_SIZE          4096        // bytes per channel
+#define DSD_IDLE_PATTERN        0x69
+#define MAX_HEADER_SIZE         512
+#define MAX_ID3_SIZE            (16 << 20)
+
+typedef struct
+{
+    int         channel_count;
+    int         lsb_first;                  // 1 bit per sample, the oldest sample in bit 0
+    uint64_t    sample_count;               // per channel
+    uint64_t    data_offset;                // first byte of the sample data
+    uint64_t    metadata_offset;            // ID3v2 tag, 0 if none
+    uint64_t    file_size;
+}
+dsf_info_t;
+
+typedef struct
+{
+    FILE               *fd;
+    int                 channel_count;
+    uint64_t            write_offset;       // file offset of the next frame chunk
+    dst_frame_index_t  *frame_indexes;      // offsets and lengths of the frames, in host order
+    size_t              frame_count;
+    size_t              frame_alloc;
+    uint64_t            frame_bytes;        // sum of the frame sizes
+    int                 error;
+}
+dst_writer_t;
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | ((uint64_t) get_le32(p + 4) << 32);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// reads the 'DSD ', 'fmt ' and 'data' chunk headers, returns 0 for a file that can be converted
+static int read_dsf_info(FILE *fd, dsf_info_t *info)
+{
+    uint8_t dsd[DSF_DSD_CHUNK_SIZE], fmt[DSF_FMT_CHUNK_SIZE], data[12];
+    uint32_t channel_type, sample_frequency, bits_per_sample, block_size;
+
+    if (fread(dsd, 1, sizeof(dsd), fd) != sizeof(dsd) || memcmp(dsd, "DSD ", 4) != 0 ||
+        fread(fmt, 1, sizeof(fmt), fd) != sizeof(fmt) || memcmp(fmt, "fmt ", 4) != 0)
+    {
+        fprintf(stderr, "not a DSF file\n");
+        return -1;
+    }
+    info->file_size = get_le64(dsd + 12);
+    info->metadata_offset = get_le64(dsd + 20);
+
+    // fmt chunk: version, format id, channel type, channel count, sampling frequency,
+    // bits per sample, sample count, block size per channel, reserved
+    channel_type = get_le32(fmt + 20);
+    info->channel_count = (int) get_le32(fmt + 24);
+    sample_frequency = get_le32(fmt + 28);
+    bits_per_sample = get_le32(fmt + 32);
+    info->sample_count = get_le64(fmt + 36);
+    block_size = get_le32(fmt + 44);
+    info->lsb_first = bits_per_sample == 1;
+
+    if (fseeko(fd, DSF_DSD_CHUNK_SIZE + get_le64(fmt + 4), SEEK_SET) != 0 ||
+        fread(data, 1, sizeof(data), fd) != sizeof(data) || memcmp(data, "data", 4) != 0)
+    {
+        fprintf(stderr, "no data chunk in the DSF file\n");
+        return -1;
+    }
+    info->data_offset = ftello(fd);
+
+    if (get_le32(fmt + 16) != 0 || sample_frequency != SACD_SAMPLING_FREQUENCY ||
+        (bits_per_sample != 1 && bits_per_sample != 8) || block_size != DSF_BLOCK_SIZE)
+    {
+        fprintf(stderr, "only DSD64 (2822400 Hz) with 4096 byte blocks can be DST encoded\n");
+        return -1;
+    }
+    if (info->channel_count != 2 && info->channel_count != 5 && info->channel_count != 6)
+    {
+        fprintf(stderr, "%d channels (channel type %u), DST encoding needs 2, 5 or 6\n", info->channel_count, channel_type);
+        return -1;
+    }
+    return 0;
+}
+
+// the DSDIFF header up to and including the FRTE chunk, with the sizes known so far
+static size_t render_header(uint8_t *header, int channel_count, uint64_t frame_count, uint64_t dst_data_size, uint64_t footer_size)
+{
+    uint8_t *write_ptr = header, *prop_ptr;
+    form_dsd_chunk_t *form_dsd_chunk;
+    property_chunk_t *property_chunk;
+    int i;
+
+    memset(header, 0, MAX_HEADER_SIZE);
+
+    form_dsd_chunk            = (form_dsd_chunk_t *) write_ptr;
+    form_dsd_chunk->chunk_id  = FRM8_MARKER;
+    form_dsd_chunk->form_type = DSD_MARKER;
+    write_ptr += FORM_DSD_CHUNK_SIZE;
+
+    {
+        format_version_chunk_t *format_version_chunk = (format_version_chunk_t *) write_ptr;
+        format_version_chunk->chunk_id        = FVER_MARKER;
+        format_version_chunk->chunk_data_size = CALC_CHUNK_SIZE(FORMAT_VERSION_CHUNK_SIZE - CHUNK_HEADER_SIZE);
+        format_version_chunk->version         = hton32(DSDIFF_VERSION);
+        write_ptr += FORMAT_VERSION_CHUNK_SIZE;
+    }
+
+    prop_ptr                      = write_ptr;
+    property_chunk                = (property_chunk_t *) write_ptr;
+    property_chunk->chunk_id      = PROP_MARKER;
+    property_chunk->property_type = SND_MARKER;
+    write_ptr += PROPERTY_CHUNK_SIZE;
+
+    {
+        sample_rate_chunk_t *sample_rate_chunk = (sample_rate_chunk_t *) write_ptr;
+        sample_rate_chunk->chunk_id        = FS_MARKER;
+        sample_rate_chunk->chunk_data_size = CALC_CHUNK_SIZE(SAMPLE_RATE_CHUNK_SIZE - CHUNK_HEADER_SIZE);
+        sample_rate_chunk->sample_rate     = hton32(SACD_SAMPLING_FREQUENCY);
+        write_ptr += SAMPLE_RATE_CHUNK_SIZE;
+    }
+
+    // DSF orders the channels of its 5 and 5.1 layouts like the DSDIFF multichannel set-ups
+    {
+        static const uint32_t stereo_ids[2] = { SLFT_MARKER, SRGT_MARKER };
+        static const uint32_t five_ids[5] = { MLFT_MARKER, MRGT_MARKER, C_MARKER, LS_MARKER, RS_MARKER };
+        static const uint32_t six_ids[6] = { MLFT_MARKER, MRGT_MARKER, C_MARKER, LFE_MARKER, LS_MARKER, RS_MARKER };
+        const uint32_t *ids = channel_count == 2 ? stereo_ids : channel_count == 5 ? five_ids : six_ids;
+        channels_chunk_t *channels_chunk = (channels_chunk_t *) write_ptr;
+
+        channels_chunk->chunk_id        = CHNL_MARKER;
+        channels_chunk->chunk_data_size = CALC_CHUNK_SIZE(CHANNELS_CHUNK_SIZE - CHUNK_HEADER_SIZE + channel_count * sizeof(uint32_t));
+        channels_chunk->channel_count   = hton16(channel_count);
+        for (i = 0; i < channel_count; i++)
+            channels_chunk->channel_ids[i] = ids[i];
+        write_ptr += CHANNELS_CHUNK_SIZE + sizeof(uint32_t) * channel_count;
+    }
+
+    {
+        compression_type_chunk_t *compression_type_chunk = (compression_type_chunk_t *) write_ptr;
+        compression_type_chunk->chunk_id         = CMPR_MARKER;
+        compression_type_chunk->compression_type = DST_MARKER;
+        compression_type_chunk->count            = 11;
+        memcpy(compression_type_chunk->compression_name, "DST Encoded", 11);
+        compression_type_chunk->chunk_data_size  = CALC_CHUNK_SIZE(COMPRESSION_TYPE_CHUNK_SIZE - CHUNK_HEADER_SIZE + compression_type_chunk->count);
+        write_ptr += CEIL_ODD_NUMBER(COMPRESSION_TYPE_CHUNK_SIZE + compression_type_chunk->count);
+    }
+
+    {
+        loudspeaker_config_chunk_t *loudspeaker_config_chunk = (loudspeaker_config_chunk_t *) write_ptr;
+        loudspeaker_config_chunk->chunk_id           = LSCO_MARKER;
+        loudspeaker_config_chunk->chunk_data_size    = CALC_CHUNK_SIZE(LOADSPEAKER_CONFIG_CHUNK_SIZE - CHUNK_HEADER_SIZE);
+        loudspeaker_config_chunk->loudspeaker_config = hton16(channel_count == 2 ? LS_CONFIG_2_CHNL :
+                                                              channel_count == 5 ? LS_CONFIG_5_CHNL : LS_CONFIG_6_CHNL);
+        write_ptr += LOADSPEAKER_CONFIG_CHUNK_SIZE;
+    }
+
+    property_chunk->chunk_data_size = CALC_CHUNK_SIZE(write_ptr - prop_ptr - CHUNK_HEADER_SIZE);
+
+    {
+        dst_sound_data_chunk_t *dst_sound_data_chunk = (dst_sound_data_chunk_t *) write_ptr;
+        dst_frame_information_chunk_t *dst_frame_information_chunk;
+
+        dst_sound_data_chunk->chunk_id        = DST_MARKER;
+        dst_sound_data_chunk->chunk_data_size = CALC_CHUNK_SIZE(dst_data_size + DST_FRAME_INFORMATION_CHUNK_SIZE);
+        write_ptr += DST_SOUND_DATA_CHUNK_SIZE;
+
+        dst_frame_information_chunk                  = (dst_frame_information_chunk_t *) write_ptr;
+        dst_frame_information_chunk->chunk_id        = FRTE_MARKER;
+        dst_frame_information_chunk->chunk_data_size = CALC_CHUNK_SIZE(DST_FRAME_INFORMATION_CHUNK_SIZE - CHUNK_HEADER_SIZE);
+        dst_frame_information_chunk->num_frames      = hton32((uint32_t) frame_count);
+        dst_frame_information_chunk->frame_rate      = hton16(SACD_FRAME_RATE);
+        write_ptr += DST_FRAME_INFORMATION_CHUNK_SIZE;
+    }
+
+    form_dsd_chunk->chunk_data_size = CALC_CHUNK_SIZE((write_ptr - header) + dst_data_size + footer_size - CHUNK_HEADER_SIZE);
+
+    return write_ptr - header;
+}
+
+// called by the encoder's write thread in frame order
+static void frame_encoded_callback(uint8_t *frame_data, size_t frame_size, void *userdata)
+{
+    dst_writer_t *writer = (dst_writer_t *) userdata;
+    dst_frame_data_chunk_t dst_frame_data_chunk;
+    static const uint8_t pad = 0;
+
+    if (writer->error)
+        return;
+
+    if (writer->frame_count == writer->frame_alloc)
+    {
+        size_t alloc = writer->frame_alloc + 10000;
+        dst_frame_index_t *indexes = (dst_frame_index_t *) realloc(writer->frame_indexes, alloc * sizeof(dst_frame_index_t));
+        if (!indexes)
+        {
+            writer->error = 1;
+            return;
+        }
+        writer->frame_indexes = indexes;
+        writer->frame_alloc = alloc;
+    }
+    writer->frame_indexes[writer->frame_count].offset = writer->write_offset + DST_FRAME_DATA_CHUNK_SIZE;
+    writer->frame_indexes[writer->frame_count].length = (uint32_t) frame_size;
+    writer->frame_count++;
+
+    dst_frame_data_chunk.chunk_id = DSTF_MARKER;
+    dst_frame_data_chunk.chunk_data_size = hton64(frame_size);
+    if (fwrite(&dst_frame_data_chunk, 1, DST_FRAME_DATA_CHUNK_SIZE, writer->fd) != DST_FRAME_DATA_CHUNK_SIZE ||
+        fwrite(frame_data, 1, frame_size, writer->fd) != frame_size ||
+        (frame_size % 2 && fwrite(&pad, 1, 1, writer->fd) != 1))
+    {
+        writer->error = 1;
+        return;
+    }
+    writer->write_offset += DST_FRAME_DATA_CHUNK_SIZE + CEIL_ODD_NUMBER(frame_size);
+    writer->frame_bytes += frame_size;
+}
+
+// the DSTI chunk and the ID3 tag of the DSF file, returns their size or -1
+static int64_t write_footer(dst_writer_t *writer, FILE *in, const dsf_info_t *info)
+{
+    dst_sound_index_chunk_t dst_sound_index_chunk;
+    uint64_t footer_size;
+    size_t frame;
+
+    dst_sound_index_chunk.chunk_id = DSTI_MARKER;
+    dst_sound_index_chunk.chunk_data_size = CALC_CHUNK_SIZE(writer->frame_count * DST_FRAME_INDEX_SIZE);
+    if (fwrite(&dst_sound_index_chunk, 1, DST_SOUND_INDEX_CHUNK_SIZE, writer->fd) != DST_SOUND_INDEX_CHUNK_SIZE)
+        return -1;
+    for (frame = 0; frame < writer->frame_count; frame++)
+    {
+        dst_frame_index_t dst_frame_index;
+        dst_frame_index.offset = hton64(writer->frame_indexes[frame].offset);
+        dst_frame_index.length = hton32(writer->frame_indexes[frame].length);
+        if (fwrite(&dst_frame_index, 1, DST_FRAME_INDEX_SIZE, writer->fd) != DST_FRAME_INDEX_SIZE)
+            return -1;
+    }
+    footer_size = DST_SOUND_INDEX_CHUNK_SIZE + writer->frame_count * DST_FRAME_INDEX_SIZE;
+
+    // the custom (unsupported) ID3 chunk sacd_extract uses for the track information
+    if (info->metadata_offset > info->data_offset && info->file_size > info->metadata_offset &&
+        info->file_size - info->metadata_offset <= MAX_ID3_SIZE)
+    {
+        size_t id3_size = (size_t) (info->file_size - info->metadata_offset);
+        uint8_t *id3_ptr = (uint8_t *) calloc(CEIL_ODD_NUMBER(CHUNK_HEADER_SIZE + id3_size), 1);
+        chunk_header_t *id3_chunk = (chunk_header_t *) id3_ptr;
+        int result = 0;
+
+        if (id3_ptr && fseeko(in, info->metadata_offset, SEEK_SET) == 0 &&
+            fread(id3_ptr + CHUNK_HEADER_SIZE, 1, id3_size, in) == id3_size &&
+            memcmp(id3_ptr + CHUNK_HEADER_SIZE, "ID3", 3) == 0)
+        {
+            id3_chunk->chunk_id        = MAKE_MARKER('I', 'D', '3', ' ');
+            id3_chunk->chunk_data_size = CALC_CHUNK_SIZE(id3_size);
+            if (fwrite(id3_ptr, 1, CEIL_ODD_NUMBER(CHUNK_HEADER_SIZE + id3_size), writer->fd) != CEIL_ODD_NUMBER(CHUNK_HEADER_SIZE + id3_size))
+                result = -1;
+            else
+                footer_size += CEIL_ODD_NUMBER(CHUNK_HEADER_SIZE + id3_size);
+        }
+        free(id3_ptr);
+        if (result < 0)
+            return -1;
+    }
+    return (int64_t) footer_size;
+}
+
+static void show_usage(void)
+{
+    fprintf(stderr,
+        "usage: dsf2dst [options] <input.dsf> <output.dff>\n"
+        "\n"
+        "  --threads=N                   encoder threads (default: one per usable processor)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *in_path = NULL, *out_path = NULL;
+    int threads = 0, i, c;
+    FILE *in;
+    dsf_info_t info;
+    dst_writer_t writer;
+    dst_encoder_t *encoder;
+    uint8_t header[MAX_HEADER_SIZE], *block, *pending, *frame, reverse[256];
+    uint64_t channel_bytes, read_bytes = 0, frame_count, frame_nr;
+    size_t header_size, have = 0;
+    int64_t footer_size;
+    double start;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+            threads = atoi(argv[i] + 10);
+        else if (argv[i][0] != '-' && !in_path)
+            in_path = argv[i];
+        else if (argv[i][0] != '-' && !out_path)
+            out_path = argv[i];
+        else
+        {
+            show_usage();
+            return 1;
+        }
+    }
+    if (!in_path || !out_path || threads < 0)
+    {
+        show_usage();
+        return 1;
+    }
+
+    in = fopen(in_path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "cannot open %s\n", in_path);
+        return 1;
+    }
+    if (read_dsf_info(in, &info) != 0)
+    {
+        fclose(in);
+        return 1;
+    }
+
+    memset(&writer, 0, sizeof(writer));
+    writer.channel_count = info.channel_count;
+    writer.fd = fopen(out_path, "wb");
+    if (!writer.fd)
+    {
+        fprintf(stderr, "cannot create %s\n", out_path);
+        fclose(in);
+        return 1;
+    }
+
+    // the sizes are filled in once all frames are written
+    header_size = render_header(header, info.channel_count, 0, 0, 0);
+    if (fwrite(header, 1, header_size, writer.fd) != header_size)
+        writer.error = 1;
+    writer.write_offset = header_size;
+
+    for (i = 0; i < 256; i++)
+    {
+        int b, r = 0;
+        for (b = 0; b < 8; b++)
+            r |= ((i >> b) & 1) << (7 - b);
+        reverse[i] = (uint8_t) r;
+    }
+
+    channel_bytes = (info.sample_count + 7) / 8;
+    frame_count = (channel_bytes + FRAME_SIZE_64 - 1) / FRAME_SIZE_64;
+    block = (uint8_t *) malloc(DSF_BLOCK_SIZE * info.channel_count);
+    pending = (uint8_t *) malloc((DSF_BLOCK_SIZE + FRAME_SIZE_64) * info.channel_count);
+    frame = (uint8_t *) malloc(FRAME_SIZE_64 * info.channel_count);
+    if (!block || !pending || !frame)
+        return 1;
+
+    init_logging(0);
+    start = now();
+    encoder = dst_encoder_create(info.channel_count, threads, frame_encoded_callback, &writer);
+    if (fseeko(in, info.data_offset, SEEK_SET) != 0)
+        writer.error = 1;
+
+    for (frame_nr = 0; frame_nr < frame_count && !writer.error; frame_nr++)
+    {
+        size_t n;
+
+        // pending holds the samples of each channel not yet in a frame, channel after channel
+        while (have < FRAME_SIZE_64 && read_bytes < channel_bytes)
+        {
+            size_t take = (size_t) min(channel_bytes - read_bytes, DSF_BLOCK_SIZE);
+
+            if (fread(block, 1, DSF_BLOCK_SIZE * info.channel_count, in) != (size_t) DSF_BLOCK_SIZE * info.channel_count)
+            {
+                fprintf(stderr, "%s is cut short\n", in_path);
+                writer.error = 1;
+                break;
+            }
+            for (c = 0; c < info.channel_count; c++)
+            {
+                uint8_t *dst = pending + c * (DSF_BLOCK_SIZE + FRAME_SIZE_64) + have;
+                const uint8_t *src = block + c * DSF_BLOCK_SIZE;
+
+                for (n = 0; n < take; n++)
+                    dst[n] = info.lsb_first ? reverse[src[n]] : src[n];
+            }
+            have += take;
+            read_bytes += take;
+        }
+        if (writer.error)
+            break;
+
+        for (c = 0; c < info.channel_count; c++)
+        {
+            uint8_t *src = pending + c * (DSF_BLOCK_SIZE + FRAME_SIZE_64);
+
+            for (n = 0; n < FRAME_SIZE_64; n++)
+                frame[n * info.channel_count + c] = n < have ? src[n] : DSD_IDLE_PATTERN;
+            if (have > FRAME_SIZE_64)
+                memmove(src, src + FRAME_SIZE_64, have - FRAME_SIZE_64);
+        }
+        have = have > FRAME_SIZE_64 ? have - FRAME_SIZE_64 : 0;
+
+        dst_encoder_encode(encoder, frame, FRAME_SIZE_64 * info.channel_count);
+    }
+
+    // waits for the frames still being encoded
+    dst_encoder_destroy(encoder);
+
+    footer_size = writer.error ? -1 : write_footer(&writer, in, &info);
+    if (footer_size < 0)
+        writer.error = 1;
+    else
+    {
+        header_size = render_header(header, info.channel_count, writer.frame_count,
+                                    writer.write_offset - header_size, (uint64_t) footer_size);
+        if (fseeko(writer.fd, 0, SEEK_SET) != 0 || fwrite(header, 1, header_size, writer.fd) != header_size)
+            writer.error = 1;
+    }
+    if (fclose(writer.fd) != 0)
+        writer.error = 1;
+    fclose(in);
+
+    if (writer.error)
+    {
+        fprintf(stderr, "error writing %s\n", out_path);
+        remove(out_path);
+    }
+    else
+    {
+        double seconds = now() - start;
+        printf("%s: %d channels, %llu frames, DST %.1f%% of DSD, %.1fx realtime\n", out_path, info.channel_count,
+               (unsigned long long) writer.frame_count,
+               100.0 * writer.frame_bytes / ((double) writer.frame_count * FRAME_SIZE_64 * info.channel_count),
+               writer.frame_count / (double) SACD_FRAME_RATE / (seconds > 0 ? seconds : 1e-9));
+    }
+
+    destroy_logging();
+    free(writer.frame_indexes);
+    free(block);
+    free(pending);
+    free(frame);
+    return writer.error ? 1 : 0;
+}
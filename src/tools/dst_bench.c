@@ -0,0 +1,585 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+// dst_bench: throughput of the DST decoder on a fixed set of frames. The frames of a disc
+// are captured once into a corpus file, together with the SHA-256 of their decoded audio,
+// then replayed through DST_FramDSTDecode() in one thread and through the dst_decoder_t
+// pool with any number of threads, for both output kernels (channel interleaved MSB first
+// for DSDIFF, per channel LSB first planes for DSF).
+//
+//   dst_bench capture [--area=2ch|mch] [--frames=N] <image> <corpus>
+//   dst_bench run [--threads=1,2,4] [--rounds=N] <corpus>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logging.h>
+#include <utils.h>
+#include <sha256.h>
+#include <cpu.h>
+#include <dst_decoder.h>
+#include <dst_init.h>
+#include <dst_fram.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "sacd_reader.h"
+
+#define CORPUS_MAGIC        "DSTCORP1"
+#define CORPUS_HEADER_SIZE  (8 + 4 + 4 + 2 * SHA256_DIGEST_SIZE)
+#define DEFAULT_FRAMES      7500        // 100 seconds
+#define MAX_THREAD_COUNTS   16
+
+// a frame stored as DSD holds one header byte before the audio
+#define MAX_FRAME_SIZE(channels)    ((size_t) FRAME_SIZE_64 * (channels) + 1)
+
+// corpus file, little endian:
+//   "DSTCORP1", channel count (u32), frame count (u32),
+//   SHA-256 of the decoded frames, interleaved MSB first, then planar LSB first,
+//   per frame: its size (u32) and the DST frame
+typedef struct
+{
+    int         channel_count;
+    int         frame_count;
+    uint8_t     digest[2][SHA256_DIGEST_SIZE];
+    uint8_t    *data;                   // the frames, each padded to a multiple of 8 bytes
+    size_t     *offset;
+    uint32_t   *size;
+    uint64_t    total_size;             // sum of the frame sizes
+}
+corpus_t;
+
+static const char *kernel_name[2] = { "msb", "lsb" };
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void corpus_free(corpus_t *corpus)
+{
+    free(corpus->data);
+    free(corpus->offset);
+    free(corpus->size);
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+static int corpus_add(corpus_t *corpus, size_t *alloc, const uint8_t *frame, uint32_t size)
+{
+    size_t offset = corpus->frame_count ? corpus->offset[corpus->frame_count - 1] + ((corpus->size[corpus->frame_count - 1] + 7) & ~7u) : 0;
+
+    if (offset + size + 8 > *alloc)
+    {
+        size_t grown = (*alloc ? *alloc * 2 : 16 << 20) + size;
+        uint8_t *data = (uint8_t *) realloc(corpus->data, grown);
+        if (!data)
+            return -1;
+        corpus->data = data;
+        *alloc = grown;
+    }
+    if ((corpus->frame_count & 1023) == 0)
+    {
+        size_t *offsets = (size_t *) realloc(corpus->offset, (corpus->frame_count + 1024) * sizeof(size_t));
+        uint32_t *sizes = (uint32_t *) realloc(corpus->size, (corpus->frame_count + 1024) * sizeof(uint32_t));
+        if (offsets)
+            corpus->offset = offsets;
+        if (sizes)
+            corpus->size = sizes;
+        if (!offsets || !sizes)
+            return -1;
+    }
+    memcpy(corpus->data + offset, frame, size);
+    memset(corpus->data + offset + size, 0, 8);
+    corpus->offset[corpus->frame_count] = offset;
+    corpus->size[corpus->frame_count] = size;
+    corpus->frame_count++;
+    corpus->total_size += size;
+    return 0;
+}
+
+static int corpus_save(const corpus_t *corpus, const char *path)
+{
+    uint8_t header[CORPUS_HEADER_SIZE], size[4];
+    FILE *fd = fopen(path, "wb");
+    int i, ok;
+
+    if (!fd)
+        return -1;
+    memcpy(header, CORPUS_MAGIC, 8);
+    put_le32(header + 8, (uint32_t) corpus->channel_count);
+    put_le32(header + 12, (uint32_t) corpus->frame_count);
+    memcpy(header + 16, corpus->digest[0], SHA256_DIGEST_SIZE);
+    memcpy(header + 16 + SHA256_DIGEST_SIZE, corpus->digest[1], SHA256_DIGEST_SIZE);
+    ok = fwrite(header, sizeof(header), 1, fd) == 1;
+    for (i = 0; ok && i < corpus->frame_count; i++)
+    {
+        put_le32(size, corpus->size[i]);
+        ok = fwrite(size, 4, 1, fd) == 1 && fwrite(corpus->data + corpus->offset[i], corpus->size[i], 1, fd) == 1;
+    }
+    if (fclose(fd) != 0)
+        ok = 0;
+    return ok ? 0 : -1;
+}
+
+static int corpus_load(corpus_t *corpus, const char *path)
+{
+    uint8_t header[CORPUS_HEADER_SIZE], size[4], *frame = NULL;
+    FILE *fd = fopen(path, "rb");
+    size_t alloc = 0;
+    int i, frame_count, ok;
+
+    memset(corpus, 0, sizeof(*corpus));
+    if (!fd)
+        return -1;
+    ok = fread(header, sizeof(header), 1, fd) == 1 && memcmp(header, CORPUS_MAGIC, 8) == 0;
+    if (ok)
+    {
+        corpus->channel_count = (int) get_le32(header + 8);
+        frame_count = (int) get_le32(header + 12);
+        memcpy(corpus->digest[0], header + 16, SHA256_DIGEST_SIZE);
+        memcpy(corpus->digest[1], header + 16 + SHA256_DIGEST_SIZE, SHA256_DIGEST_SIZE);
+        ok = corpus->channel_count >= 1 && corpus->channel_count <= MAX_CHANNELS && frame_count > 0;
+        frame = (uint8_t *) malloc(MAX_FRAME_SIZE(MAX_CHANNELS));
+        for (i = 0; ok && frame && i < frame_count; i++)
+        {
+            uint32_t len;
+
+            ok = fread(size, 4, 1, fd) == 1;
+            len = ok ? get_le32(size) : 0;
+            ok = ok && len > 0 && len <= MAX_FRAME_SIZE(corpus->channel_count) &&
+                fread(frame, len, 1, fd) == 1 && corpus_add(corpus, &alloc, frame, len) == 0;
+        }
+        ok = ok && frame != NULL;
+        free(frame);
+    }
+    fclose(fd);
+    if (!ok)
+        corpus_free(corpus);
+    return ok ? 0 : -1;
+}
+
+// -- capture --
+
+typedef struct
+{
+    corpus_t   *corpus;
+    size_t      alloc;
+    int         max_frames;
+    int         failed;
+}
+capture_t;
+
+static void capture_frame(scarletbook_handle_t *handle, uint8_t *frame_data, size_t frame_size, void *userdata)
+{
+    capture_t *capture = (capture_t *) userdata;
+
+    if (!handle->frame.dst_encoded || capture->corpus->frame_count >= capture->max_frames)
+        return;
+    if (frame_size == 0 || frame_size > MAX_FRAME_SIZE(capture->corpus->channel_count))
+        return;
+    if (corpus_add(capture->corpus, &capture->alloc, frame_data, (uint32_t) frame_size) != 0)
+        capture->failed = 1;
+}
+
+// the reference digests: the frames decoded in this thread
+static int corpus_digest(const corpus_t *corpus, int kernel, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    size_t out_size = (size_t) FRAME_SIZE_64 * corpus->channel_count;
+    uint8_t *out = (uint8_t *) malloc(out_size);
+    ebunch *D = (ebunch *) malloc(sizeof(ebunch));
+    sha256_ctx_t sha;
+    int i, errors = 0;
+
+    if (!out || !D || DST_InitDecoder(D, corpus->channel_count, 64) != 0)
+    {
+        free(out);
+        free(D);
+        return -1;
+    }
+    D->PlanarLSB = kernel;
+    sha256_init(&sha);
+    for (i = 0; i < corpus->frame_count; i++)
+    {
+        if (DST_FramDSTDecode(corpus->data + corpus->offset[i], out, corpus->size[i], i, D) != DSTErr_NoError)
+            errors++;
+        sha256_update(&sha, out, out_size);
+    }
+    sha256_final(&sha, digest);
+    DST_CloseDecoder(D);
+    free(D);
+    free(out);
+    return errors;
+}
+
+static int run_capture(const char *image, const char *path, int multichannel, int max_frames)
+{
+    sacd_reader_t *reader;
+    scarletbook_handle_t *handle;
+    area_toc_t *area_toc;
+    corpus_t corpus;
+    capture_t capture;
+    uint8_t *buffer;
+    uint32_t lsn, blocks;
+    int area, kernel, errors = 0, result = 1;
+
+    reader = sacd_open(image);
+    if (!reader)
+    {
+        fprintf(stderr, "dst_bench: cannot open %s\n", image);
+        return 1;
+    }
+    handle = scarletbook_open(reader);
+    if (!handle)
+    {
+        fprintf(stderr, "dst_bench: %s is not a SACD image\n", image);
+        sacd_close(reader);
+        return 1;
+    }
+    area = multichannel ? handle->mulch_area_idx : handle->twoch_area_idx;
+    if (area < 0 || !handle->area[area].area_toc)
+    {
+        fprintf(stderr, "dst_bench: %s has no %s area\n", image, multichannel ? "multichannel" : "stereo");
+        goto exit_capture;
+    }
+    area_toc = handle->area[area].area_toc;
+    if (area_toc->frame_format != FRAME_FORMAT_DST)
+    {
+        fprintf(stderr, "dst_bench: the %s area of %s is not DST encoded\n", multichannel ? "multichannel" : "stereo", image);
+        goto exit_capture;
+    }
+
+    memset(&corpus, 0, sizeof(corpus));
+    memset(&capture, 0, sizeof(capture));
+    corpus.channel_count = area_toc->channel_count;
+    capture.corpus = &corpus;
+    capture.max_frames = max_frames;
+
+    buffer = (uint8_t *) malloc(MAX_PROCESSING_BLOCK_SIZE * SACD_LSN_SIZE);
+    scarletbook_frame_init(handle);
+    for (lsn = area_toc->track_start; buffer && lsn <= area_toc->track_end && corpus.frame_count < max_frames && !capture.failed; lsn += blocks)
+    {
+        blocks = sacd_read_block_raw(reader, lsn, min(area_toc->track_end + 1 - lsn, MAX_PROCESSING_BLOCK_SIZE), buffer);
+        if (blocks == 0)
+        {
+            fprintf(stderr, "dst_bench: read error at lsn %u\n", lsn);
+            break;
+        }
+        sacd_decrypt(reader, buffer, blocks);
+        scarletbook_process_frames(handle, buffer, blocks, lsn + blocks > area_toc->track_end, capture_frame, &capture);
+    }
+    free(buffer);
+
+    if (corpus.frame_count == 0 || capture.failed)
+    {
+        fprintf(stderr, "dst_bench: no DST frames captured\n");
+        corpus_free(&corpus);
+        goto exit_capture;
+    }
+    for (kernel = 0; kernel < 2; kernel++)
+        errors += corpus_digest(&corpus, kernel, corpus.digest[kernel]);
+    if (errors != 0)
+        fprintf(stderr, "dst_bench: %d frames do not decode, they are kept as they are\n", errors / 2);
+
+    if (corpus_save(&corpus, path) != 0)
+        fprintf(stderr, "dst_bench: cannot write %s\n", path);
+    else
+    {
+        printf("%s: %d frames, %d channels, %.1f MB\n", path, corpus.frame_count, corpus.channel_count, corpus.total_size / 1e6);
+        result = 0;
+    }
+    corpus_free(&corpus);
+
+exit_capture:
+    scarletbook_close(handle);
+    sacd_close(reader);
+    return result;
+}
+
+// -- run --
+
+typedef struct
+{
+    const corpus_t *corpus;
+    sha256_ctx_t    sha;
+    double         *submitted;          // time each frame was passed to the decoder
+    double         *latency;
+    int             decoded;
+    int             errors;
+}
+replay_t;
+
+static void replay_decoded(uint8_t *frame_data, size_t frame_size, void *userdata)
+{
+    replay_t *replay = (replay_t *) userdata;
+
+    sha256_update(&replay->sha, frame_data, frame_size);
+    replay->latency[replay->decoded] = now() - replay->submitted[replay->decoded];
+    replay->decoded++;
+}
+
+static void replay_error(int frame_count, int frame_error_code, const char *frame_error_message, void *userdata)
+{
+    (void) frame_count;
+    (void) frame_error_code;
+    (void) frame_error_message;
+    ((replay_t *) userdata)->errors++;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const corpus_t *corpus, int kernel, int threads, double seconds, int rounds,
+                   double *latency, int count, const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    double frames = (double) corpus->frame_count * rounds;
+    char name[16];
+
+    if (threads == 0)
+        strcpy(name, "serial");
+    else
+        snprintf(name, sizeof(name), "%d", threads);
+    qsort(latency, count, sizeof(double), compare_double);
+    printf("%-6s %-7s %10.0f %9.1f %9.1f %8.3f %8.3f %8.3f %8.3f  %s\n", kernel_name[kernel], name,
+           frames / seconds, corpus->total_size * rounds / seconds / 1e6,
+           frames * FRAME_SIZE_64 * corpus->channel_count / seconds / 1e6,
+           latency[count / 2] * 1e3, latency[count * 9 / 10] * 1e3, latency[count * 99 / 100] * 1e3, latency[count - 1] * 1e3,
+           memcmp(digest, corpus->digest[kernel], SHA256_DIGEST_SIZE) == 0 ? "ok" : "MISMATCH");
+}
+
+// DST_FramDSTDecode() in this thread, the latency is the time of one call
+static int bench_serial(const corpus_t *corpus, int kernel, int rounds, double *latency)
+{
+    size_t out_size = (size_t) FRAME_SIZE_64 * corpus->channel_count;
+    uint8_t *out = (uint8_t *) malloc(out_size);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    ebunch *D = (ebunch *) malloc(sizeof(ebunch));
+    sha256_ctx_t sha;
+    double start, t;
+    int i, r, n = 0;
+
+    if (!out || !D || DST_InitDecoder(D, corpus->channel_count, 64) != 0)
+    {
+        free(out);
+        free(D);
+        return -1;
+    }
+    D->PlanarLSB = kernel;
+    start = now();
+    for (r = 0; r < rounds; r++)
+    {
+        if (r == 0)
+            sha256_init(&sha);
+        for (i = 0; i < corpus->frame_count; i++)
+        {
+            t = now();
+            DST_FramDSTDecode(corpus->data + corpus->offset[i], out, corpus->size[i], i, D);
+            latency[n++] = now() - t;
+            if (r == 0)
+                sha256_update(&sha, out, out_size);
+        }
+        if (r == 0)
+            sha256_final(&sha, digest);
+    }
+    report(corpus, kernel, 0, now() - start, rounds, latency, n, digest);
+    DST_CloseDecoder(D);
+    free(D);
+    free(out);
+    return memcmp(digest, corpus->digest[kernel], SHA256_DIGEST_SIZE) == 0 ? 0 : 1;
+}
+
+// the dst_decoder_t pool, the latency runs from dst_decoder_decode() to the frame coming back
+static int bench_pool(const corpus_t *corpus, int kernel, int threads, int rounds, double *latency)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    dst_decoder_t *decoder;
+    replay_t replay;
+    double start, seconds = 0;
+    int i, r, n = 0;
+
+    memset(&replay, 0, sizeof(replay));
+    replay.corpus = corpus;
+    replay.submitted = (double *) malloc(corpus->frame_count * sizeof(double));
+    if (!replay.submitted)
+        return -1;
+
+    dst_decoder_pool_init(threads);
+    for (r = 0; r < rounds; r++)
+    {
+        replay.latency = latency + n;
+        replay.decoded = 0;
+        sha256_init(&replay.sha);
+        start = now();
+        decoder = dst_decoder_create(corpus->channel_count, replay_decoded, replay_error, &replay);
+        dst_decoder_set_layout(decoder, kernel ? DST_DECODER_LAYOUT_PLANAR_LSB : DST_DECODER_LAYOUT_INTERLEAVED_MSB);
+        for (i = 0; i < corpus->frame_count; i++)
+        {
+            replay.submitted[i] = now();
+            dst_decoder_decode(decoder, corpus->data + corpus->offset[i], corpus->size[i]);
+        }
+        dst_decoder_destroy(decoder);
+        seconds += now() - start;
+        n += replay.decoded;
+        if (r == 0)
+            sha256_final(&replay.sha, digest);
+    }
+    // a new pool with the next thread count
+    dst_decoder_pool_destroy();
+
+    report(corpus, kernel, threads, seconds, rounds, latency, n, digest);
+    free(replay.submitted);
+    return memcmp(digest, corpus->digest[kernel], SHA256_DIGEST_SIZE) == 0 ? 0 : 1;
+}
+
+static int run_bench(const char *path, const int *thread_counts, int thread_count_count, int rounds)
+{
+    corpus_t corpus;
+    double *latency;
+    int kernel, i, mismatches = 0;
+
+    if (corpus_load(&corpus, path) != 0)
+    {
+        fprintf(stderr, "dst_bench: %s is not a frame corpus\n", path);
+        return 1;
+    }
+    latency = (double *) malloc((size_t) corpus.frame_count * rounds * sizeof(double));
+    if (!latency)
+    {
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    printf("%s: %d frames, %d channels, %.1f MB, %d round%s\n", path, corpus.frame_count, corpus.channel_count,
+           corpus.total_size / 1e6, rounds, rounds == 1 ? "" : "s");
+    printf("%-6s %-7s %10s %9s %9s %8s %8s %8s %8s  %s\n", "kernel", "threads", "frames/s", "MB/s in", "MB/s out",
+           "p50 ms", "p90 ms", "p99 ms", "max ms", "output");
+    for (kernel = 0; kernel < 2; kernel++)
+    {
+        mismatches += bench_serial(&corpus, kernel, rounds, latency) != 0;
+        for (i = 0; i < thread_count_count; i++)
+            mismatches += bench_pool(&corpus, kernel, thread_counts[i], rounds, latency) != 0;
+    }
+
+    free(latency);
+    corpus_free(&corpus);
+    if (mismatches)
+        fprintf(stderr, "dst_bench: %d runs do not match the decoded audio of the capture\n", mismatches);
+    return mismatches ? 2 : 0;
+}
+
+static void show_usage(void)
+{
+    fprintf(stderr,
+        "usage: dst_bench capture [--area=2ch|mch] [--frames=N] <image> <corpus>\n"
+        "       dst_bench run [--threads=1,2,4] [--rounds=N] <corpus>\n"
+        "\n"
+        "capture: the first N DST frames of an area (default %d) and the SHA-256 of their\n"
+        "         decoded audio are written to the corpus file.\n"
+        "run:     the corpus is decoded in this thread and by the decoder pool with each\n"
+        "         thread count (default 1, 2, 4 ... up to the processors), for both kernels:\n"
+        "         msb (DSDIFF, interleaved) and lsb (DSF, planar). The output of every run is\n"
+        "         checked against the capture.\n", DEFAULT_FRAMES);
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_counts[MAX_THREAD_COUNTS], thread_count_count = 0;
+    int multichannel = 0, frames = DEFAULT_FRAMES, rounds = 1;
+    const char *args[2];
+    int i, arg_count = 0, result;
+
+    if (argc < 2 || (strcmp(argv[1], "capture") != 0 && strcmp(argv[1], "run") != 0))
+    {
+        show_usage();
+        return 1;
+    }
+    for (i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--area=mch") == 0)
+            multichannel = 1;
+        else if (strcmp(argv[i], "--area=2ch") == 0)
+            multichannel = 0;
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+            frames = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--rounds=", 9) == 0)
+            rounds = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            char *p = argv[i] + 10;
+            while (*p && thread_count_count < MAX_THREAD_COUNTS)
+            {
+                int count = (int) strtol(p, &p, 10);
+                if (count < 1)
+                    break;
+                thread_counts[thread_count_count++] = count;
+                if (*p == ',')
+                    p++;
+            }
+        }
+        else if (argv[i][0] != '-' && arg_count < 2)
+            args[arg_count++] = argv[i];
+        else
+        {
+            show_usage();
+            return 1;
+        }
+    }
+    if (frames < 1 || rounds < 1 || arg_count != (strcmp(argv[1], "capture") == 0 ? 2 : 1))
+    {
+        show_usage();
+        return 1;
+    }
+    if (thread_count_count == 0)
+    {
+        int count;
+        for (count = 1; count < cpu_count() && thread_count_count < MAX_THREAD_COUNTS - 1; count *= 2)
+            thread_counts[thread_count_count++] = count;
+        thread_counts[thread_count_count++] = cpu_count();
+    }
+
+    init_logging(0);
+    if (strcmp(argv[1], "capture") == 0)
+        result = run_capture(args[0], args[1], multichannel, frames);
+    else
+        result = run_bench(args[0], thread_counts, thread_count_count, rounds);
+    destroy_logging();
+    return result;
+}
@@ -0,0 +1,769 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+// sacd_gen: writes a synthetic Scarlet Book image, so that read -> parse -> decode -> write
+// can be tested and benchmarked without a real disc. The image has a master TOC, one or
+// two areas with their TOC (tracklists, track text, ISRC and genre list) at both ends and
+// audio sectors multiplexed the way the reader expects them. Every channel carries a tone,
+// put through a second order sigma-delta modulator; the same options and seed give the
+// same image byte for byte.
+//
+// The stereo area holds DSD 3 in 14, DSD 3 in 16 or DST frames, the multichannel area
+// (5 or 6 channels) DST frames only, as DSD frames do not carry a channel count. DST frames
+// are encoded on all processors with the dst_encoder_t pool and packed in frame order.
+//
+//   sacd_gen [--tracks=N] [--seconds=S] [--stereo=dsd14|dsd16|dst|none]
+//            [--multichannel=5|6|none] [--silence=S] [--seed=N] <image>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <sys/types.h>
+
+#include <utils.h>
+#include <logging.h>
+#include <dst_encoder.h>
+
+#include "endianess.h"
+#include "scarletbook.h"
+
+#define DEFAULT_TRACKS          3
+#define DEFAULT_SECONDS         30.0
+#define MAX_TRACKS              255
+#define MAX_SECONDS             (60.0 * 60)
+#define MAX_AREA_FRAMES         (255u * 60 * SACD_FRAME_RATE)   // the minutes of a timecode are a byte
+#define MAX_TEXT_SIZE           (32 * SACD_LSN_SIZE)
+#define AREA_TOC_HEADER_LSN     5                   // area TOC, SACDTRL1, SACDTRL2, 2 x SACD_IGL
+#define MAX_PACKETS             7                   // per audio sector, for packets and frame starts
+#define TONE_AMPLITUDE          0.5                 // -6 dB of the DSD full scale
+#define DSD_IDLE_PATTERN        0x69
+#define TONE_PI                 3.14159265358979323846
+
+// layout of a DSD area: every 3 frames take 14 or 16 sectors
+#define DSD_GROUP_FRAMES        3
+
+typedef struct
+{
+    int         track_count;
+    uint32_t    track_frames;
+    uint32_t    silence_frames;             // of idle pattern at both ends of every track
+    int         stereo_format;              // FRAME_FORMAT_*, -1 for no stereo area
+    int         multichannel;               // 5 or 6 channels, 0 for no multichannel area
+    uint32_t    seed;
+}
+gen_options_t;
+
+typedef struct
+{
+    int         channel_count;
+    int         frame_format;
+    int         track_count;
+    uint32_t    toc_size;
+    uint32_t    toc_1_start;
+    uint32_t    toc_2_start;
+    uint32_t    track_start;                // first and last audio sector
+    uint32_t    track_end;
+    uint32_t    track_start_lsn[MAX_TRACKS];
+    uint32_t    track_length_lsn[MAX_TRACKS];
+    uint32_t    track_start_frame[MAX_TRACKS];
+    uint32_t    track_frame_count[MAX_TRACKS];
+    uint32_t    max_frame_size;
+}
+gen_area_t;
+
+// -- audio --
+
+typedef struct
+{
+    double      c, s;                       // the tone, a rotating unit vector
+    double      dc, ds;                     // its rotation per sample
+    double      e1, e2;                     // quantisation error of the last two samples
+    uint32_t    rng;                        // dither
+}
+synth_channel_t;
+
+static void synth_tone(synth_channel_t *sc, double frequency)
+{
+    double w = 2 * TONE_PI * frequency / SACD_SAMPLING_FREQUENCY;
+
+    sc->c = 1.0;
+    sc->s = 0.0;
+    sc->dc = cos(w);
+    sc->ds = sin(w);
+}
+
+static inline double synth_dither(synth_channel_t *sc)
+{
+    sc->rng = sc->rng * 1664525u + 1013904223u;
+    return ((int32_t) sc->rng) * (1.0 / 2147483648.0 / 1024);
+}
+
+// one channel interleaved frame, MSB first as on the disc. The error feedback of the
+// modulator shapes the quantisation noise with (1 - z^-1)^2.
+static void synth_frame(synth_channel_t *channels, int channel_count, int silent, uint8_t *frame)
+{
+    int ch, i, bit;
+
+    if (silent)
+    {
+        memset(frame, DSD_IDLE_PATTERN, (size_t) FRAME_SIZE_64 * channel_count);
+        return;
+    }
+    for (ch = 0; ch < channel_count; ch++)
+    {
+        synth_channel_t *sc = &channels[ch];
+        double g;
+
+        for (i = 0; i < FRAME_SIZE_64; i++)
+        {
+            uint8_t byte = 0;
+
+            for (bit = 0; bit < 8; bit++)
+            {
+                double c = sc->c * sc->dc - sc->s * sc->ds;
+                double v, y;
+
+                sc->s = sc->s * sc->dc + sc->c * sc->ds;
+                sc->c = c;
+                v = TONE_AMPLITUDE * sc->s + synth_dither(sc) - 2 * sc->e1 + sc->e2;
+                v = v > 3.0 ? 3.0 : (v < -3.0 ? -3.0 : v);
+                y = v >= 0 ? 1.0 : -1.0;
+                byte = (uint8_t) (byte << 1 | (v >= 0));
+                sc->e2 = sc->e1;
+                sc->e1 = y - v;
+            }
+            frame[i * channel_count + ch] = byte;
+        }
+
+        // keeps the rotating vector on the unit circle
+        g = 1.5 - 0.5 * (sc->c * sc->c + sc->s * sc->s);
+        sc->c *= g;
+        sc->s *= g;
+    }
+}
+
+// -- audio sectors --
+
+typedef struct
+{
+    FILE       *fd;                         // NULL while counting the packets of a frame
+    uint32_t    lsn;                        // of the sector being filled
+    int         dst_encoded;
+    int         packet_count;
+    int         frame_count;
+    uint16_t    packet_info[MAX_PACKETS];
+    uint8_t     frame_info[MAX_PACKETS][AUDIO_FRAME_INFO_SIZE];
+    uint8_t     data[SACD_LSN_SIZE];
+    size_t      data_size;
+    int         failed;
+}
+packer_t;
+
+static size_t packer_frame_info_size(const packer_t *p)
+{
+    return p->dst_encoded ? AUDIO_FRAME_INFO_SIZE : AUDIO_FRAME_INFO_SIZE - 1;
+}
+
+static size_t packer_room(const packer_t *p)
+{
+    return SACD_LSN_SIZE - AUDIO_SECTOR_HEADER_SIZE - AUDIO_PACKET_INFO_SIZE * p->packet_count
+        - packer_frame_info_size(p) * p->frame_count - p->data_size;
+}
+
+// writes the sector: header, packet infos, frame infos, then the packets
+static void packer_flush(packer_t *p)
+{
+    if (p->fd)
+    {
+        uint8_t sector[SACD_LSN_SIZE], *q = sector;
+        audio_frame_header_t header;
+        int i;
+
+        memset(sector, 0, sizeof(sector));
+        memset(&header, 0, sizeof(header));
+        header.dst_encoded = p->dst_encoded;
+        header.frame_info_count = p->frame_count;
+        header.packet_info_count = p->packet_count;
+        memcpy(q, &header, AUDIO_SECTOR_HEADER_SIZE);
+        q += AUDIO_SECTOR_HEADER_SIZE;
+        for (i = 0; i < p->packet_count; i++)
+        {
+            *q++ = (uint8_t) (p->packet_info[i] >> 8);
+            *q++ = (uint8_t) p->packet_info[i];
+        }
+        for (i = 0; i < p->frame_count; i++)
+        {
+            memcpy(q, p->frame_info[i], packer_frame_info_size(p));
+            q += packer_frame_info_size(p);
+        }
+        memcpy(q, p->data, p->data_size);
+        if (fwrite(sector, SACD_LSN_SIZE, 1, p->fd) != 1)
+            p->failed = 1;
+    }
+    p->lsn++;
+    p->packet_count = 0;
+    p->frame_count = 0;
+    p->data_size = 0;
+}
+
+static void packer_add(packer_t *p, int frame_start, int data_type, const uint8_t *data, size_t size)
+{
+    p->packet_info[p->packet_count++] = (uint16_t) (frame_start << 15 | data_type << 11 | size);
+    if (data)
+        memcpy(p->data + p->data_size, data, size);
+    else
+        memset(p->data + p->data_size, 0, size);
+    p->data_size += size;
+}
+
+// Splits the frame into audio packets, the first one in the sector that also gets the frame
+// info. Returns the number of packets, which for DST is the sector count of the frame info.
+static int packer_frame(packer_t *p, const uint8_t *frame, size_t size, uint32_t timecode,
+                        int channel_count, int sector_count, uint32_t *start_lsn)
+{
+    size_t offset = 0;
+    int packets = 0;
+
+    while (offset < size)
+    {
+        size_t need = AUDIO_PACKET_INFO_SIZE + (offset == 0 ? packer_frame_info_size(p) : 0);
+        size_t take;
+
+        // no tiny packets, unless it is the end of the frame
+        if (p->packet_count == MAX_PACKETS || (offset == 0 && p->frame_count == MAX_PACKETS) ||
+            packer_room(p) < need + min(size - offset, 64))
+            packer_flush(p);
+
+        take = min(min(packer_room(p) - need, size - offset), MAX_PACKET_SIZE);
+        if (offset == 0)
+        {
+            audio_frame_info_t info;
+
+            memset(&info, 0, sizeof(info));
+            info.timecode.minutes = (uint8_t) (timecode / (60 * SACD_FRAME_RATE));
+            info.timecode.seconds = (uint8_t) (timecode / SACD_FRAME_RATE % 60);
+            info.timecode.frames = (uint8_t) (timecode % SACD_FRAME_RATE);
+            if (p->dst_encoded)
+            {
+                info.channel_bit_2 = channel_count == 6;
+                info.channel_bit_3 = channel_count == 5;
+                info.sector_count = sector_count;
+            }
+            memcpy(p->frame_info[p->frame_count++], &info, packer_frame_info_size(p));
+            *start_lsn = p->lsn;
+        }
+        packer_add(p, offset == 0, DATA_TYPE_AUDIO, frame + offset, take);
+        offset += take;
+        packets++;
+    }
+    return packets;
+}
+
+// the encoded frames of an area, handed over by the encoder's write thread in frame order
+typedef struct
+{
+    packer_t   *packer;
+    gen_area_t *area;
+    uint32_t    track_frames;
+    uint32_t    timecode;                   // of the next frame
+}
+dst_packing_t;
+
+static void pack_dst_frame(uint8_t *frame, size_t size, void *userdata)
+{
+    dst_packing_t *packing = (dst_packing_t *) userdata;
+    gen_area_t *area = packing->area;
+    uint32_t t = packing->timecode / packing->track_frames, f = packing->timecode % packing->track_frames;
+    uint32_t start_lsn;
+    packer_t counter = *packing->packer;
+    int sector_count;
+
+    // a DST frame knows the number of sectors it spans, so it is packed twice
+    counter.fd = NULL;
+    sector_count = packer_frame(&counter, frame, size, packing->timecode, area->channel_count, 0, &start_lsn);
+    packer_frame(packing->packer, frame, size, packing->timecode, area->channel_count, sector_count, &start_lsn);
+    area->max_frame_size = max(area->max_frame_size, (uint32_t) size);
+
+    if (f == 0)
+        area->track_start_lsn[t] = start_lsn;
+    // the sector holding the end of the last frame
+    if (f == packing->track_frames - 1)
+        area->track_length_lsn[t] = packing->packer->lsn - area->track_start_lsn[t] + 1;
+    packing->timecode++;
+}
+
+// fills the sectors up to end_lsn with padding packets
+static void packer_pad(packer_t *p, uint32_t end_lsn)
+{
+    while (p->lsn < end_lsn)
+    {
+        if (p->packet_count < MAX_PACKETS && packer_room(p) > AUDIO_PACKET_INFO_SIZE)
+            packer_add(p, 0, DATA_TYPE_PADDING, NULL, min(packer_room(p) - AUDIO_PACKET_INFO_SIZE, MAX_PACKET_SIZE));
+        packer_flush(p);
+    }
+}
+
+// -- TOC --
+
+// stores the string at *used, returns its position as it is stored in the TOC
+static uint16_t put_string(uint8_t *base, size_t *used, const char *text)
+{
+    size_t len = strlen(text) + 1;
+    uint16_t position = hton16((uint16_t) *used);
+
+    memcpy(base + *used, text, len);
+    *used += (len + 3) & ~3u;
+    return position;
+}
+
+static void put_padded(char *field, size_t size, const char *text)
+{
+    size_t len = strlen(text);
+
+    memset(field, ' ', size);
+    memcpy(field, text, min(len, size));
+}
+
+// SACDTTxt: per track an entry count, 3 bytes padding, then the entries (type, 0x20 and
+// the string, zero padded to 4 bytes), into zeroed memory. Returns the size in bytes.
+static size_t build_track_text(const gen_area_t *area, uint8_t *text)
+{
+    area_text_t *area_text = (area_text_t *) text;
+    size_t used = 8 + 2 * MAX_TRACKS;
+    char title[32];
+    int i;
+
+    memcpy(area_text->id, "SACDTTxt", 8);
+    for (i = 0; i < area->track_count; i++)
+    {
+        const char *entries[2];
+        int types[2] = { TRACK_TYPE_TITLE, TRACK_TYPE_PERFORMER }, j;
+
+        snprintf(title, sizeof(title), "Track %02d", i + 1);
+        entries[0] = title;
+        entries[1] = "sacd_gen";
+
+        area_text->track_text_position[i] = hton16((uint16_t) used);
+        text[used] = 2;
+        used += 4;
+        for (j = 0; j < 2; j++)
+        {
+            size_t len = strlen(entries[j]) + 1;
+
+            text[used] = (uint8_t) types[j];
+            text[used + 1] = 0x20;
+            memcpy(text + used + 2, entries[j], len);
+            used += (2 + len + 3) & ~3u;
+        }
+    }
+    return used;
+}
+
+static uint32_t area_toc_size(const gen_area_t *area)
+{
+    uint8_t *text = (uint8_t *) calloc(1, MAX_TEXT_SIZE);
+    size_t size;
+
+    if (!text)
+        return 0;
+    size = build_track_text(area, text);
+    free(text);
+    return AREA_TOC_HEADER_LSN + (uint32_t) ((size + SACD_LSN_SIZE - 1) / SACD_LSN_SIZE);
+}
+
+static void set_time(area_tracklist_time_t *time, uint32_t frames)
+{
+    memset(time, 0, sizeof(*time));
+    time->minutes = (uint8_t) (frames / (60 * SACD_FRAME_RATE));
+    time->seconds = (uint8_t) (frames / SACD_FRAME_RATE % 60);
+    time->frames = (uint8_t) (frames % SACD_FRAME_RATE);
+}
+
+static void build_area_toc(const gen_area_t *area, uint8_t *toc)
+{
+    area_toc_t *area_toc = (area_toc_t *) toc;
+    area_tracklist_offset_t *tracklist_offset = (area_tracklist_offset_t *) (toc + SACD_LSN_SIZE);
+    area_tracklist_t *tracklist_time = (area_tracklist_t *) (toc + 2 * SACD_LSN_SIZE);
+    area_isrc_genre_t *isrc_genre = (area_isrc_genre_t *) (toc + 3 * SACD_LSN_SIZE);
+    uint32_t total_frames = 0;
+    size_t used = offsetof(area_toc_t, data);
+    int i;
+
+    memset(toc, 0, (size_t) area->toc_size * SACD_LSN_SIZE);
+
+    memcpy(area_toc->id, area->channel_count == 2 ? "TWOCHTOC" : "MULCHTOC", 8);
+    area_toc->version.major = SUPPORTED_VERSION_MAJOR;
+    area_toc->version.minor = SUPPORTED_VERSION_MINOR;
+    area_toc->size = hton16((uint16_t) area->toc_size);
+    area_toc->max_byte_rate = hton32(area->max_frame_size * SACD_FRAME_RATE);
+    area_toc->sample_frequency = 4;
+    area_toc->frame_format = area->frame_format;
+    area_toc->channel_count = area->channel_count;
+    area_toc->extra_settings = area->channel_count == 5 ? 3 : (area->channel_count == 6 ? 4 : 0);
+    area_toc->max_available_channels = area->channel_count;
+    for (i = 0; i < area->track_count; i++)
+        total_frames += area->track_frame_count[i];
+    area_toc->total_playtime.minutes = (uint8_t) (total_frames / (60 * SACD_FRAME_RATE));
+    area_toc->total_playtime.seconds = (uint8_t) (total_frames / SACD_FRAME_RATE % 60);
+    area_toc->total_playtime.frames = (uint8_t) (total_frames % SACD_FRAME_RATE);
+    area_toc->track_count = area->track_count;
+    area_toc->track_start = hton32(area->track_start);
+    area_toc->track_end = hton32(area->track_end);
+    area_toc->text_area_count = 1;
+    memcpy(area_toc->languages[0].language_code, "en", 2);
+    area_toc->languages[0].character_set = CHAR_SET_ISO8859_1;
+    area_toc->track_text_offset = hton16(AREA_TOC_HEADER_LSN);
+    area_toc->area_description_offset = put_string(toc, &used, area->channel_count == 2 ? "Synthetic stereo area" : "Synthetic multichannel area");
+    area_toc->copyright_offset = put_string(toc, &used, "Public domain");
+
+    memcpy(tracklist_offset->id, "SACDTRL1", 8);
+    memcpy(tracklist_time->id, "SACDTRL2", 8);
+    memcpy(isrc_genre->id, "SACD_IGL", 8);
+    for (i = 0; i < area->track_count; i++)
+    {
+        tracklist_offset->track_start_lsn[i] = hton32(area->track_start_lsn[i]);
+        tracklist_offset->track_length_lsn[i] = hton32(area->track_length_lsn[i]);
+        set_time(&tracklist_time->start[i], area->track_start_frame[i]);
+        set_time(&tracklist_time->duration[i], area->track_frame_count[i]);
+        isrc_genre->track_genre[i].category = CATEGORY_GENERAL;
+        isrc_genre->track_genre[i].genre = GENRE_NOT_DEFINED;
+    }
+
+    build_track_text(area, toc + AREA_TOC_HEADER_LSN * SACD_LSN_SIZE);
+}
+
+// master TOC, 8 x SACDText (only the first one filled in) and SACD_Man
+static void build_master_toc(const gen_area_t *twoch, const gen_area_t *mulch, uint32_t seed, uint8_t *master)
+{
+    master_toc_t *master_toc = (master_toc_t *) master;
+    master_sacd_text_t *master_text = (master_sacd_text_t *) (master + SACD_LSN_SIZE);
+    master_man_t *master_man = (master_man_t *) (master + (MASTER_TOC_LEN - 1) * SACD_LSN_SIZE);
+    size_t used = offsetof(master_sacd_text_t, data);
+    char catalog[17];
+    int i;
+
+    memset(master, 0, MASTER_TOC_LEN * SACD_LSN_SIZE);
+
+    memcpy(master_toc->id, "SACDMTOC", 8);
+    master_toc->version.major = SUPPORTED_VERSION_MAJOR;
+    master_toc->version.minor = SUPPORTED_VERSION_MINOR;
+    master_toc->album_set_size = hton16(1);
+    master_toc->album_sequence_number = hton16(1);
+    snprintf(catalog, sizeof(catalog), "SACDGEN-%08X", seed);
+    put_padded(master_toc->album_catalog_number, sizeof(master_toc->album_catalog_number), catalog);
+    put_padded(master_toc->disc_catalog_number, sizeof(master_toc->disc_catalog_number), catalog);
+    master_toc->album_genre[0].category = CATEGORY_GENERAL;
+    master_toc->album_genre[0].genre = GENRE_NOT_DEFINED;
+    master_toc->disc_genre[0] = master_toc->album_genre[0];
+    if (twoch)
+    {
+        master_toc->area_1_toc_1_start = hton32(twoch->toc_1_start);
+        master_toc->area_1_toc_2_start = hton32(twoch->toc_2_start);
+        master_toc->area_1_toc_size = hton16((uint16_t) twoch->toc_size);
+    }
+    if (mulch)
+    {
+        master_toc->area_2_toc_1_start = hton32(mulch->toc_1_start);
+        master_toc->area_2_toc_2_start = hton32(mulch->toc_2_start);
+        master_toc->area_2_toc_size = hton16((uint16_t) mulch->toc_size);
+    }
+    master_toc->disc_date_year = hton16(2010);
+    master_toc->disc_date_month = 1;
+    master_toc->disc_date_day = 1;
+    master_toc->text_area_count = 1;
+    memcpy(master_toc->locales[0].language_code, "en", 2);
+    master_toc->locales[0].character_set = CHAR_SET_ISO8859_1;
+
+    for (i = 0; i < MAX_LANGUAGE_COUNT; i++)
+        memcpy(master + (1 + i) * SACD_LSN_SIZE, "SACDText", 8);
+    master_text->album_title_position = put_string((uint8_t *) master_text, &used, "Synthetic Album");
+    master_text->album_artist_position = put_string((uint8_t *) master_text, &used, "sacd_gen");
+    master_text->album_publisher_position = put_string((uint8_t *) master_text, &used, "sacd-extract");
+    master_text->album_copyright_position = put_string((uint8_t *) master_text, &used, "Public domain");
+    master_text->disc_title_position = put_string((uint8_t *) master_text, &used, "Synthetic Disc");
+    master_text->disc_artist_position = put_string((uint8_t *) master_text, &used, "sacd_gen");
+    master_text->disc_publisher_position = put_string((uint8_t *) master_text, &used, "sacd-extract");
+    master_text->disc_copyright_position = put_string((uint8_t *) master_text, &used, "Public domain");
+
+    memcpy(master_man->id, "SACD_Man", 8);
+}
+
+// -- image --
+
+static int write_at(FILE *fd, uint32_t lsn, const uint8_t *data, uint32_t sectors)
+{
+    return fseeko(fd, (off_t) lsn * SACD_LSN_SIZE, SEEK_SET) == 0 &&
+           fwrite(data, SACD_LSN_SIZE, sectors, fd) == sectors ? 0 : -1;
+}
+
+// Writes the area from *lsn on: a placeholder for TOC-1, the audio, then both TOCs.
+static int write_area(FILE *fd, gen_area_t *area, const gen_options_t *opts, uint32_t *lsn)
+{
+    synth_channel_t channels[MAX_CHANNEL_COUNT];
+    size_t dsd_size = (size_t) FRAME_SIZE_64 * area->channel_count;
+    int dst = area->frame_format == FRAME_FORMAT_DST;
+    int group_sectors = area->frame_format == FRAME_FORMAT_DSD_3_IN_14 ? 14 : 16;
+    uint8_t *dsd, *toc;
+    uint32_t timecode = 0, group_start = 0, f;
+    packer_t packer;
+    dst_packing_t packing;
+    dst_encoder_t *encoder = NULL;
+    int t, ch, result = -1;
+
+    area->toc_size = area_toc_size(area);
+    area->toc_1_start = *lsn;
+
+    dsd = (uint8_t *) malloc(dsd_size);
+    toc = (uint8_t *) calloc(area->toc_size, SACD_LSN_SIZE);
+    if (!dsd || !toc || area->toc_size == 0 || write_at(fd, area->toc_1_start, toc, area->toc_size) != 0)
+        goto exit_area;
+
+    memset(&packer, 0, sizeof(packer));
+    packer.fd = fd;
+    packer.dst_encoded = dst;
+    packer.lsn = area->track_start = area->toc_1_start + area->toc_size;
+
+    if (dst)
+    {
+        packing.packer = &packer;
+        packing.area = area;
+        packing.track_frames = opts->track_frames;
+        packing.timecode = 0;
+        encoder = dst_encoder_create(area->channel_count, 0, pack_dst_frame, &packing);
+    }
+
+    memset(channels, 0, sizeof(channels));
+    for (ch = 0; ch < area->channel_count; ch++)
+        channels[ch].rng = opts->seed * 2654435761u + ch + (uint32_t) area->channel_count * 16;
+
+    // with DST the packer belongs to the encoder's write thread until the encoder is destroyed
+    for (t = 0; t < area->track_count && (dst || !packer.failed); t++)
+    {
+        uint32_t start_lsn;
+
+        // a chord per track, one tone per channel
+        for (ch = 0; ch < area->channel_count; ch++)
+            synth_tone(&channels[ch], 220.0 * (1 + t % 8) * (1.0 + ch / 4.0));
+
+        area->track_start_frame[t] = timecode;
+        area->track_frame_count[t] = opts->track_frames;
+        for (f = 0; f < opts->track_frames && (dst || !packer.failed); f++, timecode++)
+        {
+            int silent = f < opts->silence_frames || f >= opts->track_frames - opts->silence_frames;
+
+            synth_frame(channels, area->channel_count, silent, dsd);
+            if (dst)
+            {
+                dst_encoder_encode(encoder, dsd, dsd_size);
+                continue;
+            }
+
+            if (timecode % DSD_GROUP_FRAMES == 0)
+            {
+                if (timecode > 0)
+                    packer_pad(&packer, group_start + group_sectors);
+                group_start = packer.lsn;
+            }
+            packer_frame(&packer, dsd, dsd_size, timecode, area->channel_count, 0, &start_lsn);
+            area->max_frame_size = (uint32_t) dsd_size;
+            if (f == 0)
+                area->track_start_lsn[t] = start_lsn;
+        }
+        // the sector holding the end of the last frame
+        if (!dst)
+            area->track_length_lsn[t] = packer.lsn - area->track_start_lsn[t] + 1;
+    }
+    if (dst)
+    {
+        // packs the frames still being encoded
+        dst_encoder_destroy(encoder);
+        if (packer.packet_count > 0)
+            packer_flush(&packer);
+    }
+    else
+        packer_pad(&packer, group_start + group_sectors);
+    if (packer.failed)
+        goto exit_area;
+
+    area->track_end = packer.lsn - 1;
+    area->toc_2_start = packer.lsn;
+    build_area_toc(area, toc);
+    if (write_at(fd, area->toc_1_start, toc, area->toc_size) != 0 ||
+        write_at(fd, area->toc_2_start, toc, area->toc_size) != 0)
+        goto exit_area;
+
+    *lsn = area->toc_2_start + area->toc_size;
+    result = 0;
+
+exit_area:
+    free(toc);
+    free(dsd);
+    return result;
+}
+
+static int write_image(const char *path, const gen_options_t *opts)
+{
+    gen_area_t *areas;
+    uint8_t *master;
+    uint32_t lsn = START_OF_MASTER_TOC + 3 * MASTER_TOC_LEN;
+    int i, area_count = 0, result = 1;
+    FILE *fd;
+
+    areas = (gen_area_t *) calloc(2, sizeof(gen_area_t));
+    master = (uint8_t *) malloc(MASTER_TOC_LEN * SACD_LSN_SIZE);
+    fd = fopen(path, "wb");
+    if (!areas || !master || !fd)
+    {
+        fprintf(stderr, "sacd_gen: cannot create %s\n", path);
+        goto exit_image;
+    }
+
+    if (opts->stereo_format >= 0)
+    {
+        areas[area_count].channel_count = 2;
+        areas[area_count].frame_format = opts->stereo_format;
+        areas[area_count].track_count = opts->track_count;
+        area_count++;
+    }
+    if (opts->multichannel)
+    {
+        areas[area_count].channel_count = opts->multichannel;
+        areas[area_count].frame_format = FRAME_FORMAT_DST;
+        areas[area_count].track_count = opts->track_count;
+        area_count++;
+    }
+    for (i = 0; i < area_count; i++)
+    {
+        if (write_area(fd, &areas[i], opts, &lsn) != 0)
+        {
+            fprintf(stderr, "sacd_gen: cannot write %s\n", path);
+            goto exit_image;
+        }
+    }
+
+    // the file system area stays empty, the master TOC is repeated twice
+    build_master_toc(opts->stereo_format >= 0 ? &areas[0] : NULL, opts->multichannel ? &areas[area_count - 1] : NULL, opts->seed, master);
+    for (i = 0; i < 3; i++)
+    {
+        if (write_at(fd, START_OF_MASTER_TOC + i * MASTER_TOC_LEN, master, MASTER_TOC_LEN) != 0)
+        {
+            fprintf(stderr, "sacd_gen: cannot write %s\n", path);
+            goto exit_image;
+        }
+    }
+
+    for (i = 0; i < area_count; i++)
+    {
+        printf("%s: %d channels, %s, %d tracks, sectors %u - %u\n", areas[i].channel_count == 2 ? "stereo" : "multichannel",
+               areas[i].channel_count, areas[i].frame_format == FRAME_FORMAT_DST ? "DST" :
+               (areas[i].frame_format == FRAME_FORMAT_DSD_3_IN_14 ? "DSD 3 in 14" : "DSD 3 in 16"),
+               areas[i].track_count, areas[i].track_start, areas[i].track_end);
+    }
+    printf("%s: %u sectors, %.1f MB\n", path, lsn, (double) lsn * SACD_LSN_SIZE / 1e6);
+    result = 0;
+
+exit_image:
+    if (fd && fclose(fd) != 0 && result == 0)
+    {
+        fprintf(stderr, "sacd_gen: cannot write %s\n", path);
+        result = 1;
+    }
+    free(master);
+    free(areas);
+    return result;
+}
+
+static void show_usage(void)
+{
+    fprintf(stderr,
+        "usage: sacd_gen [options] <image>\n"
+        "\n"
+        "  --tracks=N                    number of tracks per area (default %d, at most %d)\n"
+        "  --seconds=S                   length of every track (default %.0f)\n"
+        "  --stereo=dsd14|dsd16|dst|none format of the stereo area (default dsd14)\n"
+        "  --multichannel=5|6|none       channels of the DST multichannel area (default none)\n"
+        "  --silence=S                   seconds of DSD idle pattern at both ends of a track\n"
+        "  --seed=N                      varies the dither and the catalog number\n",
+        DEFAULT_TRACKS, MAX_TRACKS, DEFAULT_SECONDS);
+}
+
+int main(int argc, char *argv[])
+{
+    gen_options_t opts;
+    double seconds = DEFAULT_SECONDS, silence = 0;
+    const char *path = NULL;
+    int i, result;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.track_count = DEFAULT_TRACKS;
+    opts.stereo_format = FRAME_FORMAT_DSD_3_IN_14;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--tracks=", 9) == 0)
+            opts.track_count = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--seconds=", 10) == 0)
+            seconds = atof(argv[i] + 10);
+        else if (strncmp(argv[i], "--silence=", 10) == 0)
+            silence = atof(argv[i] + 10);
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            opts.seed = (uint32_t) strtoul(argv[i] + 7, NULL, 10);
+        else if (strcmp(argv[i], "--stereo=dsd14") == 0)
+            opts.stereo_format = FRAME_FORMAT_DSD_3_IN_14;
+        else if (strcmp(argv[i], "--stereo=dsd16") == 0)
+            opts.stereo_format = FRAME_FORMAT_DSD_3_IN_16;
+        else if (strcmp(argv[i], "--stereo=dst") == 0)
+            opts.stereo_format = FRAME_FORMAT_DST;
+        else if (strcmp(argv[i], "--stereo=none") == 0)
+            opts.stereo_format = -1;
+        else if (strcmp(argv[i], "--multichannel=5") == 0)
+            opts.multichannel = 5;
+        else if (strcmp(argv[i], "--multichannel=6") == 0)
+            opts.multichannel = 6;
+        else if (strcmp(argv[i], "--multichannel=none") == 0)
+            opts.multichannel = 0;
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            show_usage();
+            return 1;
+        }
+    }
+
+    opts.track_frames = (uint32_t) (seconds * SACD_FRAME_RATE + 0.5);
+    opts.silence_frames = (uint32_t) (silence * SACD_FRAME_RATE + 0.5);
+    if (!path || opts.track_count < 1 || opts.track_count > MAX_TRACKS || seconds > MAX_SECONDS ||
+        opts.track_frames < 1 || (uint64_t) opts.track_frames * opts.track_count > MAX_AREA_FRAMES ||
+        silence < 0 || opts.silence_frames * 2 > opts.track_frames ||
+        (opts.stereo_format < 0 && !opts.multichannel))
+    {
+        show_usage();
+        return 1;
+    }
+
+    init_logging(0);
+    result = write_image(path, &opts);
+    destroy_logging();
+    return result;
+}
@@ -0,0 +1,531 @@
+/**
+ * SACD Ripper - https://github.com/sacd-ripper/
+ *
+ * Copyright (c) 2010-2015 by respective authors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+// sacd_mount: mounts a directory of SACD images as a read-only file system, every image is
+// a directory with one directory per area holding a .dsf (or .dff) file per track. Nothing
+// is extracted, the audio is decoded when it is read, see scarletbook_vfs.h.
+//
+//   sacd_mount [--format=dsf|dsdiff] [--cache=CHUNKS] <image directory> <mountpoint> [FUSE options]
+
+#define FUSE_USE_VERSION 31
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <fuse.h>
+
+#include <logging.h>
+#include <fileutils.h>
+#include <dst_decoder.h>
+
+#include "scarletbook.h"
+#include "scarletbook_read.h"
+#include "scarletbook_index.h"
+#include "scarletbook_helpers.h"
+#include "scarletbook_vfs.h"
+#include "sacd_reader.h"
+
+typedef struct mount_disc_s mount_disc_t;
+
+typedef struct
+{
+    char                   *name;               // file name in the area directory
+    mount_disc_t           *disc;
+    scarletbook_vfs_file_t *vfs;
+    int                     open_count;
+}
+mount_track_t;
+
+typedef struct
+{
+    const char             *name;               // "Stereo", "5ch", ...
+    int                     track_count;
+    mount_track_t          *tracks;
+}
+mount_area_t;
+
+struct mount_disc_s
+{
+    char                   *path;               // the image
+    char                   *name;               // its directory: the image name without extension
+    int                     state;              // 0 until the first look inside, 1 open, -1 unreadable
+    sacd_reader_t          *reader;
+    scarletbook_handle_t   *handle;
+    int                     area_count;
+    mount_area_t            areas[2];
+    pthread_mutex_t         lock;               // the reads of a disc share its reader
+};
+
+static struct
+{
+    char                   *source;
+    char                   *format;
+    int                     cache_chunks;
+    int                     help;
+    mount_disc_t           *discs;
+    int                     disc_count;
+}
+mount;
+
+enum
+{
+    KEY_HELP
+};
+
+#define MOUNT_OPT(t, p) { t, offsetof(__typeof__(mount), p), 1 }
+
+static const struct fuse_opt mount_opts[] =
+{
+    MOUNT_OPT("--format=%s", format),
+    MOUNT_OPT("--cache=%d", cache_chunks),
+    FUSE_OPT_KEY("-h", KEY_HELP),
+    FUSE_OPT_KEY("--help", KEY_HELP),
+    FUSE_OPT_END
+};
+
+static void show_usage(const char *progname)
+{
+    fprintf(stdout,
+        "Usage: %s [options] <image directory> <mountpoint>\n\n"
+        "Every SACD image (.iso) of the directory shows up as a directory holding one\n"
+        "directory per area with a file per track. The audio is decoded when it is read.\n\n"
+        "  --format=dsf|dsdiff     : format of the track files, default dsf\n"
+        "  --cache=CHUNKS          : decoded chunks (about 0.4 seconds each) kept per open file, default 16\n\n",
+        progname);
+}
+
+// the time index tells where the frames of a read are, it is kept next to the image
+static void prepare_time_index(mount_disc_t *disc)
+{
+    char *path = (char *) malloc(strlen(disc->path) + 5);
+
+    if (!path)
+        return;
+    sprintf(path, "%s.idx", disc->path);
+    if (scarletbook_index_load(disc->handle, path) != 0)
+    {
+        LOG(lm_main, LOG_NOTICE, ("sacd_mount: building the time index of %s", disc->path));
+        if (scarletbook_index_build(disc->handle) == 0 && scarletbook_index_save(disc->handle, path) != 0)
+            LOG(lm_main, LOG_NOTICE, ("sacd_mount: could not save %s", path));
+    }
+    free(path);
+}
+
+static int open_area(mount_disc_t *disc, int area)
+{
+    scarletbook_handle_t *handle = disc->handle;
+    mount_area_t *mount_area = &disc->areas[disc->area_count];
+    const char *extension = strcasecmp(mount.format, "dsf") == 0 ? "dsf" : "dff";
+    int track;
+
+    mount_area->name = get_speaker_config_string(handle->area[area].area_toc);
+    mount_area->track_count = handle->area[area].area_toc->track_count;
+    mount_area->tracks = (mount_track_t *) calloc(mount_area->track_count, sizeof(mount_track_t));
+    if (!mount_area->tracks)
+        return -1;
+
+    for (track = 0; track < mount_area->track_count; track++)
+    {
+        mount_track_t *mount_track = &mount_area->tracks[track];
+        char *name = get_music_filename(handle, area, track, "", 0);
+
+        mount_track->disc = disc;
+        mount_track->name = make_filename(NULL, NULL, name, extension);
+        free(name);
+        mount_track->vfs = scarletbook_vfs_open(handle, area, track, mount.format, mount.cache_chunks);
+        if (!mount_track->name || !mount_track->vfs)
+            return -1;
+    }
+    disc->area_count++;
+    return 0;
+}
+
+static void close_disc(mount_disc_t *disc)
+{
+    int area, track;
+
+    for (area = 0; area < disc->area_count; area++)
+    {
+        for (track = 0; track < disc->areas[area].track_count; track++)
+        {
+            free(disc->areas[area].tracks[track].name);
+            scarletbook_vfs_close(disc->areas[area].tracks[track].vfs);
+        }
+        free(disc->areas[area].tracks);
+    }
+    disc->area_count = 0;
+    if (disc->handle)
+        scarletbook_close(disc->handle);
+    if (disc->reader)
+        sacd_close(disc->reader);
+    disc->handle = NULL;
+    disc->reader = NULL;
+}
+
+// an image is opened the first time a look inside its directory is taken
+static int open_disc(mount_disc_t *disc)
+{
+    scarletbook_handle_t *handle;
+    int area;
+
+    pthread_mutex_lock(&disc->lock);
+    if (disc->state == 0)
+    {
+        disc->state = -1;
+        disc->reader = sacd_open(disc->path);
+        if (disc->reader)
+            disc->handle = scarletbook_open(disc->reader);
+        handle = disc->handle;
+        if (handle)
+        {
+            handle->audio_frame_trimming = 1;
+            handle->dsf_nopad = 0;
+            handle->concatenate = 0;
+            handle->id3_tag_mode = 4;
+            prepare_time_index(disc);
+
+            disc->state = 1;
+            for (area = 0; area < handle->area_count && disc->state == 1; area++)
+            {
+                if (handle->area[area].area_toc && open_area(disc, area) != 0)
+                    disc->state = -1;
+            }
+        }
+        if (disc->state != 1)
+        {
+            LOG(lm_main, LOG_ERROR, ("sacd_mount: cannot open %s", disc->path));
+            close_disc(disc);
+        }
+    }
+    pthread_mutex_unlock(&disc->lock);
+    return disc->state == 1 ? 0 : -EIO;
+}
+
+// splits "/disc/area/track" into its parts, returns the number of parts found or -ENOENT
+static int lookup(const char *path, mount_disc_t **disc, mount_area_t **area, mount_track_t **track)
+{
+    const char *part = path + 1, *end;
+    size_t len;
+    int i, depth = 0;
+
+    while (*part)
+    {
+        end = strchr(part, '/');
+        len = end ? (size_t) (end - part) : strlen(part);
+
+        if (depth == 0)
+        {
+            for (i = 0; i < mount.disc_count; i++)
+            {
+                if (strlen(mount.discs[i].name) == len && strncmp(mount.discs[i].name, part, len) == 0)
+                    break;
+            }
+            if (i == mount.disc_count)
+                return -ENOENT;
+            *disc = &mount.discs[i];
+        }
+        else if (depth == 1)
+        {
+            if (open_disc(*disc) != 0)
+                return -EIO;
+            for (i = 0; i < (*disc)->area_count; i++)
+            {
+                if (strlen((*disc)->areas[i].name) == len && strncmp((*disc)->areas[i].name, part, len) == 0)
+                    break;
+            }
+            if (i == (*disc)->area_count)
+                return -ENOENT;
+            *area = &(*disc)->areas[i];
+        }
+        else if (depth == 2)
+        {
+            for (i = 0; i < (*area)->track_count; i++)
+            {
+                if (strlen((*area)->tracks[i].name) == len && strncmp((*area)->tracks[i].name, part, len) == 0)
+                    break;
+            }
+            if (i == (*area)->track_count)
+                return -ENOENT;
+            *track = &(*area)->tracks[i];
+        }
+        else
+        {
+            return -ENOENT;
+        }
+
+        depth++;
+        part = end ? end + 1 : part + len;
+    }
+    return depth;
+}
+
+static int mount_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+    mount_disc_t *disc = NULL;
+    mount_area_t *area = NULL;
+    mount_track_t *track = NULL;
+    int depth = lookup(path, &disc, &area, &track);
+
+    if (depth < 0)
+        return depth;
+
+    memset(st, 0, sizeof(*st));
+    if (depth < 3)
+    {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+    }
+    else
+    {
+        st->st_mode = S_IFREG | 0444;
+        st->st_nlink = 1;
+        st->st_size = (off_t) scarletbook_vfs_size(track->vfs);
+    }
+    return 0;
+}
+
+static int mount_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+                         struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+    mount_disc_t *disc = NULL;
+    mount_area_t *area = NULL;
+    mount_track_t *track = NULL;
+    int depth = lookup(path, &disc, &area, &track);
+    int i;
+
+    if (depth < 0)
+        return depth;
+    if (depth == 3)
+        return -ENOTDIR;
+
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    if (depth == 0)
+    {
+        for (i = 0; i < mount.disc_count; i++)
+            filler(buf, mount.discs[i].name, NULL, 0, 0);
+    }
+    else if (depth == 1)
+    {
+        if (open_disc(disc) != 0)
+            return -EIO;
+        for (i = 0; i < disc->area_count; i++)
+            filler(buf, disc->areas[i].name, NULL, 0, 0);
+    }
+    else
+    {
+        for (i = 0; i < area->track_count; i++)
+            filler(buf, area->tracks[i].name, NULL, 0, 0);
+    }
+    return 0;
+}
+
+static int mount_open(const char *path, struct fuse_file_info *fi)
+{
+    mount_disc_t *disc = NULL;
+    mount_area_t *area = NULL;
+    mount_track_t *track = NULL;
+    int depth = lookup(path, &disc, &area, &track);
+
+    if (depth < 0)
+        return depth;
+    if (depth != 3)
+        return -EISDIR;
+    if ((fi->flags & O_ACCMODE) != O_RDONLY)
+        return -EACCES;
+
+    pthread_mutex_lock(&disc->lock);
+    track->open_count++;
+    pthread_mutex_unlock(&disc->lock);
+
+    fi->fh = (uint64_t) (uintptr_t) track;
+    fi->keep_cache = 1;
+    return 0;
+}
+
+static int mount_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+    mount_track_t *track = (mount_track_t *) (uintptr_t) fi->fh;
+    int result;
+
+    pthread_mutex_lock(&track->disc->lock);
+    result = scarletbook_vfs_read(track->vfs, (uint8_t *) buf, size, (uint64_t) offset);
+    pthread_mutex_unlock(&track->disc->lock);
+    return result < 0 ? -EIO : result;
+}
+
+// the decoded chunks are dropped with the last reader of the file
+static int mount_release(const char *path, struct fuse_file_info *fi)
+{
+    mount_track_t *track = (mount_track_t *) (uintptr_t) fi->fh;
+
+    pthread_mutex_lock(&track->disc->lock);
+    if (--track->open_count == 0)
+        scarletbook_vfs_drop_cache(track->vfs);
+    pthread_mutex_unlock(&track->disc->lock);
+    return 0;
+}
+
+static void mount_destroy(void *private_data)
+{
+    int i;
+
+    for (i = 0; i < mount.disc_count; i++)
+    {
+        close_disc(&mount.discs[i]);
+        pthread_mutex_destroy(&mount.discs[i].lock);
+        free(mount.discs[i].path);
+        free(mount.discs[i].name);
+    }
+    free(mount.discs);
+    mount.discs = NULL;
+    mount.disc_count = 0;
+}
+
+static const struct fuse_operations mount_operations =
+{
+    .getattr    = mount_getattr,
+    .readdir    = mount_readdir,
+    .open       = mount_open,
+    .read       = mount_read,
+    .release    = mount_release,
+    .destroy    = mount_destroy,
+};
+
+static int compare_discs(const void *a, const void *b)
+{
+    return strcmp(((const mount_disc_t *) a)->name, ((const mount_disc_t *) b)->name);
+}
+
+// every .iso of the source directory, the images are only opened when they are looked into
+static int scan_source(void)
+{
+    DIR *dir = opendir(mount.source);
+    struct dirent *entry;
+    int alloc = 0;
+
+    if (!dir)
+        return -1;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name);
+        mount_disc_t *disc;
+
+        if (len <= 4 || strcasecmp(entry->d_name + len - 4, ".iso") != 0)
+            continue;
+
+        if (mount.disc_count == alloc)
+        {
+            mount_disc_t *discs;
+
+            alloc = alloc ? alloc * 2 : 16;
+            discs = (mount_disc_t *) realloc(mount.discs, alloc * sizeof(mount_disc_t));
+            if (!discs)
+                break;
+            mount.discs = discs;
+        }
+        disc = &mount.discs[mount.disc_count];
+        memset(disc, 0, sizeof(*disc));
+        disc->path = (char *) malloc(strlen(mount.source) + len + 2);
+        disc->name = strndup(entry->d_name, len - 4);
+        if (!disc->path || !disc->name)
+        {
+            free(disc->path);
+            free(disc->name);
+            break;
+        }
+        sprintf(disc->path, "%s/%s", mount.source, entry->d_name);
+        mount.disc_count++;
+    }
+    closedir(dir);
+
+    qsort(mount.discs, mount.disc_count, sizeof(mount_disc_t), compare_discs);
+    for (alloc = 0; alloc < mount.disc_count; alloc++)
+        pthread_mutex_init(&mount.discs[alloc].lock, NULL);
+    return 0;
+}
+
+static int mount_opt_proc(void *data, const char *arg, int key, struct fuse_args *outargs)
+{
+    if (key == KEY_HELP)
+    {
+        mount.help = 1;
+        return 1;
+    }
+    if (key == FUSE_OPT_KEY_NONOPT && !mount.source)
+    {
+        mount.source = realpath(arg, NULL);
+        if (!mount.source)
+        {
+            fprintf(stderr, "sacd_mount: %s: %s\n", arg, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    int ret;
+
+    if (fuse_opt_parse(&args, &mount, mount_opts, mount_opt_proc) != 0)
+        return 1;
+
+    if (mount.help)
+    {
+        show_usage(argv[0]);
+        return fuse_main(args.argc, args.argv, &mount_operations, NULL);
+    }
+    if (!mount.format)
+        mount.format = strdup("dsf");
+    if (!mount.source || (strcasecmp(mount.format, "dsf") != 0 && strcasecmp(mount.format, "dsdiff") != 0))
+    {
+        show_usage(argv[0]);
+        return 1;
+    }
+
+    init_logging(0);
+    if (scan_source() != 0)
+    {
+        fprintf(stderr, "sacd_mount: cannot read %s: %s\n", mount.source, strerror(errno));
+        return 1;
+    }
+
+    ret = fuse_main(args.argc, args.argv, &mount_operations, NULL);
+
+    fuse_opt_free_args(&args);
+    dst_decoder_pool_destroy();
+    destroy_logging();
+    free(mount.source);
+    free(mount.format);
+    return ret;
+}